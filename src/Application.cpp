@@ -3,7 +3,10 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <memory>
+#include <numeric>
 #include <filesystem>
+#include <chrono>
 
 
 // opengl dependencies
@@ -20,6 +23,8 @@
 
 
 
+#include "GLState.h"
+#include "GPUMemory.h"
 #include "Renderer.h"
 #include "VertexBuffer.h"
 #include "VertexBufferLayout.h"
@@ -27,6 +32,34 @@
 #include "VertexArray.h"
 #include "Shader.h"
 #include "Mesh.h"
+#include "Bounds.h"
+#include "Scene.h"
+#include "BVH.h"
+#include "ThreadPool.h"
+#include "InstancedRenderer.h"
+#include "DepthPyramid.h"
+#include "GLCapabilities.h"
+#include "DepthSAT.h"
+#include "MomentSAT.h"
+#include "MomentBlur.h"
+#include "RenderGraph.h"
+#include "RenderQueue.h"
+#include "GPUCounters.h"
+#include "SampleTables.h"
+#include "TemporalShadow.h"
+#include "ShadowMask.h"
+#include "DynamicResolution.h"
+#include "DepthRasterizer.h"
+#include "ShadowBake.h"
+#include "MeshStreamer.h"
+#include "FrameRing.h"
+#include "Profiler.h"
+#include "benchmarks/Benchmarks.h"
+#include "benchmarks/PCSSBenchmark.h"
+#include "benchmarks/VariantBenchmark.h"
+#include "benchmarks/CameraPathBenchmark.h"
+#include "benchmarks/MomentFilterBenchmark.h"
+#include "benchmarks/MomentPrecisionBenchmark.h"
 
 
 
@@ -34,6 +67,7 @@
 #include "lights/PointLight.h"
 #include "lights/DirectionalLight.h"
 #include "lights/SpotLight.h"
+#include "lights/LightFrustum.h"
 
 
 
@@ -112,7 +146,6 @@ bool loadOBJData(
 	FILE* file = fopen(path, "r");
 	if (file == NULL) {
 		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
-		getchar();
 		return false;
 	}
 
@@ -191,6 +224,35 @@ bool loadOBJData(
 	return true;
 }
 
+/*-----------------------------Stress scene (grid of SphereGroup instances on the plane)---------------------------------*/
+
+// replaces every scene entry from `first` on with `count` SphereGroup instances
+void buildStressScene(Scene& scene, size_t first, int count, const AABB& meshBounds,
+	const glm::vec3& planePosition, float planeScale, unsigned int mesh, unsigned int material)
+{
+	scene.Truncate(first);
+	if (count <= 0)
+		return;
+
+	//the plane mesh spans [-5, 5] on xz at y = -0.5
+	float halfSize = 5.0f * planeScale;
+	float top = planePosition.y - 0.5f * planeScale;
+	int side = (int)std::ceil(std::sqrt((float)count));
+	float spacing = 2.0f * halfSize / side;
+	glm::vec3 extent = meshBounds.Extent();
+	float scale = 0.6f * spacing / std::max(std::max(extent.x, extent.z), 1e-4f);
+
+	scene.Reserve(first + count);
+	for (int i = 0; i < count; ++i) {
+		int x = i % side;
+		int z = i / side;
+		glm::vec3 position(planePosition.x - halfSize + (x + 0.5f) * spacing,
+						   top - meshBounds.Min.y * scale,
+						   planePosition.z - halfSize + (z + 0.5f) * spacing);
+		scene.Add(position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(scale), meshBounds, mesh, material);
+	}
+}
+
 /*-----------------------------Debug (visualization shadow map) rendering function---------------------------------*/
 
 void renderQuad(Shader &shader)
@@ -211,17 +273,22 @@ void renderQuad(Shader &shader)
 	VBL.Push<float>(3);
 	VBL.Push<float>(2);
 	VAO.AddBuffer(VBO, VBL);
-	glBindVertexArray(VAO.GetID());
+	glState().BindVertexArray(VAO.GetID());
 
 	//glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	shader.Bind();
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
+	glState().BindVertexArray(0);
 };
 
 
 
-int main(void) {
+int main(int argc, char** argv) {
+	// command line benchmarks (no window): --bench <name> [args]
+	if (argc > 2 && std::string(argv[1]) == "--bench")
+		return RunBenchmark(argv[2], argc - 3, argv + 3);
+	auto launchTime = std::chrono::high_resolution_clock::now();
+
 	GLFWwindow* window;
 	/* Initialize the library */
 	if (!glfwInit()) //GLFW
@@ -258,21 +325,30 @@ int main(void) {
 	}
 
 	std::cout << glGetString(GL_VERSION) << std::endl;
+	//compute / GL 4.3 paths are only taken when the context has them
+	GLCapabilities caps = DetectGLCapabilities();
+	PrintGLCapabilities(caps);
 
 
 	
-	// load OBJ model
-	std::vector<glm::vec3> SphereGroupVertices;
-	std::vector<glm::vec2> SphereGroupUVs;
-	std::vector<glm::vec3> SphereGroupNormals;
+	// load OBJ model on a loader thread: the first frame does not wait for it, the SphereGroup appears once resident
+	bool instancingSupported = caps.MultiDrawIndirect;
+	MeshStreamer meshStreamer(caps.BufferStorage);
+	//frames in flight: the instanced path's transforms, instance ids and commands go to per-frame slices
+	FrameSync frameSync;
+	FrameRingBuffer frameRing(caps.BufferStorage);
 	std::string SphereGroupModelPath = "F:\\M2\\IG3DA\\Project\\models\\SphereGroup.obj";
-	bool sg_res = loadOBJData(SphereGroupModelPath.c_str(), SphereGroupVertices, SphereGroupUVs, SphereGroupNormals);
-	if (sg_res) {
-		std::cout << "Model: " << SphereGroupModelPath << " loaded!" << std::endl;
-	}
-	else {
-		std::cout << "Fail to load model: " << SphereGroupModelPath << std::endl;
-	}
+	unsigned int SphereGroupStream = meshStreamer.Request(SphereGroupModelPath, [=](StreamedMeshData& data) {
+		if (!loadOBJData(SphereGroupModelPath.c_str(), data.Positions, data.UVs, data.Normals) || data.Positions.empty())
+			return false;
+		data.Bounds = ComputeAABB(data.Positions);
+		if (instancingSupported)
+			InstancedRenderer::Interleave(data.Positions, data.UVs, data.Normals, data.Interleaved, data.Indices);
+		return true;
+	});
+	//positions for the CPU passes (software light pass, shadow bake), empty until the mesh is resident
+	std::vector<glm::vec3> SphereGroupVertices;
+	bool sphereGroupResident = false;
 
 
 	
@@ -345,11 +421,15 @@ int main(void) {
 	};
 
 
-	/*-------Generate SphereGroup Mesh-------*/
-	Mesh SphereGroupMesh(SphereGroupVertices, SphereGroupUVs, SphereGroupNormals);
+	//object space bounds, used to fit the light frustum (the SphereGroup's: a unit box until it is resident)
+	AABB SphereGroupBounds(glm::vec3(-1.0f), glm::vec3(1.0f));
+	AABB PlaneBounds = ComputeAABB(PlaneVertices, 4, 8);
+
+
+	/*-------SphereGroup Mesh, created when streamed in-------*/
+	std::unique_ptr<Mesh> SphereGroupMesh;
 	Shader SphereGroupShader(VF_SHADER, "src/shaders/VSSM_Scene.shader");
 	SphereGroupShader.Bind();
-	SphereGroupMesh.setup(SphereGroupShader.GetProgram());
 
 
 	VertexArray PlaneVA;
@@ -360,6 +440,10 @@ int main(void) {
 	PlaneLayout.Push<float>(2);
 	PlaneVA.AddBuffer(PlaneVB, PlaneLayout);
 	IndexBuffer PlaneIB(PlaneIndices, 6);
+	//positions only, for the software light pass
+	std::vector<glm::vec3> PlanePositions;
+	for (int i = 0; i < 4; ++i)
+		PlanePositions.push_back(glm::vec3(PlaneVertices[i * 8], PlaneVertices[i * 8 + 1], PlaneVertices[i * 8 + 2]));
 	Shader PlaneShader(VF_SHADER, "src/shaders/VSSM_Scene.shader");
 	PlaneShader.Bind();
 	
@@ -380,26 +464,100 @@ int main(void) {
 	Shader SimpleDepthShader(VF_SHADER, "src/shaders/ShadowMap.shader");
 	Shader DebugShader(VF_SHADER, "src/shaders/Debug.shader");
 
-	Shader ComputeSATShader(CP_SHADER, "src/shaders/ComputeSAT.shader");
+	Shader ComputeSATShader(CP_SHADER, "src/shaders/ComputeSAT.shader", { "DEPTH" });
+	Shader SATColumnsShader(CP_SHADER, "src/shaders/ComputeSAT.shader", { "COLUMNS" });
+	Shader SATDoublingShader(VF_SHADER, "src/shaders/SATDoubling.shader");
+	Shader MomentWarpSATShader(CP_SHADER, "src/shaders/ComputeSAT.shader", { "MOMENTS4", "WARP" });
+	Shader MomentSATShader(CP_SHADER, "src/shaders/ComputeSAT.shader", { "MOMENTS4" });
+	Shader BlurMomentsShader(CP_SHADER, "src/shaders/BlurMoments.shader");
+	Shader DepthMinMaxShader(CP_SHADER, "src/shaders/DepthMinMax.shader");
+	Shader TemporalResolveShader(VF_SHADER, "src/shaders/TemporalShadow.shader");
+	Shader ShadowCompositeShader(VF_SHADER, "src/shaders/ShadowComposite.shader");
+	Shader PrepassShader(VF_SHADER, "src/shaders/VSSM_Scene.shader", { "DEPTH_PREPASS" });
+	Shader ShadowMaskShader(VF_SHADER, "src/shaders/ShadowMask.shader");
+	Shader ShadowUpsampleShader(VF_SHADER, "src/shaders/ShadowMask.shader", { "UPSAMPLE" });
+	Shader BakeShadowShader(VF_SHADER, "src/shaders/BakeShadow.shader");
+
+
+	//one draw per object path: sorted by program, material, geometry, then front to back
+	RenderQueue renderQueue;
+
+	/*-------Instanced (multi-draw-indirect) path, needs GL 4.3-------*/
+	InstancedRenderer instancedRenderer;
+	std::unique_ptr<Shader> InstancedSceneShader;
+	std::unique_ptr<Shader> InstancedDepthShader;
+	std::unique_ptr<Shader> InstancedPrepassShader;
+	//PCSS early exit counters (SSBO atomics), same GL 4.3 requirement
+	std::unique_ptr<Shader> StatsSceneShader;
+	std::unique_ptr<Shader> InstancedStatsSceneShader;
+	std::unique_ptr<Shader> StatsShadowMaskShader;
+	std::unique_ptr<Shader> StatsShadowUpsampleShader;
+	std::unique_ptr<GPUCounters> shadowStats;
+	std::unique_ptr<GPUCounters> maskStats;
+	std::unique_ptr<Shader> TemporalStatsResolveShader;
+	std::unique_ptr<GPUCounters> temporalStats;
+	unsigned int SphereGroupMeshID = 0, PlaneMeshID = 0;
+	unsigned int SphereGroupMaterialID = 0, PlaneMaterialID = 0, StressMaterialID = 0;
+	if (instancingSupported) {
+		SphereGroupMeshID = instancedRenderer.AddStreamedMesh();
+		PlaneMeshID = instancedRenderer.AddMesh(PlaneVertices, 4, PlaneIndices, 6);
+		instancedRenderer.Upload();
+		instancedRenderer.SetFrameRing(&frameRing);
+		SphereGroupMaterialID = instancedRenderer.AddMaterial(glm::vec3(1.0f), 1.0f);
+		PlaneMaterialID = instancedRenderer.AddMaterial(glm::vec3(1.0f), 1.0f);
+		StressMaterialID = instancedRenderer.AddMaterial(glm::vec3(1.0f), 1.0f);
+		InstancedSceneShader.reset(new Shader(VF_SHADER, "src/shaders/VSSM_Scene.shader", { "INSTANCED" }));
+		InstancedDepthShader.reset(new Shader(VF_SHADER, "src/shaders/ShadowMap.shader", { "INSTANCED" }));
+		InstancedPrepassShader.reset(new Shader(VF_SHADER, "src/shaders/VSSM_Scene.shader", { "INSTANCED", "DEPTH_PREPASS" }));
+		StatsSceneShader.reset(new Shader(VF_SHADER, "src/shaders/VSSM_Scene.shader", { "SHADOW_STATS" }));
+		InstancedStatsSceneShader.reset(new Shader(VF_SHADER, "src/shaders/VSSM_Scene.shader", { "INSTANCED", "SHADOW_STATS" }));
+		StatsShadowMaskShader.reset(new Shader(VF_SHADER, "src/shaders/ShadowMask.shader", { "SHADOW_STATS" }));
+		StatsShadowUpsampleShader.reset(new Shader(VF_SHADER, "src/shaders/ShadowMask.shader", { "UPSAMPLE", "SHADOW_STATS" }));
+		shadowStats.reset(new GPUCounters(4));
+		maskStats.reset(new GPUCounters(2));
+		TemporalStatsResolveShader.reset(new Shader(VF_SHADER, "src/shaders/TemporalShadow.shader", { "SHADOW_STATS" }));
+		temporalStats.reset(new GPUCounters(3));
+	}
+	else {
+		std::cout << "GL 4.3 not available, instanced rendering path disabled" << std::endl;
+	}
 
 
 	//create depth map FBO
 	const int SHADOW_MAP_WIDTH = 1024;
-	const int SHADOW_MAP_HEIGHT = SHADOW_MAP_WIDTH;
-	float textureSize = float(SHADOW_MAP_WIDTH); //send to fragment shader
+	const int SHADOW_MAP_MIN_WIDTH = 256; //lowest resolution under GPU memory pressure
+	int shadowMapSize = SHADOW_MAP_WIDTH; //square, halved while over the GPU memory budget
+	float textureSize = float(shadowMapSize); //send to fragment shader
+	DepthFormat depthFormat = DS_DEPTH_FORMAT; //the moments are made from the depth when the SAT / blur is built
 	unsigned int depthMapFBO;
 	glGenFramebuffers(1, &depthMapFBO);
 	//create depth texture
 	unsigned int depthMap;
 	glGenTextures(1, &depthMap);
-	glBindTexture(GL_TEXTURE_2D, depthMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, 0, GL_RG, GL_FLOAT, nullptr);
+	//the casters that are not in the shadow bake, for the baked receivers: same format and size
+	unsigned int dynamicDepthMap;
+	glGenTextures(1, &dynamicDepthMap);
+	//(re)specified at the current format and size, the shadow map left bound
+	auto specifyShadowMap = [&]() {
+		glState().BindTexture(GL_TEXTURE_2D, dynamicDepthMap);
+		glTexImage2D(GL_TEXTURE_2D, 0, depthInternalFormat(depthFormat), shadowMapSize, shadowMapSize, 0, GL_RED, GL_FLOAT, nullptr);
+		gpuMemory().TrackTexture(dynamicDepthMap, GM_SHADOW_MAPS, "Dynamic caster map", depthInternalFormat(depthFormat), shadowMapSize, shadowMapSize);
+		glState().BindTexture(GL_TEXTURE_2D, depthMap);
+		glTexImage2D(GL_TEXTURE_2D, 0, depthInternalFormat(depthFormat), shadowMapSize, shadowMapSize, 0, GL_RED, GL_FLOAT, nullptr);
+		gpuMemory().TrackTexture(depthMap, GM_SHADOW_MAPS, "Shadow map", depthInternalFormat(depthFormat), shadowMapSize, shadowMapSize);
+	};
+	specifyShadowMap();
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); //GL_TEXTURE_MIN_FILTER
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); //GL_TEXTURE_MAG_FILTER
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); //GL_TEXTURE_WRAP_S
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); //GL_TEXTURE_WRAP_T
 	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
 	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+	glState().BindTexture(GL_TEXTURE_2D, dynamicDepthMap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
 		
 		
@@ -408,63 +566,108 @@ int main(void) {
 	unsigned int depthBuffer;
 	glGenRenderbuffers(1, &depthBuffer);
 	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32, SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32, shadowMapSize, shadowMapSize);
+	gpuMemory().TrackRenderbuffer(depthBuffer, GM_SHADOW_MAPS, "Shadow map depth buffer", GL_DEPTH_COMPONENT32, shadowMapSize, shadowMapSize);
 
 
 	//attach depth texture as FBO's depth buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+	glState().BindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, depthMap, 0);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
 	//glDrawBuffer(GL_NONE);
 	//glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	glState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState().BindTexture(GL_TEXTURE_2D, 0);
 	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	//GPU shadow bake: the same depth buffer, its shadow map is a RenderGraph transient attached when it is drawn
+	unsigned int bakeDepthFBO;
+	glGenFramebuffers(1, &bakeDepthFBO);
+	glState().BindFramebuffer(GL_FRAMEBUFFER, bakeDepthFBO);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	unsigned int dynamicDepthFBO;
+	glGenFramebuffers(1, &dynamicDepthFBO);
+	glState().BindFramebuffer(GL_FRAMEBUFFER, dynamicDepthFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dynamicDepthMap, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	glState().BindFramebuffer(GL_FRAMEBUFFER, 0);
 
 
-	//frame buffer for compute variance
-	unsigned int varianceFBO[2];
-	unsigned int varianceTexture[2];
-	glGenFramebuffers(2, varianceFBO);
-	glGenTextures(2, varianceTexture);
-
-	for (int i = 0; i < 2; ++i) {
-		glBindFramebuffer(GL_FRAMEBUFFER, varianceFBO[i]);
-		glBindTexture(GL_TEXTURE_2D, varianceTexture[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, 0, GL_RG, GL_FLOAT, nullptr);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, varianceTexture[i], 0);
-	}
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+	//min/max depth pyramid for the PCSS early exit
+	DepthPyramid depthPyramid(shadowMapSize);
+	//4 moment summed area table for EVSM / MSM
+	MomentSAT momentSAT(shadowMapSize);
+	//separably blurred moments for plain VSM
+	MomentBlur momentBlur(shadowMapSize);
+
+
+	//summed area table of the depth moments, built in place from the depth map
+	DepthSAT depthSAT(shadowMapSize);
+	//orders the shadow passes, culls the ones nothing reads and pools their intermediates
+	RenderGraph renderGraph;
 
 
 	DebugShader.Bind();
 	DebugShader.SetUniform1i("u_DebugTexture", 0);
 
 		
-	PlaneShader.Bind();
-	PlaneShader.SetUniform1i("u_DepthMap", 0);
-	PlaneShader.SetUniform1i("u_DepthSAT", 1);
-
-
-	SphereGroupShader.Bind();
-	SphereGroupShader.SetUniform1i("u_DepthMap", 0);
-	SphereGroupShader.SetUniform1i("u_DepthSAT", 1);
+	//PCSS sample tables (deterministic seed) and blue noise rotation tile
+	SampleTables sampleTables;
+
+	//offscreen lit pass and shadow history for temporal accumulation
+	TemporalShadow temporalShadow(SCREEN_WIDTH, SCREEN_HEIGHT);
+	//depth prepass and per pixel shadow mask for deferred shadow evaluation
+	ShadowMask shadowMask(SCREEN_WIDTH, SCREEN_HEIGHT);
+	//camera pass render resolution against a GPU frame time target
+	DynamicResolution dynamicResolution(SCREEN_WIDTH, SCREEN_HEIGHT);
+
+
+	//texture units and uniform blocks of every shader variant that evaluates shadows (Shadows.glsl)
+	std::vector<Shader*> sceneShaders = { &PlaneShader, &SphereGroupShader };
+	std::vector<Shader*> maskShaders = { &ShadowMaskShader, &ShadowUpsampleShader };
+	if (instancingSupported) {
+		sceneShaders.insert(sceneShaders.end(), { InstancedSceneShader.get(), StatsSceneShader.get(), InstancedStatsSceneShader.get() });
+		maskShaders.insert(maskShaders.end(), { StatsShadowMaskShader.get(), StatsShadowUpsampleShader.get() });
+	}
+	//sample set 0 (per fragment Poisson disk) draws with the POISSON_PER_FRAGMENT variant of each of them
+	for (std::vector<Shader*>* shaders : { &sceneShaders, &maskShaders }) {
+		size_t count = shaders->size();
+		for (size_t i = 0; i < count; ++i)
+			shaders->push_back(&(*shaders)[i]->Variant("POISSON_PER_FRAGMENT"));
+	}
+	for (Shader* shader : sceneShaders) {
+		shader->Bind();
+		shader->SetUniform1i("u_ShadowMask", SM_MASK_TEXTURE_UNIT);
+		shader->SetUniform1i("u_BakedShadow", SB_TEXTURE_UNIT);
+		shader->SetUniform1i("u_DynamicDepthMap", SB_DYNAMIC_TEXTURE_UNIT);
+	}
+	for (Shader* shader : maskShaders) {
+		shader->Bind();
+		shader->SetUniform1i("u_SceneDepth", SM_DEPTH_TEXTURE_UNIT);
+		shader->SetUniform1i("u_SceneNormal", SM_NORMAL_TEXTURE_UNIT);
+		shader->SetUniform1i("u_DynamicDepthMap", SB_DYNAMIC_TEXTURE_UNIT);
+	}
+	std::vector<Shader*> shadowShaders = sceneShaders;
+	shadowShaders.insert(shadowShaders.end(), maskShaders.begin(), maskShaders.end());
+	shadowShaders.push_back(&BakeShadowShader);
+	shadowShaders.push_back(&BakeShadowShader.Variant("POISSON_PER_FRAGMENT"));
+	for (Shader* shader : shadowShaders) {
+		shader->Bind();
+		shader->SetUniform1i("u_DepthMap", 0);
+		shader->SetUniform1i("u_DepthSAT", DS_TEXTURE_UNIT);
+		shader->SetUniform1i("u_MomentSAT", MS_SAT_TEXTURE_UNIT);
+		shader->SetUniform1i("u_FilteredMoments", MB_TEXTURE_UNIT);
+		shader->SetUniform1i("u_DepthMinMax", DP_TEXTURE_UNIT);
+		shader->SetUniform1i("u_BlueNoise", ST_NOISE_TEXTURE_UNIT);
+		shader->SetUniformBlockBinding("SampleTables", ST_UNIFORM_BINDING);
+	}
 
 
-	ComputeSATShader.Bind();
-	ComputeSATShader.SetUniform1i("input_image", 0);
-	ComputeSATShader.SetUniform1i("output_image", 1);
 
 
 
 	//create render
 	Renderer renderer;
+	Profiler profiler;
 	//create UI
 	ImGui::CreateContext();
 	ImGuiIO& io = ImGui::GetIO(); (void)io;
@@ -509,12 +712,161 @@ int main(void) {
 	pointLight.Position = glm::vec3(3.0f, 2.5f, 3.0f);
 	pointLight.Intensity = 1.0f;
 	float lightWidth = 50.0f;
+	bool movingLight = false;
+	float lightOrbitSpeed = 0.5f; //rad/s
 
 	//shadow rander
 	int ShadowRenderType = 0;
-	
-
-	glEnable(GL_DEPTH_TEST);
+	const char* shadowTypeNames[] = { "Basic", "PCF", "PCSS", "VSSM", "EVSM", "MSM", "VSM (blurred)" };
+	bool useDepthPyramid = true;
+	bool collectShadowStats = false;
+	PCSSBenchmark pcssBenchmark;
+	int sampleSet = SAMPLES_VOGEL;
+	VariantBenchmark sampleSetBenchmark;
+	bool adaptiveSamples = false;
+	int maxTaps = 32;
+	float texelsPerTap = 8.0f;
+	VariantBenchmark adaptiveBenchmark;
+	bool temporalShadows = false;
+	int temporalTaps = 8;
+	VariantBenchmark temporalBenchmark;
+	bool deferredShadowMask = false;
+	VariantBenchmark shadowMaskBenchmark;
+	int maskResolution = 0; //index in MASK_RESOLUTION_NAMES, downsample 1 << maskResolution
+	bool measureMaskError = false;
+	VariantBenchmark maskResolutionBenchmark;
+
+	//dynamic resolution settings
+	bool dynamicResolutionEnabled = false;
+	CameraPathBenchmark cameraPathBenchmark;
+
+	bool measureLeak = false;
+	VariantBenchmark momentBenchmark;
+	std::string momentFilterResult;
+	std::string momentPrecisionResult;
+	bool forceFragmentSAT = false;
+	//software light pass
+	DepthRasterizer depthRasterizer(shadowMapSize);
+	bool softwareLightPass = false;
+	bool compareRasterizer = false;
+	std::string rasterizerResult;
+	//static shadow baking: the SphereGroup's shadow on the plane
+	ShadowBaker shadowBaker;
+	ShadowLightmap planeLightmap;
+	std::vector<ShadowLightmap*> bakedReceivers = { &planeLightmap };
+	LightFrustum bakeFrustum;
+	bool shadowBaking = false;
+	bool bakeRequested = false;
+	VariantBenchmark bakeBenchmark;
+	//frame pipelining
+	int framesInFlight = FR_FRAMES_IN_FLIGHT;
+	double frameCPUms = 0.0;
+	VariantBenchmark pipelineBenchmark;
+
+	//light frustum settings
+	LightFrustum lightFrustum;
+	bool fitLightFrustum = true;
+
+	//stress scene settings
+	bool useInstancing = instancingSupported;
+	bool stressScene = false;
+	int stressInstanceCount = 10000;
+	glm::vec3 SphereGroupStressColor(0.8f, 0.6f, 0.5f);
+	AABB stressBounds;
+	int stressBuiltCount = -1;
+	glm::vec3 stressBuiltPlanePosition(0.0f);
+	float stressBuiltPlaneScale = 0.0f;
+	//frustum culling
+	bool frustumCulling = true;
+	BVH sceneBVH;
+	std::vector<unsigned int> cameraVisible, lightVisible;
+	BVH::QueryStack cullStacks[2];
+	InstancedDrawList lightDrawList, cameraDrawList, dynamicDrawList;
+	//CPU frame work as jobs on the pool; deterministic: one thread, always the same order
+	bool deterministicJobs = false;
+	size_t jobsRunBefore = 0, jobsStolenBefore = 0;
+
+	//scene entries: SphereGroup, plane, then the stress grid
+	const glm::quat identityRotation(1.0f, 0.0f, 0.0f, 0.0f);
+	const size_t SPHERE_GROUP_ENTRY = 0, PLANE_ENTRY = 1, STRESS_FIRST_ENTRY = 2;
+	ThreadPool threadPool;
+	Scene scene;
+	scene.Add(SphereGroupPosition, identityRotation, glm::vec3(SphereGroupScale), SphereGroupBounds, SphereGroupMeshID, SphereGroupMaterialID);
+	scene.Add(planePosition, identityRotation, glm::vec3(planeScale), PlaneBounds, PlaneMeshID, PlaneMaterialID);
+
+	//SphereGroup parsed: its buffers (and its range of the instanced buffers) are made, the streamer fills them
+	meshStreamer.SetUpload(SphereGroupStream, [&](const StreamedMeshData& data) {
+		std::vector<StreamUpload> uploads;
+		SphereGroupMesh.reset(new Mesh(data.Positions.size()));
+		SphereGroupMesh->setup(SphereGroupShader.GetProgram());
+		uploads.push_back({ SphereGroupMesh->positionBuffer, 0, data.Positions.data(), data.Positions.size() * sizeof(glm::vec3) });
+		uploads.push_back({ SphereGroupMesh->texcoordsBuffer, 0, data.UVs.data(), data.UVs.size() * sizeof(glm::vec2) });
+		uploads.push_back({ SphereGroupMesh->normalBuffer, 0, data.Normals.data(), data.Normals.size() * sizeof(glm::vec3) });
+		//its range of the instanced buffers outlives an eviction, the interleaved data is dropped after the first upload
+		if (instancingSupported && !data.Interleaved.empty()) {
+			size_t vertexOffset, indexOffset;
+			instancedRenderer.ReserveMesh(SphereGroupMeshID, (unsigned int)(data.Interleaved.size() / 8), (unsigned int)data.Indices.size(), vertexOffset, indexOffset);
+			uploads.push_back({ instancedRenderer.GetVertexBuffer(), vertexOffset, data.Interleaved.data(), data.Interleaved.size() * sizeof(float) });
+			uploads.push_back({ instancedRenderer.GetIndexBuffer(), indexOffset, data.Indices.data(), data.Indices.size() * sizeof(unsigned int) });
+		}
+		return uploads;
+	}, [&](const StreamedMeshData& data) {
+		SphereGroupVertices = data.Positions;
+		SphereGroupBounds = data.Bounds;
+		scene.SetLocalBounds(SPHERE_GROUP_ENTRY, SphereGroupBounds);
+		stressBuiltCount = -1; //placed with the real bounds
+		sphereGroupResident = true;
+		const StreamRequest& request = *meshStreamer.GetRequests()[SphereGroupStream];
+		std::ostringstream out;
+		out << "SphereGroup resident " << request.ResidentMs << " ms after the request: parsed in " << request.ParseMs
+			<< " ms (loader thread), " << request.Bytes / (1024.0 * 1024.0) << " MB uploaded in " << request.Frames << " frames / "
+			<< request.UploadMs << " ms (" << request.Bytes / (1024.0 * 1024.0) / std::max(request.UploadMs * 1e-3, 1e-6) << " MB/s)";
+		profiler.Log(out.str());
+	});
+
+	//every resource sized by the shadow map: the map and its depth buffer, the tables built from it, the software light pass
+	auto resizeShadowMaps = [&](int size) {
+		shadowMapSize = size;
+		textureSize = float(size);
+		specifyShadowMap();
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32, size, size);
+		gpuMemory().TrackRenderbuffer(depthBuffer, GM_SHADOW_MAPS, "Shadow map depth buffer", GL_DEPTH_COMPONENT32, size, size);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		depthPyramid.Resize(size);
+		momentSAT.Resize(size);
+		momentBlur.Resize(size);
+		depthSAT.Resize(size);
+		depthRasterizer.Resize(size);
+	};
+	//over the GPU memory budget: the shadow maps are halved first, down to SHADOW_MAP_MIN_WIDTH, then the SphereGroup's
+	//own buffers are evicted (its range of the instanced buffers cannot be freed alone). Restore() streams it in again
+	gpuMemory().AddPressureHandler("Shadow map resolution", [&]() {
+		if (shadowMapSize / 2 < SHADOW_MAP_MIN_WIDTH)
+			return false;
+		resizeShadowMaps(shadowMapSize / 2);
+		profiler.Log("Over the GPU memory budget: shadow maps at " + std::to_string(shadowMapSize) + "^2");
+		return true;
+	}, [&]() {
+		resizeShadowMaps(SHADOW_MAP_WIDTH);
+	});
+	gpuMemory().AddPressureHandler("Streamed meshes", [&]() {
+		if (!meshStreamer.Evict(SphereGroupStream))
+			return false;
+		SphereGroupMesh.reset();
+		sphereGroupResident = false;
+		profiler.Log("Over the GPU memory budget: SphereGroup evicted");
+		return true;
+	}, [&]() {
+		meshStreamer.Restore(SphereGroupStream);
+	});
+	std::string gpuMemoryDumpResult;
+
+
+	glState().Enable(GL_DEPTH_TEST);
+	bool firstFrame = true;
+	double firstFrameMs = 0.0;
 		
 	/* Loop until the user closes the window */
 	while (!glfwWindowShouldClose(window))
@@ -534,145 +886,852 @@ int main(void) {
 		if (glfwGetKey(window, GLFW_KEY_4)) {
 			ShadowRenderType = 3;
 		}
+		if (glfwGetKey(window, GLFW_KEY_5)) {
+			ShadowRenderType = 4;
+		}
+		if (glfwGetKey(window, GLFW_KEY_6)) {
+			ShadowRenderType = 5;
+		}
+		if (glfwGetKey(window, GLFW_KEY_7)) {
+			ShadowRenderType = 6;
+		}
+
+		//frame slot: waits only when the GPU is still on the frame that used it N frames ago
+		frameSync.SetFramesInFlight(pipelineBenchmark.IsRunning() ? pipelineBenchmark.CurrentVariant() + 1 : framesInFlight);
+		frameSync.BeginFrame();
+		auto frameCPUStart = std::chrono::high_resolution_clock::now();
+		frameRing.BeginFrame(frameSync.GetSlot());
 
 		renderer.Clear();
+		profiler.NewFrame();
+		glState().NewFrame();
+		profiler.SetCounter("GL state calls", glState().GetLastIssued());
+		profiler.SetCounter("GL state calls skipped", glState().GetLastSkipped());
+		profiler.SetCounter("Fence wait ms", frameSync.LastWaitMs);
+		profiler.SetCounter("Frames in flight", frameSync.LastInFlight);
+		profiler.SetCounter("CPU frame ms", frameCPUms);
+		profiler.SetCounter("Ring KB / frame", frameRing.LastFrameBytes / 1024.0);
 
 		currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
+		profiler.SetCounter("Frame interval ms", deltaTime * 1000.0);
 
 		cam.Fov = fov;
 		cam.MovementSpeed = cameraSpeed;
 		cam.MouseSensitivity = mouseSensitivity;
 
-		//light position can change so shadow map update per frame.
-		glm::mat4 lightProjection, lightView;
+		//ghosting test: the light orbits the scene center at its current radius and height
+		if (movingLight || temporalBenchmark.IsRunning()) {
+			float radius = glm::length(glm::vec2(pointLight.Position.x, pointLight.Position.z));
+			float angle = std::atan2(pointLight.Position.z, pointLight.Position.x) + lightOrbitSpeed * deltaTime;
+			pointLight.Position.x = radius * std::cos(angle);
+			pointLight.Position.z = radius * std::sin(angle);
+		}
+
+		//scripted camera path: the same views on every run
+		if (cameraPathBenchmark.IsRunning()) {
+			glm::vec3 cameraPosition, cameraTarget;
+			cameraPathBenchmark.Pose(SphereGroupPosition, 2.0f * planeScale, cameraPosition, cameraTarget);
+			cam.LookAt(cameraPosition, cameraTarget);
+		}
+
+		//render resolution of the camera pass, from the GPU time of the frames in flight
+		bool dynamicEnabled = cameraPathBenchmark.IsRunning() ? cameraPathBenchmark.CurrentVariant() == 1 : dynamicResolutionEnabled;
+		bool scaleChanged = false;
+		if (dynamicEnabled) {
+			float previousScale = dynamicResolution.Scale;
+			//one Update() per GPU frame time read back, a frame without a new one would count the last twice
+			if (profiler.HasNewGPUFrame())
+				scaleChanged = dynamicResolution.Update(profiler.GetGPUFrameMs());
+			if (scaleChanged) {
+				std::ostringstream line;
+				line.precision(2);
+				line << std::fixed << "Render scale " << previousScale << " -> " << dynamicResolution.Scale
+					<< " (GPU frame " << dynamicResolution.LastChangeMs << " ms, target " << dynamicResolution.TargetMs << " ms)";
+				profiler.Log(line.str());
+			}
+		}
+		else {
+			dynamicResolution.Reset();
+		}
+		int renderWidth = dynamicEnabled ? dynamicResolution.GetWidth() : SCREEN_WIDTH;
+		int renderHeight = dynamicEnabled ? dynamicResolution.GetHeight() : SCREEN_HEIGHT;
+		temporalShadow.Resize(renderWidth, renderHeight);
+		shadowMask.Resize(renderWidth, renderHeight);
+		profiler.SetCounter("Render scale %", 100.0 * renderWidth / SCREEN_WIDTH);
+
+		//before anything of the frame is allocated or drawn
+		gpuMemory().Enforce();
+		profiler.SetCounter("GPU memory MB", gmMiB(gpuMemory().GetTotal()));
+
+		//streamed meshes: copies under the frame's upload budget, resident callbacks
+		profiler.BeginCPU("Mesh streaming");
+		meshStreamer.Update();
+		profiler.EndCPU("Mesh streaming");
+		profiler.SetCounter("Upload KB / frame", meshStreamer.LastFrameBytes / 1024.0);
+
+		//CPU side of the frame as jobs: scene update -> BVH update and light frustum -> culls -> draw lists. They run on
+		//the pool while the GPU still works on the previous frame; profiler, logs and GL calls stay on this thread
+		threadPool.SetDeterministic(deterministicJobs);
+		auto frameJobsStart = std::chrono::high_resolution_clock::now();
+		auto msSince = [](std::chrono::high_resolution_clock::time_point start) {
+			return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		};
+		bool drawInstanced = useInstancing && instancingSupported;
+		glm::mat4 cameraViewProjection = cam.GetProjectionMatrix(PERSPECTIVE) * cam.GetViewMatrix();
+		size_t transformsUpdated = 0;
+		bool bvhRebuilt = false;
+		double sceneMs = 0.0, bvhMs = 0.0, cullMs[2] = { 0.0, 0.0 }, listMs[2] = { 0.0, 0.0 };
+		unsigned int nodesVisited[2] = { 0, 0 };
+		//world space bounds, index 0: SphereGroup, 1: plane, 2: stress grid (all cast and receive shadows)
+		std::vector<AABB> shadowCasters, shadowReceivers;
 		glm::mat4 lightSpaceMatrix;
-		float near_plane = 1.0f, far_plane = 100.0f;
-
-		lightProjection = glm::perspective(glm::radians(45.0f), (float)SHADOW_MAP_WIDTH / SHADOW_MAP_HEIGHT, near_plane, far_plane);
-		lightView = glm::lookAt(pointLight.Position, SphereGroupPosition, glm::vec3(0.0f, 1.0f, 0.0f));
-		//transform matrix from world space to light view space.
-		lightSpaceMatrix = lightProjection * lightView;
-		//render scene from light's point of view
-		SimpleDepthShader.Bind();
-		SimpleDepthShader.SetUniformM4fv("u_LightSpaceMatrix", 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
-			
+		float lightSize = lightWidth;
+
+		//objects transforms (only entries that changed are rebuilt)
+		ThreadPool::JobHandle sceneJob = threadPool.Spawn([&]() {
+			auto start = std::chrono::high_resolution_clock::now();
+			scene.SetPosition(SPHERE_GROUP_ENTRY, SphereGroupPosition);
+			scene.SetScale(SPHERE_GROUP_ENTRY, glm::vec3(SphereGroupScale));
+			scene.SetPosition(PLANE_ENTRY, planePosition);
+			scene.SetScale(PLANE_ENTRY, glm::vec3(planeScale));
+
+			//stress scene follows the plane
+			int wantedStressCount = stressScene ? stressInstanceCount : 0;
+			bool stressRebuilt = false;
+			if (wantedStressCount != stressBuiltCount || planePosition != stressBuiltPlanePosition || planeScale != stressBuiltPlaneScale) {
+				buildStressScene(scene, STRESS_FIRST_ENTRY, wantedStressCount, SphereGroupBounds, planePosition, planeScale, SphereGroupMeshID, StressMaterialID);
+				stressBuiltCount = wantedStressCount;
+				stressBuiltPlanePosition = planePosition;
+				stressBuiltPlaneScale = planeScale;
+				stressRebuilt = true;
+			}
+			transformsUpdated = scene.Update(&threadPool);
+			if (stressRebuilt)
+				stressBounds = scene.BoundsOf(STRESS_FIRST_ENTRY, scene.Count());
+
+			SphereGroupModel = scene.World[SPHERE_GROUP_ENTRY];
+			PlaneModel = scene.World[PLANE_ENTRY];
+			size_t stressCount = scene.Count() - STRESS_FIRST_ENTRY;
+			shadowCasters = { scene.WorldBounds[SPHERE_GROUP_ENTRY], scene.WorldBounds[PLANE_ENTRY] };
+			if (stressCount > 0)
+				shadowCasters.push_back(stressBounds);
+			shadowReceivers = shadowCasters;
+			sceneMs = msSince(start);
+		});
+
+		ThreadPool::JobHandle bvhJob = threadPool.Spawn([&]() {
+			auto start = std::chrono::high_resolution_clock::now();
+			bvhRebuilt = sceneBVH.Update(scene.WorldBounds.data(), scene.Count(), transformsUpdated > 0);
+			bvhMs = msSince(start);
+		}, { sceneJob });
 
-		//***********----------------First Pass rendering from light view space-----------------**********************//
-		//glDepthFunc(GL_LESS);
-		glViewport(0, 0, SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT);
-		glBindTexture(GL_TEXTURE_2D, depthMap);
-		glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-		glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		//light position can change so shadow map update per frame.
+		//fit the light frustum to the receivers in view and the casters in front of them
+		ThreadPool::JobHandle lightJob = threadPool.Spawn([&]() {
+			if (fitLightFrustum)
+				lightFrustum.Fit(pointLight.Position, shadowCasters, shadowReceivers, cameraViewProjection, shadowMapSize, lightWidth);
+			else
+				lightFrustum.SetFixed(pointLight.Position, SphereGroupPosition, (int)shadowCasters.size());
+			//transform matrix from world space to light view space.
+			lightSpaceMatrix = lightFrustum.LightSpaceMatrix;
+			//keep the filter widths (in texels) the same size in world space, the fit left half of it as border
+			lightSize = lightFrustum.FilterWidth(lightWidth);
+		}, { sceneJob });
+
+		//per view visible lists: the depth pass draws what the light sees, the lit pass what the camera sees.
+		//view 0: light, 1: camera; each query has its own BVH stack
+		auto cullView = [&](int view, const glm::mat4& viewProjection, std::vector<unsigned int>& visible) {
+			auto start = std::chrono::high_resolution_clock::now();
+			if (frustumCulling) {
+				nodesVisited[view] = sceneBVH.Query(Frustum(viewProjection), visible, cullStacks[view]);
+			}
+			else {
+				visible.resize(scene.Count());
+				std::iota(visible.begin(), visible.end(), 0u);
+			}
+			//every entry but the plane draws the SphereGroup mesh: nothing of it before it is resident
+			if (!sphereGroupResident)
+				visible.erase(std::remove_if(visible.begin(), visible.end(), [&](unsigned int i) { return i != PLANE_ENTRY; }), visible.end());
+			cullMs[view] = msSince(start);
+		};
+		//the multi-draw-indirect commands of a view (from the mesh array SetInstances gets below)
+		auto prepareList = [&](int view, const std::vector<unsigned int>& visible, InstancedDrawList& list) {
+			auto start = std::chrono::high_resolution_clock::now();
+			instancedRenderer.Prepare(visible.data(), visible.size(), scene.Meshes().data, list);
+			listMs[view] = msSince(start);
+		};
+		ThreadPool::JobHandle lightCullJob = threadPool.Spawn([&]() { cullView(0, lightSpaceMatrix, lightVisible); }, { bvhJob, lightJob });
+		ThreadPool::JobHandle cameraCullJob = threadPool.Spawn([&]() { cullView(1, cameraViewProjection, cameraVisible); }, { bvhJob });
+		std::vector<ThreadPool::JobHandle> frameJobs = { lightCullJob, cameraCullJob };
+		if (drawInstanced) {
+			frameJobs.push_back(threadPool.Spawn([&]() { prepareList(0, lightVisible, lightDrawList); }, { lightCullJob }));
+			frameJobs.push_back(threadPool.Spawn([&]() { prepareList(1, cameraVisible, cameraDrawList); }, { cameraCullJob }));
+		}
+		threadPool.Wait(frameJobs);
+		profiler.RecordCPU("Frame jobs", msSince(frameJobsStart));
+
+		profiler.RecordCPU("Scene update", sceneMs);
+		profiler.SetCounter("Transforms updated", (double)transformsUpdated);
+		profiler.RecordCPU("BVH update", bvhMs);
+		if (bvhRebuilt)
+			profiler.Log("BVH rebuilt (" + std::to_string(scene.Count()) + " objects)");
+		const char* viewNames[2] = { "light", "camera" };
+		const std::vector<unsigned int>* viewVisible[2] = { &lightVisible, &cameraVisible };
+		for (int view = 0; view < 2; ++view) {
+			std::string name = viewNames[view];
+			profiler.RecordCPU("Cull " + name, cullMs[view]);
+			if (frustumCulling)
+				profiler.SetCounter("BVH nodes (" + name + ")", nodesVisited[view]);
+			profiler.SetCounter("Visible (" + name + ")", (double)viewVisible[view]->size());
+			if (drawInstanced)
+				profiler.RecordCPU("Draw list " + name, listMs[view]);
+		}
+		profiler.SetCounter("Jobs run", double(threadPool.GetJobsRun() - jobsRunBefore));
+		profiler.SetCounter("Jobs stolen", double(threadPool.GetJobsStolen() - jobsStolenBefore));
+		jobsRunBefore = threadPool.GetJobsRun();
+		jobsStolenBefore = threadPool.GetJobsStolen();
+
+		//the multi-draw-indirect path reads the scene arrays as they are
+		if (drawInstanced) {
+			instancedRenderer.SetMaterial(SphereGroupMaterialID, SphereGroupColor, SphereGroupShininess);
+			instancedRenderer.SetMaterial(PlaneMaterialID, planeColor, planeShininess);
+			instancedRenderer.SetMaterial(StressMaterialID, SphereGroupStressColor, SphereGroupShininess);
+			instancedRenderer.SetInstances(scene.WorldMatrices().data, scene.Materials().data, scene.Meshes().data, scene.Count());
+		}
+
+		//the benchmarks drive the PCSS settings while they run
+		bool benchmarkRunning = pcssBenchmark.IsRunning() || sampleSetBenchmark.IsRunning() || adaptiveBenchmark.IsRunning()
+			|| temporalBenchmark.IsRunning() || shadowMaskBenchmark.IsRunning() || maskResolutionBenchmark.IsRunning()
+			|| cameraPathBenchmark.IsRunning() || momentBenchmark.IsRunning() || bakeBenchmark.IsRunning() || pipelineBenchmark.IsRunning();
+		if (momentBenchmark.IsRunning())
+			ShadowRenderType = 3 + momentBenchmark.CurrentVariant();
+		else if (benchmarkRunning)
+			ShadowRenderType = 2;
+		//EVSM / MSM / blurred VSM build their tables with compute shaders
+		if (!caps.ComputeShaders && ShadowRenderType > 3)
+			ShadowRenderType = 3;
+		int activeSampleSet = sampleSetBenchmark.IsRunning() ? sampleSetBenchmark.CurrentVariant() : sampleSet;
+		//the precomputed tables are read by the default variants, only sample set 0 generates a disk per fragment
+		auto sampleSetVariant = [&](Shader& shader) -> Shader& {
+			return activeSampleSet == SAMPLES_PROCEDURAL ? shader.Variant("POISSON_PER_FRAGMENT") : shader;
+		};
+		bool pyramidEnabled = caps.ComputeShaders && (pcssBenchmark.IsRunning() ? pcssBenchmark.UsePyramid() : useDepthPyramid);
+		bool adaptiveEnabled = adaptiveBenchmark.IsRunning() ? adaptiveBenchmark.CurrentVariant() == 1 : adaptiveSamples && !temporalBenchmark.IsRunning();
+		//temporal accumulation: a small adaptive tap budget per frame, the history does the rest
+		bool temporalEnabled = temporalBenchmark.IsRunning() ? temporalBenchmark.CurrentVariant() > 0 : temporalShadows;
+		int tapBudget = maxTaps;
+		if (temporalEnabled) {
+			adaptiveEnabled = true;
+			tapBudget = temporalBenchmark.IsRunning() ? (temporalBenchmark.CurrentVariant() == 1 ? 8 : 4) : temporalTaps;
+		}
+		//the moment benchmark measures leaking on the full resolution mask
+		bool maskEnabled = shadowMaskBenchmark.IsRunning() ? shadowMaskBenchmark.CurrentVariant() == 1
+			: deferredShadowMask || maskResolutionBenchmark.IsRunning() || momentBenchmark.IsRunning();
+		shadowMask.Downsample = momentBenchmark.IsRunning() ? 1 : 1 << (maskResolutionBenchmark.IsRunning() ? maskResolutionBenchmark.CurrentVariant() : maskResolution);
+		bool collectStats = benchmarkRunning ? pcssBenchmark.CollectStats() || adaptiveBenchmark.CollectStats() || temporalBenchmark.CollectStats()
+			|| shadowMaskBenchmark.CollectStats() || maskResolutionBenchmark.CollectStats() || momentBenchmark.CollectStats() : collectShadowStats;
+		bool statsEnabled = collectStats && shadowStats && ShadowRenderType == 2;
+		bool temporalStatsEnabled = collectStats && temporalStats && temporalEnabled;
+		bool maskStatsEnabled = collectStats && maskStats && maskEnabled && shadowMask.Downsample > 1;
+		bool maskErrorEnabled = maskEnabled && (maskResolutionBenchmark.IsRunning() ? maskResolutionBenchmark.CollectStats() : measureMaskError);
+		bool leakEnabled = maskEnabled && ShadowRenderType >= 3 && (momentBenchmark.IsRunning() ? momentBenchmark.CollectStats() : measureLeak);
+
+		// GL 3.3 contexts (or the UI toggle) build the SAT with the fragment shader path
+		bool satEnabled = ShadowRenderType >= 3 && ShadowRenderType <= 5;
+		bool satFragment = !caps.ComputeShaders || forceFragmentSAT;
+
+		//shadow parameters shared by the scene shaders and the shadow mask pass
+		auto setShadowUniforms = [&](Shader& shader) {
+			shader.Bind();
+			shader.SetUniform1i("u_ShadowRenderType", ShadowRenderType);
+			shader.SetUniform1f("u_TextureSize", textureSize);
+			shader.SetUniform1f("u_SATCenter", depthSAT.Center);
+			shader.SetUniform1f("u_LightSize", lightSize);
+			shader.SetUniform1i("u_UseDepthPyramid", pyramidEnabled ? 1 : 0);
+			shader.SetUniform1i("u_SampleSet", activeSampleSet);
+			shader.SetUniform1i("u_AdaptiveSamples", adaptiveEnabled ? 1 : 0);
+			shader.SetUniform1i("u_MaxTaps", tapBudget);
+			shader.SetUniform1f("u_TexelsPerTap", texelsPerTap);
+			shader.SetUniform2f("u_EVSMExponents", momentSAT.EVSMPositive, momentSAT.EVSMNegative);
+			shader.SetUniform1f("u_MomentBias", momentSAT.MomentBias);
+			shader.SetUniform1f("u_NoiseOffset", temporalEnabled ? temporalShadow.NoiseOffset() : 0.0f);
+		};
+		//the tables of the shadow map: imported by every graph that builds them, the technique's passes, what its shader samples
+		struct ShadowTables {
+			unsigned int SAT, Pyramid, MomentSAT, MomentBlur;
+			unsigned int SATScratch, MomentRows, BlurRows; //transients
+		};
+		auto importTables = [&]() {
+			double texels = double(shadowMapSize) * shadowMapSize;
+			RGTextureDesc rowsDesc = { shadowMapSize, shadowMapSize, GL_RG32F, 1, GL_CLAMP_TO_EDGE, GL_NEAREST };
+			RGTextureDesc momentRowsDesc = { shadowMapSize, shadowMapSize, GL_RGBA32F, 1, GL_CLAMP_TO_EDGE, GL_NEAREST };
+			ShadowTables tables;
+			tables.SAT = renderGraph.Import("SAT", depthSAT.GetTexture(), texels * 8.0);
+			tables.Pyramid = renderGraph.Import("Depth pyramid", depthPyramid.GetTexture(), depthPyramid.GetResidentBytes());
+			tables.MomentSAT = renderGraph.Import("Moment SAT", momentSAT.GetTexture(), texels * 16.0);
+			tables.MomentBlur = renderGraph.Import("Moment blur", momentBlur.GetTexture(), momentBlur.GetResidentBytes());
+			tables.SATScratch = renderGraph.CreateTexture("SAT scratch", rowsDesc);
+			tables.MomentRows = renderGraph.CreateTexture("Moment SAT rows", momentRowsDesc);
+			tables.BlurRows = renderGraph.CreateTexture("Moment blur rows", rowsDesc);
+			return tables;
+		};
+		//rgSource: the shadow map resource of the graph. prefix: names of the passes and of their GPU scopes
+		auto addTablePasses = [&](const std::string& prefix, unsigned int rgSource, const ShadowTables& tables) {
+			// min/max depth pyramid, only PCSS reads it
+			if (pyramidEnabled) {
+				renderGraph.AddPass(prefix + "Depth pyramid", { { rgSource, RG_SAMPLE } }, { { tables.Pyramid, RG_IMAGE_WRITE } }, [&, prefix, rgSource]() {
+					profiler.BeginGPU(prefix + "Depth pyramid");
+					depthPyramid.BuildLevels(renderGraph.GetTexture(rgSource), DepthMinMaxShader);
+					profiler.EndGPU(prefix + "Depth pyramid");
+				});
+			}
 
-		glCullFace(GL_FRONT);
+			// calculate SAT, VSSM reads it and EVSM / MSM take the mean blocker depth from it
+			if (satFragment) {
+				renderGraph.AddPass(prefix + "SAT", { { rgSource, RG_SAMPLE }, { tables.SAT, RG_SAMPLE }, { tables.SATScratch, RG_SAMPLE } },
+					{ { tables.SAT, RG_ATTACHMENT }, { tables.SATScratch, RG_ATTACHMENT } }, [&, prefix, rgSource, tables]() {
+					profiler.BeginGPU(prefix + "SAT");
+					depthSAT.BuildFragment(renderGraph.GetTexture(rgSource), SATDoublingShader, renderGraph.GetTexture(tables.SATScratch));
+					profiler.EndGPU(prefix + "SAT");
+				});
+			}
+			else {
+				//every pass times itself: the graph culls and orders them one by one
+				renderGraph.AddPass(prefix + "SAT rows", { { rgSource, RG_SAMPLE } }, { { tables.SAT, RG_IMAGE_WRITE } }, [&, prefix, rgSource]() {
+					profiler.BeginGPU(prefix + "SAT rows");
+					depthSAT.BuildRows(renderGraph.GetTexture(rgSource), ComputeSATShader);
+					profiler.EndGPU(prefix + "SAT rows");
+				});
+				renderGraph.AddPass(prefix + "SAT columns", { { tables.SAT, RG_IMAGE_READ } }, { { tables.SAT, RG_IMAGE_WRITE } }, [&, prefix]() {
+					profiler.BeginGPU(prefix + "SAT columns");
+					depthSAT.BuildColumns(SATColumnsShader);
+					profiler.EndGPU(prefix + "SAT columns");
+				});
+			}
 
-		SimpleDepthShader.Bind();
-		SphereGroupModel = glm::mat4(1.0);
-		SphereGroupModel = glm::translate(SphereGroupModel, SphereGroupPosition);
-		SphereGroupModel = glm::scale(SphereGroupModel, glm::vec3(1.0f, 1.0f, 1.0f) * SphereGroupScale);
-		SimpleDepthShader.SetUniformM4fv("u_Model", 1, GL_FALSE, glm::value_ptr(SphereGroupModel));
-		SphereGroupMesh.draw();
+			// 4 moment table, only EVSM / MSM read it
+			MomentTechnique momentTechnique = ShadowRenderType == 4 ? MOMENTS_EVSM : MOMENTS_MSM;
+			renderGraph.AddPass(prefix + "Moment SAT warp", { { rgSource, RG_SAMPLE } }, { { tables.MomentRows, RG_IMAGE_WRITE } }, [&, prefix, rgSource, momentTechnique, tables]() {
+				profiler.BeginGPU(prefix + "Moment SAT warp");
+				momentSAT.BuildWarp(renderGraph.GetTexture(rgSource), momentTechnique, MomentWarpSATShader, renderGraph.GetTexture(tables.MomentRows));
+				profiler.EndGPU(prefix + "Moment SAT warp");
+			});
+			renderGraph.AddPass(prefix + "Moment SAT columns", { { tables.MomentRows, RG_IMAGE_READ } }, { { tables.MomentSAT, RG_IMAGE_WRITE } }, [&, prefix, tables]() {
+				profiler.BeginGPU(prefix + "Moment SAT columns");
+				momentSAT.BuildColumns(MomentSATShader, renderGraph.GetTexture(tables.MomentRows));
+				profiler.EndGPU(prefix + "Moment SAT columns");
+			});
+
+			// prefiltered moments, only VSM reads them
+			renderGraph.AddPass(prefix + "Moment blur rows", { { rgSource, RG_SAMPLE } }, { { tables.BlurRows, RG_IMAGE_WRITE } }, [&, prefix, rgSource, tables]() {
+				profiler.BeginGPU(prefix + "Moment blur rows");
+				momentBlur.BlurRows(renderGraph.GetTexture(rgSource), BlurMomentsShader, renderGraph.GetTexture(tables.BlurRows));
+				profiler.EndGPU(prefix + "Moment blur rows");
+			});
+			renderGraph.AddPass(prefix + "Moment blur columns", { { tables.BlurRows, RG_IMAGE_READ } }, { { tables.MomentBlur, RG_IMAGE_WRITE } }, [&, prefix, tables]() {
+				profiler.BeginGPU(prefix + "Moment blur columns");
+				momentBlur.BlurColumns(BlurMomentsShader, renderGraph.GetTexture(tables.BlurRows));
+				profiler.EndGPU(prefix + "Moment blur columns");
+			});
+			renderGraph.AddPass(prefix + "Moment mips", { { tables.MomentBlur, RG_UPDATE } }, { { tables.MomentBlur, RG_UPDATE } }, [&, prefix]() {
+				profiler.BeginGPU(prefix + "Moment mips");
+				momentBlur.BuildMips();
+				profiler.EndGPU(prefix + "Moment mips");
+			});
+		};
+		auto tableReads = [&](unsigned int rgSource, const ShadowTables& tables) {
+			std::vector<RGUse> reads = { { rgSource, RG_SAMPLE } };
+			if (ShadowRenderType == 2 && pyramidEnabled)
+				reads.push_back({ tables.Pyramid, RG_SAMPLE });
+			if (satEnabled)
+				reads.push_back({ tables.SAT, RG_SAMPLE });
+			if (ShadowRenderType == 4 || ShadowRenderType == 5)
+				reads.push_back({ tables.MomentSAT, RG_SAMPLE });
+			if (ShadowRenderType == 6)
+				reads.push_back({ tables.MomentBlur, RG_SAMPLE });
+			return reads;
+		};
+		//every table to the units the shadow shaders sample, the shadow map to unit 0
+		auto bindTables = [&](unsigned int shadowMap) {
+			glState().ActiveTexture(GL_TEXTURE0);
+			glState().BindTexture(GL_TEXTURE_2D, shadowMap);
+			depthSAT.Bind();
+			depthPyramid.Bind();
+			momentSAT.Bind();
+			momentBlur.Bind();
+			sampleTables.Bind();
+		};
+
+		//static shadow bake: the SphereGroup (static caster) over the plane (static receiver), from a camera independent frustum.
+		//the stress grid is dynamic: when part of it is in the light's view the plane adds the shadow of a map of those casters alone
+		bool bakingEnabled = bakeBenchmark.IsRunning() ? bakeBenchmark.CurrentVariant() == 1 : shadowBaking;
+		bool dynamicCasters = std::any_of(lightVisible.begin(), lightVisible.end(), [&](unsigned int i) { return i >= STRESS_FIRST_ENTRY; });
+		planeLightmap.SetRect(PlaneModel, glm::vec3(-5.0f, -0.5f, -5.0f), glm::vec3(10.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 10.0f));
+		bakeFrustum.SetFixed(pointLight.Position, SphereGroupPosition, 1);
+		int bakeType = shadowBaker.Source == BAKE_CPU ? std::min(ShadowRenderType, CS_TYPES - 1) : ShadowRenderType;
+		uint64_t casterKey = bakeHash(bakeHash(bakeHash(SB_HASH_SEED, pointLight.Position), scene.World[SPHERE_GROUP_ENTRY]), SphereGroupVertices.size());
+		//the filter width is in live shadow map texels: a new shadow map size rebakes
+		uint64_t bakeKey = bakeHash(bakeHash(bakeHash(bakeHash(bakeHash(casterKey, lightWidth), bakeType), shadowBaker.Source), depthFormat), shadowMapSize);
+		bool bakeStale = ShadowBaker::IsStale(planeLightmap, bakeKey);
+		bool bakeNow = bakingEnabled && bakeStale && (shadowBaker.AutoRebake || bakeRequested);
+		bakeRequested = false;
+		if (bakeNow && shadowBaker.Source == BAKE_CPU) {
+			glm::mat4 bakeMatrix = bakeFrustum.LightSpaceMatrix;
+			profiler.BeginCPU("Shadow bake");
+			//same filter width in world units on the larger map
+			shadowBaker.BakeCPU(bakedReceivers, casterKey, bakeKey, [&](DepthRasterizer& rasterizer) {
+				rasterizer.Submit(SphereGroupVertices.data(), nullptr, SphereGroupVertices.size() / 3, bakeMatrix * scene.World[SPHERE_GROUP_ENTRY]);
+			}, bakeMatrix, pointLight.Position, lightWidth * SB_SHADOW_MAP_SIZE / shadowMapSize, bakeType, &threadPool);
+			profiler.EndCPU("Shadow bake");
+			profiler.Log("Shadow bake (CPU, " + std::string(CPU_SHADOW_TYPE_NAMES[bakeType]) + "): " + std::to_string(shadowBaker.LastBaked)
+				+ " lightmaps, " + std::to_string(shadowBaker.LastBakeMs) + " ms (shadow map " + std::to_string(shadowBaker.LastMapMs) + " ms)");
+			bakeStale = false;
+		}
+		//GPU bake: a graph of its own draws the static casters from the bake frustum into a transient shadow map, builds the
+		//technique's tables from it and bakes the lightmaps. The frame's light data is left alone, its graph builds the tables again
+		if (bakeNow && shadowBaker.Source == BAKE_GPU) {
+			renderGraph.Reset();
+			RGTextureDesc bakeMapDesc = { shadowMapSize, shadowMapSize, depthInternalFormat(depthFormat), 1, GL_CLAMP_TO_EDGE, GL_LINEAR };
+			unsigned int rgBakeMap = renderGraph.CreateTexture("Bake shadow map", bakeMapDesc);
+			ShadowTables rgBakeTables = importTables();
+			renderGraph.AddPass("Bake depth", {}, { { rgBakeMap, RG_ATTACHMENT } }, [&]() {
+				glState().Viewport(0, 0, shadowMapSize, shadowMapSize);
+				glState().BindFramebuffer(GL_FRAMEBUFFER, bakeDepthFBO);
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderGraph.GetTexture(rgBakeMap), 0);
+				glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				glState().CullFace(GL_FRONT);
+				profiler.BeginGPU("Bake shadow pass");
+				SimpleDepthShader.Bind();
+				SimpleDepthShader.SetUniformM4fv("u_LightSpaceMatrix", 1, GL_FALSE, glm::value_ptr(bakeFrustum.LightSpaceMatrix));
+				SimpleDepthShader.SetUniformM4fv("u_Model", 1, GL_FALSE, glm::value_ptr(scene.World[SPHERE_GROUP_ENTRY]));
+				if (SphereGroupMesh)
+					SphereGroupMesh->draw();
+				profiler.EndGPU("Bake shadow pass");
+				glState().CullFace(GL_BACK);
+			});
+			addTablePasses("Bake ", rgBakeMap, rgBakeTables);
+			renderGraph.AddPass("Bake", tableReads(rgBakeMap, rgBakeTables), {}, [&]() {
+				bindTables(renderGraph.GetTexture(rgBakeMap));
+				Shader& bakeShader = sampleSetVariant(BakeShadowShader);
+				setShadowUniforms(bakeShader);
+				bakeShader.SetUniform1f("u_LightSize", bakeFrustum.FilterWidth(lightWidth));
+				bakeShader.SetUniformM4fv("u_LightSpaceMatrix", 1, GL_FALSE, glm::value_ptr(bakeFrustum.LightSpaceMatrix));
+				bakeShader.SetUniform3f("u_LightPosition", pointLight.Position.x, pointLight.Position.y, pointLight.Position.z);
+				profiler.BeginGPU("Shadow bake");
+				shadowBaker.BakeGPU(bakedReceivers, bakeKey, bakeShader);
+				profiler.EndGPU("Shadow bake");
+			}, true);
+			renderGraph.Execute();
+			profiler.Log("Shadow bake (GPU, " + std::string(shadowTypeNames[ShadowRenderType]) + "): " + std::to_string(shadowBaker.LastBaked) + " lightmaps");
+			glState().Viewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+			bakeStale = false;
+		}
 
+		//a stale bake is not used: the plane falls back to the realtime shadow until it is baked again.
+		//a live one takes the dynamic casters from a shadow map of their own, not from the full one
+		bool bakeActive = bakingEnabled && !bakeStale;
+		bool dynamicPass = bakeActive && dynamicCasters;
+
+		//the GPU passes up to the lit pass as a render graph: it culls what the shadow technique does not read,
+		//places the barriers and takes the intermediates from a pool shared by all of them
+		renderGraph.Reset();
+		double texels = double(shadowMapSize) * shadowMapSize;
+		unsigned int rgDepth = renderGraph.Import("Shadow map", depthMap, texels * depthTexelBytes(depthFormat));
+		unsigned int rgDynamicDepth = renderGraph.Import("Dynamic caster map", dynamicDepthMap, texels * depthTexelBytes(depthFormat));
+		ShadowTables rgTables = importTables();
+
+		//the same casters for the CPU rasterizer: the software pass, or the comparison with the GL pass
+		auto rasterizeLightPass = [&]() {
+			profiler.BeginCPU("Software light pass");
+			depthRasterizer.Clear();
+			for (unsigned int i : lightVisible) {
+				if (i == PLANE_ENTRY)
+					depthRasterizer.Submit(PlanePositions.data(), PlaneIndices, 2, lightSpaceMatrix * scene.World[i]);
+				else
+					depthRasterizer.Submit(SphereGroupVertices.data(), nullptr, SphereGroupVertices.size() / 3, lightSpaceMatrix * scene.World[i]);
+			}
+			depthRasterizer.Rasterize(&threadPool);
+			profiler.EndCPU("Software light pass");
+			profiler.SetCounter("Raster triangles", (double)depthRasterizer.LastTriangles);
+			profiler.SetCounter("Raster fragments", (double)depthRasterizer.LastFragments);
+		};
+
+		//the software light pass uploads the depth map
+		renderGraph.AddPass("Shadow depth", {}, { { rgDepth, softwareLightPass ? RG_UPDATE : RG_ATTACHMENT } }, [&]() {
+			//render scene from light's point of view
+			SimpleDepthShader.Bind();
+			SimpleDepthShader.SetUniformM4fv("u_LightSpaceMatrix", 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
 			
-		SimpleDepthShader.Bind();
-		PlaneModel = glm::mat4(1.0);
-		PlaneModel = glm::translate(PlaneModel, planePosition);
-		PlaneModel = glm::scale(PlaneModel, glm::vec3(1.0f, 1.0f, 1.0f) * planeScale);
-		SimpleDepthShader.SetUniformM4fv("u_Model", 1, GL_FALSE, glm::value_ptr(PlaneModel));
-			
-		renderer.Draw(PlaneVA, PlaneIB, SimpleDepthShader);
+
+			//***********----------------First Pass rendering from light view space-----------------**********************//
+			//glDepthFunc(GL_LESS);
+			glState().Viewport(0, 0, shadowMapSize, shadowMapSize);
+			glState().BindTexture(GL_TEXTURE_2D, depthMap);
+			glState().BindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+			glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			glState().CullFace(GL_FRONT);
+
+			profiler.BeginGPU("Shadow pass");
+			profiler.BeginCPU("Shadow pass submit");
+			//casters outside the light frustum are skipped
+			if (softwareLightPass) {
+				rasterizeLightPass();
+				depthRasterizer.Upload(depthMap, depthFormat);
+			}
+			else if (drawInstanced) {
+				InstancedDepthShader->Bind();
+				InstancedDepthShader->SetUniformM4fv("u_LightSpaceMatrix", 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+				instancedRenderer.Draw(lightDrawList);
+				profiler.AddCounter("Draw calls", instancedRenderer.LastDrawCalls);
+				profiler.AddCounter("Indirect commands", instancedRenderer.LastCommands);
+			}
+			else {
+				SimpleDepthShader.Bind();
+				for (unsigned int i : lightVisible) {
+					SimpleDepthShader.SetUniformM4fv("u_Model", 1, GL_FALSE, glm::value_ptr(scene.World[i]));
+					if (i == PLANE_ENTRY)
+						renderer.Draw(PlaneVA, PlaneIB, SimpleDepthShader);
+					else
+						SphereGroupMesh->draw();
+				}
+				profiler.AddCounter("Draw calls", (double)lightVisible.size());
+			}
+			profiler.EndCPU("Shadow pass submit");
+			profiler.EndGPU("Shadow pass");
 			
-		glCullFace(GL_BACK);
+			glState().CullFace(GL_BACK);
+		});
+
+		//the casters that are not in the bake, for the baked receivers: they skip the SphereGroup the lightmap already has
+		renderGraph.AddPass("Dynamic shadow depth", {}, { { rgDynamicDepth, RG_ATTACHMENT } }, [&]() {
+			std::vector<unsigned int> dynamicVisible;
+			for (unsigned int i : lightVisible)
+				if (i >= STRESS_FIRST_ENTRY)
+					dynamicVisible.push_back(i);
+			glState().Viewport(0, 0, shadowMapSize, shadowMapSize);
+			glState().BindFramebuffer(GL_FRAMEBUFFER, dynamicDepthFBO);
+			glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glState().CullFace(GL_FRONT);
+			profiler.BeginGPU("Dynamic shadow pass");
+			if (drawInstanced) {
+				instancedRenderer.Prepare(dynamicVisible.data(), dynamicVisible.size(), scene.Meshes().data, dynamicDrawList);
+				InstancedDepthShader->Bind();
+				InstancedDepthShader->SetUniformM4fv("u_LightSpaceMatrix", 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+				instancedRenderer.Draw(dynamicDrawList);
+				profiler.AddCounter("Draw calls", instancedRenderer.LastDrawCalls);
+				profiler.AddCounter("Indirect commands", instancedRenderer.LastCommands);
+			}
+			else {
+				SimpleDepthShader.Bind();
+				SimpleDepthShader.SetUniformM4fv("u_LightSpaceMatrix", 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+				for (unsigned int i : dynamicVisible) {
+					SimpleDepthShader.SetUniformM4fv("u_Model", 1, GL_FALSE, glm::value_ptr(scene.World[i]));
+					SphereGroupMesh->draw();
+				}
+				profiler.AddCounter("Draw calls", (double)dynamicVisible.size());
+			}
+			profiler.EndGPU("Dynamic shadow pass");
+			glState().CullFace(GL_BACK);
+		});
+
+
+		addTablePasses("", rgDepth, rgTables);
+
+		//sinks: the lit pass samples the tables of the technique, the debug view the depth map. Both are drawn further down
+		std::vector<RGUse> litReads = tableReads(rgDepth, rgTables);
+		if (dynamicPass)
+			litReads.push_back({ rgDynamicDepth, RG_SAMPLE });
+		renderGraph.AddPass("Lit", litReads, {}, [&]() {
+			bindTables(depthMap);
+			glState().ActiveTexture(GL_TEXTURE0 + SB_DYNAMIC_TEXTURE_UNIT);
+			glState().BindTexture(GL_TEXTURE_2D, dynamicDepthMap);
+		}, true);
+		renderGraph.AddPass("Debug", { { rgDepth, RG_SAMPLE } }, {}, nullptr, true);
+
+		renderGraph.Execute();
+		profiler.SetCounter("Graph passes", renderGraph.LastPasses);
+		profiler.SetCounter("Graph barriers", renderGraph.LastBarriers);
+		profiler.SetCounter("Graph pool MB", renderGraph.GetPoolBytes() / (1024.0 * 1024.0));
+
+		//GL light pass read back against the CPU one (stalls): texels only one of them covers, depth error where both do
+		if (compareRasterizer && !softwareLightPass) {
+			compareRasterizer = false;
+			std::vector<float> gpuDepth(size_t(shadowMapSize) * shadowMapSize);
+			glState().BindTexture(GL_TEXTURE_2D, depthMap);
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, gpuDepth.data());
+			glState().BindTexture(GL_TEXTURE_2D, 0);
+			rasterizeLightPass();
+			const std::vector<float>& cpuDepth = depthRasterizer.GetDepth();
+			size_t coverageDiffers = 0, covered = 0;
+			double maxError = 0.0, sumError = 0.0;
+			for (size_t t = 0; t < gpuDepth.size(); ++t) {
+				bool gpuCovered = gpuDepth[t] < 1.0f, cpuCovered = cpuDepth[t] < 1.0f;
+				if (gpuCovered != cpuCovered) {
+					coverageDiffers++;
+				}
+				else if (gpuCovered) {
+					double error = std::abs(double(gpuDepth[t]) - cpuDepth[t]);
+					maxError = std::max(maxError, error);
+					sumError += error;
+					covered++;
+				}
+			}
+			std::ostringstream out;
+			out << "Software vs GL light pass (" << DEPTH_FORMAT_NAMES[depthFormat] << "): " << depthRasterizer.LastTriangles
+				<< " triangles in " << profiler.GetCPUms("Software light pass") << " ms on " << threadPool.GetThreadCount() << " threads, "
+				<< coverageDiffers << " texels covered by one only (" << 100.0 * coverageDiffers / gpuDepth.size() << "%), depth error mean "
+				<< (covered ? sumError / covered : 0.0) << " max " << maxError;
+			rasterizerResult = out.str();
+			profiler.Log(rasterizerResult);
+		}
 
+		double satBytes = satFragment ? depthSAT.GetFragmentBuildBytes(depthFormat) : depthSAT.GetBuildBytes(depthFormat);
+		if (ShadowRenderType == 4 || ShadowRenderType == 5)
+			satBytes += momentSAT.GetBuildBytes();
+		if (satEnabled) {
+			profiler.SetCounter("SAT MB / frame", satBytes / (1024.0 * 1024.0));
+			//4 corners per table lookup: VSSM 2 RG lookups, EVSM / MSM one RG (mean depth) and 2 RGBA
+			profiler.SetCounter("Shadow bytes / lookup", ShadowRenderType == 3 ? 2 * 4 * 8 : 4 * 8 + 2 * 4 * 16);
+		}
+		if (ShadowRenderType == 6) {
+			profiler.SetCounter("Blur MB / frame", momentBlur.GetBuildBytes(depthFormat) / (1024.0 * 1024.0));
+			profiler.SetCounter("Shadow bytes / lookup", 4 * 8);
+		}
 
-		// calculate SAT
-		ComputeSATShader.Bind();
-		glBindImageTexture(0, depthMap, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
-		glBindImageTexture(1, varianceTexture[0], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
-		glDispatchCompute(SHADOW_MAP_WIDTH, 1, 1);
-		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-		glBindImageTexture(0, varianceTexture[0], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
-		glBindImageTexture(1, varianceTexture[1], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
-		glDispatchCompute(SHADOW_MAP_WIDTH, 1, 1);
-		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
+		/***********--------------------------	Second Pass Rendering from camera view space ---------------------***********/
 
+		//glDeleteFramebuffers(1, &depthMapFBO);
 
-		/***********--------------------------	Second Pass Rendering from camera view space ---------------------***********/
+		//light, camera and shadow parameters shared by every scene shader
+		auto setSceneUniforms = [&](Shader& shader) {
+			setShadowUniforms(shader);
+			// light parameters
+			shader.SetUniform1f("u_Light.intensity", pointLight.Intensity);
+			shader.SetUniform3f("u_Light.position", pointLight.Position.x, pointLight.Position.y, pointLight.Position.z);
+			shader.SetUniform3f("u_Light.color", pointLight.Color.x, pointLight.Color.y, pointLight.Color.z);
+			shader.SetUniform3f("u_Light.ambient", pointLight.GetAmbient().x, pointLight.GetAmbient().y, pointLight.GetAmbient().z);
+			shader.SetUniform3f("u_Light.diffuse", pointLight.GetDiffuse().x, pointLight.GetDiffuse().y, pointLight.GetDiffuse().z);
+			shader.SetUniform3f("u_Light.specular", pointLight.GetSpecular().x, pointLight.GetSpecular().y, pointLight.GetSpecular().z);
+			shader.SetUniform1f("u_Light.kc", pointLight.Constant);
+			shader.SetUniform1f("u_Light.kl", pointLight.Linear);
+			shader.SetUniform1f("u_Light.kq", pointLight.Quadratic);
+			shader.SetUniform3f("u_ViewPos", cam.GetCamPos().x, cam.GetCamPos().y, cam.GetCamPos().z);
+			// VP
+			shader.SetUniformM4fv("u_View", 1, GL_FALSE, glm::value_ptr(cam.GetViewMatrix()));
+			shader.SetUniformM4fv("u_Projection", 1, GL_FALSE, glm::value_ptr(cam.GetProjectionMatrix(PERSPECTIVE)));
+			// shadow parameters
+			shader.SetUniformM4fv("u_LightSpaceMatrix", 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+			shader.SetUniform1i("u_TemporalShadow", temporalEnabled ? 1 : 0);
+			shader.SetUniform1i("u_UseShadowMask", maskEnabled ? 1 : 0);
+		};
+
+		planeLightmap.Bind();
+		auto setBakeUniforms = [&](Shader& shader, bool receiver) {
+			shader.SetUniform1i("u_UseBakedShadow", receiver && bakeActive ? 1 : 0);
+			shader.SetUniform1i("u_DynamicCasters", dynamicPass ? 1 : 0);
+			planeLightmap.SetUniforms(shader);
+		};
+
+		//the stats variants count the PCSS early exits
+		Shader& litSphereShader = sampleSetVariant(statsEnabled ? *StatsSceneShader : SphereGroupShader);
+		Shader& litPlaneShader = sampleSetVariant(statsEnabled ? *StatsSceneShader : PlaneShader);
+		Shader& litInstancedShader = instancingSupported ? sampleSetVariant(statsEnabled ? *InstancedStatsSceneShader : *InstancedSceneShader) : litSphereShader;
+		if (statsEnabled) {
+			shadowStats->Reset();
+			shadowStats->Bind(3);
+		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glEnable(GL_DEPTH_TEST);
+		//deferred shadow mask: depth prepass of the visible objects, then one shadow evaluation per pixel
+		if (maskEnabled) {
+			profiler.BeginGPU("Depth prepass");
+			shadowMask.BeginPrepass();
+			if (drawInstanced) {
+				InstancedPrepassShader->Bind();
+				InstancedPrepassShader->SetUniformM4fv("u_View", 1, GL_FALSE, glm::value_ptr(cam.GetViewMatrix()));
+				InstancedPrepassShader->SetUniformM4fv("u_Projection", 1, GL_FALSE, glm::value_ptr(cam.GetProjectionMatrix(PERSPECTIVE)));
+				//the baked receiver is marked for the mask pass
+				InstancedPrepassShader->SetUniform1i("u_UseBakedShadow", bakeActive ? 1 : 0);
+				InstancedPrepassShader->SetUniform1i("u_BakedMaterial", (int)PlaneMaterialID);
+				instancedRenderer.Draw(cameraDrawList);
+				profiler.AddCounter("Draw calls", instancedRenderer.LastDrawCalls);
+				profiler.AddCounter("Indirect commands", instancedRenderer.LastCommands);
+			}
+			else {
+				PrepassShader.Bind();
+				PrepassShader.SetUniformM4fv("u_View", 1, GL_FALSE, glm::value_ptr(cam.GetViewMatrix()));
+				PrepassShader.SetUniformM4fv("u_Projection", 1, GL_FALSE, glm::value_ptr(cam.GetProjectionMatrix(PERSPECTIVE)));
+				for (unsigned int i : cameraVisible) {
+					PrepassShader.SetUniformM4fv("u_Model", 1, GL_FALSE, glm::value_ptr(scene.World[i]));
+					PrepassShader.SetUniform1i("u_UseBakedShadow", i == PLANE_ENTRY && bakeActive ? 1 : 0);
+					if (i == PLANE_ENTRY)
+						renderer.Draw(PlaneVA, PlaneIB, PrepassShader);
+					else
+						SphereGroupMesh->draw();
+				}
+				profiler.AddCounter("Draw calls", (double)cameraVisible.size());
+			}
+			profiler.EndGPU("Depth prepass");
+
+			//evaluation (every pixel, or every 2nd / 4th one) and bilateral upsample
+			Shader& maskShader = sampleSetVariant(statsEnabled ? *StatsShadowMaskShader : ShadowMaskShader);
+			Shader& upsampleShader = sampleSetVariant(maskStatsEnabled ? *StatsShadowUpsampleShader : ShadowUpsampleShader);
+			setShadowUniforms(maskShader);
+			setShadowUniforms(upsampleShader);
+			if (maskStatsEnabled) {
+				maskStats->Reset();
+				maskStats->Bind(5);
+			}
+			ShadowMaskView maskView = { cameraViewProjection, lightSpaceMatrix, pointLight.Position, cam.NearPlane, cam.FarPlane, dynamicPass };
+			profiler.BeginGPU("Shadow mask");
+			shadowMask.Evaluate(maskShader, upsampleShader, maskView);
+			profiler.EndGPU("Shadow mask");
+			if (maskStatsEnabled) {
+				const std::vector<unsigned int>& stats = maskStats->Read();
+				profiler.SetCounter("Mask fallback %", 100.0 * stats[1] / std::max(1u, stats[0]));
+			}
+			else if (shadowMask.Downsample == 1)
+				profiler.SetCounter("Mask fallback %", 0.0);
+			//compared to a full resolution evaluation of the same frame (readback, outside the timed scope)
+			if (maskErrorEnabled && !leakEnabled) {
+				Shader& referenceShader = sampleSetVariant(ShadowMaskShader);
+				setShadowUniforms(referenceShader);
+				MaskError error = shadowMask.MeasureError(referenceShader, maskView);
+				profiler.SetCounter("Mask error (mean)", error.Mean);
+				profiler.SetCounter("Mask error > 0.1 %", 100.0 * error.AboveThreshold);
+			}
+			//light leaking of the filtered techniques, against PCSS (depth comparisons, no moment bound)
+			if (leakEnabled) {
+				setShadowUniforms(ShadowMaskShader);
+				ShadowMaskShader.SetUniform1i("u_ShadowRenderType", 2);
+				ShadowMaskShader.SetUniform1i("u_UseDepthPyramid", 0);
+				MaskError error = shadowMask.MeasureError(ShadowMaskShader, maskView);
+				profiler.SetCounter("Leak %", 100.0 * error.Leak);
+				profiler.SetCounter("Error vs PCSS (mean)", error.Mean);
+			}
+			shadowMask.Bind();
+		}
 
-		//reset viewport
-		glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
-		glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		//glDeleteFramebuffers(1, &depthMapFBO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, depthMap);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, varianceTexture[1]);
-			
-		//SphereGroup
-		SphereGroupShader.Bind();
-		// light parameters
-		SphereGroupShader.SetUniform1f("u_Light.intensity", pointLight.Intensity);
-		SphereGroupShader.SetUniform3f("u_Light.position", pointLight.Position.x, pointLight.Position.y, pointLight.Position.z);
-		SphereGroupShader.SetUniform3f("u_Light.color", pointLight.Color.x, pointLight.Color.y, pointLight.Color.z);
-		SphereGroupShader.SetUniform3f("u_Light.ambient", pointLight.GetAmbient().x, pointLight.GetAmbient().y, pointLight.GetAmbient().z);
-		SphereGroupShader.SetUniform3f("u_Light.diffuse", pointLight.GetDiffuse().x, pointLight.GetDiffuse().y, pointLight.GetDiffuse().z);
-		SphereGroupShader.SetUniform3f("u_Light.specular", pointLight.GetSpecular().x, pointLight.GetSpecular().y, pointLight.GetSpecular().z);
-		SphereGroupShader.SetUniform1f("u_Light.kc", pointLight.Constant);
-		SphereGroupShader.SetUniform1f("u_Light.kl", pointLight.Linear);
-		SphereGroupShader.SetUniform1f("u_Light.kq", pointLight.Quadratic);
-		// material parameters
-		SphereGroupShader.SetUniform3f("u_Material.color", SphereGroupColor.x, SphereGroupColor.y, SphereGroupColor.z);
-		SphereGroupShader.SetUniform1f("u_Material.shininess", SphereGroupShininess);
-		SphereGroupShader.SetUniform3f("u_ViewPos", cam.GetCamPos().x, cam.GetCamPos().y, cam.GetCamPos().z);
-		// MVP
-		SphereGroupShader.SetUniformM4fv("u_View", 1, GL_FALSE, glm::value_ptr(cam.GetViewMatrix()));
-		SphereGroupShader.SetUniformM4fv("u_Projection", 1, GL_FALSE, glm::value_ptr(cam.GetProjectionMatrix(PERSPECTIVE)));
-		SphereGroupShader.SetUniformM4fv("u_Model", 1, GL_FALSE, glm::value_ptr(SphereGroupModel));
-		// shadow parameters
-		SphereGroupShader.SetUniform1i("u_ShadowRenderType", ShadowRenderType);
-		SphereGroupShader.SetUniformM4fv("u_LightSpaceMatrix", 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
-		SphereGroupShader.SetUniform1f("u_TextureSize", textureSize);
-		SphereGroupShader.SetUniform1f("u_LightSize", lightWidth);
-		// render
-		SphereGroupMesh.draw();
+		glState().Enable(GL_DEPTH_TEST);
+		//dynamic resolution: the camera pass renders offscreen at renderWidth x renderHeight, upscaled after the light gizmo
+		if (dynamicEnabled)
+			dynamicResolution.Begin(glm::vec3(0.1f, 0.1f, 0.1f));
+		if (temporalEnabled) {
+			//offscreen: ambient, direct light and this frame's shadow are resolved after the pass
+			temporalShadow.BeginScene(glm::vec3(0.1f, 0.1f, 0.1f));
+		}
+		else {
+			temporalShadow.Invalidate();
+			if (!dynamicEnabled) {
+				glState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+				//reset viewport
+				glState().Viewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+				glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			}
+		}
 
+		profiler.BeginGPU("Lit pass");
+		profiler.BeginCPU("Lit pass submit");
+		if (drawInstanced) {
+			//SphereGroup, plane and stress grid in one multi-draw
+			setSceneUniforms(litInstancedShader);
+			setBakeUniforms(litInstancedShader, true);
+			litInstancedShader.SetUniform1i("u_BakedMaterial", (int)PlaneMaterialID);
+			instancedRenderer.Draw(cameraDrawList);
+			profiler.AddCounter("Draw calls", instancedRenderer.LastDrawCalls);
+			profiler.AddCounter("Indirect commands", instancedRenderer.LastCommands);
+		}
+		else {
+			//SphereGroup, stress grid and plane, one draw per visible instance through the render queue
+			renderQueue.Reset();
+			unsigned int sphereProgram = renderQueue.AddProgram(litSphereShader, [&](Shader& shader) {
+				setSceneUniforms(shader);
+				setBakeUniforms(shader, false);
+			});
+			unsigned int planeProgram = renderQueue.AddProgram(litPlaneShader, [&](Shader& shader) {
+				setSceneUniforms(shader);
+				setBakeUniforms(shader, true);
+			});
+			unsigned int sphereMaterial = renderQueue.AddMaterial(SphereGroupColor, SphereGroupShininess);
+			unsigned int stressMaterial = renderQueue.AddMaterial(SphereGroupStressColor, SphereGroupShininess);
+			unsigned int planeMaterial = renderQueue.AddMaterial(planeColor, planeShininess);
+			//no SphereGroup buffers before it is streamed in or once evicted, nothing visible draws it then
+			unsigned int sphereGeometry = 0;
+			if (SphereGroupMesh)
+				sphereGeometry = renderQueue.AddGeometry(SphereGroupMesh->vao, SphereGroupMesh->hasIndexBuffer ? SphereGroupMesh->indexBuffer : 0,
+					(unsigned int)(SphereGroupMesh->hasIndexBuffer ? SphereGroupMesh->numIndices : SphereGroupMesh->numVertices));
+			unsigned int planeGeometry = renderQueue.AddGeometry(PlaneVA.GetID(), PlaneIB.GetID(), PlaneIB.GetCount());
+			glm::vec3 eye = cam.GetCamPos();
+			for (unsigned int i : cameraVisible) {
+				float depth = glm::length(glm::vec3(scene.World[i][3]) - eye) / cam.FarPlane;
+				if (i == PLANE_ENTRY)
+					renderQueue.Submit(RQ_PASS_OPAQUE, planeProgram, planeMaterial, planeGeometry, depth, PlaneModel);
+				else
+					renderQueue.Submit(RQ_PASS_OPAQUE, sphereProgram, i == SPHERE_GROUP_ENTRY ? sphereMaterial : stressMaterial, sphereGeometry, depth, scene.World[i]);
+			}
+			renderQueue.Sort(&threadPool);
+			renderQueue.Execute(RQ_PASS_OPAQUE);
+			profiler.RecordCPU("Queue sort", renderQueue.LastSortMs);
+			profiler.SetCounter("Queue state changes", renderQueue.LastChanges.Total());
+			profiler.SetCounter("Queue state changes (unsorted)", renderQueue.LastUnsortedChanges.Total());
+			profiler.AddCounter("Draw calls", renderQueue.LastDraws);
+		}
+		profiler.EndCPU("Lit pass submit");
+		profiler.EndGPU("Lit pass");
+
+		if (statsEnabled) {
+			const std::vector<unsigned int>& stats = shadowStats->Read();
+			profiler.SetCounter("PCSS fragments", stats[0]);
+			profiler.SetCounter("PCSS early lit", stats[1]);
+			profiler.SetCounter("PCSS early shadowed", stats[2]);
+			profiler.SetCounter("PCSS taps", stats[3]);
+			profiler.SetCounter("PCSS taps / fragment", stats[0] ? double(stats[3]) / stats[0] : 0.0);
+		}
 
-			
-		//PLANE
-		PlaneShader.Bind();
-		// light parameters
-		PlaneShader.SetUniform1f("u_Light.intensity", pointLight.Intensity);
-		PlaneShader.SetUniform3f("u_Light.position", pointLight.Position.x, pointLight.Position.y, pointLight.Position.z);
-		PlaneShader.SetUniform3f("u_Light.color", pointLight.Color.x, pointLight.Color.y, pointLight.Color.z);
-		PlaneShader.SetUniform3f("u_Light.ambient", pointLight.GetAmbient().x, pointLight.GetAmbient().y, pointLight.GetAmbient().z);
-		PlaneShader.SetUniform3f("u_Light.diffuse", pointLight.GetDiffuse().x, pointLight.GetDiffuse().y, pointLight.GetDiffuse().z);
-		PlaneShader.SetUniform3f("u_Light.specular", pointLight.GetSpecular().x, pointLight.GetSpecular().y, pointLight.GetSpecular().z);
-		PlaneShader.SetUniform1f("u_Light.kc", pointLight.Constant);
-		PlaneShader.SetUniform1f("u_Light.kl", pointLight.Linear);
-		PlaneShader.SetUniform1f("u_Light.kq", pointLight.Quadratic);
-		// material parameters
-		PlaneShader.SetUniform3f("u_Material.color", planeColor.x, planeColor.y, planeColor.z);
-		PlaneShader.SetUniform1f("u_Material.shininess", planeShininess);
-		PlaneShader.SetUniform3f("u_ViewPos", cam.GetCamPos().x, cam.GetCamPos().y, cam.GetCamPos().z);
-		// MVP
-		PlaneShader.SetUniformM4fv("u_View", 1, GL_FALSE, glm::value_ptr(cam.GetViewMatrix()));
-		PlaneShader.SetUniformM4fv("u_Projection", 1, GL_FALSE, glm::value_ptr(cam.GetProjectionMatrix(PERSPECTIVE)));
-		PlaneShader.SetUniformM4fv("u_Model", 1, GL_FALSE, glm::value_ptr(PlaneModel));
-		// shadow parameters
-		PlaneShader.SetUniform1i("u_ShadowRenderType", ShadowRenderType);
-		PlaneShader.SetUniformM4fv("u_LightSpaceMatrix", 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
-		PlaneShader.SetUniform1f("u_TextureSize", textureSize);
-		PlaneShader.SetUniform1f("u_LightSize", lightWidth);
-		// render
-		renderer.Draw(PlaneVA, PlaneIB, PlaneShader);
+		//reproject, validate and blend the shadow history, then light the frame with it
+		if (temporalEnabled) {
+			if (temporalStatsEnabled) {
+				temporalStats->Reset();
+				temporalStats->Bind(4);
+			}
+			profiler.BeginGPU("Temporal resolve");
+			temporalShadow.Resolve(temporalStatsEnabled ? *TemporalStatsResolveShader : TemporalResolveShader,
+				cameraViewProjection, cam.NearPlane, cam.FarPlane);
+			temporalShadow.Composite(ShadowCompositeShader, dynamicEnabled ? dynamicResolution.GetFBO() : 0);
+			profiler.EndGPU("Temporal resolve");
+			if (temporalStatsEnabled) {
+				const std::vector<unsigned int>& stats = temporalStats->Read();
+				double pixels = std::max(1u, stats[0]);
+				profiler.SetCounter("Temporal rejected %", 100.0 * stats[1] / pixels);
+				profiler.SetCounter("Temporal clamped %", 100.0 * stats[2] / pixels);
+			}
+		}
+
+		if (pcssBenchmark.Record(profiler, scene.Count()))
+			profiler.Log(pcssBenchmark.Result);
+		if (sampleSetBenchmark.Record(profiler))
+			profiler.Log(sampleSetBenchmark.Result);
+		if (adaptiveBenchmark.Record(profiler))
+			profiler.Log(adaptiveBenchmark.Result);
+		if (temporalBenchmark.Record(profiler))
+			profiler.Log(temporalBenchmark.Result);
+		if (shadowMaskBenchmark.Record(profiler))
+			profiler.Log(shadowMaskBenchmark.Result);
+		if (maskResolutionBenchmark.Record(profiler))
+			profiler.Log(maskResolutionBenchmark.Result);
+		if (bakeBenchmark.Record(profiler))
+			profiler.Log(bakeBenchmark.Result);
+		if (momentBenchmark.Record(profiler))
+			profiler.Log(momentBenchmark.Result);
+		if (pipelineBenchmark.Record(profiler))
+			profiler.Log(pipelineBenchmark.Result);
 
 
 		//LIGHT
@@ -689,13 +1748,21 @@ int main(void) {
 		// render
 		renderer.Draw(LightVA, LightIB, LightShader);
 
+		if (dynamicEnabled) {
+			profiler.BeginGPU("Upscale");
+			dynamicResolution.Upscale();
+			profiler.EndGPU("Upscale");
+		}
+		if (cameraPathBenchmark.Record(profiler, dynamicEnabled ? dynamicResolution.Scale : 1.0f, scaleChanged))
+			profiler.Log(cameraPathBenchmark.Result);
+
 		
 		// Debug rendering
-		glViewport(0, 0, (int)(SCREEN_WIDTH/4), (int)(SCREEN_WIDTH/4));
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glState().Viewport(0, 0, (int)(SCREEN_WIDTH/4), (int)(SCREEN_WIDTH/4));
+		glState().BindFramebuffer(GL_FRAMEBUFFER, 0);
 		DebugShader.Bind();
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, depthMap);
+		glState().ActiveTexture(GL_TEXTURE0);
+		glState().BindTexture(GL_TEXTURE_2D, depthMap);
 		renderQuad(DebugShader);
 
 
@@ -742,6 +1809,8 @@ int main(void) {
 			ImGui::SliderFloat("Light width", &lightWidth, 2.0f, 250.0f);
 			ImGui::ColorEdit3("Light color", &pointLight.Color.x);
 			ImGui::SliderFloat("Intensity", &pointLight.Intensity, 0.0f, 5.0f);
+			ImGui::Checkbox("Orbit (ghosting test)", &movingLight);
+			ImGui::SliderFloat("Orbit speed", &lightOrbitSpeed, 0.1f, 3.0f);
 			//ImGui::SliderFloat("Ambient Strength", &pointLight.AmbientCoef, 0.01f, 0.9f);
 			//ImGui::SliderFloat("Diffuse intensity", &pointLight.DiffuseCoef, 0.0f, 2.0f);
 			//ImGui::SliderFloat("Specular strength", &pointLight.SpecularCoef, 0.0f, 1.0f);
@@ -750,8 +1819,205 @@ int main(void) {
 			//ImGui::SliderFloat("Attenuation quadratic", &pointLight.Quadratic, 0.0f, 2.0f);
 			ImGui::End();
 		}
+		{
+			ImGui::Begin("Dynamic Resolution");
+			ImGui::Checkbox("Scale the camera pass to hold the target", &dynamicResolutionEnabled);
+			ImGui::SliderFloat("Target GPU frame (ms)", &dynamicResolution.TargetMs, 4.0f, 50.0f, "%.1f");
+			ImGui::SliderFloat("Min scale", &dynamicResolution.MinScale, 0.25f, DR_MAX_SCALE);
+			ImGui::Text("GPU frame %.2f ms, rendering %d x %d", profiler.GetGPUFrameAvgMs(), renderWidth, renderHeight);
+			if (!benchmarkRunning && ImGui::Button("Camera path: full / dynamic resolution (stress scene)")) {
+				stressScene = true;
+				cameraPathBenchmark.Start({ "full resolution", "dynamic" }, dynamicResolution.TargetMs);
+			}
+			ImGui::TextWrapped("%s", cameraPathBenchmark.Result.c_str());
+			ImGui::End();
+		}
+		{
+			ImGui::Begin("Stress Test");
+			if (instancingSupported)
+				ImGui::Checkbox("Instanced path (multi-draw-indirect)", &useInstancing);
+			else
+				ImGui::Text("Instanced path needs GL 4.3");
+			ImGui::Checkbox("Stress scene", &stressScene);
+			ImGui::Checkbox("Frustum culling (BVH)", &frustumCulling);
+			ImGui::SliderInt("Instances", &stressInstanceCount, 10000, 100000);
+			ImGui::Text("Draw calls: %.0f (indirect commands: %.0f)", profiler.GetCounter("Draw calls"), profiler.GetCounter("Indirect commands"));
+			ImGui::Text("CPU submit: shadow %.3f ms, lit %.3f ms", profiler.GetCPUms("Shadow pass submit"), profiler.GetCPUms("Lit pass submit"));
+			ImGui::Text("Visible: camera %.0f, light %.0f of %d", profiler.GetCounter("Visible (camera)"), profiler.GetCounter("Visible (light)"), (int)scene.Count());
+			ImGui::Text("Culling: camera %.3f ms, light %.3f ms, BVH update %.3f ms", profiler.GetCPUms("Cull camera"), profiler.GetCPUms("Cull light"), profiler.GetCPUms("BVH update"));
+			ImGui::Text("BVH: %d nodes, SAH cost %.1f (built %.1f), %u rebuilds", (int)sceneBVH.GetNodeCount(), sceneBVH.GetCost(), sceneBVH.GetBuildCost(), sceneBVH.Rebuilds);
+			ImGui::Separator();
+			ImGui::Checkbox("Deterministic jobs (one thread)", &deterministicJobs);
+			ImGui::Text("Frame jobs: %.3f ms on %d threads, %.0f jobs, %.0f stolen", profiler.GetCPUms("Frame jobs"), (int)threadPool.GetThreadCount(),
+				profiler.GetCounter("Jobs run"), profiler.GetCounter("Jobs stolen"));
+			ImGui::Text("Draw lists: camera %.3f ms, light %.3f ms", profiler.GetCPUms("Draw list camera"), profiler.GetCPUms("Draw list light"));
+			if (!drawInstanced) {
+				ImGui::Separator();
+				ImGui::Checkbox("Sort the render queue", &renderQueue.Sorted);
+				ImGui::Text("Queue: %zu draws, sorted in %.3f ms, %.0f state changes (%.0f in submission order)", renderQueue.GetSize(),
+					profiler.GetCPUms("Queue sort"), profiler.GetCounter("Queue state changes"), profiler.GetCounter("Queue state changes (unsorted)"));
+			}
+			ImGui::End();
+		}
+		{
+			ImGui::Begin("Streaming");
+			ImGui::Text("Time to first frame: %.1f ms", firstFrameMs);
+			ImGui::Text("Staging ring: %s, %.1f / %.0f MB in flight", meshStreamer.IsPersistent() ? "persistently mapped" : "mapped per copy",
+				meshStreamer.GetRingUsed() / (1024.0 * 1024.0), MS_RING_SIZE / (1024.0 * 1024.0));
+			int budgetKB = (int)(meshStreamer.UploadBudget / 1024);
+			if (ImGui::SliderInt("Upload budget (KB / frame)", &budgetKB, 64, 16384))
+				meshStreamer.UploadBudget = size_t(budgetKB) * 1024;
+			ImGui::Text("Last frame: %.0f KB in %.3f ms%s, total %.1f MB", meshStreamer.LastFrameBytes / 1024.0, meshStreamer.LastUpdateMs,
+				meshStreamer.LastRingWaits ? " (ring full)" : "", meshStreamer.TotalBytes / (1024.0 * 1024.0));
+			for (const auto& request : meshStreamer.GetRequests()) {
+				ImGui::TextWrapped("%s: %s, parsed in %.1f ms, %.2f MB in %d frames, resident after %.1f ms (%.1f MB/s)", request->Name.c_str(),
+					STREAM_STATE_NAMES[request->State.load()], request->ParseMs, request->Bytes / (1024.0 * 1024.0), request->Frames, request->ResidentMs,
+					request->UploadMs > 0.0 ? request->Bytes / (1024.0 * 1024.0) / (request->UploadMs * 1e-3) : 0.0);
+			}
+			ImGui::End();
+		}
+		{
+			ImGui::Begin("Frame Pipelining");
+			ImGui::SliderInt("Frames in flight", &framesInFlight, 1, FR_MAX_FRAMES_IN_FLIGHT);
+			ImGui::Text("CPU frame %.3f ms, GPU frame %.3f ms, %d frames ahead", frameCPUms, profiler.GetGPUFrameMs(), frameSync.LastInFlight);
+			ImGui::Text("Fence wait %.3f ms, %u stalled frames", frameSync.LastWaitMs, frameSync.Stalls);
+			ImGui::Text("Frame ring: %s, %.0f KB / frame of %.0f KB slices, %u grows", frameRing.IsPersistent() ? "persistently mapped" : "mapped per write",
+				frameRing.LastFrameBytes / 1024.0, frameRing.GetSliceSize() / 1024.0, frameRing.Grows);
+			if (ImGui::Button("Benchmark frames in flight")) {
+				pipelineBenchmark.Start({ "1 frame", "2 frames", "3 frames" }, std::vector<std::string>{ "Shadow pass", "Lit pass" },
+					{ "Fence wait ms", "Frames in flight", "CPU frame ms", "Frame interval ms" });
+			}
+			ImGui::TextWrapped("%s", pipelineBenchmark.Result.c_str());
+			ImGui::End();
+		}
+		{
+			ImGui::Begin("GL State");
+			ImGui::Checkbox("Drop redundant binds and state changes", &glState().Enabled);
+			ImGui::Text("Last frame: %u calls issued, %u skipped", glState().GetLastIssued(), glState().GetLastSkipped());
+			for (int k = 0; k < GS_KINDS; ++k)
+				ImGui::Text("  %s: %u issued, %u skipped", GS_KIND_NAMES[k], glState().LastIssued[k], glState().LastSkipped[k]);
+			ImGui::End();
+		}
+		{
+			ImGui::Begin("Render Graph");
+			ImGui::Text("%d passes run, %d culled", renderGraph.LastPasses, renderGraph.LastCulled);
+			std::string culled;
+			for (const std::string& name : renderGraph.LastCulledNames)
+				culled += (culled.empty() ? "" : ", ") + name;
+			ImGui::TextWrapped("Culled: %s", culled.empty() ? "none" : culled.c_str());
+			//by hand every pass with image stores ended in a barrier, the pyramid's per level barriers are inside its pass either way
+			ImGui::Text("glMemoryBarrier calls: %d (one per image writing pass: %d)", renderGraph.LastBarriers, renderGraph.LastImageWrites);
+			//before: every table owned its intermediates, the fragment SAT scratch only on that path
+			double intermediateBytes = momentSAT.GetIntermediateBytes() + momentBlur.GetIntermediateBytes()
+				+ (!caps.ComputeShaders || forceFragmentSAT ? depthSAT.GetIntermediateBytes() : 0.0);
+			double importedBytes = renderGraph.GetImportedBytes();
+			ImGui::Text("Shadow VRAM: %.1f MB with per pass intermediates, %.1f MB pooled", (importedBytes + intermediateBytes) / (1024.0 * 1024.0),
+				(importedBytes + renderGraph.GetPoolBytes()) / (1024.0 * 1024.0));
+			ImGui::Text("Pool: %zu textures, %.1f MB, %.1f MB in use at most (%.1f MB of transients this frame)", renderGraph.GetPoolSize(),
+				renderGraph.GetPoolBytes() / (1024.0 * 1024.0), renderGraph.LastPeakBytes / (1024.0 * 1024.0),
+				renderGraph.LastTransientBytes / (1024.0 * 1024.0));
+			ImGui::End();
+		}
+		{
+			ImGui::Begin("GPU Memory");
+			GPUMemory& memory = gpuMemory();
+			int budgetMB = int(memory.Budget >> 20);
+			if (ImGui::SliderInt("Budget MB (0: none)", &budgetMB, 0, 1024))
+				memory.Budget = size_t(budgetMB) << 20;
+			ImGui::Text("%.1f MB in %zu allocations, peak %.1f MB%s", gmMiB(memory.GetTotal()), memory.GetCount(), gmMiB(memory.PeakBytes),
+				memory.LastOverBudget ? ", OVER BUDGET" : "");
+			for (int c = 0; c < GM_CATEGORIES; ++c)
+				ImGui::Text("  %s: %.2f MB", GM_CATEGORY_NAMES[c], gmMiB(memory.GetTotal(GPUMemoryCategory(c))));
+			for (const GPUMemory::PressureHandler& handler : memory.GetHandlers())
+				ImGui::Text("%s: degraded %u step%s", handler.Name.c_str(), handler.Steps, handler.Steps == 1 ? "" : "s");
+			ImGui::Text("Shadow maps %d^2, SphereGroup %s", shadowMapSize, STREAM_STATE_NAMES[meshStreamer.GetState(SphereGroupStream)]);
+			if (ImGui::Button("Restore full quality"))
+				memory.Restore();
+			ImGui::SameLine();
+			if (ImGui::Button("Save gpu_memory.json"))
+				gpuMemoryDumpResult = memory.SaveJSON("gpu_memory.json") ? "Saved gpu_memory.json" : "Could not write gpu_memory.json";
+			ImGui::TextWrapped("%s", gpuMemoryDumpResult.c_str());
+			if (ImGui::CollapsingHeader("Allocations")) {
+				for (const auto& entry : memory.GetAllocations()) {
+					const GPUMemory::Allocation& a = entry.second;
+					const GMFormat* format = gmFindFormat(a.Format);
+					if (a.Kind == GM_KIND_BUFFER)
+						ImGui::Text("%s (%s %u): %.2f MB", a.Owner, GM_KIND_NAMES[a.Kind], a.Name, gmMiB(a.Bytes));
+					else
+						ImGui::Text("%s (%s %u): %s %dx%d, %d level%s, %.2f MB", a.Owner, GM_KIND_NAMES[a.Kind], a.Name, format ? format->Name : "unknown",
+							a.Width, a.Height, a.Levels, a.Levels == 1 ? "" : "s", gmMiB(a.Bytes));
+				}
+			}
+			ImGui::End();
+		}
+		profiler.DrawUI();
+		{
+			ImGui::Begin("Shadow Frustum");
+			ImGui::Checkbox("Fit to casters and receivers", &fitLightFrustum);
+			ImGui::Checkbox("CPU light pass (software rasterizer)", &softwareLightPass);
+			if (softwareLightPass) {
+				ImGui::Text("Software light pass: %.3f ms, %.0f triangles, %.0f fragments", profiler.GetCPUms("Software light pass"),
+					profiler.GetCounter("Raster triangles"), profiler.GetCounter("Raster fragments"));
+			}
+			else if (ImGui::Button("Compare the software light pass with GL (stalls)")) {
+				compareRasterizer = true;
+			}
+			ImGui::TextWrapped("%s", rasterizerResult.c_str());
+			ImGui::Text("Near / far: %.3f / %.3f", lightFrustum.NearPlane, lightFrustum.FarPlane);
+			ImGui::Text("Casters culled: %d / %d", lightFrustum.CastersCulled, lightFrustum.CastersTotal);
+			if (fitLightFrustum) {
+				ImGui::Text("Texel density: %.1f texels/unit (fixed frustum: %.1f, x%.2f)", lightFrustum.TexelDensity,
+					lightFrustum.BaselineTexelDensity, lightFrustum.TexelDensity / lightFrustum.BaselineTexelDensity);
+			}
+			ImGui::End();
+		}
+		{
+			ImGui::Begin("Shadow Bake");
+			ImGui::Checkbox("Baked shadow on the plane (SphereGroup)", &shadowBaking);
+			int bakeSource = shadowBaker.Source;
+			if (ImGui::Combo("Bake with", &bakeSource, BAKE_SOURCE_NAMES, 2))
+				shadowBaker.Source = BakeSource(bakeSource);
+			ImGui::Checkbox("Re-bake when the light or a static object moves", &shadowBaker.AutoRebake);
+			if (ImGui::Button("Bake now")) {
+				shadowBaker.Invalidate(bakedReceivers);
+				bakeRequested = true;
+			}
+			ImGui::Text("Lightmap %d^2 (%.2f MB): %s", planeLightmap.GetSize(), planeLightmap.GetResidentBytes() / (1024.0 * 1024.0),
+				!planeLightmap.Valid ? "not baked" : bakeStale ? "stale, realtime shadow" : "up to date");
+			ImGui::Text("Last bake: %.2f ms (shadow map %.2f ms), %d lightmaps, %.0f texels on %d threads", shadowBaker.LastBakeMs,
+				shadowBaker.LastMapMs, shadowBaker.LastBaked, (double)shadowBaker.LastTexels, (int)threadPool.GetThreadCount());
+			ImGui::Text("Dynamic casters in the light view: %s", dynamicCasters ? "yes, their own shadow map on the plane too" : "no");
+			if (!benchmarkRunning && ImGui::Button("Frame time: realtime / baked")) {
+				shadowBaker.AutoRebake = true;
+				bakeBenchmark.Start({ "realtime", "baked" }, std::vector<std::string>{ "Shadow pass", "Dynamic shadow pass", "Shadow mask", "Lit pass" });
+			}
+			ImGui::TextWrapped("%s", bakeBenchmark.Result.c_str());
+			ImGui::End();
+		}
 		{
 			ImGui::Begin("Shadow Render Mode");
+			ImGui::Combo("Technique (keys 1-7)", &ShadowRenderType, shadowTypeNames, 7);
+			if (ImGui::Combo("Shadow map format", (int*)&depthFormat, DEPTH_FORMAT_NAMES, DEPTH_FORMATS_COUNT)) {
+				specifyShadowMap();
+				glState().BindTexture(GL_TEXTURE_2D, 0);
+			}
+			bool centered = depthSAT.Center != 0.0f;
+			if (ImGui::Checkbox("Center the SAT moments", &centered))
+				depthSAT.Center = centered ? DS_CENTER : 0.0f;
+			ImGui::Text("Shadow map %d^2 + SAT %.1f MB", shadowMapSize, depthSAT.GetResidentBytes(depthFormat) / (1024.0 * 1024.0));
+			if (caps.ComputeShaders) {
+				ImGui::Checkbox("GL 3.3 SAT path (fragment shader recursive doubling)", &forceFragmentSAT);
+			}
+			else {
+				ImGui::Text("GL %d.%d: fragment shader SAT, no depth pyramid / EVSM / MSM / blurred VSM", caps.Major, caps.Minor);
+			}
+			if (caps.ComputeShaders && ImGui::Button("Analyse moment storage precision (stalls)")) {
+				momentPrecisionResult = RunMomentPrecisionBenchmark(depthMap, shadowMapSize, DEPTH_FORMAT_NAMES[depthFormat],
+					ComputeSATShader, SATColumnsShader);
+				profiler.Log(momentPrecisionResult);
+			}
+			ImGui::TextWrapped("%s", momentPrecisionResult.c_str());
+			ImGui::Separator();
 			if (ShadowRenderType == 0) {
 				ImGui::Text("Basic");
 			}
@@ -760,10 +2026,130 @@ int main(void) {
 			}
 			else if (ShadowRenderType == 2) {
 				ImGui::Text("PCSS");
+				ImGui::Combo("Sample set", &sampleSet, SAMPLE_SET_NAMES, SAMPLES_COUNT);
+				if (!benchmarkRunning && ImGui::Button("Benchmark sample sets"))
+					sampleSetBenchmark.Start(std::vector<std::string>(SAMPLE_SET_NAMES, SAMPLE_SET_NAMES + SAMPLES_COUNT), "Lit pass");
+				ImGui::TextWrapped("%s", sampleSetBenchmark.Result.c_str());
+				ImGui::Checkbox("Adaptive tap count", &adaptiveSamples);
+				if (adaptiveSamples) {
+					ImGui::SliderInt("Max taps per loop", &maxTaps, 4, 64);
+					ImGui::SliderFloat("Texels per tap", &texelsPerTap, 1.0f, 64.0f, "%.1f", 2.0f);
+				}
+				ImGui::Checkbox("Min/max depth pyramid early exit", &useDepthPyramid);
+				if (shadowStats) {
+					ImGui::Checkbox("Count early exits and taps (atomics, slower)", &collectShadowStats);
+					double fragments = std::max(1.0, profiler.GetCounter("PCSS fragments"));
+					if (statsEnabled) {
+						ImGui::Text("Early exit: lit %.1f%%, shadowed %.1f%%", 100.0 * profiler.GetCounter("PCSS early lit") / fragments,
+							100.0 * profiler.GetCounter("PCSS early shadowed") / fragments);
+						ImGui::Text("Taps per PCSS fragment: %.1f", profiler.GetCounter("PCSS taps / fragment"));
+					}
+					if (!benchmarkRunning && ImGui::Button("Benchmark pyramid on/off"))
+						pcssBenchmark.Start();
+					ImGui::TextWrapped("%s", pcssBenchmark.Result.c_str());
+					if (!benchmarkRunning && ImGui::Button("Benchmark fixed / adaptive taps"))
+						adaptiveBenchmark.Start({ "fixed 25 + 25", "adaptive" }, "Lit pass", { "PCSS taps / fragment" });
+					ImGui::TextWrapped("%s", adaptiveBenchmark.Result.c_str());
+				}
 			}
 			else if (ShadowRenderType == 3) {
 				ImGui::Text("VSSM");
 			}
+			else if (ShadowRenderType == 4) {
+				ImGui::Text("EVSM");
+				ImGui::SliderFloat("Positive exponent", &momentSAT.EVSMPositive, 1.0f, 20.0f);
+				ImGui::SliderFloat("Negative exponent", &momentSAT.EVSMNegative, 1.0f, 20.0f);
+			}
+			else if (ShadowRenderType == 5) {
+				ImGui::Text("MSM (Hamburger, 4 moments)");
+				ImGui::SliderFloat("Moment bias", &momentSAT.MomentBias, 1e-5f, 1e-2f, "%.5f", 3.0f);
+			}
+			else if (ShadowRenderType == 6) {
+				ImGui::Text("VSM, separable blur of the moments");
+				ImGui::SliderInt("Blur radius (texels)", &momentBlur.Radius, 1, MB_MAX_RADIUS);
+				ImGui::Checkbox("Gaussian (box when off)", &momentBlur.Gaussian);
+				ImGui::Checkbox("Mip chain (wider filter with distance)", &momentBlur.Mipmaps);
+				ImGui::Text("Blur %.2f MB / frame", profiler.GetCounter("Blur MB / frame"));
+				if (deferredShadowMask) {
+					ImGui::Checkbox("Measure leaking vs PCSS (readback, slow)", &measureLeak);
+					if (measureLeak)
+						ImGui::Text("Leak %.2f%% of the umbra, mean error %.4f", profiler.GetCounter("Leak %"), profiler.GetCounter("Error vs PCSS (mean)"));
+				}
+				if (!benchmarkRunning && ImGui::Button("Benchmark SAT vs blur at 1K / 2K / 4K (stalls)")) {
+					momentFilterResult = RunMomentFilterBenchmark(ComputeSATShader, SATColumnsShader, BlurMomentsShader, depthFormat,
+						momentBlur.Radius, momentBlur.Gaussian);
+					profiler.Log(momentFilterResult);
+				}
+				ImGui::TextWrapped("%s", momentFilterResult.c_str());
+			}
+			if (ShadowRenderType >= 3 && ShadowRenderType <= 5) {
+				ImGui::Text("SAT build %.2f MB / frame, %.0f bytes / lookup", profiler.GetCounter("SAT MB / frame"),
+					profiler.GetCounter("Shadow bytes / lookup"));
+				if (deferredShadowMask) {
+					ImGui::Checkbox("Measure leaking vs PCSS (readback, slow)", &measureLeak);
+					if (measureLeak)
+						ImGui::Text("Leak %.2f%% of the umbra, mean error %.4f", profiler.GetCounter("Leak %"), profiler.GetCounter("Error vs PCSS (mean)"));
+				}
+				if (!benchmarkRunning && caps.ComputeShaders && ImGui::Button("Benchmark VSSM / EVSM / MSM (leaking vs PCSS)")) {
+					std::vector<std::string> scopes = { "SAT", "SAT rows", "SAT columns", "Moment SAT warp", "Moment SAT columns", "Shadow mask" };
+					momentBenchmark.Start({ "VSSM", "EVSM", "MSM" }, scopes, { "SAT MB / frame", "Shadow bytes / lookup", "Leak %", "Error vs PCSS (mean)" });
+				}
+				ImGui::TextWrapped("%s", momentBenchmark.Result.c_str());
+			}
+			ImGui::Separator();
+			ImGui::Checkbox("Temporal accumulation", &temporalShadows);
+			if (temporalShadows) {
+				ImGui::SliderInt("PCSS taps per loop and frame", &temporalTaps, 4, 16);
+				ImGui::SliderFloat("Current frame weight", &temporalShadow.Blend, 0.02f, 0.5f);
+				ImGui::SliderFloat("Depth tolerance", &temporalShadow.DepthTolerance, 0.001f, 0.1f, "%.3f");
+				ImGui::SliderFloat("Normal tolerance (cos)", &temporalShadow.NormalTolerance, 0.5f, 1.0f);
+				ImGui::Checkbox("Neighborhood clamp", &temporalShadow.NeighborhoodClamp);
+				if (temporalStatsEnabled) {
+					ImGui::Text("History rejected %.1f%%, clamped %.1f%%", profiler.GetCounter("Temporal rejected %"),
+						profiler.GetCounter("Temporal clamped %"));
+				}
+			}
+			if (!benchmarkRunning && ImGui::Button("Benchmark forward / temporal PCSS (orbiting light)")) {
+				std::vector<std::string> counters;
+				if (temporalStats)
+					counters = { "PCSS taps / fragment", "Temporal rejected %", "Temporal clamped %" };
+				std::vector<std::string> scopes = { "Lit pass", "Temporal resolve" };
+				temporalBenchmark.Start({ "forward 25 + 25", "temporal 8 taps", "temporal 4 taps" }, scopes, counters);
+			}
+			ImGui::TextWrapped("%s", temporalBenchmark.Result.c_str());
+			ImGui::Separator();
+			ImGui::Checkbox("Deferred shadow mask (depth prepass)", &deferredShadowMask);
+			if (!benchmarkRunning && ImGui::Button("Benchmark forward / shadow mask PCSS (stress scene)")) {
+				//the stress grid seen from the side overlaps heavily: most shaded fragments are overdrawn
+				stressScene = true;
+				std::vector<std::string> counters;
+				if (shadowStats)
+					counters = { "PCSS fragments" };
+				std::vector<std::string> scopes = { "Depth prepass", "Shadow mask", "Lit pass" };
+				shadowMaskBenchmark.Start({ "forward", "shadow mask" }, scopes, counters);
+			}
+			ImGui::TextWrapped("%s", shadowMaskBenchmark.Result.c_str());
+			if (deferredShadowMask) {
+				ImGui::Combo("Mask resolution", &maskResolution, MASK_RESOLUTION_NAMES, 3);
+				if (maskResolution > 0) {
+					ImGui::Checkbox("Full resolution fallback at shadow edges", &shadowMask.EdgeFallback);
+					ImGui::SliderFloat("Edge threshold", &shadowMask.EdgeThreshold, 0.05f, 1.0f);
+					if (maskStats && collectShadowStats)
+						ImGui::Text("Full resolution fallback: %.1f%% of the pixels", profiler.GetCounter("Mask fallback %"));
+				}
+				ImGui::Checkbox("Measure error vs full resolution (readback, slow)", &measureMaskError);
+				if (measureMaskError) {
+					ImGui::Text("Mean error %.4f, %.2f%% of the pixels off by > %.1f", profiler.GetCounter("Mask error (mean)"),
+						profiler.GetCounter("Mask error > 0.1 %"), SM_ERROR_THRESHOLD);
+				}
+			}
+			if (!benchmarkRunning && ImGui::Button("Benchmark full / half / quarter resolution shadow mask")) {
+				std::vector<std::string> counters = { "Mask error (mean)", "Mask error > 0.1 %" };
+				if (maskStats)
+					counters.push_back("Mask fallback %");
+				maskResolutionBenchmark.Start(std::vector<std::string>(MASK_RESOLUTION_NAMES, MASK_RESOLUTION_NAMES + 3), "Shadow mask", counters);
+			}
+			ImGui::TextWrapped("%s", maskResolutionBenchmark.Result.c_str());
 			ImGui::End();
 		}
 
@@ -772,7 +2158,16 @@ int main(void) {
 		ImGui_ImplGlfwGL3_RenderDrawData(ImGui::GetDrawData());
 
 		/* Swap front and back buffers */
+		profiler.EndFrame();
+		frameSync.EndFrame();
+		frameCPUms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameCPUStart).count();
 		glfwSwapBuffers(window);
+		if (firstFrame) {
+			firstFrame = false;
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - launchTime).count();
+			firstFrameMs = ms;
+			profiler.Log("Time to first frame: " + std::to_string(ms) + " ms (" + std::to_string(meshStreamer.GetPending()) + " meshes still streaming)");
+		}
 
 		/* Poll for and process events */
 		glfwPollEvents();
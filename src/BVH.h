@@ -0,0 +1,357 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cfloat>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define BVH_SIMD 1
+#else
+#define BVH_SIMD 0
+#endif
+
+#include "Bounds.h"
+
+//default BVH settings:
+const unsigned int BVH_LEAF_SIZE = 4; //max objects per leaf (one SIMD frustum test)
+const int BVH_BINS = 12; //SAH bins per split axis
+const float BVH_TRAVERSAL_COST = 1.0f;
+const float BVH_INTERSECT_COST = 1.0f;
+const float BVH_REBUILD_RATIO = 1.5f; //rebuild when the refitted SAH cost grows past this factor of the built one
+
+
+/*
+ * Bounding volume hierarchy over object bounds, for frustum culling.
+ * Built top-down with binned SAH; moving objects are handled by refitting the node bounds
+ * and the tree is rebuilt only when the refitted SAH cost has degraded too far.
+ * Every node covers a contiguous range of the object order, so a node fully inside the
+ * frustum emits its objects without visiting children, and leaf objects are stored SoA
+ * so one leaf is tested against a plane 4 objects at a time.
+ */
+class BVH {
+private:
+	struct Node {
+		AABB Bounds;
+		unsigned int First; //first object in m_Order
+		unsigned int Count; //objects under this node
+		unsigned int Left; //0 for leaves, right child is Left + 1
+	};
+
+	std::vector<Node> m_Nodes;
+	std::vector<unsigned int> m_Order; //object index per slot
+	//object bounds in slot order (SoA, padded to a multiple of 4)
+	std::vector<float> m_MinX, m_MinY, m_MinZ;
+	std::vector<float> m_MaxX, m_MaxY, m_MaxZ;
+
+	size_t m_ObjectCount;
+	float m_BuildCost;
+	float m_Cost;
+
+	//build scratch
+	std::vector<glm::vec3> m_Centroids;
+	std::vector<AABB> m_Boxes;
+	std::vector<std::pair<unsigned int, unsigned int>> m_Stack;
+
+public:
+	//node, planes still to test
+	typedef std::vector<std::pair<unsigned int, unsigned int>> QueryStack;
+
+	//stats
+	unsigned int LastNodesVisited;
+	unsigned int Rebuilds;
+	unsigned int Refits;
+
+	//ctor
+	BVH()
+		: m_ObjectCount(0), m_BuildCost(0.0f), m_Cost(0.0f), LastNodesVisited(0), Rebuilds(0), Refits(0) {};
+
+	//gtor
+	size_t GetObjectCount() const {
+		return m_ObjectCount;
+	}
+	size_t GetNodeCount() const {
+		return m_Nodes.size();
+	}
+	float GetCost() const {
+		return m_Cost;
+	}
+	float GetBuildCost() const {
+		return m_BuildCost;
+	}
+
+	//keep the tree in sync with the object bounds: rebuild when the count changed,
+	//otherwise refit if anything moved and rebuild if the refit degraded the tree. returns true on rebuild
+	bool Update(const AABB* bounds, size_t count, bool moved = true) {
+		if (count != m_ObjectCount || m_Nodes.empty()) {
+			Build(bounds, count);
+			return true;
+		}
+		if (!moved)
+			return false;
+		Refit(bounds);
+		if (m_Cost > m_BuildCost * BVH_REBUILD_RATIO) {
+			Build(bounds, count);
+			return true;
+		}
+		return false;
+	}
+
+	void Build(const AABB* bounds, size_t count) {
+		Rebuilds++;
+		m_ObjectCount = count;
+		m_Nodes.clear();
+		m_Order.resize(count);
+		m_Centroids.resize(count);
+		m_Boxes.assign(bounds, bounds + count);
+		for (size_t i = 0; i < count; ++i) {
+			m_Order[i] = (unsigned int)i;
+			m_Centroids[i] = bounds[i].Center();
+		}
+		if (count == 0) {
+			m_BuildCost = m_Cost = 0.0f;
+			return;
+		}
+
+		m_Nodes.reserve(2 * count);
+		m_Nodes.push_back({ AABB(), 0, (unsigned int)count, 0 });
+		m_Stack.clear();
+		m_Stack.push_back({ 0u, 0u });
+		while (!m_Stack.empty()) {
+			unsigned int nodeIndex = m_Stack.back().first;
+			m_Stack.pop_back();
+			Subdivide(nodeIndex);
+		}
+
+		WriteLeafBounds(bounds);
+		m_BuildCost = m_Cost = ComputeCost();
+	}
+
+	//update node bounds bottom-up, the tree topology is kept
+	void Refit(const AABB* bounds) {
+		Refits++;
+		WriteLeafBounds(bounds);
+		//children are always stored after their parent
+		for (size_t n = m_Nodes.size(); n-- > 0;) {
+			Node& node = m_Nodes[n];
+			node.Bounds = AABB();
+			if (node.Left == 0) {
+				for (unsigned int i = node.First; i < node.First + node.Count; ++i)
+					node.Bounds.Expand(bounds[m_Order[i]]);
+			}
+			else {
+				node.Bounds.Expand(m_Nodes[node.Left].Bounds);
+				node.Bounds.Expand(m_Nodes[node.Left + 1].Bounds);
+			}
+		}
+		m_Cost = ComputeCost();
+	}
+
+	//indices of the objects whose bounds intersect the frustum (same result as Frustum::Intersects per object)
+	void Query(const Frustum& frustum, std::vector<unsigned int>& visible) {
+		LastNodesVisited = Query(frustum, visible, m_Stack);
+	}
+
+	//same, with the caller's traversal stack: queries from several threads at once. Returns the nodes visited
+	unsigned int Query(const Frustum& frustum, std::vector<unsigned int>& visible, QueryStack& stack) const {
+		visible.clear();
+		unsigned int nodesVisited = 0;
+		if (m_Nodes.empty())
+			return 0;
+
+		const unsigned int ALL_PLANES = (1u << 6) - 1;
+		stack.clear();
+		stack.push_back({ 0u, ALL_PLANES });
+		while (!stack.empty()) {
+			unsigned int nodeIndex = stack.back().first;
+			unsigned int planeMask = stack.back().second;
+			stack.pop_back();
+			const Node& node = m_Nodes[nodeIndex];
+			nodesVisited++;
+
+			//drop the planes the node is fully inside of, its children are inside them too
+			bool culled = false;
+			for (int p = 0; p < 6 && !culled; ++p) {
+				if (!(planeMask & (1u << p)))
+					continue;
+				const glm::vec4& plane = frustum.Planes[p];
+				glm::vec3 positive(plane.x >= 0.0f ? node.Bounds.Max.x : node.Bounds.Min.x,
+								   plane.y >= 0.0f ? node.Bounds.Max.y : node.Bounds.Min.y,
+								   plane.z >= 0.0f ? node.Bounds.Max.z : node.Bounds.Min.z);
+				glm::vec3 negative(plane.x >= 0.0f ? node.Bounds.Min.x : node.Bounds.Max.x,
+								   plane.y >= 0.0f ? node.Bounds.Min.y : node.Bounds.Max.y,
+								   plane.z >= 0.0f ? node.Bounds.Min.z : node.Bounds.Max.z);
+				if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+					culled = true;
+				else if (glm::dot(glm::vec3(plane), negative) + plane.w >= 0.0f)
+					planeMask &= ~(1u << p);
+			}
+			if (culled)
+				continue;
+
+			if (planeMask == 0) {
+				visible.insert(visible.end(), m_Order.begin() + node.First, m_Order.begin() + node.First + node.Count);
+			}
+			else if (node.Left == 0) {
+				QueryLeaf(frustum, planeMask, node.First, node.Count, visible);
+			}
+			else {
+				stack.push_back({ node.Left + 1, planeMask });
+				stack.push_back({ node.Left, planeMask });
+			}
+		}
+		return nodesVisited;
+	}
+
+private:
+	void Subdivide(unsigned int nodeIndex) {
+		unsigned int first = m_Nodes[nodeIndex].First;
+		unsigned int count = m_Nodes[nodeIndex].Count;
+
+		AABB bounds, centroidBounds;
+		for (unsigned int i = first; i < first + count; ++i) {
+			bounds.Expand(m_Boxes[m_Order[i]]);
+			centroidBounds.Expand(m_Centroids[m_Order[i]]);
+		}
+		m_Nodes[nodeIndex].Bounds = bounds;
+		if (count <= BVH_LEAF_SIZE)
+			return;
+
+		//binned SAH over the centroid bounds
+		int bestAxis = -1;
+		int bestSplit = 0;
+		float bestCost = FLT_MAX;
+		glm::vec3 extent = centroidBounds.Extent();
+		for (int axis = 0; axis < 3; ++axis) {
+			if (extent[axis] <= 0.0f)
+				continue;
+			AABB binBounds[BVH_BINS];
+			unsigned int binCount[BVH_BINS] = { 0 };
+			float binScale = BVH_BINS / extent[axis];
+			for (unsigned int i = first; i < first + count; ++i) {
+				int bin = std::min(BVH_BINS - 1, (int)((m_Centroids[m_Order[i]][axis] - centroidBounds.Min[axis]) * binScale));
+				binCount[bin]++;
+				binBounds[bin].Expand(m_Boxes[m_Order[i]]);
+			}
+			//sweep from the right, then evaluate every split from the left
+			float rightArea[BVH_BINS];
+			unsigned int rightCount[BVH_BINS];
+			AABB acc;
+			unsigned int accCount = 0;
+			for (int b = BVH_BINS - 1; b > 0; --b) {
+				acc.Expand(binBounds[b]);
+				accCount += binCount[b];
+				rightArea[b] = acc.SurfaceArea();
+				rightCount[b] = accCount;
+			}
+			acc = AABB();
+			accCount = 0;
+			for (int b = 0; b < BVH_BINS - 1; ++b) {
+				acc.Expand(binBounds[b]);
+				accCount += binCount[b];
+				if (accCount == 0 || rightCount[b + 1] == 0)
+					continue;
+				float cost = acc.SurfaceArea() * accCount + rightArea[b + 1] * rightCount[b + 1];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		//leaves stay small for the SIMD test: when the SAH finds no split cheaper than a leaf
+		//(or all centroids coincide) split at the median of the widest axis instead
+		float leafCost = bounds.SurfaceArea() * count * BVH_INTERSECT_COST;
+		float splitCost = BVH_TRAVERSAL_COST * bounds.SurfaceArea() + BVH_INTERSECT_COST * bestCost;
+		unsigned int mid;
+		if (bestAxis >= 0 && splitCost < leafCost) {
+			float binScale = BVH_BINS / extent[bestAxis];
+			auto begin = m_Order.begin() + first;
+			auto it = std::partition(begin, begin + count, [&](unsigned int o) {
+				int bin = std::min(BVH_BINS - 1, (int)((m_Centroids[o][bestAxis] - centroidBounds.Min[bestAxis]) * binScale));
+				return bin <= bestSplit;
+			});
+			mid = (unsigned int)(it - m_Order.begin());
+		}
+		else {
+			int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+			mid = first + count / 2;
+			std::nth_element(m_Order.begin() + first, m_Order.begin() + mid, m_Order.begin() + first + count,
+				[&](unsigned int a, unsigned int b) { return m_Centroids[a][axis] < m_Centroids[b][axis]; });
+		}
+
+		unsigned int left = (unsigned int)m_Nodes.size();
+		m_Nodes[nodeIndex].Left = left;
+		m_Nodes.push_back({ AABB(), first, mid - first, 0 });
+		m_Nodes.push_back({ AABB(), mid, first + count - mid, 0 });
+		m_Stack.push_back({ left + 1, 0u });
+		m_Stack.push_back({ left, 0u });
+	}
+
+	void WriteLeafBounds(const AABB* bounds) {
+		size_t padded = (m_ObjectCount + 3) & ~size_t(3);
+		std::vector<float>* arrays[6] = { &m_MinX, &m_MinY, &m_MinZ, &m_MaxX, &m_MaxY, &m_MaxZ };
+		for (int a = 0; a < 6; ++a)
+			arrays[a]->resize(padded + 4, a < 3 ? FLT_MAX : -FLT_MAX);
+		for (size_t i = 0; i < m_ObjectCount; ++i) {
+			const AABB& box = bounds[m_Order[i]];
+			m_MinX[i] = box.Min.x; m_MinY[i] = box.Min.y; m_MinZ[i] = box.Min.z;
+			m_MaxX[i] = box.Max.x; m_MaxY[i] = box.Max.y; m_MaxZ[i] = box.Max.z;
+		}
+	}
+
+	//expected cost of a random query, relative to the root area
+	float ComputeCost() const {
+		float rootArea = m_Nodes[0].Bounds.SurfaceArea();
+		if (rootArea <= 0.0f)
+			return 0.0f;
+		float cost = 0.0f;
+		for (const Node& node : m_Nodes)
+			cost += node.Bounds.SurfaceArea() * (node.Left == 0 ? BVH_INTERSECT_COST * node.Count : BVH_TRAVERSAL_COST);
+		return cost / rootArea;
+	}
+
+	//test up to 4 objects per step against the planes still in the mask
+	void QueryLeaf(const Frustum& frustum, unsigned int planeMask, unsigned int first, unsigned int count, std::vector<unsigned int>& visible) const {
+		for (unsigned int base = first; base < first + count; base += 4) {
+			unsigned int lanes = std::min(4u, first + count - base);
+			unsigned int inside = (1u << lanes) - 1;
+#if BVH_SIMD
+			for (int p = 0; p < 6 && inside; ++p) {
+				if (!(planeMask & (1u << p)))
+					continue;
+				const glm::vec4& plane = frustum.Planes[p];
+				//the corner furthest along the plane normal, picked per axis by the normal sign
+				__m128 x = _mm_loadu_ps((plane.x >= 0.0f ? m_MaxX.data() : m_MinX.data()) + base);
+				__m128 y = _mm_loadu_ps((plane.y >= 0.0f ? m_MaxY.data() : m_MinY.data()) + base);
+				__m128 z = _mm_loadu_ps((plane.z >= 0.0f ? m_MaxZ.data() : m_MinZ.data()) + base);
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+					_mm_mul_ps(z, _mm_set1_ps(plane.z))), _mm_set1_ps(plane.w));
+				inside &= (unsigned int)_mm_movemask_ps(_mm_cmpge_ps(d, _mm_setzero_ps()));
+			}
+#else
+			for (int p = 0; p < 6 && inside; ++p) {
+				if (!(planeMask & (1u << p)))
+					continue;
+				const glm::vec4& plane = frustum.Planes[p];
+				for (unsigned int l = 0; l < lanes; ++l) {
+					unsigned int i = base + l;
+					float d = plane.x * (plane.x >= 0.0f ? m_MaxX[i] : m_MinX[i]) +
+							  plane.y * (plane.y >= 0.0f ? m_MaxY[i] : m_MinY[i]) +
+							  plane.z * (plane.z >= 0.0f ? m_MaxZ[i] : m_MinZ[i]) + plane.w;
+					if (d < 0.0f)
+						inside &= ~(1u << l);
+				}
+			}
+#endif
+			for (unsigned int l = 0; l < lanes; ++l) {
+				if (inside & (1u << l))
+					visible.push_back(m_Order[base + l]);
+			}
+		}
+	}
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <vector>
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+
+/*-----------------------------Axis aligned bounding box---------------------------------*/
+
+struct AABB {
+	glm::vec3 Min;
+	glm::vec3 Max;
+
+	//ctor (empty box, any Expand() makes it valid)
+	AABB()
+		: Min(glm::vec3(FLT_MAX)), Max(glm::vec3(-FLT_MAX)) {}
+
+	AABB(const glm::vec3& min, const glm::vec3& max)
+		: Min(min), Max(max) {}
+
+	bool IsValid() const {
+		return Min.x <= Max.x && Min.y <= Max.y && Min.z <= Max.z;
+	}
+
+	void Expand(const glm::vec3& p) {
+		Min = glm::min(Min, p);
+		Max = glm::max(Max, p);
+	}
+
+	void Expand(const AABB& box) {
+		if (!box.IsValid())
+			return;
+		Min = glm::min(Min, box.Min);
+		Max = glm::max(Max, box.Max);
+	}
+
+	glm::vec3 Center() const {
+		return (Min + Max) * 0.5f;
+	}
+
+	glm::vec3 Extent() const {
+		return Max - Min;
+	}
+
+	float SurfaceArea() const {
+		if (!IsValid())
+			return 0.0f;
+		glm::vec3 e = Extent();
+		return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+
+	//i in [0, 8), bit 0 -> x, bit 1 -> y, bit 2 -> z
+	glm::vec3 Corner(int i) const {
+		return glm::vec3((i & 1) ? Max.x : Min.x,
+						 (i & 2) ? Max.y : Min.y,
+						 (i & 4) ? Max.z : Min.z);
+	}
+
+	bool Overlaps(const AABB& box) const {
+		return Min.x <= box.Max.x && Max.x >= box.Min.x &&
+			   Min.y <= box.Max.y && Max.y >= box.Min.y &&
+			   Min.z <= box.Max.z && Max.z >= box.Min.z;
+	}
+
+	AABB Intersect(const AABB& box) const {
+		return AABB(glm::max(Min, box.Min), glm::min(Max, box.Max));
+	}
+
+	//bounds of the transformed box (Arvo's method, no need to transform 8 corners)
+	AABB Transform(const glm::mat4& m) const {
+		if (!IsValid())
+			return *this;
+		glm::vec3 t(m[3]);
+		AABB result(t, t);
+		for (int col = 0; col < 3; ++col) {
+			for (int row = 0; row < 3; ++row) {
+				float a = m[col][row] * Min[col];
+				float b = m[col][row] * Max[col];
+				result.Min[row] += glm::min(a, b);
+				result.Max[row] += glm::max(a, b);
+			}
+		}
+		return result;
+	}
+};
+
+
+// bounds of a vertex list (e.g. the data loaded by loadOBJData)
+inline AABB ComputeAABB(const std::vector<glm::vec3>& vertices) {
+	AABB box;
+	for (const auto& v : vertices)
+		box.Expand(v);
+	return box;
+}
+
+// bounds of interleaved vertex data, position is the first 3 floats of each vertex
+inline AABB ComputeAABB(const float* vertices, unsigned int numVertices, unsigned int strideFloats) {
+	AABB box;
+	for (unsigned int i = 0; i < numVertices; ++i) {
+		const float* p = vertices + i * strideFloats;
+		box.Expand(glm::vec3(p[0], p[1], p[2]));
+	}
+	return box;
+}
+
+
+/*-----------------------------View frustum (6 planes)---------------------------------*/
+
+enum FrustumPlane
+{
+	FRUSTUM_LEFT,
+	FRUSTUM_RIGHT,
+	FRUSTUM_BOTTOM,
+	FRUSTUM_TOP,
+	FRUSTUM_NEAR,
+	FRUSTUM_FAR
+};
+
+struct Frustum {
+	//plane: dot(xyz, p) + w >= 0 for points inside
+	glm::vec4 Planes[6];
+
+	Frustum() {}
+
+	//extract planes from a view-projection matrix (Gribb & Hartmann)
+	explicit Frustum(const glm::mat4& viewProjection) {
+		glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+		glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+		glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+		glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+		Planes[FRUSTUM_LEFT] = row3 + row0;
+		Planes[FRUSTUM_RIGHT] = row3 - row0;
+		Planes[FRUSTUM_BOTTOM] = row3 + row1;
+		Planes[FRUSTUM_TOP] = row3 - row1;
+		Planes[FRUSTUM_NEAR] = row3 + row2;
+		Planes[FRUSTUM_FAR] = row3 - row2;
+
+		for (int i = 0; i < 6; ++i) {
+			float len = glm::length(glm::vec3(Planes[i]));
+			if (len > 0.0f)
+				Planes[i] = Planes[i] / len;
+		}
+	}
+
+	//conservative test: false only when the box is fully outside one plane
+	bool Intersects(const AABB& box) const {
+		if (!box.IsValid())
+			return false;
+		for (int i = 0; i < 6; ++i) {
+			const glm::vec4& p = Planes[i];
+			//the box corner furthest along the plane normal
+			glm::vec3 positive(p.x >= 0.0f ? box.Max.x : box.Min.x,
+							   p.y >= 0.0f ? box.Max.y : box.Min.y,
+							   p.z >= 0.0f ? box.Max.z : box.Min.z);
+			if (glm::dot(glm::vec3(p), positive) + p.w < 0.0f)
+				return false;
+		}
+		return true;
+	}
+};
+
+
+// world space bounds of the frustum volume of a view-projection matrix
+inline AABB FrustumBounds(const glm::mat4& viewProjection) {
+	glm::mat4 inv = glm::inverse(viewProjection);
+	AABB box;
+	for (int i = 0; i < 8; ++i) {
+		glm::vec4 ndc((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f, 1.0f);
+		glm::vec4 p = inv * ndc;
+		box.Expand(glm::vec3(p) / p.w);
+	}
+	return box;
+}
@@ -0,0 +1,537 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CPU_SHADOWS_SIMD 1
+#else
+#define CPU_SHADOWS_SIMD 0
+#endif
+
+#include "ThreadPool.h"
+
+//default CPU shadow settings:
+const int CS_TILE = 32; //pixels per tile side, one tile per thread pool chunk
+const int CS_BLOCK = 4; //pixels per SIMD batch
+const int CS_NUM_SAMPLES = 25; //NUM_SAMPLES in Shadows.glsl
+const int CS_NUM_RINGS = 10;
+const int CS_TYPES = 4;
+const float CS_EPS = 1e-3f;
+const float CS_MIN_VARIANCE = 0.0001f;
+const float CS_PI = 3.141592653589793f;
+const float CS_PI2 = 6.283185307179586f;
+const float CS_LIGHT_SIZE = 10.0f;
+static const char* CPU_SHADOW_TYPE_NAMES[CS_TYPES] = { "Basic", "PCF", "PCSS", "VSSM" };
+
+
+/*
+ * Shadow map on the CPU: the depth (clamp to edge, bilinear like u_DepthMap) and the summed area
+ * table of the depth and the squared depth in double precision (border 0, bilinear like u_DepthSAT),
+ * so the oracle's window means carry no fp32 SAT error.
+ */
+class CPUShadowMap {
+private:
+	int m_Size;
+	std::vector<float> m_Depth;
+	std::vector<double> m_SAT; //interleaved sums of depth, depth^2
+
+public:
+	//ctor, size: texels per side
+	explicit CPUShadowMap(int size)
+		: m_Size(size), m_Depth(size_t(size) * size, 1.0f), m_SAT(size_t(size) * size * 2, 0.0) {};
+
+	//gtor
+	int GetSize() const {
+		return m_Size;
+	}
+	const std::vector<float>& GetDepth() const {
+		return m_Depth;
+	}
+
+	//size * size depth values, row 0 at v = 0; builds the SAT
+	void SetDepth(const float* depth) {
+		m_Depth.assign(depth, depth + size_t(m_Size) * m_Size);
+		size_t row = size_t(m_Size) * 2;
+		for (int y = 0; y < m_Size; ++y) {
+			for (int x = 0; x < m_Size; ++x) {
+				double d = m_Depth[size_t(y) * m_Size + x];
+				double* s = &m_SAT[(size_t(y) * m_Size + x) * 2];
+				s[0] = d;
+				s[1] = d * d;
+				for (int c = 0; c < 2; ++c) {
+					if (x > 0)
+						s[c] += s[c - 2];
+					if (y > 0)
+						s[c] += s[c - row];
+					if (x > 0 && y > 0)
+						s[c] -= s[c - row - 2];
+				}
+			}
+		}
+	}
+
+	float Texel(int x, int y) const {
+		x = std::min(std::max(x, 0), m_Size - 1);
+		y = std::min(std::max(y, 0), m_Size - 1);
+		return m_Depth[size_t(y) * m_Size + x];
+	}
+
+	//texture(u_DepthMap, uv).r; the SIMD path does the same float operations lane by lane
+	float SampleDepth(float u, float v) const {
+		float size = float(m_Size);
+		float x = std::min(std::max(u * size - 0.5f, -1.0f), size);
+		float y = std::min(std::max(v * size - 0.5f, -1.0f), size);
+		float x0 = std::floor(x), y0 = std::floor(y);
+		float fx = x - x0, fy = y - y0;
+		int ix = int(x0), iy = int(y0);
+		float t00 = Texel(ix, iy), t10 = Texel(ix + 1, iy);
+		float t01 = Texel(ix, iy + 1), t11 = Texel(ix + 1, iy + 1);
+		float top = t00 + (t10 - t00) * fx;
+		float bottom = t01 + (t11 - t01) * fx;
+		return top + (bottom - top) * fy;
+	}
+
+	//bilinear SAT lookup, 0 outside the map
+	void SampleSAT(double u, double v, double& sum, double& sum2) const {
+		double x = u * m_Size - 0.5, y = v * m_Size - 0.5;
+		double x0 = std::floor(x), y0 = std::floor(y);
+		double fx = x - x0, fy = y - y0;
+		int ix = int(std::max(std::min(x0, double(m_Size)), -2.0)), iy = int(std::max(std::min(y0, double(m_Size)), -2.0));
+		double t[2][2][2];
+		for (int j = 0; j < 2; ++j)
+			for (int i = 0; i < 2; ++i) {
+				int tx = ix + i, ty = iy + j;
+				bool inside = tx >= 0 && ty >= 0 && tx < m_Size && ty < m_Size;
+				const double* s = inside ? &m_SAT[(size_t(ty) * m_Size + tx) * 2] : nullptr;
+				t[j][i][0] = s ? s[0] : 0.0;
+				t[j][i][1] = s ? s[1] : 0.0;
+			}
+		double r[2];
+		for (int c = 0; c < 2; ++c) {
+			double top = t[0][0][c] + (t[0][1][c] - t[0][0][c]) * fx;
+			double bottom = t[1][0][c] + (t[1][1][c] - t[1][0][c]) * fx;
+			r[c] = top + (bottom - top) * fy;
+		}
+		sum = r[0];
+		sum2 = r[1];
+	}
+};
+
+
+/*
+ * The lit pass inputs of every pixel, structure of arrays: the fragment position in light clip
+ * space (fragPosLightSpace) and dot(normal, lightDir), the only part of the normal the shadow uses.
+ */
+struct ShadowGBuffer {
+	int Width;
+	int Height;
+	std::vector<float> LightX, LightY, LightZ, LightW;
+	std::vector<float> NdotL;
+
+	//ctor
+	ShadowGBuffer(int width, int height) : Width(width), Height(height) {
+		size_t count = size_t(width) * height;
+		for (auto* v : { &LightX, &LightY, &LightZ, &LightW, &NdotL })
+			v->assign(count, 0.0f);
+	};
+};
+
+
+/*
+ * CPU reference of the Basic, PCF, PCSS and VSSM paths of Shadows.glsl, for golden images and
+ * for throughput numbers without a GPU. PCSS is the default configuration: per fragment Poisson disk
+ * (u_SampleSet 0), fixed tap counts, no depth pyramid early exit. The scalar functions follow the
+ * GLSL line by line; the SIMD path shades 4 pixels at once with the same float operations in the
+ * same order (texture fetches stay scalar, SSE has no gather), so both give identical images.
+ * Evaluate() splits the frame into CS_TILE tiles over the thread pool.
+ * GPU images differ in the sin() of the per fragment disk rotation and the fp32 SAT: compare with a tolerance.
+ */
+class CPUShadowEvaluator {
+public:
+	int Type; //0 Basic, 1 PCF, 2 PCSS, 3 VSSM (u_ShadowRenderType)
+	float LightSize;
+	bool UseSIMD;
+
+	//ctor
+	CPUShadowEvaluator() : Type(3), LightSize(CS_LIGHT_SIZE), UseSIMD(true) {};
+
+	//shadow factor (1: lit, 0: shadowed) of every pixel, out: Width * Height
+	void Evaluate(const CPUShadowMap& map, const ShadowGBuffer& gbuffer, std::vector<float>& shadow, ThreadPool* pool) const {
+		shadow.resize(size_t(gbuffer.Width) * gbuffer.Height);
+		int tilesX = (gbuffer.Width + CS_TILE - 1) / CS_TILE;
+		int tilesY = (gbuffer.Height + CS_TILE - 1) / CS_TILE;
+		auto job = [&](size_t begin, size_t end) {
+			for (size_t t = begin; t < end; ++t) {
+				int x0 = int(t % tilesX) * CS_TILE, y0 = int(t / tilesX) * CS_TILE;
+				int x1 = std::min(x0 + CS_TILE, gbuffer.Width), y1 = std::min(y0 + CS_TILE, gbuffer.Height);
+				for (int y = y0; y < y1; ++y)
+					shadeSpan(map, gbuffer, size_t(y) * gbuffer.Width, x0, x1, shadow.data());
+			}
+		};
+		if (pool)
+			pool->ParallelFor(size_t(tilesX) * tilesY, 1, job);
+		else
+			job(0, size_t(tilesX) * tilesY);
+	}
+
+	//reference path of one pixel, also used without SSE and for the ends of the rows
+	float ShadeScalar(const CPUShadowMap& map, float lx, float ly, float lz, float lw, float ndotl) const {
+		float px = lx / lw * 0.5f + 0.5f, py = ly / lw * 0.5f + 0.5f, pz = lz / lw * 0.5f + 0.5f;
+		if (Type == 0)
+			return basic(map, px, py, pz, ndotl);
+		if (Type == 1)
+			return pcf(map, px, py, pz, ndotl);
+		if (Type == 2)
+			return pcss(map, px, py, pz, ndotl);
+		if (Type == 3)
+			return vssm(map, px, py, pz, ndotl);
+		return 1.0f;
+	}
+
+	/*-----------------------------scalar (Shadows.glsl)---------------------------------*/
+
+	static float rand2to1(float u, float v) {
+		const float a = 12.9898f, b = 78.233f, c = 43758.5453f;
+		float dt = u * a + v * b;
+		float sn = dt - CS_PI * std::floor(dt / CS_PI); //GLSL mod
+		float r = std::sin(sn) * c;
+		return r - std::floor(r);
+	}
+
+	//poissonDiskSamples(): NUM_RINGS turns of a spiral, rotated by the hash of the seed
+	static void poissonDisk(float u, float v, float* diskX, float* diskY) {
+		const float angleStep = CS_PI2 * float(CS_NUM_RINGS) / float(CS_NUM_SAMPLES);
+		const float* radii = spiralRadii();
+		float angle = rand2to1(u, v) * CS_PI2;
+		for (int i = 0; i < CS_NUM_SAMPLES; ++i) {
+			diskX[i] = std::cos(angle) * radii[i];
+			diskY[i] = std::sin(angle) * radii[i];
+			angle += angleStep;
+		}
+	}
+
+	//pow(radius, 0.75) of every sample, the same for every fragment
+	static const float* spiralRadii() {
+		struct Radii {
+			float R[CS_NUM_SAMPLES];
+			Radii() {
+				const float invSamples = 1.0f / float(CS_NUM_SAMPLES);
+				float radius = invSamples;
+				for (int i = 0; i < CS_NUM_SAMPLES; ++i) {
+					R[i] = std::pow(radius, 0.75f);
+					radius += invSamples;
+				}
+			}
+		};
+		static const Radii radii;
+		return radii.R;
+	}
+
+	static float chebyshev(float mean, float mean2, float t) {
+		if (t <= mean)
+			return 1.0f;
+		float variance = std::max(mean2 - mean * mean, CS_MIN_VARIANCE);
+		float d = t - mean;
+		return variance / (variance + d * d);
+	}
+
+	//getMean() of the depth SAT: window of half width w texels around (u, v)
+	static void getMean(const CPUShadowMap& map, float w, float u, float v, float& mean, float& mean2) {
+		double stride = 1.0 / map.GetSize();
+		double xmax = u + w * stride, xmin = u - w * stride;
+		double ymax = v + w * stride, ymin = v - w * stride;
+		double a[2], b[2], c[2], d[2];
+		map.SampleSAT(xmin, ymin, a[0], a[1]);
+		map.SampleSAT(xmax, ymin, b[0], b[1]);
+		map.SampleSAT(xmin, ymax, c[0], c[1]);
+		map.SampleSAT(xmax, ymax, d[0], d[1]);
+		double area = 4.0 * double(w) * w;
+		mean = float((d[0] + a[0] - b[0] - c[0]) / area);
+		mean2 = float((d[1] + a[1] - b[1] - c[1]) / area);
+	}
+
+private:
+	float basic(const CPUShadowMap& map, float px, float py, float pz, float ndotl) const {
+		float closest = map.SampleDepth(px, py);
+		if (pz > 1.0f)
+			return 1.0f;
+		float bias = std::max(0.05f * (1.0f - ndotl), 0.005f);
+		return pz - bias > closest ? 0.0f : 1.0f;
+	}
+
+	float pcf(const CPUShadowMap& map, float px, float py, float pz, float ndotl) const {
+		if (pz > 1.0f)
+			return 1.0f;
+		float bias = std::max(0.05f * (1.0f - ndotl), 0.005f);
+		float texel = 1.0f / float(map.GetSize());
+		float shadow = 0.0f;
+		for (int x = -1; x <= 1; ++x)
+			for (int y = -1; y <= 1; ++y)
+				shadow += pz - bias > map.SampleDepth(px + float(x) * texel, py + float(y) * texel) ? 0.0f : 1.0f;
+		return shadow / 9.0f;
+	}
+
+	float pcss(const CPUShadowMap& map, float px, float py, float pz, float ndotl) const {
+		if (pz > 1.0f)
+			return 1.0f;
+		float bias = std::max(0.05f * (1.0f - ndotl), 0.005f);
+		float size = float(map.GetSize());
+		float sampleStride = LightSize / 2.5f;
+		float sampleSize = 1.0f / size * sampleStride;
+		float border = sampleStride / size;
+		if (px <= border || px >= 1.0f - border || py <= border || py >= 1.0f - border)
+			return 1.0f;
+
+		float diskX[CS_NUM_SAMPLES], diskY[CS_NUM_SAMPLES];
+		poissonDisk(px, py, diskX, diskY);
+		float dBlocker = 0.0f;
+		int count = 0;
+		for (int i = 0; i < CS_NUM_SAMPLES; ++i) {
+			float depth = map.SampleDepth(diskX[i] * sampleSize + px, diskY[i] * sampleSize + py);
+			if (depth < pz) {
+				dBlocker += depth;
+				count++;
+			}
+		}
+		if (count == 0)
+			return 1.0f;
+		dBlocker /= float(count);
+		if (dBlocker < bias)
+			return 0.0f;
+		if (dBlocker > 1.0f)
+			return 1.0f;
+
+		float wPenumbra = (pz - dBlocker) * (LightSize / 2.5f) / dBlocker;
+		float filterSize = 1.0f / size * 5.0f * wPenumbra;
+		float shadow = 0.0f;
+		for (int i = 0; i < CS_NUM_SAMPLES; ++i)
+			shadow += pz - bias > map.SampleDepth(diskX[i] * filterSize + px, diskY[i] * filterSize + py) ? 0.0f : 1.0f;
+		return shadow / float(CS_NUM_SAMPLES);
+	}
+
+	float vssm(const CPUShadowMap& map, float px, float py, float pz, float ndotl) const {
+		float bias = std::max(0.005f * (1.0f - ndotl), 0.005f);
+		float blockerSearchSize = LightSize / 2.0f;
+		float current = pz - bias;
+		if (current > 1.0f)
+			return 1.0f;
+		float border = blockerSearchSize / float(map.GetSize());
+		if (px <= border || px >= 1.0f - border || py <= border || py >= 1.0f - border)
+			return 1.0f;
+		float mean, mean2;
+		getMean(map, blockerSearchSize, px, py, mean, mean2);
+		float alpha = chebyshev(mean, mean2, current);
+		float dBlocker = (mean - alpha * (current - bias)) / (1.0f - alpha);
+		if (dBlocker < CS_EPS)
+			return 0.0f;
+		if (dBlocker > 1.0f)
+			return 1.0f;
+		float wPenumbra = (current - dBlocker) * LightSize / dBlocker;
+		if (wPenumbra <= 0.0f)
+			return 1.0f;
+		getMean(map, wPenumbra, px, py, mean, mean2);
+		if (current <= mean)
+			return 1.0f;
+		return chebyshev(mean, mean2, current);
+	}
+
+	//pixels [x0, x1) of the row starting at `row`
+	void shadeSpan(const CPUShadowMap& map, const ShadowGBuffer& g, size_t row, int x0, int x1, float* out) const {
+		int x = x0;
+#if CPU_SHADOWS_SIMD
+		if (UseSIMD) {
+			for (; x + CS_BLOCK <= x1; x += CS_BLOCK) {
+				size_t i = row + x;
+				_mm_storeu_ps(&out[i], shade4(map, _mm_loadu_ps(&g.LightX[i]), _mm_loadu_ps(&g.LightY[i]),
+					_mm_loadu_ps(&g.LightZ[i]), _mm_loadu_ps(&g.LightW[i]), _mm_loadu_ps(&g.NdotL[i])));
+			}
+		}
+#endif
+		for (; x < x1; ++x) {
+			size_t i = row + x;
+			out[i] = ShadeScalar(map, g.LightX[i], g.LightY[i], g.LightZ[i], g.LightW[i], g.NdotL[i]);
+		}
+	}
+
+#if CPU_SHADOWS_SIMD
+	/*-----------------------------4 pixels per call (SSE2)---------------------------------*/
+
+	static __m128 select4(__m128 mask, __m128 a, __m128 b) {
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+	static __m128 floor4(__m128 x) {
+		__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+	}
+
+	//CPUShadowMap::SampleDepth in 4 lanes
+	static __m128 sampleDepth4(const CPUShadowMap& map, __m128 u, __m128 v) {
+		__m128 size = _mm_set1_ps(float(map.GetSize()));
+		__m128 half = _mm_set1_ps(0.5f), low = _mm_set1_ps(-1.0f);
+		__m128 x = _mm_min_ps(_mm_max_ps(_mm_sub_ps(_mm_mul_ps(u, size), half), low), size);
+		__m128 y = _mm_min_ps(_mm_max_ps(_mm_sub_ps(_mm_mul_ps(v, size), half), low), size);
+		__m128 x0 = floor4(x), y0 = floor4(y);
+		__m128 fx = _mm_sub_ps(x, x0), fy = _mm_sub_ps(y, y0);
+		alignas(16) int ix[4], iy[4];
+		alignas(16) float t00[4], t10[4], t01[4], t11[4];
+		_mm_store_si128((__m128i*)ix, _mm_cvttps_epi32(x0));
+		_mm_store_si128((__m128i*)iy, _mm_cvttps_epi32(y0));
+		for (int lane = 0; lane < 4; ++lane) {
+			t00[lane] = map.Texel(ix[lane], iy[lane]);
+			t10[lane] = map.Texel(ix[lane] + 1, iy[lane]);
+			t01[lane] = map.Texel(ix[lane], iy[lane] + 1);
+			t11[lane] = map.Texel(ix[lane] + 1, iy[lane] + 1);
+		}
+		__m128 a = _mm_load_ps(t00), b = _mm_load_ps(t10), c = _mm_load_ps(t01), d = _mm_load_ps(t11);
+		__m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fx));
+		__m128 bottom = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), fx));
+		return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+	}
+
+	static __m128 chebyshev4(__m128 mean, __m128 mean2, __m128 t) {
+		__m128 variance = _mm_max_ps(_mm_sub_ps(mean2, _mm_mul_ps(mean, mean)), _mm_set1_ps(CS_MIN_VARIANCE));
+		__m128 d = _mm_sub_ps(t, mean);
+		__m128 p = _mm_div_ps(variance, _mm_add_ps(variance, _mm_mul_ps(d, d)));
+		return select4(_mm_cmple_ps(t, mean), _mm_set1_ps(1.0f), p);
+	}
+
+	//getMean in 4 lanes (the SAT lookups are double precision, lane by lane)
+	static void getMean4(const CPUShadowMap& map, __m128 w, __m128 u, __m128 v, __m128& mean, __m128& mean2) {
+		alignas(16) float W[4], U[4], V[4], M[4], M2[4];
+		_mm_store_ps(W, w);
+		_mm_store_ps(U, u);
+		_mm_store_ps(V, v);
+		for (int lane = 0; lane < 4; ++lane)
+			getMean(map, W[lane], U[lane], V[lane], M[lane], M2[lane]);
+		mean = _mm_load_ps(M);
+		mean2 = _mm_load_ps(M2);
+	}
+
+	__m128 shade4(const CPUShadowMap& map, __m128 lx, __m128 ly, __m128 lz, __m128 lw, __m128 ndotl) const {
+		const __m128 half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+		__m128 px = _mm_add_ps(_mm_mul_ps(_mm_div_ps(lx, lw), half), half);
+		__m128 py = _mm_add_ps(_mm_mul_ps(_mm_div_ps(ly, lw), half), half);
+		__m128 pz = _mm_add_ps(_mm_mul_ps(_mm_div_ps(lz, lw), half), half);
+		__m128 outside = _mm_cmpgt_ps(pz, one);
+		float slope = Type == 3 ? 0.005f : 0.05f;
+		__m128 bias = _mm_max_ps(_mm_mul_ps(_mm_set1_ps(slope), _mm_sub_ps(one, ndotl)), _mm_set1_ps(0.005f));
+
+		if (Type == 0) {
+			__m128 closest = sampleDepth4(map, px, py);
+			__m128 shadow = select4(_mm_cmpgt_ps(_mm_sub_ps(pz, bias), closest), zero, one);
+			return select4(outside, one, shadow);
+		}
+		if (Type == 1) {
+			__m128 texel = _mm_set1_ps(1.0f / float(map.GetSize()));
+			__m128 reference = _mm_sub_ps(pz, bias);
+			__m128 shadow = zero;
+			for (int x = -1; x <= 1; ++x)
+				for (int y = -1; y <= 1; ++y) {
+					__m128 depth = sampleDepth4(map, _mm_add_ps(px, _mm_mul_ps(_mm_set1_ps(float(x)), texel)),
+						_mm_add_ps(py, _mm_mul_ps(_mm_set1_ps(float(y)), texel)));
+					shadow = _mm_add_ps(shadow, select4(_mm_cmpgt_ps(reference, depth), zero, one));
+				}
+			return select4(outside, one, _mm_div_ps(shadow, _mm_set1_ps(9.0f)));
+		}
+		if (Type == 2)
+			return pcss4(map, px, py, pz, bias, outside);
+		if (Type == 3)
+			return vssm4(map, px, py, pz, bias);
+		return one;
+	}
+
+	//lanes that are still undecided are `active`, the others keep their result
+	__m128 pcss4(const CPUShadowMap& map, __m128 px, __m128 py, __m128 pz, __m128 bias, __m128 outside) const {
+		const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+		float size = float(map.GetSize());
+		float sampleStride = LightSize / 2.5f;
+		__m128 sampleSize = _mm_set1_ps(1.0f / size * sampleStride);
+		__m128 low = _mm_set1_ps(sampleStride / size), high = _mm_set1_ps(1.0f - sampleStride / size);
+		__m128 edge = _mm_or_ps(_mm_or_ps(_mm_cmple_ps(px, low), _mm_cmpge_ps(px, high)),
+			_mm_or_ps(_mm_cmple_ps(py, low), _mm_cmpge_ps(py, high)));
+		__m128 active = _mm_andnot_ps(_mm_or_ps(outside, edge), _mm_castsi128_ps(_mm_set1_epi32(-1)));
+		__m128 result = one;
+		int activeBits = _mm_movemask_ps(active);
+		if (!activeBits)
+			return result;
+
+		//per lane disks, [sample][lane]
+		alignas(16) float diskX[CS_NUM_SAMPLES][4], diskY[CS_NUM_SAMPLES][4];
+		alignas(16) float U[4], V[4];
+		_mm_store_ps(U, px);
+		_mm_store_ps(V, py);
+		for (int lane = 0; lane < 4; ++lane) {
+			float dx[CS_NUM_SAMPLES], dy[CS_NUM_SAMPLES];
+			if (activeBits & (1 << lane))
+				poissonDisk(U[lane], V[lane], dx, dy);
+			else
+				std::fill(dx, dx + CS_NUM_SAMPLES, 0.0f), std::fill(dy, dy + CS_NUM_SAMPLES, 0.0f);
+			for (int i = 0; i < CS_NUM_SAMPLES; ++i) {
+				diskX[i][lane] = dx[i];
+				diskY[i][lane] = dy[i];
+			}
+		}
+
+		__m128 blockerSum = zero, count = zero;
+		for (int i = 0; i < CS_NUM_SAMPLES; ++i) {
+			__m128 dx = _mm_load_ps(diskX[i]), dy = _mm_load_ps(diskY[i]);
+			__m128 depth = sampleDepth4(map, _mm_add_ps(_mm_mul_ps(dx, sampleSize), px), _mm_add_ps(_mm_mul_ps(dy, sampleSize), py));
+			__m128 blocker = _mm_cmplt_ps(depth, pz);
+			blockerSum = _mm_add_ps(blockerSum, _mm_and_ps(blocker, depth));
+			count = _mm_add_ps(count, _mm_and_ps(blocker, one));
+		}
+		active = _mm_andnot_ps(_mm_cmpeq_ps(count, zero), active);
+		__m128 dBlocker = _mm_div_ps(blockerSum, select4(active, count, one));
+		__m128 shadowed = _mm_and_ps(active, _mm_cmplt_ps(dBlocker, bias));
+		result = select4(shadowed, zero, result);
+		active = _mm_andnot_ps(shadowed, active);
+		active = _mm_andnot_ps(_mm_cmpgt_ps(dBlocker, one), active);
+		if (!_mm_movemask_ps(active))
+			return result;
+
+		__m128 wPenumbra = _mm_div_ps(_mm_mul_ps(_mm_sub_ps(pz, dBlocker), _mm_set1_ps(LightSize / 2.5f)), dBlocker);
+		__m128 filterSize = _mm_mul_ps(_mm_set1_ps(1.0f / size * 5.0f), wPenumbra);
+		__m128 reference = _mm_sub_ps(pz, bias);
+		__m128 shadow = zero;
+		for (int i = 0; i < CS_NUM_SAMPLES; ++i) {
+			__m128 dx = _mm_load_ps(diskX[i]), dy = _mm_load_ps(diskY[i]);
+			__m128 depth = sampleDepth4(map, _mm_add_ps(_mm_mul_ps(dx, filterSize), px), _mm_add_ps(_mm_mul_ps(dy, filterSize), py));
+			shadow = _mm_add_ps(shadow, select4(_mm_cmpgt_ps(reference, depth), zero, one));
+		}
+		return select4(active, _mm_div_ps(shadow, _mm_set1_ps(float(CS_NUM_SAMPLES))), result);
+	}
+
+	__m128 vssm4(const CPUShadowMap& map, __m128 px, __m128 py, __m128 pz, __m128 bias) const {
+		const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+		__m128 blockerSearchSize = _mm_set1_ps(LightSize / 2.0f);
+		__m128 current = _mm_sub_ps(pz, bias);
+		float border = LightSize / 2.0f / float(map.GetSize());
+		__m128 low = _mm_set1_ps(border), high = _mm_set1_ps(1.0f - border);
+		__m128 done = _mm_or_ps(_mm_cmpgt_ps(current, one), _mm_or_ps(_mm_or_ps(_mm_cmple_ps(px, low), _mm_cmpge_ps(px, high)),
+			_mm_or_ps(_mm_cmple_ps(py, low), _mm_cmpge_ps(py, high))));
+		__m128 result = one;
+		if (_mm_movemask_ps(done) == 0xF)
+			return result;
+
+		__m128 mean, mean2;
+		getMean4(map, blockerSearchSize, px, py, mean, mean2);
+		__m128 alpha = chebyshev4(mean, mean2, current);
+		__m128 dBlocker = _mm_div_ps(_mm_sub_ps(mean, _mm_mul_ps(alpha, _mm_sub_ps(current, bias))), _mm_sub_ps(one, alpha));
+		__m128 shadowed = _mm_andnot_ps(done, _mm_cmplt_ps(dBlocker, _mm_set1_ps(CS_EPS)));
+		result = select4(shadowed, zero, result);
+		done = _mm_or_ps(done, shadowed);
+		done = _mm_or_ps(done, _mm_cmpgt_ps(dBlocker, one));
+		__m128 wPenumbra = _mm_div_ps(_mm_mul_ps(_mm_sub_ps(current, dBlocker), _mm_set1_ps(LightSize)), dBlocker);
+		done = _mm_or_ps(done, _mm_cmple_ps(wPenumbra, zero));
+		if (_mm_movemask_ps(done) == 0xF)
+			return result;
+
+		//finished lanes look up a valid window, their result is kept
+		getMean4(map, select4(done, blockerSearchSize, wPenumbra), px, py, mean, mean2);
+		return select4(done, result, chebyshev4(mean, mean2, current));
+	}
+#endif
+};
@@ -169,6 +169,15 @@ public:
 		updateCameraVectors();
 	}
 
+	//place the camera at `position` facing `target` (scripted camera paths)
+	void LookAt(glm::vec3 position, glm::vec3 target) {
+		glm::vec3 front = glm::normalize(target - position);
+		Position = position;
+		Pitch = glm::degrees(asin(front.y));
+		Yaw = glm::degrees(atan2(front.z, front.x));
+		updateCameraVectors();
+	}
+
 	//gtor
 	glm::vec3 GetVectorFront() {
 		return Front;
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+#include "Shader.h"
+
+//default depth pyramid settings:
+const unsigned int DP_GROUP_SIZE = 8; //matches local_size in DepthMinMax.shader
+const unsigned int DP_TEXTURE_UNIT = 2; //u_DepthMinMax in VSSM_Scene.shader
+
+
+/*
+ * Min/max depth pyramid over the shadow map (RG32F, R: min, G: max).
+ * Level 0 is half the shadow map resolution, so texel (x, y) of level l covers the
+ * 2^(l+1) x 2^(l+1) shadow map texels starting at (x, y) * 2^(l+1). Any square region of the
+ * shadow map can be bounded with 4 texel fetches at the level whose texels are as wide as it.
+ */
+class DepthPyramid {
+private:
+	unsigned int m_Texture;
+	int m_Size; //level 0 size
+	int m_Levels;
+
+	void create(int shadowMapSize) {
+		m_Size = std::max(1, shadowMapSize / 2);
+		m_Levels = 0;
+		for (int size = m_Size; size >= 1; size /= 2)
+			m_Levels++;
+
+		glGenTextures(1, &m_Texture);
+		glState().BindTexture(GL_TEXTURE_2D, m_Texture);
+		for (int level = 0, size = m_Size; level < m_Levels; ++level, size /= 2)
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RG32F, size, size, 0, GL_RG, GL_FLOAT, nullptr);
+		gpuMemory().TrackTexture(m_Texture, GM_SHADOW_TABLES, "DepthPyramid", GL_RG32F, m_Size, m_Size, m_Levels);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_Levels - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+	}
+
+public:
+	//ctor, shadowMapSize: power of two
+	explicit DepthPyramid(int shadowMapSize)
+		: m_Texture(0), m_Size(0), m_Levels(0) {
+		create(shadowMapSize);
+	};
+	//dtor
+	~DepthPyramid() {
+		glState().DeleteTextures(1, &m_Texture);
+	};
+
+	//new shadow map size, the pyramid is rebuilt by the next Build
+	void Resize(int shadowMapSize) {
+		if (std::max(1, shadowMapSize / 2) == m_Size)
+			return;
+		glState().DeleteTextures(1, &m_Texture);
+		create(shadowMapSize);
+	}
+
+	//gtor
+	unsigned int GetTexture() const {
+		return m_Texture;
+	}
+	int GetLevels() const {
+		return m_Levels;
+	}
+	double GetResidentBytes() const {
+		double bytes = 0.0;
+		for (int level = 0, size = m_Size; level < m_Levels; ++level, size /= 2)
+			bytes += double(size) * size * 8.0;
+		return bytes;
+	}
+
+	//reduce the depth map (depth in R, any format) level by level, one dispatch per level
+	void Build(unsigned int depthMap, Shader& reduceShader) {
+		BuildLevels(depthMap, reduceShader);
+		//the lit pass samples it
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+
+	//Build without the barrier after the last level (RenderGraph places it)
+	void BuildLevels(unsigned int depthMap, Shader& reduceShader) {
+		reduceShader.Bind();
+		reduceShader.SetUniform1i("u_Depth", 0);
+		glState().ActiveTexture(GL_TEXTURE0);
+		glState().BindTexture(GL_TEXTURE_2D, depthMap);
+		for (int level = 0, size = m_Size; level < m_Levels; ++level, size /= 2) {
+			//reads the level before as an image
+			if (level > 0) {
+				glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+				glState().BindImageTexture(0, m_Texture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+			}
+			glState().BindImageTexture(1, m_Texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+			reduceShader.SetUniform1i("u_FromDepth", level == 0 ? 1 : 0);
+			unsigned int groups = (size + DP_GROUP_SIZE - 1) / DP_GROUP_SIZE;
+			glDispatchCompute(groups, groups, 1);
+		}
+	}
+
+	void Bind(unsigned int unit = DP_TEXTURE_UNIT) const {
+		glState().ActiveTexture(GL_TEXTURE0 + unit);
+		glState().BindTexture(GL_TEXTURE_2D, m_Texture);
+	}
+};
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DEPTH_RASTERIZER_SIMD 1
+#else
+#define DEPTH_RASTERIZER_SIMD 0
+#endif
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+#include "ThreadPool.h"
+#include "DepthSAT.h"
+
+//default depth rasterizer settings:
+const int DR_TILE = 64; //pixels per bin side, one bin per thread pool chunk
+const int DR_SUBPIXEL_BITS = 4; //GL_SUBPIXEL_BITS is at least 4
+const int DR_SUBPIXEL = 1 << DR_SUBPIXEL_BITS;
+const float DR_GUARD_BAND = 2.0f; //|x|, |y| <= 2w: vertices further out are clipped, so the fixed point fits in 32 bits
+const int DR_MAX_SIZE = 4096;
+const size_t DR_SETUP_GRAIN = 2048; //triangles per setup chunk
+const int32_t DR_EDGE_LIMIT = 1 << 30; //edge values are saturated here, a tile moves them by less than 2^28
+
+
+/*
+ * CPU version of the light depth pass (ShadowMap.shader): depth of the nearest triangle per texel,
+ * gl_FragCoord.z, cleared to 1. Submit() records draws (positions, optional indices, light space
+ * matrix * model), Rasterize() runs them in two parallel phases:
+ *  - setup, over chunks of triangles: vertex transform, clipping against the near plane (and the guard
+ *    band for far away vertices), snapping to DR_SUBPIXEL_BITS fixed point, binning into DR_TILE tiles,
+ *  - raster, over tiles: every tile walks the triangles of the chunks in submission order, so the
+ *    result does not depend on the thread count.
+ * Coverage follows the GL rules: pixel centers, integer edge functions, top-left fill rule in window
+ * space (y up), so shared edges are drawn once. Depth is the screen space plane of the window z,
+ * tested with GL_LESS. No face culling: the light pass leaves GL_CULL_FACE disabled.
+ * The SSE2 path tests 4 pixels of a row at once with the same integer and float operations as the
+ * scalar one.
+ */
+class DepthRasterizer {
+private:
+	struct Draw {
+		const glm::vec3* Positions;
+		const unsigned int* Indices; //nullptr: triangle list
+		size_t Triangles;
+		glm::mat4 Matrix;
+		size_t FirstTriangle; //over all draws
+	};
+	//fixed point edge functions and depth plane of a setup triangle
+	struct Triangle {
+		int32_t A[3], B[3];
+		int64_t C[3];
+		int32_t Bias[3]; //0 on top / left edges, -1 elsewhere
+		float Z0, DzDx, DzDy, X0, Y0; //z = Z0 + DzDx * (x - X0) + DzDy * (y - Y0), subpixel units
+		int MinX, MinY, MaxX, MaxY; //covered pixels
+	};
+	struct Chunk {
+		std::vector<Triangle> Triangles;
+		std::vector<std::vector<uint32_t>> Bins; //triangle indices per tile
+		size_t Clipped;
+		size_t Culled;
+	};
+	struct ClipVertex { float X, Y, Z, W; };
+
+	int m_Size;
+	int m_Tiles; //per side
+	std::vector<float> m_Depth;
+	std::vector<Draw> m_Draws;
+	size_t m_TriangleCount;
+	std::vector<Chunk> m_Chunks;
+	std::vector<size_t> m_TileFragments;
+
+	//Sutherland-Hodgman against d(v) >= 0, count: in / out vertices
+	template<typename Distance>
+	static int clipPolygon(const ClipVertex* in, int count, ClipVertex* out, Distance d) {
+		int n = 0;
+		for (int i = 0; i < count; ++i) {
+			const ClipVertex& a = in[i];
+			const ClipVertex& b = in[(i + 1) % count];
+			float da = d(a), db = d(b);
+			if (da >= 0.0f)
+				out[n++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f)) {
+				//always from the inside vertex, so the neighbour sharing the edge gets the same point
+				const ClipVertex& p = da >= 0.0f ? a : b;
+				const ClipVertex& q = da >= 0.0f ? b : a;
+				float dp = da >= 0.0f ? da : db, dq = da >= 0.0f ? db : da;
+				float t = dp / (dp - dq);
+				out[n++] = { p.X + (q.X - p.X) * t, p.Y + (q.Y - p.Y) * t, p.Z + (q.Z - p.Z) * t, p.W + (q.W - p.W) * t };
+			}
+		}
+		return n;
+	}
+
+	//snaps a clipped triangle to the viewport and bins it, returns false when it covers no pixel center
+	bool setupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, Chunk& chunk) const {
+		const ClipVertex* v[3] = { &v0, &v1, &v2 };
+		int64_t x[3], y[3];
+		float z[3];
+		float scale = 0.5f * float(m_Size) * float(DR_SUBPIXEL);
+		for (int i = 0; i < 3; ++i) {
+			float invW = 1.0f / v[i]->W;
+			x[i] = (int64_t)std::llround((v[i]->X * invW + 1.0f) * scale);
+			y[i] = (int64_t)std::llround((v[i]->Y * invW + 1.0f) * scale);
+			z[i] = v[i]->Z * invW * 0.5f + 0.5f;
+		}
+		int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (area == 0)
+			return false;
+		if (area < 0) { //both windings are drawn, make it counter clockwise
+			std::swap(x[1], x[2]);
+			std::swap(y[1], y[2]);
+			std::swap(z[1], z[2]);
+			area = -area;
+		}
+
+		//pixel centers at (i + 0.5) * DR_SUBPIXEL
+		const int64_t half = DR_SUBPIXEL / 2;
+		auto floorDiv = [](int64_t a) { return a >= 0 ? a / DR_SUBPIXEL : -((-a + DR_SUBPIXEL - 1) / DR_SUBPIXEL); };
+		int64_t minX = std::min({ x[0], x[1], x[2] }), maxX = std::max({ x[0], x[1], x[2] });
+		int64_t minY = std::min({ y[0], y[1], y[2] }), maxY = std::max({ y[0], y[1], y[2] });
+		Triangle t;
+		t.MinX = (int)std::max<int64_t>(floorDiv(minX - half + DR_SUBPIXEL - 1), 0);
+		t.MinY = (int)std::max<int64_t>(floorDiv(minY - half + DR_SUBPIXEL - 1), 0);
+		t.MaxX = (int)std::min<int64_t>(floorDiv(maxX - half), m_Size - 1);
+		t.MaxY = (int)std::min<int64_t>(floorDiv(maxY - half), m_Size - 1);
+		if (t.MinX > t.MaxX || t.MinY > t.MaxY)
+			return false;
+
+		//edge i goes from vertex i to vertex i + 1, positive inside
+		for (int i = 0; i < 3; ++i) {
+			int j = (i + 1) % 3;
+			t.A[i] = int32_t(y[i] - y[j]);
+			t.B[i] = int32_t(x[j] - x[i]);
+			t.C[i] = -(int64_t(t.A[i]) * x[i] + int64_t(t.B[i]) * y[i]);
+			bool topLeft = t.A[i] > 0 || (t.A[i] == 0 && t.B[i] < 0);
+			t.Bias[i] = topLeft ? 0 : -1;
+		}
+		float invArea = 1.0f / float(area);
+		float dx1 = float(x[1] - x[0]), dy1 = float(y[1] - y[0]);
+		float dx2 = float(x[2] - x[0]), dy2 = float(y[2] - y[0]);
+		float dz1 = z[1] - z[0], dz2 = z[2] - z[0];
+		t.DzDx = (dz1 * dy2 - dz2 * dy1) * invArea;
+		t.DzDy = (dz2 * dx1 - dz1 * dx2) * invArea;
+		t.Z0 = z[0];
+		t.X0 = float(x[0]);
+		t.Y0 = float(y[0]);
+
+		uint32_t index = (uint32_t)chunk.Triangles.size();
+		chunk.Triangles.push_back(t);
+		for (int ty = t.MinY / DR_TILE; ty <= t.MaxY / DR_TILE; ++ty)
+			for (int tx = t.MinX / DR_TILE; tx <= t.MaxX / DR_TILE; ++tx)
+				chunk.Bins[size_t(ty) * m_Tiles + tx].push_back(index);
+		return true;
+	}
+
+	void setupRange(size_t begin, size_t end, Chunk& chunk) const {
+		chunk.Triangles.clear();
+		for (auto& bin : chunk.Bins)
+			bin.clear();
+		chunk.Clipped = 0;
+		chunk.Culled = 0;
+		//first draw of the range
+		size_t d = 0;
+		while (m_Draws[d].FirstTriangle + m_Draws[d].Triangles <= begin)
+			d++;
+		for (size_t global = begin; global < end; ++global) {
+			while (global >= m_Draws[d].FirstTriangle + m_Draws[d].Triangles)
+				d++;
+			const Draw& draw = m_Draws[d];
+			size_t local = global - draw.FirstTriangle;
+			ClipVertex polygon[2][8];
+			for (int i = 0; i < 3; ++i) {
+				size_t vertex = draw.Indices ? draw.Indices[local * 3 + i] : local * 3 + i;
+				glm::vec4 p = draw.Matrix * glm::vec4(draw.Positions[vertex], 1.0f);
+				polygon[0][i] = { p.x, p.y, p.z, p.w };
+			}
+
+			//trivial reject against the view volume planes
+			const ClipVertex* tri = polygon[0];
+			auto allOutside = [&](auto plane) { return plane(tri[0]) < 0.0f && plane(tri[1]) < 0.0f && plane(tri[2]) < 0.0f; };
+			if (allOutside([](const ClipVertex& v) { return v.W - v.X; }) || allOutside([](const ClipVertex& v) { return v.W + v.X; })
+				|| allOutside([](const ClipVertex& v) { return v.W - v.Y; }) || allOutside([](const ClipVertex& v) { return v.W + v.Y; })
+				|| allOutside([](const ClipVertex& v) { return v.W - v.Z; }) || allOutside([](const ClipVertex& v) { return v.W + v.Z; })) {
+				chunk.Culled++;
+				continue;
+			}
+
+			//the near plane always, the guard band when a vertex is outside it. The far plane is a per pixel test
+			int count = 3, current = 0;
+			bool inside = true;
+			for (int i = 0; i < 3; ++i) {
+				const ClipVertex& v = tri[i];
+				float g = DR_GUARD_BAND * v.W;
+				inside &= v.Z >= -v.W && v.X <= g && v.X >= -g && v.Y <= g && v.Y >= -g;
+			}
+			if (!inside) {
+				chunk.Clipped++;
+				auto clip = [&](auto distance) {
+					count = clipPolygon(polygon[current], count, polygon[1 - current], distance);
+					current = 1 - current;
+				};
+				clip([](const ClipVertex& v) { return v.Z + v.W; });
+				clip([](const ClipVertex& v) { return DR_GUARD_BAND * v.W - v.X; });
+				clip([](const ClipVertex& v) { return DR_GUARD_BAND * v.W + v.X; });
+				clip([](const ClipVertex& v) { return DR_GUARD_BAND * v.W - v.Y; });
+				clip([](const ClipVertex& v) { return DR_GUARD_BAND * v.W + v.Y; });
+			}
+			bool drawn = false;
+			for (int i = 1; i + 1 < count; ++i)
+				drawn |= setupTriangle(polygon[current][0], polygon[current][i], polygon[current][i + 1], chunk);
+			if (!drawn)
+				chunk.Culled++;
+		}
+	}
+
+	//one triangle over the pixels [x0, x1] x [y0, y1] of a tile, returns the fragments that passed
+	size_t rasterizeTriangle(const Triangle& t, int x0, int y0, int x1, int y1) {
+		//edge values at the first pixel center, saturated: within a tile they move by less than 2^28
+		int32_t e0[3], stepX[3], stepY[3];
+		int64_t px = int64_t(x0) * DR_SUBPIXEL + DR_SUBPIXEL / 2, py = int64_t(y0) * DR_SUBPIXEL + DR_SUBPIXEL / 2;
+		for (int i = 0; i < 3; ++i) {
+			int64_t e = int64_t(t.A[i]) * px + int64_t(t.B[i]) * py + t.C[i] + t.Bias[i];
+			e0[i] = (int32_t)std::min<int64_t>(std::max<int64_t>(e, -DR_EDGE_LIMIT), DR_EDGE_LIMIT);
+			stepX[i] = t.A[i] * DR_SUBPIXEL;
+			stepY[i] = t.B[i] * DR_SUBPIXEL;
+		}
+		size_t fragments = 0;
+		for (int y = y0; y <= y1; ++y) {
+			int32_t e[3] = { e0[0], e0[1], e0[2] };
+			float fy = float(y * DR_SUBPIXEL + DR_SUBPIXEL / 2) - t.Y0;
+			float* row = &m_Depth[size_t(y) * m_Size];
+			int x = x0;
+#if DEPTH_RASTERIZER_SIMD
+			__m128i edge[3], edgeStep[3];
+			for (int i = 0; i < 3; ++i) {
+				edge[i] = _mm_add_epi32(_mm_set1_epi32(e[i]), _mm_set_epi32(3 * stepX[i], 2 * stepX[i], stepX[i], 0));
+				edgeStep[i] = _mm_set1_epi32(4 * stepX[i]);
+			}
+			const __m128 z0 = _mm_set1_ps(t.Z0), dzdx = _mm_set1_ps(t.DzDx), dzdy = _mm_set1_ps(t.DzDy), x0f = _mm_set1_ps(t.X0);
+			const __m128 zy = _mm_mul_ps(dzdy, _mm_set1_ps(fy));
+			const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+			for (; x + 3 <= x1; x += 4) {
+				__m128i outside = _mm_or_si128(_mm_or_si128(edge[0], edge[1]), edge[2]); //sign bit: some edge < 0
+				for (int i = 0; i < 3; ++i)
+					edge[i] = _mm_add_epi32(edge[i], edgeStep[i]);
+				if (_mm_movemask_ps(_mm_castsi128_ps(outside)) == 0xF)
+					continue;
+				__m128 pxf = _mm_sub_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x * DR_SUBPIXEL + DR_SUBPIXEL / 2),
+					_mm_set_epi32(3 * DR_SUBPIXEL, 2 * DR_SUBPIXEL, DR_SUBPIXEL, 0))), x0f);
+				__m128 z = _mm_add_ps(_mm_add_ps(z0, _mm_mul_ps(dzdx, pxf)), zy);
+				__m128 stored = _mm_loadu_ps(row + x);
+				__m128 pass = _mm_andnot_ps(_mm_castsi128_ps(_mm_srai_epi32(outside, 31)),
+					_mm_and_ps(_mm_cmplt_ps(z, stored), _mm_and_ps(_mm_cmpge_ps(z, zero), _mm_cmple_ps(z, one))));
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, stored)));
+				int passed = _mm_movemask_ps(pass);
+				fragments += (passed & 1) + ((passed >> 1) & 1) + ((passed >> 2) & 1) + (passed >> 3);
+			}
+			for (int i = 0; i < 3; ++i)
+				e[i] += stepX[i] * (x - x0);
+#endif
+			for (; x <= x1; ++x) {
+				if ((e[0] | e[1] | e[2]) >= 0) {
+					float pxf = float(x * DR_SUBPIXEL + DR_SUBPIXEL / 2) - t.X0;
+					float z = t.Z0 + t.DzDx * pxf + t.DzDy * fy;
+					if (z < row[x] && z >= 0.0f && z <= 1.0f) {
+						row[x] = z;
+						fragments++;
+					}
+				}
+				for (int i = 0; i < 3; ++i)
+					e[i] += stepX[i];
+			}
+			for (int i = 0; i < 3; ++i)
+				e0[i] += stepY[i];
+		}
+		return fragments;
+	}
+
+public:
+	//last Rasterize()
+	size_t LastTriangles; //submitted
+	size_t LastBinned; //set up, after clipping
+	size_t LastClipped;
+	size_t LastCulled; //outside the view volume or no pixel center
+	size_t LastFragments; //passed the depth test
+
+	//ctor, size: square depth buffer, at most DR_MAX_SIZE
+	explicit DepthRasterizer(int size)
+		: m_Size(std::min(size, DR_MAX_SIZE)), m_Tiles((std::min(size, DR_MAX_SIZE) + DR_TILE - 1) / DR_TILE),
+		m_Depth(size_t(m_Size) * m_Size, 1.0f), m_TriangleCount(0),
+		LastTriangles(0), LastBinned(0), LastClipped(0), LastCulled(0), LastFragments(0) {};
+
+	//new depth buffer size, at most DR_MAX_SIZE
+	void Resize(int size) {
+		m_Size = std::min(size, DR_MAX_SIZE);
+		m_Tiles = (m_Size + DR_TILE - 1) / DR_TILE;
+		m_Depth.assign(size_t(m_Size) * m_Size, 1.0f);
+	}
+
+	//gtor
+	int GetSize() const {
+		return m_Size;
+	}
+	//window space depth, row 0 at the bottom like the texture
+	const std::vector<float>& GetDepth() const {
+		return m_Depth;
+	}
+
+	//drops the recorded draws
+	void Clear() {
+		m_Draws.clear();
+		m_TriangleCount = 0;
+	}
+
+	//matrix: u_LightSpaceMatrix * u_Model. indices: 3 per triangle, nullptr for a plain triangle list.
+	//the arrays are read by Rasterize(), they have to live until then
+	void Submit(const glm::vec3* positions, const unsigned int* indices, size_t triangles, const glm::mat4& matrix) {
+		if (triangles == 0)
+			return;
+		m_Draws.push_back({ positions, indices, triangles, matrix, m_TriangleCount });
+		m_TriangleCount += triangles;
+	}
+
+	//clears the depth to 1 and draws everything submitted since Clear(), pool: nullptr runs on the caller
+	void Rasterize(ThreadPool* pool) {
+		std::fill(m_Depth.begin(), m_Depth.end(), 1.0f);
+		size_t chunks = (m_TriangleCount + DR_SETUP_GRAIN - 1) / DR_SETUP_GRAIN;
+		if (m_Chunks.size() < chunks)
+			m_Chunks.resize(chunks);
+		for (size_t c = 0; c < chunks; ++c)
+			m_Chunks[c].Bins.resize(size_t(m_Tiles) * m_Tiles);
+
+		auto setup = [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; ++c)
+				setupRange(c * DR_SETUP_GRAIN, std::min((c + 1) * DR_SETUP_GRAIN, m_TriangleCount), m_Chunks[c]);
+		};
+		size_t tiles = size_t(m_Tiles) * m_Tiles;
+		m_TileFragments.assign(tiles, 0);
+		auto raster = [&](size_t begin, size_t end) {
+			for (size_t tile = begin; tile < end; ++tile) {
+				int tx0 = int(tile % m_Tiles) * DR_TILE, ty0 = int(tile / m_Tiles) * DR_TILE;
+				int tx1 = std::min(tx0 + DR_TILE, m_Size) - 1, ty1 = std::min(ty0 + DR_TILE, m_Size) - 1;
+				size_t fragments = 0;
+				for (size_t c = 0; c < chunks; ++c) {
+					const Chunk& chunk = m_Chunks[c];
+					for (uint32_t index : chunk.Bins[tile]) {
+						const Triangle& t = chunk.Triangles[index];
+						fragments += rasterizeTriangle(t, std::max(t.MinX, tx0), std::max(t.MinY, ty0), std::min(t.MaxX, tx1), std::min(t.MaxY, ty1));
+					}
+				}
+				m_TileFragments[tile] = fragments;
+			}
+		};
+		if (pool) {
+			pool->ParallelFor(chunks, 1, setup);
+			pool->ParallelFor(tiles, 1, raster);
+		}
+		else {
+			setup(0, chunks);
+			raster(0, tiles);
+		}
+
+		LastTriangles = m_TriangleCount;
+		LastBinned = LastClipped = LastCulled = LastFragments = 0;
+		for (size_t c = 0; c < chunks; ++c) {
+			LastBinned += m_Chunks[c].Triangles.size();
+			LastClipped += m_Chunks[c].Clipped;
+			LastCulled += m_Chunks[c].Culled;
+		}
+		for (size_t f : m_TileFragments)
+			LastFragments += f;
+	}
+
+	//writes the depth into the shadow map texture (RG32F gets depth^2 too, like ShadowMap.shader)
+	void Upload(unsigned int texture, DepthFormat format) const {
+		glState().BindTexture(GL_TEXTURE_2D, texture);
+		if (format == DEPTH_RG32F) {
+			std::vector<float> moments(m_Depth.size() * 2);
+			for (size_t i = 0; i < m_Depth.size(); ++i) {
+				moments[2 * i] = m_Depth[i];
+				moments[2 * i + 1] = m_Depth[i] * m_Depth[i];
+			}
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_Size, m_Size, GL_RG, GL_FLOAT, moments.data());
+		}
+		else {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_Size, m_Size, GL_RED, GL_FLOAT, m_Depth.data());
+		}
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+	}
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+#include "Shader.h"
+#include "FullscreenQuad.h"
+
+//default depth SAT settings:
+const unsigned int DS_TEXTURE_UNIT = 1; //u_DepthSAT in Shadows.glsl
+const float DS_CENTER = 0.5f; //middle of the depth range
+const float DS_BORDER_COLOR[4] = { 0.0f, 0.0f, 0.0f, 0.0f }; //nothing summed left of / above the map
+
+//shadow map (depth) storage
+enum DepthFormat {
+	DEPTH_RG32F = 0, //depth and depth^2
+	DEPTH_R16 = 1, //depth only, 16 bit unorm: uniform steps over [0, 1]
+	DEPTH_R16F = 2 //depth only, half float: steps of 2^-11 near 1
+};
+const char* const DEPTH_FORMAT_NAMES[] = { "RG32F (depth, depth^2)", "R16 unorm (depth)", "R16F (depth)" };
+const int DEPTH_FORMATS_COUNT = 3;
+const DepthFormat DS_DEPTH_FORMAT = DEPTH_R16;
+
+inline GLenum depthInternalFormat(DepthFormat format) {
+	return format == DEPTH_R16 ? GL_R16 : format == DEPTH_R16F ? GL_R16F : GL_RG32F;
+}
+inline double depthTexelBytes(DepthFormat format) {
+	return format == DEPTH_RG32F ? 8.0 : 2.0;
+}
+
+
+/*
+ * Summed area table of the 2 shadow map moments (RG32F) for VSSM, and the mean blocker depth of
+ * EVSM / MSM. The shadow map only has to hold the depth: the first ComputeSAT.shader pass (DEPTH)
+ * reads it through a sampler, so any DepthFormat works, makes the moments in fp32 and sums the
+ * rows, the second (COLUMNS) sums the columns in place. One table, no transposed intermediate.
+ * The depth is centered on Center before it is squared and summed: the sums of a shadow map
+ * mostly near one depth stay small, so the corner differences of a window lose fewer bits.
+ * getDepthMean in Shadows.glsl adds the center back.
+ * GL 3.3 contexts (no compute shaders) use BuildFragment: recursive doubling with SATDoubling.shader,
+ * 2 * ceil(log2(size)) full screen passes ping-ponging between the table and a scratch target.
+ */
+class DepthSAT {
+private:
+	unsigned int m_Texture;
+	int m_Size;
+	//fragment path, created by the first BuildFragment
+	unsigned int m_Scratch;
+	unsigned int m_FBO[2]; //0: table, 1: scratch
+	FullscreenQuad m_Quad;
+
+	int doublingSteps() const {
+		int steps = 0;
+		while ((1 << steps) < m_Size)
+			steps++;
+		return steps;
+	}
+
+	void createTable() {
+		glGenTextures(1, &m_Texture);
+		glState().BindTexture(GL_TEXTURE_2D, m_Texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, m_Size, m_Size, 0, GL_RG, GL_FLOAT, nullptr);
+		gpuMemory().TrackTexture(m_Texture, GM_SHADOW_TABLES, "DepthSAT", GL_RG32F, m_Size, m_Size);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, DS_BORDER_COLOR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	void release() {
+		glState().DeleteTextures(1, &m_Texture);
+		if (m_Scratch)
+			glState().DeleteTextures(1, &m_Scratch);
+		if (m_FBO[0])
+			glState().DeleteFramebuffers(2, m_FBO);
+		m_Texture = m_Scratch = 0;
+		m_FBO[0] = m_FBO[1] = 0;
+	}
+
+	void createScratch() {
+		glGenTextures(1, &m_Scratch);
+		glState().BindTexture(GL_TEXTURE_2D, m_Scratch);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, m_Size, m_Size, 0, GL_RG, GL_FLOAT, nullptr);
+		gpuMemory().TrackTexture(m_Scratch, GM_SHADOW_TABLES, "DepthSAT scratch", GL_RG32F, m_Size, m_Size);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	//framebuffers of the table and of a scratch target, which may change between builds
+	void bindFragmentTargets(unsigned int scratch) {
+		if (!m_FBO[0]) {
+			glGenFramebuffers(2, m_FBO);
+			glState().BindFramebuffer(GL_FRAMEBUFFER, m_FBO[0]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_Texture, 0);
+		}
+		glState().BindFramebuffer(GL_FRAMEBUFFER, m_FBO[1]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scratch, 0);
+		glState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+public:
+	float Center;
+
+	//ctor, size: shadow map size, at most 2048 on the compute path (ComputeSAT.shader scans a row in one work group)
+	explicit DepthSAT(int size)
+		: m_Texture(0), m_Size(size), m_Scratch(0), m_FBO{ 0, 0 }, Center(DS_CENTER) {
+		createTable();
+	};
+	//dtor
+	~DepthSAT() {
+		release();
+	};
+
+	//new shadow map size, the table is rebuilt by the next Build
+	void Resize(int size) {
+		if (size == m_Size)
+			return;
+		release();
+		m_Size = size;
+		createTable();
+	}
+
+	//gtor
+	unsigned int GetTexture() const {
+		return m_Texture;
+	}
+	//bytes the two passes read and write per build from a shadow map in `format`
+	double GetBuildBytes(DepthFormat format) const {
+		double texels = double(m_Size) * m_Size;
+		return texels * ((depthTexelBytes(format) + 8.0) + (8.0 + 8.0));
+	}
+	//same for BuildFragment: every pass reads 2 texels and writes one
+	double GetFragmentBuildBytes(DepthFormat format) const {
+		double texels = double(m_Size) * m_Size;
+		return texels * ((2.0 * depthTexelBytes(format) + 8.0) + (2 * doublingSteps() - 1) * (2.0 * 8.0 + 8.0));
+	}
+	int GetFragmentPasses() const {
+		return 2 * doublingSteps();
+	}
+	//resident bytes of the shadow map and the table (plus the scratch target once the fragment path ran)
+	double GetResidentBytes(DepthFormat format) const {
+		return double(m_Size) * m_Size * (depthTexelBytes(format) + (m_Scratch ? 16.0 : 8.0));
+	}
+	//bytes of the fragment path's scratch target (RG32F, the table size)
+	double GetIntermediateBytes() const {
+		return double(m_Size) * m_Size * 8.0;
+	}
+
+	//depthMap: the shadow map, depth in R; rowShader / columnShader: ComputeSAT.shader DEPTH / COLUMNS
+	void Build(unsigned int depthMap, Shader& rowShader, Shader& columnShader) {
+		BuildRows(depthMap, rowShader);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		BuildColumns(columnShader);
+		//the lit pass samples the table
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+
+	//the two passes of Build, without barriers (RenderGraph places them): moments and row sums, image store
+	void BuildRows(unsigned int depthMap, Shader& rowShader) {
+		rowShader.Bind();
+		rowShader.SetUniform1i("u_Depth", 0);
+		rowShader.SetUniform1f("u_Center", Center);
+		glState().ActiveTexture(GL_TEXTURE0);
+		glState().BindTexture(GL_TEXTURE_2D, depthMap);
+		glState().BindImageTexture(1, m_Texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+		glDispatchCompute(m_Size, 1, 1);
+	}
+	//column sums in place, image load / store
+	void BuildColumns(Shader& columnShader) {
+		columnShader.Bind();
+		glState().BindImageTexture(1, m_Texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RG32F);
+		glDispatchCompute(m_Size, 1, 1);
+	}
+
+	//GL 3.3 path, doublingShader: SATDoubling.shader. Leaves the default framebuffer bound, the viewport at the table size
+	void BuildFragment(unsigned int depthMap, Shader& doublingShader) {
+		if (!m_Scratch)
+			createScratch();
+		BuildFragment(depthMap, doublingShader, m_Scratch);
+	}
+
+	//same with the caller's scratch target: RG32F, the table size (a transient of RenderGraph)
+	void BuildFragment(unsigned int depthMap, Shader& doublingShader, unsigned int scratch) {
+		bindFragmentTargets(scratch);
+		int steps = doublingSteps();
+		int passes = 2 * steps;
+		glState().Viewport(0, 0, m_Size, m_Size);
+		glState().Disable(GL_DEPTH_TEST);
+		doublingShader.Bind();
+		doublingShader.SetUniform1i("u_Source", 0);
+		doublingShader.SetUniform1f("u_Center", Center);
+		glState().ActiveTexture(GL_TEXTURE0);
+		unsigned int source = depthMap;
+		for (int pass = 0; pass < passes; ++pass) {
+			int target = (passes - 1 - pass) % 2; //the last pass writes the table
+			bool rows = pass < steps;
+			int offset = 1 << (rows ? pass : pass - steps);
+			glState().BindFramebuffer(GL_FRAMEBUFFER, m_FBO[target]);
+			glState().BindTexture(GL_TEXTURE_2D, source);
+			doublingShader.SetUniform1b("u_FromDepth", pass == 0);
+			doublingShader.SetUniform2i("u_Offset", rows ? offset : 0, rows ? 0 : offset);
+			m_Quad.Draw(doublingShader);
+			source = target == 0 ? m_Texture : scratch;
+		}
+		glState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+		glState().Enable(GL_DEPTH_TEST);
+	}
+
+	void Bind(unsigned int unit = DS_TEXTURE_UNIT) const {
+		glState().ActiveTexture(GL_TEXTURE0 + unit);
+		glState().BindTexture(GL_TEXTURE_2D, m_Texture);
+	}
+};
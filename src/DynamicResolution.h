@@ -0,0 +1,178 @@
+#pragma once
+
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+#include "Profiler.h"
+
+//default dynamic resolution settings:
+const float DR_TARGET_MS = 16.6f;
+const float DR_MIN_SCALE = 0.5f;
+const float DR_MAX_SCALE = 1.0f;
+const float DR_SCALE_STEP = 0.05f; //scales are whole steps, small timing jitter never reallocates
+const float DR_HEADROOM = 0.85f; //scale up only once the frame is below this fraction of the target
+const float DR_SMOOTHING = 0.2f; //moving average of the GPU frame time
+const int DR_SETTLE_FRAMES = 2 * PF_QUERY_FRAMES + 4; //frames measured at a new scale before the next decision
+
+
+/*
+ * Dynamic resolution of the camera pass.
+ * Update() reads the GPU frame time (timestamp queries, PF_QUERY_FRAMES old) and picks the render
+ * scale that holds TargetMs: over the target it steps down at once by the estimated amount (cost taken
+ * as proportional to the pixel count), under DR_HEADROOM * target it steps up one DR_SCALE_STEP at
+ * a time, in between it holds (hysteresis). After a change it waits DR_SETTLE_FRAMES so the queries
+ * in flight, rendered at the old scale, don't drive the next decision.
+ * The camera pass renders into an offscreen target of GetWidth() x GetHeight(), Upscale() stretches
+ * it (bilinear blit) over the window.
+ */
+class DynamicResolution {
+private:
+	int m_Width; //window
+	int m_Height;
+	unsigned int m_FBO;
+	unsigned int m_Color;
+	unsigned int m_Depth;
+	int m_TargetWidth; //allocated target
+	int m_TargetHeight;
+	double m_SmoothedMs;
+	int m_Settle;
+
+	void deleteTarget() {
+		if (!m_FBO)
+			return;
+		glState().DeleteFramebuffers(1, &m_FBO);
+		glState().DeleteTextures(1, &m_Color);
+		gpuMemory().Release(GM_KIND_RENDERBUFFER, 1, &m_Depth);
+		glDeleteRenderbuffers(1, &m_Depth);
+		m_FBO = m_Color = m_Depth = 0;
+	}
+
+	void createTarget(int width, int height) {
+		deleteTarget();
+		glGenTextures(1, &m_Color);
+		glState().BindTexture(GL_TEXTURE_2D, m_Color);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		gpuMemory().TrackTexture(m_Color, GM_SCREEN_TARGETS, "DynamicResolution color", GL_RGBA8, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+
+		glGenRenderbuffers(1, &m_Depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, m_Depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		gpuMemory().TrackRenderbuffer(m_Depth, GM_SCREEN_TARGETS, "DynamicResolution depth", GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &m_FBO);
+		glState().BindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_Color, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_Depth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "Dynamic resolution framebuffer incomplete!" << std::endl;
+		glState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+		m_TargetWidth = width;
+		m_TargetHeight = height;
+	}
+
+	static int steps(float scale) {
+		return (int)std::lround(scale / DR_SCALE_STEP);
+	}
+
+public:
+	float TargetMs;
+	float MinScale;
+	float MaxScale;
+	float Scale; //render resolution / window resolution, per axis
+
+	//stats
+	double LastChangeMs; //smoothed GPU frame time the last scale change was decided on
+
+	//ctor
+	DynamicResolution(int width, int height)
+		: m_Width(width), m_Height(height), m_FBO(0), m_Color(0), m_Depth(0), m_TargetWidth(0), m_TargetHeight(0),
+		m_SmoothedMs(0.0), m_Settle(0),
+		TargetMs(DR_TARGET_MS), MinScale(DR_MIN_SCALE), MaxScale(DR_MAX_SCALE), Scale(DR_MAX_SCALE), LastChangeMs(0.0) {};
+	//dtor
+	~DynamicResolution() {
+		deleteTarget();
+	};
+
+	//gtor
+	int GetWidth() const {
+		return std::max(1, (int)std::lround(m_Width * Scale));
+	}
+	int GetHeight() const {
+		return std::max(1, (int)std::lround(m_Height * Scale));
+	}
+	unsigned int GetFBO() const {
+		return m_FBO;
+	}
+	double GetSmoothedMs() const {
+		return m_SmoothedMs;
+	}
+
+	//back to full resolution, measuring from scratch
+	void Reset() {
+		Scale = MaxScale;
+		m_SmoothedMs = 0.0;
+		m_Settle = 0;
+	}
+
+	//call once per GPU frame time read back (Profiler::HasNewGPUFrame()); returns true when Scale changed
+	bool Update(double gpuFrameMs) {
+		if (gpuFrameMs <= 0.0)
+			return false;
+		m_SmoothedMs = m_SmoothedMs > 0.0 ? m_SmoothedMs + (gpuFrameMs - m_SmoothedMs) * DR_SMOOTHING : gpuFrameMs;
+		if (m_Settle > 0) {
+			--m_Settle;
+			return false;
+		}
+
+		int current = steps(Scale);
+		int wanted = current;
+		if (m_SmoothedMs > TargetMs) {
+			//at least one step down, more when far over the target
+			float estimate = Scale * (float)std::sqrt(TargetMs / m_SmoothedMs);
+			wanted = std::min(current - 1, (int)std::floor(estimate / DR_SCALE_STEP));
+		}
+		else if (m_SmoothedMs < DR_HEADROOM * TargetMs) {
+			wanted = current + 1;
+		}
+		wanted = std::max(steps(MinScale), std::min(steps(MaxScale), wanted));
+		if (wanted == current)
+			return false;
+
+		Scale = wanted * DR_SCALE_STEP;
+		LastChangeMs = m_SmoothedMs;
+		m_SmoothedMs = 0.0;
+		m_Settle = DR_SETTLE_FRAMES;
+		return true;
+	}
+
+	//bind and clear the offscreen target at the current render resolution
+	void Begin(const glm::vec3& clearColor) {
+		if (GetWidth() != m_TargetWidth || GetHeight() != m_TargetHeight)
+			createTarget(GetWidth(), GetHeight());
+		glState().BindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+		glState().Viewport(0, 0, m_TargetWidth, m_TargetHeight);
+		glClearColor(clearColor.x, clearColor.y, clearColor.z, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	//stretch the target over the window (color only, later window draws are overlays)
+	void Upscale() const {
+		glState().BindFramebuffer(GL_READ_FRAMEBUFFER, m_FBO);
+		glState().BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, m_TargetWidth, m_TargetHeight, 0, 0, m_Width, m_Height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		glState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+		glState().Viewport(0, 0, m_Width, m_Height);
+	}
+};
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+
+//default frame pipelining settings:
+const int FR_MAX_FRAMES_IN_FLIGHT = 3;
+const int FR_FRAMES_IN_FLIGHT = 2;
+const size_t FR_SLICE_SIZE = 1 << 20; //bytes per frame slice to start with, grows to the largest frame
+const size_t FR_MIN_ALIGNMENT = 16;
+
+
+/*
+ * Frames in flight: a fence at the end of every frame, and before a frame writes its dynamic data the
+ * fence of the frame that used the same slot N frames ago is waited on. The CPU only waits when it is
+ * more than N frames ahead of the GPU; then everything written in that slot is safe to overwrite.
+ */
+class FrameSync {
+private:
+	GLsync m_Fences[FR_MAX_FRAMES_IN_FLIGHT];
+	int m_FramesInFlight;
+	unsigned int m_Frame;
+
+public:
+	//stats of the last BeginFrame()
+	double LastWaitMs; //CPU blocked on the GPU
+	int LastInFlight; //earlier frames the GPU had not finished when the frame began
+	unsigned int Stalls; //frames that had to wait
+
+	//ctor
+	explicit FrameSync(int framesInFlight = FR_FRAMES_IN_FLIGHT)
+		: m_FramesInFlight(std::min(std::max(framesInFlight, 1), FR_MAX_FRAMES_IN_FLIGHT)), m_Frame(0),
+		LastWaitMs(0.0), LastInFlight(0), Stalls(0) {
+		for (int i = 0; i < FR_MAX_FRAMES_IN_FLIGHT; ++i)
+			m_Fences[i] = nullptr;
+	};
+	//dtor
+	~FrameSync() {
+		for (int i = 0; i < FR_MAX_FRAMES_IN_FLIGHT; ++i)
+			if (m_Fences[i])
+				glDeleteSync(m_Fences[i]);
+	};
+
+	int GetFramesInFlight() const {
+		return m_FramesInFlight;
+	}
+	//slice of the frame rings the current frame writes to
+	unsigned int GetSlot() const {
+		return m_Frame % m_FramesInFlight;
+	}
+
+	//between frames: every frame in flight is waited on, the slots are renumbered
+	void SetFramesInFlight(int framesInFlight) {
+		framesInFlight = std::min(std::max(framesInFlight, 1), FR_MAX_FRAMES_IN_FLIGHT);
+		if (framesInFlight == m_FramesInFlight)
+			return;
+		for (int i = 0; i < FR_MAX_FRAMES_IN_FLIGHT; ++i)
+			wait(i);
+		m_FramesInFlight = framesInFlight;
+	}
+
+	//before the frame's first write to a frame ring
+	void BeginFrame() {
+		m_Frame++;
+		LastInFlight = 0;
+		for (int i = 0; i < FR_MAX_FRAMES_IN_FLIGHT; ++i)
+			if (m_Fences[i] && !signaled(m_Fences[i]))
+				LastInFlight++;
+		auto start = std::chrono::high_resolution_clock::now();
+		bool stalled = wait(GetSlot());
+		LastWaitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		Stalls += stalled ? 1 : 0;
+	}
+
+	//after the frame's last GPU command
+	void EndFrame() {
+		m_Fences[GetSlot()] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+private:
+	static bool signaled(GLsync fence) {
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+	}
+
+	//true when the fence had not signaled yet
+	bool wait(int slot) {
+		GLsync& fence = m_Fences[slot];
+		if (!fence)
+			return false;
+		bool stalled = false;
+		GLbitfield flags = 0;
+		while (true) {
+			GLenum status = glClientWaitSync(fence, flags, 1000000); //1 ms
+			if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED)
+				break;
+			stalled = true;
+			flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		}
+		glDeleteSync(fence);
+		fence = nullptr;
+		return stalled;
+	}
+};
+
+
+//where a Write() landed, for glBindBufferRange / attribute and indirect offsets
+struct FrameAllocation {
+	unsigned int Buffer;
+	size_t Offset;
+	size_t Bytes;
+};
+
+/*
+ * Per-frame dynamic data (instance transforms, draw commands, ...) in one buffer cut into one slice per
+ * frame in flight. A frame writes only its own slice, which FrameSync::BeginFrame() made sure the GPU is
+ * done with, so nothing is orphaned and nothing waits: persistently mapped when the context has buffer
+ * storage, mapped unsynchronized per write otherwise. A frame that does not fit its slice moves to a
+ * larger buffer; the old one stays alive until the next frame, the draws already recorded still read it.
+ */
+class FrameRingBuffer {
+private:
+	unsigned int m_Buffer;
+	unsigned char* m_Mapped; //persistent mapping, nullptr when mapped per write
+	bool m_Persistent;
+	size_t m_SliceSize;
+	size_t m_Alignment;
+	unsigned int m_Slot;
+	size_t m_Head; //next byte written in the slice
+	size_t m_FrameBytes;
+	std::vector<unsigned int> m_Retired; //outgrown buffers, deleted at the next frame
+
+public:
+	//stats
+	size_t LastFrameBytes;
+	unsigned int Grows;
+
+	//ctor, persistent: the context has buffer storage (GLCapabilities::BufferStorage)
+	explicit FrameRingBuffer(bool persistent, size_t sliceSize = FR_SLICE_SIZE)
+		: m_Buffer(0), m_Mapped(nullptr), m_Persistent(persistent), m_SliceSize(sliceSize), m_Alignment(FR_MIN_ALIGNMENT),
+		m_Slot(0), m_Head(0), m_FrameBytes(0), LastFrameBytes(0), Grows(0) {
+		//slices are bound as SSBO ranges
+		int alignment = 0;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		m_Alignment = std::max(m_Alignment, size_t(alignment));
+		allocate();
+	};
+	//dtor
+	~FrameRingBuffer() {
+		if (m_Mapped) {
+			glState().BindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glState().BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		glState().DeleteBuffers(1, &m_Buffer);
+		for (unsigned int buffer : m_Retired)
+			glState().DeleteBuffers(1, &buffer);
+	};
+
+	bool IsPersistent() const {
+		return m_Mapped != nullptr;
+	}
+	size_t GetSliceSize() const {
+		return m_SliceSize;
+	}
+	//bytes of GPU memory, every slice
+	size_t GetResidentBytes() const {
+		return m_SliceSize * FR_MAX_FRAMES_IN_FLIGHT;
+	}
+
+	//after FrameSync::BeginFrame()
+	void BeginFrame(unsigned int slot) {
+		for (unsigned int buffer : m_Retired)
+			glState().DeleteBuffers(1, &buffer);
+		m_Retired.clear();
+		m_Slot = slot;
+		LastFrameBytes = m_FrameBytes;
+		m_Head = 0;
+		m_FrameBytes = 0;
+	}
+
+	//copy bytes into this frame's slice
+	FrameAllocation Write(const void* data, size_t bytes) {
+		size_t offset = (m_Head + m_Alignment - 1) / m_Alignment * m_Alignment;
+		if (offset + bytes > m_SliceSize) {
+			size_t size = m_SliceSize * 2;
+			while (size < bytes)
+				size *= 2;
+			m_SliceSize = size;
+			//deleting a mapped buffer unmaps it
+			m_Retired.push_back(m_Buffer);
+			m_Buffer = 0;
+			allocate();
+			Grows++;
+			offset = 0;
+		}
+		size_t start = size_t(m_Slot) * m_SliceSize + offset;
+		if (bytes > 0) {
+			if (m_Mapped) {
+				std::memcpy(m_Mapped + start, data, bytes);
+			}
+			else {
+				glState().BindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+				void* target = glMapBufferRange(GL_COPY_WRITE_BUFFER, start, bytes,
+					GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+				std::memcpy(target, data, bytes);
+				glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+				glState().BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			}
+		}
+		m_Head = offset + bytes;
+		m_FrameBytes += bytes;
+		return { m_Buffer, start, bytes };
+	}
+
+private:
+	void allocate() {
+		size_t size = m_SliceSize * FR_MAX_FRAMES_IN_FLIGHT;
+		glGenBuffers(1, &m_Buffer);
+		glState().BindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+		if (m_Persistent) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+			gpuMemory().TrackBuffer(m_Buffer, GM_PER_FRAME, "FrameRingBuffer", size);
+			m_Mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+		}
+		else {
+			glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+			gpuMemory().TrackBuffer(m_Buffer, GM_PER_FRAME, "FrameRingBuffer", size);
+		}
+		glState().BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+};
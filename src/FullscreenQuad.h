@@ -0,0 +1,45 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+#include "VertexArray.h"
+#include "VertexBuffer.h"
+#include "VertexBufferLayout.h"
+#include "Shader.h"
+
+//triangle strip covering the viewport: position, texcoord
+const float FQ_VERTICES[] = {
+	-1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
+	-1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+	 1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
+	 1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
+};
+
+
+/*
+ * Fullscreen pass geometry, same layout as renderQuad() (location 0: position, 1: texcoord),
+ * created once and kept by the screen-space passes.
+ */
+class FullscreenQuad {
+private:
+	VertexArray m_VA;
+	VertexBuffer m_VB;
+
+public:
+	//ctor
+	FullscreenQuad() : m_VB(FQ_VERTICES, sizeof(FQ_VERTICES)) {
+		VertexBufferLayout layout;
+		layout.Push<float>(3);
+		layout.Push<float>(2);
+		m_VA.AddBuffer(m_VB, layout);
+		glState().BindVertexArray(0);
+	};
+
+	void Draw(const Shader& shader) const {
+		shader.Bind();
+		m_VA.Bind();
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		glState().BindVertexArray(0);
+	}
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <iostream>
+
+#include <GL/glew.h>
+
+
+/*
+ * What the current context can run, read once after glewInit(). main() asks GLFW for a 3.3 core
+ * context: most drivers hand out their newest core version anyway, but GL 3.3-class GPUs and some
+ * software rasterizers stop there, without compute shaders or image load / store.
+ */
+struct GLCapabilities {
+	int Major;
+	int Minor;
+	std::string Renderer;
+	bool ComputeShaders; //GL 4.3 (the compute shaders are #version 430): DepthSAT, depth pyramid, moment filters
+	bool MultiDrawIndirect; //GL 4.3: instanced path, SSBO counters
+	bool BufferStorage; //GL 4.4 / ARB_buffer_storage: persistently mapped staging ring (MeshStreamer)
+	bool Software; //llvmpipe, softpipe, SwiftShader
+};
+
+inline GLCapabilities DetectGLCapabilities() {
+	GLCapabilities caps;
+	glGetIntegerv(GL_MAJOR_VERSION, &caps.Major);
+	glGetIntegerv(GL_MINOR_VERSION, &caps.Minor);
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	caps.Renderer = renderer ? renderer : "unknown";
+	caps.MultiDrawIndirect = GLEW_VERSION_4_3 != 0;
+	caps.ComputeShaders = caps.Major > 4 || (caps.Major == 4 && caps.Minor >= 3);
+	caps.BufferStorage = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+	caps.Software = caps.Renderer.find("llvmpipe") != std::string::npos || caps.Renderer.find("softpipe") != std::string::npos
+		|| caps.Renderer.find("SwiftShader") != std::string::npos;
+	return caps;
+}
+
+inline void PrintGLCapabilities(const GLCapabilities& caps) {
+	std::cout << "GL " << caps.Major << "." << caps.Minor << " (" << caps.Renderer << (caps.Software ? ", software" : "") << ")"
+		<< ", compute shaders: " << (caps.ComputeShaders ? "yes" : "no")
+		<< ", multi-draw-indirect: " << (caps.MultiDrawIndirect ? "yes" : "no")
+		<< ", persistent mapping: " << (caps.BufferStorage ? "yes" : "no") << std::endl;
+}
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <map>
+#include <utility>
+
+#include <GL/glew.h>
+
+#include "GPUMemory.h"
+
+//default GL state cache settings:
+const unsigned int GS_TEXTURE_UNITS = 32; //units tracked, binds to higher ones are always issued
+const unsigned int GS_IMAGE_UNITS = 8;
+const unsigned int GS_UNKNOWN = ~0u;
+
+//kinds of state calls, counted separately
+enum GLStateKind {
+	GS_PROGRAM = 0,
+	GS_VERTEX_ARRAY,
+	GS_BUFFER,
+	GS_TEXTURE, //active unit and texture binds
+	GS_IMAGE,
+	GS_FRAMEBUFFER,
+	GS_VIEWPORT,
+	GS_RASTER, //enable / disable, cull face, depth func and mask
+	GS_KINDS
+};
+const char* const GS_KIND_NAMES[GS_KINDS] = { "Program", "Vertex array", "Buffer", "Texture", "Image", "Framebuffer", "Viewport", "Raster" };
+
+
+/*
+ * Shadow copy of the GL binding state in front of the bind calls: program, vertex array, buffers
+ * (generic and indexed targets), textures per unit and target, image units, framebuffers, viewport and
+ * the cull / depth state. A call that sets what is already set is dropped. The methods take the
+ * arguments of the GL function they replace.
+ *  - all the code binds through glState(); what changes the state behind its back (a library that
+ *    does not restore it, another context) has to Invalidate() it. The ImGui backend restores what it
+ *    changes, so it can stay outside,
+ *  - GL recycles names: objects are deleted through it, which forgets the bindings of the name (and
+ *    releases its gpuMemory() record),
+ *  - the element array binding is vertex array state, it is forgotten when the vertex array changes,
+ *  - main thread only, like the context.
+ */
+class GLStateCache {
+private:
+	struct ImageBinding {
+		unsigned int Texture;
+		int Level;
+		GLboolean Layered;
+		int Layer;
+		GLenum Access;
+		GLenum Format;
+	};
+	struct BufferRange {
+		unsigned int Buffer;
+		GLintptr Offset;
+		GLsizeiptr Size; //0: whole buffer (glBindBufferBase)
+	};
+
+	unsigned int m_Program;
+	unsigned int m_VertexArray;
+	std::map<GLenum, unsigned int> m_Buffers; //by target, a missing target is unknown
+	std::map<std::pair<GLenum, unsigned int>, BufferRange> m_IndexedBuffers;
+	unsigned int m_ActiveUnit;
+	std::map<GLenum, unsigned int> m_Textures[GS_TEXTURE_UNITS]; //by target
+	ImageBinding m_Images[GS_IMAGE_UNITS];
+	unsigned int m_DrawFramebuffer;
+	unsigned int m_ReadFramebuffer;
+	GLint m_Viewport[4];
+	std::map<GLenum, bool> m_Caps;
+	GLenum m_CullFace;
+	GLenum m_DepthFunc;
+	unsigned int m_DepthMask;
+
+	//true when the call has to be issued
+	bool issue(GLStateKind kind, bool redundant) {
+		if (Enabled && redundant) {
+			Skipped[kind]++;
+			return false;
+		}
+		Issued[kind]++;
+		return true;
+	}
+
+public:
+	bool Enabled; //off: every call is issued, the state is still tracked
+	//calls since NewFrame(), and over the frame before it
+	unsigned int Issued[GS_KINDS];
+	unsigned int Skipped[GS_KINDS];
+	unsigned int LastIssued[GS_KINDS];
+	unsigned int LastSkipped[GS_KINDS];
+
+	//ctor, no GL calls: the first call of every kind is issued
+	GLStateCache()
+		: Enabled(true) {
+		Invalidate();
+		for (int k = 0; k < GS_KINDS; ++k)
+			Issued[k] = Skipped[k] = LastIssued[k] = LastSkipped[k] = 0;
+	};
+
+	//totals of the frame before
+	unsigned int GetLastIssued() const {
+		unsigned int total = 0;
+		for (int k = 0; k < GS_KINDS; ++k)
+			total += LastIssued[k];
+		return total;
+	}
+	unsigned int GetLastSkipped() const {
+		unsigned int total = 0;
+		for (int k = 0; k < GS_KINDS; ++k)
+			total += LastSkipped[k];
+		return total;
+	}
+
+	//forget everything, the next call of every kind is issued
+	void Invalidate() {
+		m_Program = GS_UNKNOWN;
+		m_VertexArray = GS_UNKNOWN;
+		m_Buffers.clear();
+		m_IndexedBuffers.clear();
+		m_ActiveUnit = GS_UNKNOWN;
+		for (unsigned int u = 0; u < GS_TEXTURE_UNITS; ++u)
+			m_Textures[u].clear();
+		for (unsigned int u = 0; u < GS_IMAGE_UNITS; ++u)
+			m_Images[u].Texture = GS_UNKNOWN;
+		m_DrawFramebuffer = GS_UNKNOWN;
+		m_ReadFramebuffer = GS_UNKNOWN;
+		for (int i = 0; i < 4; ++i)
+			m_Viewport[i] = -1;
+		m_Caps.clear();
+		m_CullFace = GS_UNKNOWN;
+		m_DepthFunc = GS_UNKNOWN;
+		m_DepthMask = GS_UNKNOWN;
+	}
+
+	//per frame counts, the state itself carries over
+	void NewFrame() {
+		for (int k = 0; k < GS_KINDS; ++k) {
+			LastIssued[k] = Issued[k];
+			LastSkipped[k] = Skipped[k];
+			Issued[k] = Skipped[k] = 0;
+		}
+	}
+
+	/*-------binds-------*/
+
+	void UseProgram(unsigned int program) {
+		if (issue(GS_PROGRAM, m_Program == program))
+			glUseProgram(program);
+		m_Program = program;
+	}
+
+	void BindVertexArray(unsigned int vertexArray) {
+		if (issue(GS_VERTEX_ARRAY, m_VertexArray == vertexArray))
+			glBindVertexArray(vertexArray);
+		if (m_VertexArray != vertexArray)
+			m_Buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+		m_VertexArray = vertexArray;
+	}
+
+	void BindBuffer(GLenum target, unsigned int buffer) {
+		auto it = m_Buffers.find(target);
+		if (issue(GS_BUFFER, it != m_Buffers.end() && it->second == buffer))
+			glBindBuffer(target, buffer);
+		m_Buffers[target] = buffer;
+	}
+	//also binds the generic target
+	void BindBufferBase(GLenum target, unsigned int index, unsigned int buffer) {
+		BindBufferRange(target, index, buffer, 0, 0);
+	}
+	void BindBufferRange(GLenum target, unsigned int index, unsigned int buffer, GLintptr offset, GLsizeiptr size) {
+		auto it = m_IndexedBuffers.find({ target, index });
+		auto generic = m_Buffers.find(target);
+		bool redundant = it != m_IndexedBuffers.end() && it->second.Buffer == buffer && it->second.Offset == offset && it->second.Size == size
+			&& generic != m_Buffers.end() && generic->second == buffer;
+		if (issue(GS_BUFFER, redundant)) {
+			if (size == 0)
+				glBindBufferBase(target, index, buffer);
+			else
+				glBindBufferRange(target, index, buffer, offset, size);
+		}
+		m_IndexedBuffers[{ target, index }] = { buffer, offset, size };
+		m_Buffers[target] = buffer;
+	}
+
+	//texture: GL_TEXTURE0 + unit
+	void ActiveTexture(GLenum texture) {
+		unsigned int unit = texture - GL_TEXTURE0;
+		if (issue(GS_TEXTURE, m_ActiveUnit == unit))
+			glActiveTexture(texture);
+		m_ActiveUnit = unit;
+	}
+	//on the active unit
+	void BindTexture(GLenum target, unsigned int texture) {
+		bool tracked = m_ActiveUnit < GS_TEXTURE_UNITS;
+		bool redundant = false;
+		if (tracked) {
+			auto it = m_Textures[m_ActiveUnit].find(target);
+			redundant = it != m_Textures[m_ActiveUnit].end() && it->second == texture;
+		}
+		if (issue(GS_TEXTURE, redundant))
+			glBindTexture(target, texture);
+		if (tracked)
+			m_Textures[m_ActiveUnit][target] = texture;
+	}
+
+	void BindImageTexture(unsigned int unit, unsigned int texture, int level, GLboolean layered, int layer, GLenum access, GLenum format) {
+		bool tracked = unit < GS_IMAGE_UNITS;
+		bool redundant = false;
+		if (tracked) {
+			const ImageBinding& image = m_Images[unit];
+			redundant = image.Texture == texture && image.Level == level && image.Layered == layered && image.Layer == layer
+				&& image.Access == access && image.Format == format;
+		}
+		if (issue(GS_IMAGE, redundant))
+			glBindImageTexture(unit, texture, level, layered, layer, access, format);
+		if (tracked)
+			m_Images[unit] = { texture, level, layered, layer, access, format };
+	}
+
+	//GL_FRAMEBUFFER binds both the draw and the read framebuffer
+	void BindFramebuffer(GLenum target, unsigned int framebuffer) {
+		bool draw = target != GL_READ_FRAMEBUFFER, read = target != GL_DRAW_FRAMEBUFFER;
+		bool redundant = (!draw || m_DrawFramebuffer == framebuffer) && (!read || m_ReadFramebuffer == framebuffer);
+		if (issue(GS_FRAMEBUFFER, redundant))
+			glBindFramebuffer(target, framebuffer);
+		if (draw)
+			m_DrawFramebuffer = framebuffer;
+		if (read)
+			m_ReadFramebuffer = framebuffer;
+	}
+
+	/*-------fixed function state-------*/
+
+	void Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+		bool redundant = m_Viewport[0] == x && m_Viewport[1] == y && m_Viewport[2] == width && m_Viewport[3] == height;
+		if (issue(GS_VIEWPORT, redundant))
+			glViewport(x, y, width, height);
+		m_Viewport[0] = x;
+		m_Viewport[1] = y;
+		m_Viewport[2] = width;
+		m_Viewport[3] = height;
+	}
+
+	void Enable(GLenum cap) {
+		auto it = m_Caps.find(cap);
+		if (issue(GS_RASTER, it != m_Caps.end() && it->second))
+			glEnable(cap);
+		m_Caps[cap] = true;
+	}
+	void Disable(GLenum cap) {
+		auto it = m_Caps.find(cap);
+		if (issue(GS_RASTER, it != m_Caps.end() && !it->second))
+			glDisable(cap);
+		m_Caps[cap] = false;
+	}
+	void CullFace(GLenum mode) {
+		if (issue(GS_RASTER, m_CullFace == mode))
+			glCullFace(mode);
+		m_CullFace = mode;
+	}
+	void DepthFunc(GLenum func) {
+		if (issue(GS_RASTER, m_DepthFunc == func))
+			glDepthFunc(func);
+		m_DepthFunc = func;
+	}
+	void DepthMask(GLboolean flag) {
+		if (issue(GS_RASTER, m_DepthMask == flag))
+			glDepthMask(flag);
+		m_DepthMask = flag;
+	}
+
+	/*-------deletes: GL unbinds a deleted name and may hand it out again-------*/
+
+	void DeleteProgram(unsigned int program) {
+		if (m_Program == program)
+			m_Program = GS_UNKNOWN;
+		glDeleteProgram(program);
+	}
+
+	void DeleteVertexArrays(GLsizei n, const unsigned int* vertexArrays) {
+		for (GLsizei i = 0; i < n; ++i) {
+			if (m_VertexArray == vertexArrays[i]) {
+				m_VertexArray = GS_UNKNOWN;
+				m_Buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+			}
+		}
+		glDeleteVertexArrays(n, vertexArrays);
+	}
+
+	void DeleteBuffers(GLsizei n, const unsigned int* buffers) {
+		for (GLsizei i = 0; i < n; ++i) {
+			for (auto it = m_Buffers.begin(); it != m_Buffers.end();)
+				it = it->second == buffers[i] ? m_Buffers.erase(it) : std::next(it);
+			for (auto it = m_IndexedBuffers.begin(); it != m_IndexedBuffers.end();)
+				it = it->second.Buffer == buffers[i] ? m_IndexedBuffers.erase(it) : std::next(it);
+		}
+		gpuMemory().Release(GM_KIND_BUFFER, n, buffers);
+		glDeleteBuffers(n, buffers);
+	}
+
+	void DeleteTextures(GLsizei n, const unsigned int* textures) {
+		for (GLsizei i = 0; i < n; ++i) {
+			for (unsigned int u = 0; u < GS_TEXTURE_UNITS; ++u)
+				for (auto& binding : m_Textures[u])
+					if (binding.second == textures[i])
+						binding.second = 0;
+			for (unsigned int u = 0; u < GS_IMAGE_UNITS; ++u)
+				if (m_Images[u].Texture == textures[i])
+					m_Images[u].Texture = GS_UNKNOWN;
+		}
+		gpuMemory().Release(GM_KIND_TEXTURE, n, textures);
+		glDeleteTextures(n, textures);
+	}
+
+	void DeleteFramebuffers(GLsizei n, const unsigned int* framebuffers) {
+		for (GLsizei i = 0; i < n; ++i) {
+			if (m_DrawFramebuffer == framebuffers[i])
+				m_DrawFramebuffer = 0;
+			if (m_ReadFramebuffer == framebuffers[i])
+				m_ReadFramebuffer = 0;
+		}
+		glDeleteFramebuffers(n, framebuffers);
+	}
+};
+
+//the cache of the application's context
+inline GLStateCache& glState() {
+	static GLStateCache state;
+	return state;
+}
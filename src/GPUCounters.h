@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+
+
+/*
+ * A small SSBO of uint counters that shaders bump with atomicAdd (debug/stats variants only).
+ * Read() waits for the GPU, so it is meant for stats modes, not for every frame of normal rendering.
+ */
+class GPUCounters {
+private:
+	unsigned int m_Buffer;
+	std::vector<unsigned int> m_Values;
+
+public:
+	//ctor
+	explicit GPUCounters(size_t count)
+		: m_Buffer(0), m_Values(count, 0) {
+		glGenBuffers(1, &m_Buffer);
+		glState().BindBuffer(GL_SHADER_STORAGE_BUFFER, m_Buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, m_Values.size() * sizeof(unsigned int), m_Values.data(), GL_DYNAMIC_READ);
+		gpuMemory().TrackBuffer(m_Buffer, GM_PER_FRAME, "GPUCounters", m_Values.size() * sizeof(unsigned int));
+		glState().BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	};
+	//dtor
+	~GPUCounters() {
+		glState().DeleteBuffers(1, &m_Buffer);
+	};
+
+	void Reset() {
+		std::fill(m_Values.begin(), m_Values.end(), 0u);
+		glState().BindBuffer(GL_SHADER_STORAGE_BUFFER, m_Buffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_Values.size() * sizeof(unsigned int), m_Values.data());
+		glState().BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	void Bind(unsigned int binding) const {
+		glState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, m_Buffer);
+	}
+
+	//values written by the draws issued so far
+	const std::vector<unsigned int>& Read() {
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glState().BindBuffer(GL_SHADER_STORAGE_BUFFER, m_Buffer);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_Values.size() * sizeof(unsigned int), m_Values.data());
+		glState().BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		return m_Values;
+	}
+
+	//gtor
+	unsigned int Get(size_t i) const {
+		return m_Values[i];
+	}
+};
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+#include <fstream>
+#include <ostream>
+#include <functional>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+//default GPU memory settings:
+const size_t GM_BUDGET = size_t(1024) << 20; //bytes, 0: no budget
+const int GM_MAX_RELIEF_STEPS = 16; //per handler and Enforce()
+
+enum GPUMemoryKind {
+	GM_KIND_TEXTURE = 0,
+	GM_KIND_RENDERBUFFER,
+	GM_KIND_BUFFER,
+	GM_KINDS
+};
+const char* const GM_KIND_NAMES[GM_KINDS] = { "texture", "renderbuffer", "buffer" };
+
+//what an allocation is for, the totals are reported per category
+enum GPUMemoryCategory {
+	GM_SHADOW_MAPS = 0, //the shadow map and its depth buffer, baked lightmaps
+	GM_SHADOW_TABLES, //SATs, moment blur, depth pyramid
+	GM_SCREEN_TARGETS, //shadow mask, temporal history, dynamic resolution
+	GM_MESHES,
+	GM_STREAMING, //staging rings
+	GM_PER_FRAME, //frame ring, instance data, counters
+	GM_RENDER_GRAPH, //pooled transients
+	GM_LOOKUP, //sample tables, noise
+	GM_CATEGORIES
+};
+const char* const GM_CATEGORY_NAMES[GM_CATEGORIES] = { "Shadow maps", "Shadow tables", "Screen targets", "Meshes", "Streaming",
+	"Per-frame buffers", "Render graph", "Lookup tables" };
+
+//sized internal formats the renderer allocates
+struct GMFormat {
+	GLenum Format;
+	const char* Name;
+	size_t TexelBytes;
+};
+const GMFormat GM_FORMATS[] = {
+	{ GL_R8, "R8", 1 },
+	{ GL_R16, "R16", 2 },
+	{ GL_R16F, "R16F", 2 },
+	{ GL_R32F, "R32F", 4 },
+	{ GL_RG16F, "RG16F", 4 },
+	{ GL_RG32F, "RG32F", 8 },
+	{ GL_RGBA8, "RGBA8", 4 },
+	{ GL_RGBA16F, "RGBA16F", 8 },
+	{ GL_RGBA32F, "RGBA32F", 16 },
+	{ GL_DEPTH_COMPONENT24, "DEPTH_COMPONENT24", 4 }, //padded to 32 bits
+	{ GL_DEPTH_COMPONENT32, "DEPTH_COMPONENT32", 4 },
+	{ GL_DEPTH_COMPONENT32F, "DEPTH_COMPONENT32F", 4 },
+	{ GL_DEPTH24_STENCIL8, "DEPTH24_STENCIL8", 4 },
+};
+
+inline const GMFormat* gmFindFormat(GLenum format) {
+	for (const GMFormat& f : GM_FORMATS)
+		if (f.Format == format)
+			return &f;
+	return nullptr;
+}
+//0 when the format is not in GM_FORMATS
+inline size_t gmTexelBytes(GLenum format) {
+	const GMFormat* f = gmFindFormat(format);
+	return f ? f->TexelBytes : 0;
+}
+//bytes of a 2D texture with `levels` mip levels, each half the size of the one before
+inline size_t gmTextureBytes(GLenum format, int width, int height, int levels = 1) {
+	size_t bytes = 0;
+	for (int level = 0; level < levels; ++level, width = std::max(width / 2, 1), height = std::max(height / 2, 1))
+		bytes += size_t(width) * height * gmTexelBytes(format);
+	return bytes;
+}
+
+inline double gmMiB(size_t bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
+
+
+/*
+ * Accounting of the GPU memory the renderer allocates: every glTexImage2D / glTexStorage2D,
+ * glRenderbufferStorage and glBufferData / glBufferStorage is followed by a Track call with the
+ * category and the owner, the deletes through glState() release it (renderbuffers are released by
+ * hand, they have no cache entry). Specifying a name again replaces its record. Sizes are what the
+ * formats need, the driver's padding and alignment are not known.
+ * A budget: Enforce(), once per frame, calls the pressure handlers in their order while the total is
+ * over it. A handler frees something (a lower shadow map resolution, an evicted mesh) and returns
+ * false once it has nothing left to give; Restore() undoes what they did, the next Enforce() degrades
+ * again if the budget still does not allow it. Main thread only, like the context.
+ */
+class GPUMemory {
+public:
+	struct Allocation {
+		GPUMemoryKind Kind;
+		unsigned int Name;
+		GPUMemoryCategory Category;
+		const char* Owner;
+		GLenum Format; //GL_NONE for buffers
+		int Width;
+		int Height;
+		int Levels;
+		size_t Bytes;
+	};
+	struct PressureHandler {
+		std::string Name;
+		std::function<bool()> Relieve; //frees something, false when nothing is left
+		std::function<void()> Restore;
+		unsigned int Steps; //Relieve() calls that freed something since the last Restore()
+	};
+
+private:
+	std::map<std::pair<int, unsigned int>, Allocation> m_Allocations; //by kind and GL name
+	size_t m_Totals[GM_CATEGORIES];
+	size_t m_Total;
+	std::vector<PressureHandler> m_Handlers;
+
+	void record(const Allocation& allocation) {
+		auto key = std::make_pair(int(allocation.Kind), allocation.Name);
+		auto it = m_Allocations.find(key);
+		if (it != m_Allocations.end())
+			forget(it->second);
+		m_Allocations[key] = allocation;
+		m_Totals[allocation.Category] += allocation.Bytes;
+		m_Total += allocation.Bytes;
+		PeakBytes = std::max(PeakBytes, m_Total);
+	}
+	void forget(const Allocation& allocation) {
+		m_Totals[allocation.Category] -= allocation.Bytes;
+		m_Total -= allocation.Bytes;
+	}
+
+	static void writeString(std::ostream& out, const char* s) {
+		out << '"';
+		for (; s && *s; ++s) {
+			if (*s == '"' || *s == '\\')
+				out << '\\';
+			out << *s;
+		}
+		out << '"';
+	}
+
+public:
+	size_t Budget;
+	size_t PeakBytes;
+	//stats of the last Enforce()
+	bool LastOverBudget; //still over once every handler gave what it could
+	unsigned int LastReliefSteps;
+
+	//ctor, no GL calls
+	explicit GPUMemory(size_t budget = GM_BUDGET)
+		: m_Total(0), Budget(budget), PeakBytes(0), LastOverBudget(false), LastReliefSteps(0) {
+		for (int c = 0; c < GM_CATEGORIES; ++c)
+			m_Totals[c] = 0;
+	};
+
+	//gtor
+	size_t GetTotal() const {
+		return m_Total;
+	}
+	size_t GetTotal(GPUMemoryCategory category) const {
+		return m_Totals[category];
+	}
+	size_t GetCount() const {
+		return m_Allocations.size();
+	}
+	const std::map<std::pair<int, unsigned int>, Allocation>& GetAllocations() const {
+		return m_Allocations;
+	}
+	//nullptr when the name is not tracked
+	const Allocation* Find(GPUMemoryKind kind, unsigned int name) const {
+		auto it = m_Allocations.find({ int(kind), name });
+		return it != m_Allocations.end() ? &it->second : nullptr;
+	}
+	const std::vector<PressureHandler>& GetHandlers() const {
+		return m_Handlers;
+	}
+	bool IsOverBudget() const {
+		return Budget > 0 && m_Total > Budget;
+	}
+
+	/*-------tracking-------*/
+
+	//the texture bound when it was specified, levels: the whole mip chain
+	void TrackTexture(unsigned int texture, GPUMemoryCategory category, const char* owner, GLenum format, int width, int height, int levels = 1) {
+		record({ GM_KIND_TEXTURE, texture, category, owner, format, width, height, levels, gmTextureBytes(format, width, height, levels) });
+	}
+	void TrackRenderbuffer(unsigned int renderbuffer, GPUMemoryCategory category, const char* owner, GLenum format, int width, int height) {
+		record({ GM_KIND_RENDERBUFFER, renderbuffer, category, owner, format, width, height, 1, gmTextureBytes(format, width, height) });
+	}
+	void TrackBuffer(unsigned int buffer, GPUMemoryCategory category, const char* owner, size_t bytes) {
+		record({ GM_KIND_BUFFER, buffer, category, owner, GL_NONE, 0, 0, 0, bytes });
+	}
+
+	//names that are not tracked are ignored
+	void Release(GPUMemoryKind kind, GLsizei n, const unsigned int* names) {
+		for (GLsizei i = 0; i < n; ++i) {
+			auto it = m_Allocations.find({ int(kind), names[i] });
+			if (it == m_Allocations.end())
+				continue;
+			forget(it->second);
+			m_Allocations.erase(it);
+		}
+	}
+
+	/*-------budget-------*/
+
+	//handlers are asked in the order they are added: the cheapest quality loss first
+	void AddPressureHandler(const std::string& name, const std::function<bool()>& relieve, const std::function<void()>& restore) {
+		m_Handlers.push_back({ name, relieve, restore, 0 });
+	}
+
+	//once per frame, before anything of the frame is allocated
+	void Enforce() {
+		LastReliefSteps = 0;
+		for (PressureHandler& handler : m_Handlers) {
+			for (int step = 0; step < GM_MAX_RELIEF_STEPS && IsOverBudget(); ++step) {
+				if (!handler.Relieve())
+					break;
+				handler.Steps++;
+				LastReliefSteps++;
+			}
+		}
+		LastOverBudget = IsOverBudget();
+	}
+
+	//back to full quality, latest handler first
+	void Restore() {
+		for (auto it = m_Handlers.rbegin(); it != m_Handlers.rend(); ++it) {
+			if (it->Steps > 0 && it->Restore)
+				it->Restore();
+			it->Steps = 0;
+		}
+	}
+
+	/*-------report-------*/
+
+	void WriteJSON(std::ostream& out) const {
+		out << "{\n  \"budget\": " << Budget << ",\n  \"total\": " << m_Total << ",\n  \"peak\": " << PeakBytes << ",\n  \"categories\": [";
+		for (int c = 0; c < GM_CATEGORIES; ++c) {
+			size_t count = 0;
+			for (const auto& entry : m_Allocations)
+				count += entry.second.Category == c ? 1 : 0;
+			out << (c ? ",\n" : "\n") << "    { \"name\": ";
+			writeString(out, GM_CATEGORY_NAMES[c]);
+			out << ", \"bytes\": " << m_Totals[c] << ", \"count\": " << count << " }";
+		}
+		out << "\n  ],\n  \"allocations\": [";
+		bool first = true;
+		for (const auto& entry : m_Allocations) {
+			const Allocation& a = entry.second;
+			const GMFormat* format = gmFindFormat(a.Format);
+			out << (first ? "\n" : ",\n") << "    { \"kind\": \"" << GM_KIND_NAMES[a.Kind] << "\", \"name\": " << a.Name << ", \"category\": ";
+			writeString(out, GM_CATEGORY_NAMES[a.Category]);
+			out << ", \"owner\": ";
+			writeString(out, a.Owner);
+			if (a.Kind != GM_KIND_BUFFER) {
+				out << ", \"format\": ";
+				writeString(out, format ? format->Name : "unknown");
+				out << ", \"width\": " << a.Width << ", \"height\": " << a.Height << ", \"levels\": " << a.Levels;
+			}
+			out << ", \"bytes\": " << a.Bytes << " }";
+			first = false;
+		}
+		out << "\n  ]\n}\n";
+	}
+
+	bool SaveJSON(const std::string& path) const {
+		std::ofstream file(path);
+		if (!file)
+			return false;
+		WriteJSON(file);
+		return bool(file);
+	}
+};
+
+//the accounting of the application's context
+inline GPUMemory& gpuMemory() {
+	static GPUMemory memory;
+	return memory;
+}
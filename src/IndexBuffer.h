@@ -12,21 +12,23 @@ public:
 		: m_Count(count) {
 		//ASSERT(sizeof(unsigned int) == sizeof(GLuint));
 		glGenBuffers(1, &m_RendererID);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_RendererID);
+		glState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_RendererID);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(unsigned int), data, GL_STATIC_DRAW);
+		gpuMemory().TrackBuffer(m_RendererID, GM_MESHES, "IndexBuffer", count * sizeof(unsigned int));
 	};
 	//dtor
 	~IndexBuffer() {
-		glDeleteBuffers(1, &m_RendererID);
+		glState().DeleteBuffers(1, &m_RendererID);
 	};
 
 	void Bind() const {
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_RendererID);
+		glState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_RendererID);
 	};
 
 	void Unbind() const {
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		glState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	};
 
 	inline unsigned int GetCount() const { return m_Count; }
+	inline unsigned int GetID() const { return m_RendererID; }
 };
\ No newline at end of file
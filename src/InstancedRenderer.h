@@ -0,0 +1,398 @@
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <unordered_map>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+#include "FrameRing.h"
+
+
+//binding points shared with the INSTANCED variants of the shaders
+const unsigned int IR_MODEL_BINDING = 0;
+const unsigned int IR_MATERIAL_BINDING = 1;
+const unsigned int IR_INSTANCE_MATERIAL_BINDING = 2;
+const unsigned int IR_INSTANCE_ID_LOCATION = 3; //per-instance attribute, divisor 1
+
+
+//std430 layout, matches MaterialData in VSSM_Scene.shader
+struct MaterialData {
+	glm::vec4 colorShininess; //rgb: color, a: shininess
+};
+
+//same layout as glMultiDrawElementsIndirect expects
+struct DrawElementsIndirectCommand {
+	unsigned int count;
+	unsigned int instanceCount;
+	unsigned int firstIndex;
+	int baseVertex;
+	unsigned int baseInstance;
+};
+
+//commands of one pass, built by InstancedRenderer::Prepare (any thread), drawn by Draw (GL thread)
+struct InstancedDrawList {
+	std::vector<unsigned int> MeshOffsets;
+	std::vector<unsigned int> InstanceIDs; //grouped by mesh, the per-instance attribute
+	std::vector<DrawElementsIndirectCommand> Commands;
+};
+
+
+/*
+ * Draws many objects with one glMultiDrawElementsIndirect per pass:
+ *  - all meshes share one interleaved vertex buffer (position, normal, texcoord) and one index buffer,
+ *  - instance transforms and material indices live in SSBOs (uploaded straight from the Scene arrays),
+ *  - each pass passes the list of instances it wants drawn; the list is grouped by mesh and fed to
+ *    the shader through a per-instance attribute so baseInstance selects the group (GL 4.3, no
+ *    need for gl_BaseInstance / ARB_shader_draw_parameters).
+ */
+class InstancedRenderer {
+private:
+	struct MeshRange {
+		unsigned int firstIndex;
+		unsigned int indexCount;
+		int baseVertex;
+	};
+
+	std::vector<float> m_Vertices; //interleaved, 8 floats per vertex
+	std::vector<unsigned int> m_Indices;
+	std::vector<MeshRange> m_Meshes;
+	std::vector<MaterialData> m_Materials;
+	std::vector<unsigned int> m_InstanceMesh; //mesh of every instance
+
+	unsigned int m_VAO;
+	unsigned int m_VertexBuffer;
+	unsigned int m_IndexBuffer;
+	unsigned int m_ModelBuffer;
+	unsigned int m_InstanceMaterialBuffer;
+	unsigned int m_MaterialBuffer;
+	unsigned int m_InstanceIDBuffer;
+	unsigned int m_IndirectBuffer;
+
+	size_t m_InstanceCount;
+	bool m_MaterialsDirty;
+	//vertices / indices in the GPU buffers, streamed meshes included
+	unsigned int m_GPUVertices;
+	unsigned int m_GPUIndices;
+
+	//list of Draw(visible, count)
+	InstancedDrawList m_Scratch;
+	//per frame data in the frames in flight ring, orphaned buffers without it
+	FrameRingBuffer* m_Ring;
+	FrameAllocation m_ModelSlice;
+	FrameAllocation m_InstanceMaterialSlice;
+
+public:
+	//stats of the last Draw()
+	unsigned int LastDrawCalls;
+	unsigned int LastCommands;
+	unsigned int LastInstances;
+
+public:
+	//ctor
+	InstancedRenderer()
+		: m_VAO(0), m_VertexBuffer(0), m_IndexBuffer(0), m_ModelBuffer(0), m_InstanceMaterialBuffer(0), m_MaterialBuffer(0),
+		m_InstanceIDBuffer(0), m_IndirectBuffer(0), m_InstanceCount(0), m_MaterialsDirty(true), m_GPUVertices(0), m_GPUIndices(0),
+		m_Ring(nullptr), m_ModelSlice{ 0, 0, 0 }, m_InstanceMaterialSlice{ 0, 0, 0 }, LastDrawCalls(0), LastCommands(0), LastInstances(0) {};
+	//dtor
+	~InstancedRenderer() {
+		unsigned int buffers[] = { m_VertexBuffer, m_IndexBuffer, m_ModelBuffer, m_InstanceMaterialBuffer, m_MaterialBuffer, m_InstanceIDBuffer, m_IndirectBuffer };
+		glState().DeleteBuffers(7, buffers);
+		glState().DeleteVertexArrays(1, &m_VAO);
+	};
+
+	/*-------mesh registration (before Upload)-------*/
+
+	//interleaved position(3) normal(3) texcoord(2), indexed
+	unsigned int AddMesh(const float* vertices, unsigned int numVertices, const unsigned int* indices, unsigned int numIndices) {
+		MeshRange range;
+		range.firstIndex = (unsigned int)m_Indices.size();
+		range.indexCount = numIndices;
+		range.baseVertex = (int)(m_Vertices.size() / 8);
+		m_Vertices.insert(m_Vertices.end(), vertices, vertices + numVertices * 8);
+		m_Indices.insert(m_Indices.end(), indices, indices + numIndices);
+		m_Meshes.push_back(range);
+		return (unsigned int)m_Meshes.size() - 1;
+	}
+
+	//triangle soup as produced by loadOBJData, identical vertices are merged
+	unsigned int AddMesh(const std::vector<glm::vec3>& positions,
+						 const std::vector<glm::vec2>& uvs,
+						 const std::vector<glm::vec3>& normals) {
+		std::vector<float> vertices;
+		std::vector<unsigned int> indices;
+		Interleave(positions, uvs, normals, vertices, indices);
+		return AddMesh(vertices.data(), (unsigned int)(vertices.size() / 8), indices.data(), (unsigned int)indices.size());
+	}
+
+	//mesh streamed in after Upload(): no geometry until ReserveMesh(), its instances must not be drawn before it is resident
+	unsigned int AddStreamedMesh() {
+		m_Meshes.push_back({ 0, 0, 0 });
+		return (unsigned int)m_Meshes.size() - 1;
+	}
+
+	//triangle soup -> interleaved, indexed vertices (AddMesh layout), thread safe: loader threads call it
+	static void Interleave(const std::vector<glm::vec3>& positions,
+						   const std::vector<glm::vec2>& uvs,
+						   const std::vector<glm::vec3>& normals,
+						   std::vector<float>& vertices,
+						   std::vector<unsigned int>& indices) {
+		struct Vertex {
+			float v[8];
+			bool operator==(const Vertex& o) const { return std::memcmp(v, o.v, sizeof(v)) == 0; }
+		};
+		struct VertexHash {
+			size_t operator()(const Vertex& vert) const {
+				size_t h = 2166136261u;
+				const unsigned char* bytes = (const unsigned char*)vert.v;
+				for (size_t i = 0; i < sizeof(vert.v); ++i)
+					h = (h ^ bytes[i]) * 16777619u;
+				return h;
+			}
+		};
+
+		std::unordered_map<Vertex, unsigned int, VertexHash> unique;
+		vertices.clear();
+		indices.clear();
+		indices.reserve(positions.size());
+		for (size_t i = 0; i < positions.size(); ++i) {
+			Vertex vert = { { positions[i].x, positions[i].y, positions[i].z,
+							  normals[i].x, normals[i].y, normals[i].z,
+							  uvs[i].x, uvs[i].y } };
+			auto it = unique.find(vert);
+			if (it == unique.end()) {
+				it = unique.emplace(vert, (unsigned int)(vertices.size() / 8)).first;
+				vertices.insert(vertices.end(), vert.v, vert.v + 8);
+			}
+			indices.push_back(it->second);
+		}
+	}
+
+	unsigned int AddMaterial(const glm::vec3& color, float shininess) {
+		m_Materials.push_back({ glm::vec4(color, shininess) });
+		m_MaterialsDirty = true;
+		return (unsigned int)m_Materials.size() - 1;
+	}
+
+	void SetMaterial(unsigned int material, const glm::vec3& color, float shininess) {
+		glm::vec4 value(color, shininess);
+		if (m_Materials[material].colorShininess != value) {
+			m_Materials[material].colorShininess = value;
+			m_MaterialsDirty = true;
+		}
+	}
+
+	//create the shared buffers and the VAO, call once after all AddMesh()
+	void Upload() {
+		glGenVertexArrays(1, &m_VAO);
+		glGenBuffers(1, &m_VertexBuffer);
+		glGenBuffers(1, &m_IndexBuffer);
+		glGenBuffers(1, &m_ModelBuffer);
+		glGenBuffers(1, &m_InstanceMaterialBuffer);
+		glGenBuffers(1, &m_MaterialBuffer);
+		glGenBuffers(1, &m_InstanceIDBuffer);
+		glGenBuffers(1, &m_IndirectBuffer);
+
+		glState().BindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, m_Vertices.size() * sizeof(float), m_Vertices.data(), GL_STATIC_DRAW);
+		gpuMemory().TrackBuffer(m_VertexBuffer, GM_MESHES, "InstancedRenderer vertices", m_Vertices.size() * sizeof(float));
+		glState().BindBuffer(GL_ARRAY_BUFFER, m_IndexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, m_Indices.size() * sizeof(unsigned int), m_Indices.data(), GL_STATIC_DRAW);
+		gpuMemory().TrackBuffer(m_IndexBuffer, GM_MESHES, "InstancedRenderer indices", m_Indices.size() * sizeof(unsigned int));
+		m_GPUVertices = (unsigned int)(m_Vertices.size() / 8);
+		m_GPUIndices = (unsigned int)m_Indices.size();
+
+		glState().BindVertexArray(m_VAO);
+		glState().BindBuffer(GL_ARRAY_BUFFER, m_InstanceIDBuffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(unsigned int), nullptr, GL_STREAM_DRAW);
+		gpuMemory().TrackBuffer(m_InstanceIDBuffer, GM_PER_FRAME, "InstancedRenderer instance ids", sizeof(unsigned int));
+		glEnableVertexAttribArray(IR_INSTANCE_ID_LOCATION);
+		glVertexAttribIPointer(IR_INSTANCE_ID_LOCATION, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (const void*)0);
+		glVertexAttribDivisor(IR_INSTANCE_ID_LOCATION, 1);
+		bindGeometry();
+	}
+
+	/*
+	 * Room for a streamed mesh (AddStreamedMesh) after Upload(): the shared buffers grow, their content is
+	 * copied over on the GPU. Returns the byte offsets its interleaved vertices and indices are to be copied to
+	 * (MeshStreamer, glCopyBufferSubData orders these copies after the growth)
+	 */
+	void ReserveMesh(unsigned int mesh, unsigned int numVertices, unsigned int numIndices, size_t& vertexOffset, size_t& indexOffset) {
+		vertexOffset = size_t(m_GPUVertices) * 8 * sizeof(float);
+		indexOffset = size_t(m_GPUIndices) * sizeof(unsigned int);
+		m_VertexBuffer = growBuffer(m_VertexBuffer, "InstancedRenderer vertices", vertexOffset, vertexOffset + size_t(numVertices) * 8 * sizeof(float));
+		m_IndexBuffer = growBuffer(m_IndexBuffer, "InstancedRenderer indices", indexOffset, indexOffset + size_t(numIndices) * sizeof(unsigned int));
+		m_Meshes[mesh] = { m_GPUIndices, numIndices, (int)m_GPUVertices };
+		m_GPUVertices += numVertices;
+		m_GPUIndices += numIndices;
+		bindGeometry();
+	}
+
+	unsigned int GetVertexBuffer() const {
+		return m_VertexBuffer;
+	}
+	unsigned int GetIndexBuffer() const {
+		return m_IndexBuffer;
+	}
+
+	/*-------per frame-------*/
+
+	//transforms, instance ids and commands go to the ring's slice of the frame (nullptr: buffers orphaned every frame)
+	void SetFrameRing(FrameRingBuffer* ring) {
+		m_Ring = ring;
+	}
+
+	//all instances of the frame, index in these arrays is the instance id used by Draw()
+	void SetInstances(const glm::mat4* models, const unsigned int* materials, const unsigned int* meshes, size_t count) {
+		m_InstanceCount = count;
+		m_InstanceMesh.assign(meshes, meshes + count);
+		if (m_Ring) {
+			m_ModelSlice = m_Ring->Write(models, count * sizeof(glm::mat4));
+			m_InstanceMaterialSlice = m_Ring->Write(materials, count * sizeof(unsigned int));
+			return;
+		}
+		m_ModelSlice = { m_ModelBuffer, 0, count * sizeof(glm::mat4) };
+		m_InstanceMaterialSlice = { m_InstanceMaterialBuffer, 0, count * sizeof(unsigned int) };
+		//orphan, the previous frame may still read the old storage
+		glState().BindBuffer(GL_SHADER_STORAGE_BUFFER, m_ModelBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(glm::mat4), models, GL_STREAM_DRAW);
+		gpuMemory().TrackBuffer(m_ModelBuffer, GM_PER_FRAME, "InstancedRenderer transforms", count * sizeof(glm::mat4));
+		glState().BindBuffer(GL_SHADER_STORAGE_BUFFER, m_InstanceMaterialBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(unsigned int), materials, GL_STREAM_DRAW);
+		gpuMemory().TrackBuffer(m_InstanceMaterialBuffer, GM_PER_FRAME, "InstancedRenderer instance materials", count * sizeof(unsigned int));
+		glState().BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	size_t GetInstanceCount() const {
+		return m_InstanceCount;
+	}
+
+	unsigned int GetMeshCount() const {
+		return (unsigned int)m_Meshes.size();
+	}
+
+	//draw the listed instances (nullptr: all of them) with the bound program
+	void Draw(const unsigned int* visible, size_t visibleCount) {
+		Prepare(visible, visible ? visibleCount : m_InstanceCount, m_InstanceMesh.data(), m_Scratch);
+		Draw(m_Scratch);
+	}
+
+	//group the listed instances (nullptr: the first count) by mesh into commands. meshes: mesh of every
+	//instance, the array SetInstances() will get, so lists can be built on other threads before it is called.
+	//Touches no GL state; the mesh ranges must not change meanwhile (ReserveMesh)
+	void Prepare(const unsigned int* visible, size_t count, const unsigned int* meshes, InstancedDrawList& list) const {
+		list.Commands.clear();
+		list.InstanceIDs.resize(count);
+		if (count == 0)
+			return;
+
+		//counting sort
+		size_t meshCount = m_Meshes.size();
+		list.MeshOffsets.assign(meshCount + 1, 0);
+		for (size_t i = 0; i < count; ++i)
+			list.MeshOffsets[meshes[visible ? visible[i] : i] + 1]++;
+		for (size_t m = 0; m < meshCount; ++m)
+			list.MeshOffsets[m + 1] += list.MeshOffsets[m];
+
+		for (size_t m = 0; m < meshCount; ++m) {
+			unsigned int instanceCount = list.MeshOffsets[m + 1] - list.MeshOffsets[m];
+			if (instanceCount == 0)
+				continue;
+			const MeshRange& range = m_Meshes[m];
+			list.Commands.push_back({ range.indexCount, instanceCount, range.firstIndex, range.baseVertex, list.MeshOffsets[m] });
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			unsigned int id = visible ? visible[i] : (unsigned int)i;
+			list.InstanceIDs[list.MeshOffsets[meshes[id]]++] = id;
+		}
+	}
+
+	//draw a prepared list with the bound program
+	void Draw(const InstancedDrawList& list) {
+		size_t count = list.InstanceIDs.size();
+		LastDrawCalls = 0;
+		LastCommands = 0;
+		LastInstances = (unsigned int)count;
+		if (count == 0)
+			return;
+
+		if (m_MaterialsDirty) {
+			glState().BindBuffer(GL_SHADER_STORAGE_BUFFER, m_MaterialBuffer);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, m_Materials.size() * sizeof(MaterialData), m_Materials.data(), GL_DYNAMIC_DRAW);
+			gpuMemory().TrackBuffer(m_MaterialBuffer, GM_PER_FRAME, "InstancedRenderer materials", m_Materials.size() * sizeof(MaterialData));
+			glState().BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			m_MaterialsDirty = false;
+		}
+
+		size_t idBytes = count * sizeof(unsigned int);
+		size_t commandBytes = list.Commands.size() * sizeof(DrawElementsIndirectCommand);
+		FrameAllocation ids = { m_InstanceIDBuffer, 0, idBytes };
+		FrameAllocation commands = { m_IndirectBuffer, 0, commandBytes };
+		if (m_Ring) {
+			ids = m_Ring->Write(list.InstanceIDs.data(), idBytes);
+			commands = m_Ring->Write(list.Commands.data(), commandBytes);
+		}
+		else {
+			glState().BindBuffer(GL_ARRAY_BUFFER, m_InstanceIDBuffer);
+			glBufferData(GL_ARRAY_BUFFER, idBytes, list.InstanceIDs.data(), GL_STREAM_DRAW);
+			gpuMemory().TrackBuffer(m_InstanceIDBuffer, GM_PER_FRAME, "InstancedRenderer instance ids", idBytes);
+			glState().BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_IndirectBuffer);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, commandBytes, list.Commands.data(), GL_STREAM_DRAW);
+			gpuMemory().TrackBuffer(m_IndirectBuffer, GM_PER_FRAME, "InstancedRenderer commands", commandBytes);
+		}
+
+		glState().BindBufferRange(GL_SHADER_STORAGE_BUFFER, IR_MODEL_BINDING, m_ModelSlice.Buffer, m_ModelSlice.Offset, m_ModelSlice.Bytes);
+		glState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, IR_MATERIAL_BINDING, m_MaterialBuffer);
+		glState().BindBufferRange(GL_SHADER_STORAGE_BUFFER, IR_INSTANCE_MATERIAL_BINDING, m_InstanceMaterialSlice.Buffer, m_InstanceMaterialSlice.Offset, m_InstanceMaterialSlice.Bytes);
+		glState().BindVertexArray(m_VAO);
+		//the instance id attribute points at this draw's ids
+		glState().BindBuffer(GL_ARRAY_BUFFER, ids.Buffer);
+		glVertexAttribIPointer(IR_INSTANCE_ID_LOCATION, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (const void*)ids.Offset);
+		glState().BindBuffer(GL_ARRAY_BUFFER, 0);
+		glState().BindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.Buffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)commands.Offset, (GLsizei)list.Commands.size(), 0);
+		glState().BindVertexArray(0);
+		glState().BindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+		LastDrawCalls = 1;
+		LastCommands = (unsigned int)list.Commands.size();
+	}
+
+private:
+	//vertex attributes and index buffer of the VAO, after Upload() and every growth
+	void bindGeometry() {
+		glState().BindVertexArray(m_VAO);
+		glState().BindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+		const int stride = 8 * sizeof(float);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (const void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (const void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (const void*)(6 * sizeof(float)));
+		glState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
+		glState().BindVertexArray(0);
+		glState().BindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	//new storage of `size` bytes holding the first `used` bytes of buffer, which is deleted
+	static unsigned int growBuffer(unsigned int buffer, const char* owner, size_t used, size_t size) {
+		unsigned int grown;
+		glGenBuffers(1, &grown);
+		glState().BindBuffer(GL_COPY_WRITE_BUFFER, grown);
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW);
+		gpuMemory().TrackBuffer(grown, GM_MESHES, owner, size);
+		if (used > 0) {
+			glState().BindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+			glState().BindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+		glState().BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glState().DeleteBuffers(1, &buffer);
+		return grown;
+	}
+};
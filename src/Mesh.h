@@ -5,6 +5,9 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include "GLState.h"
+#include "GPUMemory.h"
+
 
 struct Mesh
 {
@@ -25,16 +28,41 @@ struct Mesh
 
 		numVertices = vertices.size();
 		glGenBuffers(1, &positionBuffer);
-		glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+		glState().BindBuffer(GL_ARRAY_BUFFER, positionBuffer);
 		glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
+		gpuMemory().TrackBuffer(positionBuffer, GM_MESHES, "Mesh positions", numVertices * sizeof(glm::vec3));
 
 		glGenBuffers(1, &texcoordsBuffer);
-		glBindBuffer(GL_ARRAY_BUFFER, texcoordsBuffer);
+		glState().BindBuffer(GL_ARRAY_BUFFER, texcoordsBuffer);
 		glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
+		gpuMemory().TrackBuffer(texcoordsBuffer, GM_MESHES, "Mesh texcoords", uvs.size() * sizeof(glm::vec2));
 
 		glGenBuffers(1, &normalBuffer);
-		glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+		glState().BindBuffer(GL_ARRAY_BUFFER, normalBuffer);
 		glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
+		gpuMemory().TrackBuffer(normalBuffer, GM_MESHES, "Mesh normals", normals.size() * sizeof(glm::vec3));
+
+	}
+
+	//storage only, filled later by copies (MeshStreamer)
+	explicit Mesh(size_t vertexCount) : hasIndexBuffer(false), numVertices(vertexCount), numIndices(0)
+	{
+		glGenVertexArrays(1, &vao);
+
+		glGenBuffers(1, &positionBuffer);
+		glState().BindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+		glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(glm::vec3), nullptr, GL_STATIC_DRAW);
+		gpuMemory().TrackBuffer(positionBuffer, GM_MESHES, "Mesh positions", numVertices * sizeof(glm::vec3));
+
+		glGenBuffers(1, &texcoordsBuffer);
+		glState().BindBuffer(GL_ARRAY_BUFFER, texcoordsBuffer);
+		glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(glm::vec2), nullptr, GL_STATIC_DRAW);
+		gpuMemory().TrackBuffer(texcoordsBuffer, GM_MESHES, "Mesh texcoords", numVertices * sizeof(glm::vec2));
+
+		glGenBuffers(1, &normalBuffer);
+		glState().BindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+		glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(glm::vec3), nullptr, GL_STATIC_DRAW);
+		gpuMemory().TrackBuffer(normalBuffer, GM_MESHES, "Mesh normals", numVertices * sizeof(glm::vec3));
 
 	}
 
@@ -47,33 +75,34 @@ struct Mesh
 
 		numIndices = indices.size();
 		glGenBuffers(1, &indexBuffer);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		glState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(unsigned), &indices[0], GL_STATIC_DRAW);
+		gpuMemory().TrackBuffer(indexBuffer, GM_MESHES, "Mesh indices", numIndices * sizeof(unsigned));
 
 	}
 
 	virtual ~Mesh()
 	{
-		glDeleteBuffers(1, &positionBuffer);
-		glDeleteBuffers(1, &texcoordsBuffer);
-		glDeleteBuffers(1, &normalBuffer);
+		glState().DeleteBuffers(1, &positionBuffer);
+		glState().DeleteBuffers(1, &texcoordsBuffer);
+		glState().DeleteBuffers(1, &normalBuffer);
 
 		if (hasIndexBuffer)
-			glDeleteBuffers(1, &indexBuffer);
+			glState().DeleteBuffers(1, &indexBuffer);
 
-		glDeleteVertexArrays(1, &vao);
+		glState().DeleteVertexArrays(1, &vao);
 	}
 
 
 	void setup(GLuint program)
 	{
-		glBindVertexArray(vao);
+		glState().BindVertexArray(vao);
 
 		// Specify the layout of the vertex data
 		GLint positionAttribute = glGetAttribLocation(program, "aPosition");
 		if (positionAttribute != -1)
 		{
-			glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+			glState().BindBuffer(GL_ARRAY_BUFFER, positionBuffer);
 			glEnableVertexAttribArray(positionAttribute);
 			glVertexAttribPointer(positionAttribute, 3, GL_FLOAT, GL_FALSE, 0, 0);
 		}
@@ -81,7 +110,7 @@ struct Mesh
 		GLint texcoordsAttribute = glGetAttribLocation(program, "aTexCoord");
 		if (texcoordsAttribute != -1)
 		{
-			glBindBuffer(GL_ARRAY_BUFFER, texcoordsBuffer);
+			glState().BindBuffer(GL_ARRAY_BUFFER, texcoordsBuffer);
 			glEnableVertexAttribArray(texcoordsAttribute);
 			glVertexAttribPointer(texcoordsAttribute, 2, GL_FLOAT, GL_FALSE, 0, 0);
 		}
@@ -89,20 +118,20 @@ struct Mesh
 		GLint normalAttribute = glGetAttribLocation(program, "aNormal");
 		if (normalAttribute != -1)
 		{
-			glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+			glState().BindBuffer(GL_ARRAY_BUFFER, normalBuffer);
 			glEnableVertexAttribArray(normalAttribute);
 			glVertexAttribPointer(normalAttribute, 3, GL_FLOAT, GL_FALSE, 0, 0);
 		}
 
 		if (hasIndexBuffer)
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+			glState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
 
 	}
 
 
 	void draw() const
 	{
-		glBindVertexArray(vao);
+		glState().BindVertexArray(vao);
 		if (hasIndexBuffer)
 			glDrawElements(GL_TRIANGLES, (GLsizei)numIndices, GL_UNSIGNED_INT, 0);
 		else
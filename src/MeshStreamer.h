@@ -0,0 +1,375 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+#include "Bounds.h"
+
+//default mesh streaming settings:
+const size_t MS_RING_SIZE = 16 << 20; //staging ring, bytes
+const size_t MS_UPLOAD_BUDGET = 4 << 20; //bytes copied to the GPU per frame
+const int MS_LOADER_THREADS = 2;
+
+enum StreamState {
+	STREAM_QUEUED = 0,
+	STREAM_LOADING, //loader thread
+	STREAM_PARSED, //waiting for its turn on the staging ring
+	STREAM_UPLOADING,
+	STREAM_FENCED, //every copy issued, waiting for the GPU
+	STREAM_RESIDENT,
+	STREAM_FAILED,
+	STREAM_EVICTED //GPU copy freed by the caller, the parsed data kept for Restore()
+};
+const char* const STREAM_STATE_NAMES[] = { "queued", "loading", "parsed", "uploading", "fenced", "resident", "failed", "evicted" };
+
+//CPU side of a streamed mesh, filled by a loader thread
+struct StreamedMeshData {
+	//triangle soup, as loadOBJData gives it
+	std::vector<glm::vec3> Positions;
+	std::vector<glm::vec2> UVs;
+	std::vector<glm::vec3> Normals;
+	//deduplicated, InstancedRenderer layout (optional)
+	std::vector<float> Interleaved;
+	std::vector<unsigned int> Indices;
+	AABB Bounds;
+};
+
+//one copy from the loaded data to a GPU buffer
+struct StreamUpload {
+	unsigned int Buffer;
+	size_t Offset;
+	const void* Data;
+	size_t Bytes;
+};
+
+typedef std::function<bool(StreamedMeshData&)> StreamLoadFn; //loader thread
+typedef std::function<std::vector<StreamUpload>(const StreamedMeshData&)> StreamAllocateFn; //render thread
+typedef std::function<void(const StreamedMeshData&)> StreamResidentFn; //render thread
+
+struct StreamRequest {
+	std::string Name;
+	std::atomic<int> State; //StreamState
+	StreamedMeshData Data;
+	StreamLoadFn Load;
+	StreamAllocateFn Allocate;
+	StreamResidentFn Resident;
+	std::vector<StreamUpload> Uploads;
+	size_t Next; //upload in progress
+	size_t Done; //bytes of it already copied
+	GLsync Fence;
+	//stats
+	std::chrono::high_resolution_clock::time_point Requested;
+	std::chrono::high_resolution_clock::time_point FirstCopy;
+	double ParseMs; //on the loader thread
+	double UploadMs; //first copy -> fence signaled
+	double ResidentMs; //Request() -> resident
+	size_t Bytes;
+	int Frames; //frames with copies of this mesh
+	unsigned int LastFrame;
+
+	//ctor
+	StreamRequest(const std::string& name, const StreamLoadFn& load)
+		: Name(name), State(STREAM_QUEUED), Load(load), Next(0), Done(0), Fence(nullptr),
+		Requested(std::chrono::high_resolution_clock::now()), ParseMs(0.0), UploadMs(0.0), ResidentMs(0.0),
+		Bytes(0), Frames(0), LastFrame(0) {};
+};
+
+
+/*
+ * Streams meshes in without blocking the render thread:
+ *  - Request(): a loader thread parses the mesh (or anything slow: decompression, vertex deduplication),
+ *  - SetUpload(): once parsed, `allocate` creates the GPU buffers on the render thread and lists the copies,
+ *  - Update(), once per frame: the data goes through a staging ring (persistently mapped when the
+ *    context has buffer storage, mapped unsynchronized otherwise) and glCopyBufferSubData to its buffers,
+ *    at most UploadBudget bytes per frame, one mesh after the other,
+ *  - a fence after the last copy of a mesh: `resident` is called on the render thread once it signals,
+ *  - Evict() / Restore(): under memory pressure the caller frees a resident mesh's buffers and evicts
+ *    it, Restore() streams it again from the data kept on the CPU: `allocate` is called again.
+ * The ring is reused behind per-frame fences, a full ring waits for the next frame rather than stalling.
+ */
+class MeshStreamer {
+private:
+	std::vector<std::unique_ptr<StreamRequest>> m_Requests;
+	std::deque<StreamRequest*> m_Queue; //not loaded yet
+	std::vector<std::thread> m_Loaders;
+	std::mutex m_Mutex;
+	std::condition_variable m_WakeUp;
+	bool m_Quit;
+
+	//staging ring
+	unsigned int m_Ring;
+	unsigned char* m_Mapped; //persistent mapping, nullptr when mapped per copy
+	size_t m_Head; //next byte written
+	size_t m_Used; //bytes still read by copies in flight
+	struct Frame {
+		GLsync Fence;
+		size_t Bytes;
+	};
+	std::deque<Frame> m_InFlight;
+	StreamRequest* m_Active; //mesh being copied
+	unsigned int m_Frame;
+
+public:
+	size_t UploadBudget;
+	//stats
+	size_t TotalBytes;
+	size_t LastFrameBytes;
+	double LastUpdateMs; //CPU time of the last Update()
+	int LastRingWaits; //1 when the ring was full this frame
+
+	//ctor, persistent: the context has buffer storage (GLCapabilities::BufferStorage)
+	explicit MeshStreamer(bool persistent, int loaders = MS_LOADER_THREADS)
+		: m_Quit(false), m_Ring(0), m_Mapped(nullptr), m_Head(0), m_Used(0), m_Active(nullptr), m_Frame(0),
+		UploadBudget(MS_UPLOAD_BUDGET), TotalBytes(0), LastFrameBytes(0), LastUpdateMs(0.0), LastRingWaits(0) {
+		glGenBuffers(1, &m_Ring);
+		glState().BindBuffer(GL_COPY_READ_BUFFER, m_Ring);
+		if (persistent) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_COPY_READ_BUFFER, MS_RING_SIZE, nullptr, flags);
+			gpuMemory().TrackBuffer(m_Ring, GM_STREAMING, "MeshStreamer ring", MS_RING_SIZE);
+			m_Mapped = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, MS_RING_SIZE, flags);
+		}
+		else {
+			glBufferData(GL_COPY_READ_BUFFER, MS_RING_SIZE, nullptr, GL_STREAM_COPY);
+			gpuMemory().TrackBuffer(m_Ring, GM_STREAMING, "MeshStreamer ring", MS_RING_SIZE);
+		}
+		glState().BindBuffer(GL_COPY_READ_BUFFER, 0);
+		for (int i = 0; i < std::max(loaders, 1); ++i)
+			m_Loaders.emplace_back([this]() { LoaderLoop(); });
+	};
+	//dtor
+	~MeshStreamer() {
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Quit = true;
+		}
+		m_WakeUp.notify_all();
+		for (auto& t : m_Loaders)
+			t.join();
+		for (Frame& frame : m_InFlight)
+			glDeleteSync(frame.Fence);
+		for (auto& request : m_Requests)
+			if (request->Fence)
+				glDeleteSync(request->Fence);
+		if (m_Mapped) {
+			glState().BindBuffer(GL_COPY_READ_BUFFER, m_Ring);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+			glState().BindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+		glState().DeleteBuffers(1, &m_Ring);
+	};
+
+	bool IsPersistent() const {
+		return m_Mapped != nullptr;
+	}
+	size_t GetRingUsed() const {
+		return m_Used;
+	}
+	const std::vector<std::unique_ptr<StreamRequest>>& GetRequests() const {
+		return m_Requests;
+	}
+	StreamState GetState(unsigned int id) const {
+		return StreamState(m_Requests[id]->State.load());
+	}
+	//meshes not resident (or failed) yet
+	int GetPending() const {
+		int pending = 0;
+		for (const auto& request : m_Requests)
+			pending += request->State < STREAM_RESIDENT ? 1 : 0;
+		return pending;
+	}
+
+	//render thread, the load starts right away on a loader thread
+	unsigned int Request(const std::string& name, const StreamLoadFn& load) {
+		std::unique_ptr<StreamRequest> request(new StreamRequest(name, load));
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Queue.push_back(request.get());
+		}
+		m_Requests.push_back(std::move(request));
+		m_WakeUp.notify_one();
+		return (unsigned int)m_Requests.size() - 1;
+	}
+
+	//render thread: what to do with the mesh once parsed. The upload does not start before this is set
+	void SetUpload(unsigned int id, const StreamAllocateFn& allocate, const StreamResidentFn& resident) {
+		m_Requests[id]->Allocate = allocate;
+		m_Requests[id]->Resident = resident;
+	}
+
+	//render thread, after the caller freed the buffers of a resident mesh. false when it is not resident
+	bool Evict(unsigned int id) {
+		StreamRequest& request = *m_Requests[id];
+		if (request.State != STREAM_RESIDENT)
+			return false;
+		request.State = STREAM_EVICTED;
+		return true;
+	}
+	//render thread: an evicted mesh is uploaded again, from the next Update()
+	void Restore(unsigned int id) {
+		StreamRequest& request = *m_Requests[id];
+		if (request.State != STREAM_EVICTED)
+			return;
+		request.Uploads.clear();
+		request.Next = 0;
+		request.Done = 0;
+		request.Bytes = 0;
+		request.Frames = 0;
+		request.Requested = std::chrono::high_resolution_clock::now();
+		request.State = STREAM_PARSED;
+	}
+
+	//render thread, once per frame: retires the signaled fences, then copies up to UploadBudget bytes
+	void Update() {
+		auto start = std::chrono::high_resolution_clock::now();
+		while (!m_InFlight.empty() && signaled(m_InFlight.front().Fence)) {
+			glDeleteSync(m_InFlight.front().Fence);
+			m_Used -= m_InFlight.front().Bytes;
+			m_InFlight.pop_front();
+		}
+		for (auto& request : m_Requests) {
+			if (request->State != STREAM_FENCED || !signaled(request->Fence))
+				continue;
+			glDeleteSync(request->Fence);
+			request->Fence = nullptr;
+			auto now = std::chrono::high_resolution_clock::now();
+			request->UploadMs = std::chrono::duration<double, std::milli>(now - request->FirstCopy).count();
+			request->ResidentMs = std::chrono::duration<double, std::milli>(now - request->Requested).count();
+			request->State = STREAM_RESIDENT;
+			if (request->Resident)
+				request->Resident(request->Data);
+		}
+
+		size_t budget = UploadBudget, copied = 0;
+		LastRingWaits = 0;
+		m_Frame++;
+		while (budget > 0) {
+			if (!m_Active && !(m_Active = nextParsed()))
+				break;
+			StreamRequest& request = *m_Active;
+			if (request.Next == request.Uploads.size()) {
+				//every copy issued: the mesh is resident once the GPU is past them
+				request.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+				request.State = STREAM_FENCED;
+				request.Data.Interleaved.clear(); //the soup stays: the caller may keep it for the CPU passes
+				request.Data.Interleaved.shrink_to_fit();
+				m_Active = nullptr;
+				continue;
+			}
+			const StreamUpload& upload = request.Uploads[request.Next];
+			if (upload.Bytes == 0) {
+				request.Next++;
+				continue;
+			}
+			size_t bytes = std::min(std::min(upload.Bytes - request.Done, budget), contiguousFree());
+			if (bytes == 0) {
+				LastRingWaits = 1;
+				break;
+			}
+			if (request.LastFrame != m_Frame) {
+				if (request.Frames == 0)
+					request.FirstCopy = std::chrono::high_resolution_clock::now();
+				request.Frames++;
+				request.LastFrame = m_Frame;
+			}
+			stage(upload, request.Done, bytes);
+			request.Done += bytes;
+			request.Bytes += bytes;
+			budget -= bytes;
+			copied += bytes;
+			if (request.Done == upload.Bytes) {
+				request.Next++;
+				request.Done = 0;
+			}
+		}
+		if (copied > 0) {
+			m_InFlight.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), copied });
+			glState().BindBuffer(GL_COPY_READ_BUFFER, 0);
+			glState().BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		TotalBytes += copied;
+		LastFrameBytes = copied;
+		LastUpdateMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+private:
+	void LoaderLoop() {
+		while (true) {
+			StreamRequest* request;
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_WakeUp.wait(lock, [this]() { return m_Quit || !m_Queue.empty(); });
+				if (m_Quit)
+					return;
+				request = m_Queue.front();
+				m_Queue.pop_front();
+			}
+			request->State = STREAM_LOADING;
+			auto start = std::chrono::high_resolution_clock::now();
+			bool loaded = request->Load(request->Data);
+			request->ParseMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			request->State = loaded ? STREAM_PARSED : STREAM_FAILED;
+		}
+	}
+
+	//first parsed mesh with an upload set, its buffers are created now
+	StreamRequest* nextParsed() {
+		for (auto& request : m_Requests) {
+			if (request->State != STREAM_PARSED || !request->Allocate)
+				continue;
+			request->Uploads = request->Allocate(request->Data);
+			request->State = STREAM_UPLOADING;
+			return request.get();
+		}
+		return nullptr;
+	}
+
+	static bool signaled(GLsync fence) {
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+	}
+
+	//bytes writable at m_Head without wrapping over copies in flight
+	size_t contiguousFree() {
+		if (m_Head == MS_RING_SIZE)
+			m_Head = 0;
+		if (m_Used == MS_RING_SIZE)
+			return 0;
+		size_t tail = (m_Head + MS_RING_SIZE - m_Used) % MS_RING_SIZE;
+		return tail > m_Head ? tail - m_Head : MS_RING_SIZE - m_Head;
+	}
+
+	//ring[m_Head, +bytes) <- upload.Data[offset, +bytes), then the copy to the mesh's buffer
+	void stage(const StreamUpload& upload, size_t offset, size_t bytes) {
+		const unsigned char* source = (const unsigned char*)upload.Data + offset;
+		glState().BindBuffer(GL_COPY_READ_BUFFER, m_Ring);
+		if (m_Mapped) {
+			std::memcpy(m_Mapped + m_Head, source, bytes);
+		}
+		else {
+			//the range is not read by any copy in flight (fences), no need to synchronize
+			void* range = glMapBufferRange(GL_COPY_READ_BUFFER, m_Head, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			std::memcpy(range, source, bytes);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+		}
+		glState().BindBuffer(GL_COPY_WRITE_BUFFER, upload.Buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, m_Head, upload.Offset + offset, bytes);
+		m_Head += bytes;
+		m_Used += bytes;
+	}
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+#include "Shader.h"
+#include "DepthSAT.h"
+
+//default moment blur settings:
+const unsigned int MB_TILE = 128; //matches TILE in BlurMoments.shader
+const int MB_MAX_RADIUS = 32; //matches MAX_RADIUS in BlurMoments.shader
+const int MB_RADIUS = 4;
+const unsigned int MB_TEXTURE_UNIT = 9; //u_FilteredMoments in Shadows.glsl
+
+
+/*
+ * Prefiltered moment map for plain VSM: a separable box / Gaussian blur of the depth moments
+ * (RG32F, made from the shadow map by the row pass), rows then columns, with BlurMoments.shader. One fixed filter width for the whole map,
+ * so it costs two reads and two writes of the map instead of the two scans and transposes of a SAT.
+ * With Mipmaps on, the blurred map gets a mip chain and trilinear filtering: distant receivers,
+ * whose pixels cover more shadow map texels, read a wider filter.
+ */
+class MomentBlur {
+private:
+	unsigned int m_Texture[2]; //0: rows blurred, made by the first Build(); 1: result
+	int m_Size;
+	int m_Levels;
+
+	unsigned int createTexture(int levels, const char* owner) const {
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glState().BindTexture(GL_TEXTURE_2D, texture);
+		//mutable levels, allocated like the RenderGraph transient textures
+		for (int level = 0, size = m_Size; level < levels; ++level, size = std::max(size / 2, 1))
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RG32F, size, size, 0, GL_RG, GL_FLOAT, nullptr);
+		gpuMemory().TrackTexture(texture, GM_SHADOW_TABLES, owner, GL_RG32F, m_Size, m_Size, levels);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+
+	void create(int size) {
+		m_Size = size;
+		m_Levels = 1;
+		for (int s = size; s > 1; s /= 2)
+			m_Levels++;
+		m_Texture[0] = 0;
+		m_Texture[1] = createTexture(m_Levels, "MomentBlur");
+	}
+
+public:
+	int Radius;
+	bool Gaussian;
+	bool Mipmaps;
+
+	//ctor, size: shadow map size
+	explicit MomentBlur(int size)
+		: m_Texture{ 0, 0 }, m_Size(0), m_Levels(0), Radius(MB_RADIUS), Gaussian(true), Mipmaps(false) {
+		create(size);
+	};
+	//dtor
+	~MomentBlur() {
+		glState().DeleteTextures(m_Texture[0] ? 2 : 1, m_Texture[0] ? m_Texture : m_Texture + 1);
+	};
+
+	//new shadow map size, the moments are blurred again by the next Build
+	void Resize(int size) {
+		if (size == m_Size)
+			return;
+		glState().DeleteTextures(m_Texture[0] ? 2 : 1, m_Texture[0] ? m_Texture : m_Texture + 1);
+		create(size);
+	}
+
+	//gtor
+	unsigned int GetTexture() const {
+		return m_Texture[1];
+	}
+	//bytes the two passes read (tile and apron) and write per build from a shadow map in `format`, without the mip chain
+	double GetBuildBytes(DepthFormat format) const {
+		double texels = double(m_Size) * m_Size;
+		double apron = 1.0 + 2.0 * std::min(Radius, MB_MAX_RADIUS) / MB_TILE;
+		return texels * (apron * depthTexelBytes(format) + 8.0) + texels * 8.0 * (apron + 1.0);
+	}
+
+	//bytes of the result with its mip chain
+	double GetResidentBytes() const {
+		double bytes = 0.0;
+		for (int level = 0, size = m_Size; level < m_Levels; ++level, size = std::max(size / 2, 1))
+			bytes += double(size) * size * 8.0;
+		return bytes;
+	}
+	//bytes of the row pass result, the intermediate the two passes share (RG32F, the map size)
+	double GetIntermediateBytes() const {
+		return double(m_Size) * m_Size * 8.0;
+	}
+
+	//moments of the shadow map (depth in R, any format), blurred
+	void Build(unsigned int depthMap, Shader& blurShader) {
+		if (!m_Texture[0])
+			m_Texture[0] = createTexture(1, "MomentBlur rows");
+		BlurRows(depthMap, blurShader, m_Texture[0]);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		BlurColumns(blurShader, m_Texture[0]);
+		//the lit pass samples the result, the mip chain is built from it
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+		BuildMips();
+	}
+
+	//the passes of Build, without barriers (RenderGraph places them), through the caller's row target
+	void BlurRows(unsigned int depthMap, Shader& blurShader, unsigned int rows) {
+		blurShader.Bind();
+		blurShader.SetUniform1i("u_Radius", std::min(Radius, MB_MAX_RADIUS));
+		blurShader.SetUniform1b("u_Gaussian", Gaussian);
+		blurShader.SetUniform1i("u_Depth", 0);
+		blurShader.SetUniform2i("u_Direction", 1, 0);
+		blurShader.SetUniform1b("u_FromDepth", true);
+		glState().ActiveTexture(GL_TEXTURE0);
+		glState().BindTexture(GL_TEXTURE_2D, depthMap);
+		glState().BindImageTexture(1, rows, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+		glDispatchCompute((m_Size + MB_TILE - 1) / MB_TILE, m_Size, 1);
+	}
+	//blurShader is still bound from BlurRows()
+	void BlurColumns(Shader& blurShader, unsigned int rows) {
+		blurShader.SetUniform2i("u_Direction", 0, 1);
+		blurShader.SetUniform1b("u_FromDepth", false);
+		glState().BindImageTexture(0, rows, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+		glState().BindImageTexture(1, m_Texture[1], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+		glDispatchCompute((m_Size + MB_TILE - 1) / MB_TILE, m_Size, 1);
+	}
+	void BuildMips() {
+		glState().BindTexture(GL_TEXTURE_2D, m_Texture[1]);
+		if (Mipmaps)
+			glGenerateMipmap(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, Mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	void Bind(unsigned int unit = MB_TEXTURE_UNIT) const {
+		glState().ActiveTexture(GL_TEXTURE0 + unit);
+		glState().BindTexture(GL_TEXTURE_2D, m_Texture[1]);
+	}
+};
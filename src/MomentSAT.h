@@ -0,0 +1,124 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+#include "Shader.h"
+
+//default moment shadow map settings:
+const unsigned int MS_SAT_TEXTURE_UNIT = 8; //u_MomentSAT in Shadows.glsl
+const unsigned int MS_MAX_SIZE = 1024; //row width one ComputeSAT.shader MOMENTS4 work group covers
+const float MS_EVSM_POSITIVE = 10.0f; //warp exponents, low enough that the SAT sums keep fp32 precision
+const float MS_EVSM_NEGATIVE = 5.0f;
+const float MS_MOMENT_BIAS = 3e-4f; //MSM moment bias, well above the 3e-5 of a plain 32 bit map: SAT differences lose bits
+const float MS_BORDER_COLOR[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+enum MomentTechnique {
+	MOMENTS_EVSM = 0,
+	MOMENTS_MSM = 1
+};
+
+
+/*
+ * Summed area table of 4 shadow map moments (RGBA32F) for the EVSM and MSM techniques.
+ * Built from the depth map like the 2 moment VSSM table, with ComputeSAT.shader: the first pass
+ * (WARP) turns the depth of every texel into the technique's moments and sums the rows, the second
+ * sums the columns; both passes transpose, so the result is in shadow map orientation.
+ * EVSM: exp(c+ d), exp(c+ d)^2, -exp(-c- d), exp(-c- d)^2 with d the depth mapped to [-1, 1].
+ * MSM: depth, depth^2, depth^3, depth^4 (Hamburger 4MSM reconstruction in Shadows.glsl).
+ */
+class MomentSAT {
+private:
+	unsigned int m_Texture[2]; //0: rows summed (transposed), made by the first Build(); 1: SAT
+	int m_Size;
+
+	unsigned int createTexture(const char* owner) const {
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glState().BindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_Size, m_Size, 0, GL_RGBA, GL_FLOAT, nullptr);
+		gpuMemory().TrackTexture(texture, GM_SHADOW_TABLES, owner, GL_RGBA32F, m_Size, m_Size);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, MS_BORDER_COLOR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+
+public:
+	float EVSMPositive;
+	float EVSMNegative;
+	float MomentBias;
+
+	//ctor, size: shadow map size, at most MS_MAX_SIZE
+	explicit MomentSAT(int size)
+		: m_Texture{ 0, 0 }, m_Size(size), EVSMPositive(MS_EVSM_POSITIVE), EVSMNegative(MS_EVSM_NEGATIVE), MomentBias(MS_MOMENT_BIAS) {
+		m_Texture[1] = createTexture("MomentSAT");
+	};
+	//dtor
+	~MomentSAT() {
+		glState().DeleteTextures(m_Texture[0] ? 2 : 1, m_Texture[0] ? m_Texture : m_Texture + 1);
+	};
+
+	//new shadow map size, the table is rebuilt by the next Build
+	void Resize(int size) {
+		if (size == m_Size)
+			return;
+		glState().DeleteTextures(m_Texture[0] ? 2 : 1, m_Texture[0] ? m_Texture : m_Texture + 1);
+		m_Size = size;
+		m_Texture[0] = 0;
+		m_Texture[1] = createTexture("MomentSAT");
+	}
+
+	//gtor
+	unsigned int GetTexture() const {
+		return m_Texture[1];
+	}
+	//bytes the two passes read and write per build
+	double GetBuildBytes() const {
+		double texels = double(m_Size) * m_Size;
+		return texels * ((8.0 + 16.0) + (16.0 + 16.0));
+	}
+
+	//bytes of the row sums, the intermediate the two passes share (RGBA32F, the table size)
+	double GetIntermediateBytes() const {
+		return double(m_Size) * m_Size * 16.0;
+	}
+
+	//warp the depth map (depth in R, any format) into the moments of `technique` and sum them
+	void Build(unsigned int depthMap, MomentTechnique technique, Shader& warpShader, Shader& satShader) {
+		if (!m_Texture[0])
+			m_Texture[0] = createTexture("MomentSAT rows");
+		BuildWarp(depthMap, technique, warpShader, m_Texture[0]);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		BuildColumns(satShader, m_Texture[0]);
+		//the lit pass samples the table
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+
+	//the two passes of Build, without barriers (RenderGraph places them), through the caller's row sums
+	void BuildWarp(unsigned int depthMap, MomentTechnique technique, Shader& warpShader, unsigned int rows) {
+		warpShader.Bind();
+		warpShader.SetUniform1i("u_MomentTechnique", technique);
+		warpShader.SetUniform2f("u_EVSMExponents", EVSMPositive, EVSMNegative);
+		warpShader.SetUniform1i("u_Depth", 0);
+		glState().ActiveTexture(GL_TEXTURE0);
+		glState().BindTexture(GL_TEXTURE_2D, depthMap);
+		glState().BindImageTexture(1, rows, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+		glDispatchCompute(m_Size, 1, 1);
+	}
+	void BuildColumns(Shader& satShader, unsigned int rows) {
+		satShader.Bind();
+		glState().BindImageTexture(0, rows, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+		glState().BindImageTexture(1, m_Texture[1], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+		glDispatchCompute(m_Size, 1, 1);
+	}
+
+	void Bind(unsigned int unit = MS_SAT_TEXTURE_UNIT) const {
+		glState().ActiveTexture(GL_TEXTURE0 + unit);
+		glState().BindTexture(GL_TEXTURE_2D, m_Texture[1]);
+	}
+};
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <chrono>
+
+#include <GL/glew.h>
+
+#include "vendor/imgui/imgui.h"
+
+//default profiler settings:
+const int PF_QUERY_FRAMES = 4; //frames a GPU query stays in flight before it is read back
+const float PF_SMOOTHING = 0.1f; //exponential moving average factor
+const size_t PF_LOG_LINES = 64;
+
+
+/*
+ * Frame profiler: CPU scopes (std::chrono), GPU scopes (GL_TIME_ELAPSED queries, read back
+ * PF_QUERY_FRAMES frames later so it never stalls; a query still in flight by then is not reissued
+ * that frame), per-frame counters and a small log.
+ * GPU scopes must not nest (one GL_TIME_ELAPSED query can be active at a time).
+ * The whole GPU frame is timed with a pair of GL_TIMESTAMP queries from NewFrame() to EndFrame(),
+ * which can overlap the scopes.
+ */
+class Profiler {
+private:
+	struct CPUScope {
+		std::chrono::high_resolution_clock::time_point start;
+		double lastMs = 0.0;
+		double avgMs = 0.0;
+	};
+
+	struct GPUScope {
+		unsigned int queries[PF_QUERY_FRAMES] = { 0 };
+		bool issued[PF_QUERY_FRAMES] = { false };
+		double lastMs = 0.0;
+		double avgMs = 0.0;
+	};
+
+	std::unordered_map<std::string, CPUScope> m_CPUScopes;
+	std::unordered_map<std::string, GPUScope> m_GPUScopes;
+	std::unordered_map<std::string, double> m_Counters;
+	std::vector<std::string> m_CPUOrder;
+	std::vector<std::string> m_GPUOrder;
+	std::vector<std::string> m_CounterOrder;
+	std::deque<std::string> m_Log;
+
+	//start / end timestamps of every frame in flight
+	unsigned int m_FrameQueries[PF_QUERY_FRAMES][2] = { { 0 } };
+	bool m_FrameIssued[PF_QUERY_FRAMES] = { false };
+	bool m_FrameTimed; //the start timestamp of this frame was issued
+	bool m_ScopeTimed; //the open GPU scope began a query
+	double m_FrameMs;
+	double m_FrameAvgMs;
+	bool m_FrameRead; //NewFrame() read back a GPU frame time
+
+	unsigned int m_Frame;
+	bool m_GPUEnabled;
+
+	//GPU frame time of the frame issued PF_QUERY_FRAMES ago in `slot`
+	void readFrameQueries(unsigned int slot) {
+		if (!m_FrameIssued[slot])
+			return;
+		int available = 0;
+		glGetQueryObjectiv(m_FrameQueries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return;
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(m_FrameQueries[slot][0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(m_FrameQueries[slot][1], GL_QUERY_RESULT, &end);
+		m_FrameIssued[slot] = false;
+		m_FrameRead = true;
+		m_FrameMs = double(end - start) * 1e-6;
+		m_FrameAvgMs += (m_FrameMs - m_FrameAvgMs) * PF_SMOOTHING;
+	}
+
+public:
+	//ctor
+	Profiler() : m_FrameTimed(false), m_ScopeTimed(false), m_FrameMs(0.0), m_FrameAvgMs(0.0), m_FrameRead(false), m_Frame(0), m_GPUEnabled(true) {};
+	//dtor
+	~Profiler() {
+		for (auto& it : m_GPUScopes) {
+			if (it.second.queries[0] != 0)
+				glDeleteQueries(PF_QUERY_FRAMES, it.second.queries);
+		}
+		if (m_FrameQueries[0][0] != 0) {
+			for (int i = 0; i < PF_QUERY_FRAMES; ++i)
+				glDeleteQueries(2, m_FrameQueries[i]);
+		}
+	};
+
+	//GPU timing needs a GL context, benchmarks without one turn it off
+	void SetGPUEnabled(bool enabled) {
+		m_GPUEnabled = enabled;
+	}
+
+	//call once per frame before any scope: collects finished GPU queries
+	void NewFrame() {
+		m_Frame++;
+		m_FrameRead = false;
+		if (!m_GPUEnabled)
+			return;
+		unsigned int slot = m_Frame % PF_QUERY_FRAMES;
+		if (m_FrameQueries[0][0] == 0) {
+			for (int i = 0; i < PF_QUERY_FRAMES; ++i)
+				glGenQueries(2, m_FrameQueries[i]);
+		}
+		readFrameQueries(slot);
+		//the GPU is more than PF_QUERY_FRAMES behind: leave the slot to finish, this frame goes untimed
+		m_FrameTimed = !m_FrameIssued[slot];
+		if (m_FrameTimed)
+			glQueryCounter(m_FrameQueries[slot][0], GL_TIMESTAMP);
+		for (auto& it : m_GPUScopes) {
+			GPUScope& scope = it.second;
+			if (!scope.issued[slot]) {
+				//the scope did not run that frame
+				scope.lastMs = 0.0;
+				continue;
+			}
+			int available = 0;
+			glGetQueryObjectiv(scope.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				continue;
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(scope.queries[slot], GL_QUERY_RESULT, &ns);
+			scope.issued[slot] = false;
+			scope.lastMs = double(ns) * 1e-6;
+			scope.avgMs += (scope.lastMs - scope.avgMs) * PF_SMOOTHING;
+		}
+		for (auto& it : m_Counters)
+			it.second = 0.0;
+	}
+
+	//call once per frame after the last GPU command (before the buffer swap)
+	void EndFrame() {
+		if (!m_GPUEnabled || !m_FrameTimed)
+			return;
+		unsigned int slot = m_Frame % PF_QUERY_FRAMES;
+		glQueryCounter(m_FrameQueries[slot][1], GL_TIMESTAMP);
+		m_FrameIssued[slot] = true;
+	}
+
+	/*-------CPU scopes-------*/
+	void BeginCPU(const std::string& name) {
+		auto it = m_CPUScopes.find(name);
+		if (it == m_CPUScopes.end()) {
+			m_CPUOrder.push_back(name);
+			it = m_CPUScopes.emplace(name, CPUScope()).first;
+		}
+		it->second.start = std::chrono::high_resolution_clock::now();
+	}
+
+	double EndCPU(const std::string& name) {
+		CPUScope& scope = m_CPUScopes[name];
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - scope.start;
+		scope.lastMs = elapsed.count();
+		scope.avgMs += (scope.lastMs - scope.avgMs) * PF_SMOOTHING;
+		return scope.lastMs;
+	}
+
+	//a scope timed elsewhere (a job on another thread), reported from the main thread
+	void RecordCPU(const std::string& name, double ms) {
+		auto it = m_CPUScopes.find(name);
+		if (it == m_CPUScopes.end()) {
+			m_CPUOrder.push_back(name);
+			it = m_CPUScopes.emplace(name, CPUScope()).first;
+		}
+		it->second.lastMs = ms;
+		it->second.avgMs += (ms - it->second.avgMs) * PF_SMOOTHING;
+	}
+
+	/*-------GPU scopes-------*/
+	void BeginGPU(const std::string& name) {
+		if (!m_GPUEnabled)
+			return;
+		auto it = m_GPUScopes.find(name);
+		if (it == m_GPUScopes.end()) {
+			m_GPUOrder.push_back(name);
+			it = m_GPUScopes.emplace(name, GPUScope()).first;
+			glGenQueries(PF_QUERY_FRAMES, it->second.queries);
+		}
+		GPUScope& scope = it->second;
+		unsigned int slot = m_Frame % PF_QUERY_FRAMES;
+		//result still in flight: skip this run rather than wait on it
+		m_ScopeTimed = !scope.issued[slot];
+		if (!m_ScopeTimed)
+			return;
+		glBeginQuery(GL_TIME_ELAPSED, scope.queries[slot]);
+		scope.issued[slot] = true;
+	}
+
+	void EndGPU(const std::string& name) {
+		if (!m_GPUEnabled || !m_ScopeTimed)
+			return;
+		(void)name;
+		glEndQuery(GL_TIME_ELAPSED);
+		m_ScopeTimed = false;
+	}
+
+	/*-------counters (reset every frame)-------*/
+	void SetCounter(const std::string& name, double value) {
+		if (m_Counters.find(name) == m_Counters.end())
+			m_CounterOrder.push_back(name);
+		m_Counters[name] = value;
+	}
+
+	void AddCounter(const std::string& name, double value) {
+		if (m_Counters.find(name) == m_Counters.end())
+			m_CounterOrder.push_back(name);
+		m_Counters[name] += value;
+	}
+
+	/*-------log-------*/
+	void Log(const std::string& line) {
+		m_Log.push_back(line);
+		if (m_Log.size() > PF_LOG_LINES)
+			m_Log.pop_front();
+	}
+
+	//gtor
+	double GetCPUms(const std::string& name) const {
+		auto it = m_CPUScopes.find(name);
+		return it != m_CPUScopes.end() ? it->second.avgMs : 0.0;
+	}
+	double GetGPUms(const std::string& name) const {
+		auto it = m_GPUScopes.find(name);
+		return it != m_GPUScopes.end() ? it->second.avgMs : 0.0;
+	}
+	double GetLastGPUms(const std::string& name) const {
+		auto it = m_GPUScopes.find(name);
+		return it != m_GPUScopes.end() ? it->second.lastMs : 0.0;
+	}
+	double GetCounter(const std::string& name) const {
+		auto it = m_Counters.find(name);
+		return it != m_Counters.end() ? it->second : 0.0;
+	}
+	unsigned int GetFrame() const {
+		return m_Frame;
+	}
+	//GPU time of the latest frame read back (PF_QUERY_FRAMES frames old) and its moving average
+	//last GPU frame time read back, HasNewGPUFrame() on the frames it arrived
+	double GetGPUFrameMs() const {
+		return m_FrameMs;
+	}
+	bool HasNewGPUFrame() const {
+		return m_FrameRead;
+	}
+	double GetGPUFrameAvgMs() const {
+		return m_FrameAvgMs;
+	}
+
+	void DrawUI() {
+		ImGui::Begin("Profiler");
+		if (ImGui::CollapsingHeader("CPU (ms)", ImGuiTreeNodeFlags_DefaultOpen)) {
+			for (const auto& name : m_CPUOrder)
+				ImGui::Text("%-24s %8.3f", name.c_str(), m_CPUScopes[name].avgMs);
+		}
+		if (m_GPUEnabled && ImGui::CollapsingHeader("GPU (ms)", ImGuiTreeNodeFlags_DefaultOpen)) {
+			ImGui::Text("%-24s %8.3f", "Frame", m_FrameAvgMs);
+			for (const auto& name : m_GPUOrder)
+				ImGui::Text("%-24s %8.3f", name.c_str(), m_GPUScopes[name].avgMs);
+		}
+		if (ImGui::CollapsingHeader("Counters", ImGuiTreeNodeFlags_DefaultOpen)) {
+			for (const auto& name : m_CounterOrder)
+				ImGui::Text("%-24s %10.0f", name.c_str(), m_Counters[name]);
+		}
+		if (ImGui::CollapsingHeader("Log")) {
+			for (const auto& line : m_Log)
+				ImGui::TextUnformatted(line.c_str());
+		}
+		ImGui::End();
+	}
+};
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+
+//default render graph settings:
+const unsigned int RG_POOL_IDLE_FRAMES = 120; //pooled textures unused that long are freed
+
+//how a pass uses a texture
+enum RGAccess {
+	RG_SAMPLE = 0, //texture fetch
+	RG_IMAGE_READ, //image load
+	RG_IMAGE_WRITE, //image store: incoherent, the next use needs a barrier
+	RG_ATTACHMENT, //framebuffer attachment, ordered by GL
+	RG_UPDATE //glTexSubImage / glGenerateMipmap, ordered by GL
+};
+
+struct RGUse {
+	unsigned int Resource;
+	RGAccess Access;
+};
+
+//transient texture, allocated from the pool for the passes that use it
+struct RGTextureDesc {
+	int Width;
+	int Height;
+	GLenum Format; //GL_R32F, GL_RG32F or GL_RGBA32F, or a DepthFormat's shadow map format
+	int Levels;
+	GLenum Wrap;
+	GLenum Filter;
+
+	bool operator==(const RGTextureDesc& other) const {
+		return Width == other.Width && Height == other.Height && Format == other.Format && Levels == other.Levels
+			&& Wrap == other.Wrap && Filter == other.Filter;
+	}
+};
+
+inline double rgTextureBytes(const RGTextureDesc& desc) {
+	double texel = desc.Format == GL_RGBA32F ? 16.0 : desc.Format == GL_RG32F ? 8.0 : desc.Format == GL_R16 || desc.Format == GL_R16F ? 2.0 : 4.0;
+	double bytes = 0.0;
+	for (int level = 0, w = desc.Width, h = desc.Height; level < desc.Levels; ++level, w = std::max(w / 2, 1), h = std::max(h / 2, 1))
+		bytes += texel * w * h;
+	return bytes;
+}
+
+
+/*
+ * Frame graph of the GPU passes: every pass lists the textures it reads and writes and how
+ * (sampled, image load / store, attachment), the graph is rebuilt every frame. Execute():
+ *  - culls the passes nothing live reads (from the sink passes back: the SAT when the technique
+ *    does not sample it, ...),
+ *  - puts a glMemoryBarrier before a pass only for the incoherent image stores it depends on, with
+ *    just the bits its uses need; one barrier covers every texture written before it,
+ *  - gives transient textures a pooled texture of the same description for the span of passes
+ *    that use them, the same texture goes to the next transient that starts after that span.
+ *    Textures of the pool unused for RG_POOL_IDLE_FRAMES frames are freed.
+ * Imported textures (the shadow map, tables kept between frames) are tracked, never pooled.
+ * Sink passes are always live; one without an execute function stands for the rest of the frame.
+ */
+class RenderGraph {
+private:
+	struct Resource {
+		std::string Name;
+		bool Transient;
+		RGTextureDesc Desc;
+		unsigned int Texture; //imported, or pooled while it lives
+		double Bytes;
+		//Execute() state
+		bool Needed;
+		int FirstUse;
+		int LastUse;
+		bool Dirty; //image stores not covered by a barrier yet
+		GLbitfield Covered; //barrier bits issued since the last image store
+	};
+	struct Pass {
+		std::string Name;
+		std::vector<RGUse> Reads;
+		std::vector<RGUse> Writes;
+		std::function<void()> Execute;
+		bool Sink;
+		bool Live;
+	};
+	struct PooledTexture {
+		RGTextureDesc Desc;
+		unsigned int Texture;
+		bool InUse;
+		unsigned int LastFrame;
+	};
+
+	std::vector<Resource> m_Resources;
+	std::vector<Pass> m_Passes;
+	std::vector<PooledTexture> m_Pool;
+	unsigned int m_Frame;
+
+public:
+	//stats of the last Execute()
+	int LastPasses;
+	int LastCulled;
+	std::vector<std::string> LastCulledNames;
+	int LastBarriers;
+	int LastImageWrites; //passes with image stores: one barrier each when placed by hand after every dispatch
+	double LastTransientBytes; //transients of the live passes, one texture each
+	double LastPeakBytes; //most pooled bytes in use at once
+	int LastTexturesCreated;
+
+	//ctor
+	RenderGraph()
+		: m_Frame(0), LastPasses(0), LastCulled(0), LastBarriers(0), LastImageWrites(0), LastTransientBytes(0.0), LastPeakBytes(0.0),
+		LastTexturesCreated(0) {};
+	//dtor
+	~RenderGraph() {
+		for (PooledTexture& pooled : m_Pool)
+			glState().DeleteTextures(1, &pooled.Texture);
+	};
+
+	//bytes of the imported textures, as passed to Import()
+	double GetImportedBytes() const {
+		double bytes = 0.0;
+		for (const Resource& resource : m_Resources)
+			bytes += resource.Transient ? 0.0 : resource.Bytes;
+		return bytes;
+	}
+	//bytes of the pool's textures
+	double GetPoolBytes() const {
+		double bytes = 0.0;
+		for (const PooledTexture& pooled : m_Pool)
+			bytes += rgTextureBytes(pooled.Desc);
+		return bytes;
+	}
+	size_t GetPoolSize() const {
+		return m_Pool.size();
+	}
+
+	/*-------building, every frame-------*/
+
+	void Reset() {
+		m_Resources.clear();
+		m_Passes.clear();
+	}
+
+	unsigned int Import(const std::string& name, unsigned int texture, double bytes = 0.0) {
+		m_Resources.push_back({ name, false, RGTextureDesc(), texture, bytes, false, -1, -1, false, 0 });
+		return (unsigned int)m_Resources.size() - 1;
+	}
+
+	unsigned int CreateTexture(const std::string& name, const RGTextureDesc& desc) {
+		m_Resources.push_back({ name, true, desc, 0, rgTextureBytes(desc), false, -1, -1, false, 0 });
+		return (unsigned int)m_Resources.size() - 1;
+	}
+
+	//a read-write use goes in both lists
+	void AddPass(const std::string& name, const std::vector<RGUse>& reads, const std::vector<RGUse>& writes,
+				 const std::function<void()>& execute, bool sink = false) {
+		m_Passes.push_back({ name, reads, writes, execute, sink, false });
+	}
+
+	//texture of a resource, valid while the passes run
+	unsigned int GetTexture(unsigned int resource) const {
+		return m_Resources[resource].Texture;
+	}
+
+	/*-------execution-------*/
+
+	void Execute() {
+		m_Frame++;
+		cull();
+		LastPasses = 0;
+		LastBarriers = 0;
+		LastImageWrites = 0;
+		LastTransientBytes = 0.0;
+		LastPeakBytes = 0.0;
+		LastTexturesCreated = 0;
+		double inUse = 0.0;
+		for (size_t p = 0; p < m_Passes.size(); ++p) {
+			Pass& pass = m_Passes[p];
+			if (!pass.Live)
+				continue;
+			for (const RGUse& use : pass.Reads)
+				inUse += acquire(use.Resource, int(p));
+			for (const RGUse& use : pass.Writes)
+				inUse += acquire(use.Resource, int(p));
+			LastPeakBytes = std::max(LastPeakBytes, inUse);
+
+			//barrier for the image stores this pass depends on
+			GLbitfield bits = 0;
+			for (const RGUse& use : pass.Reads)
+				bits |= barrierBits(m_Resources[use.Resource], use.Access);
+			for (const RGUse& use : pass.Writes)
+				bits |= barrierBits(m_Resources[use.Resource], use.Access);
+			if (bits) {
+				glMemoryBarrier(bits);
+				LastBarriers++;
+				for (Resource& resource : m_Resources)
+					if (resource.Dirty)
+						resource.Covered |= bits;
+			}
+
+			if (pass.Execute)
+				pass.Execute();
+			LastPasses++;
+
+			bool imageWrite = false;
+			for (const RGUse& use : pass.Writes) {
+				if (use.Access != RG_IMAGE_WRITE)
+					continue;
+				m_Resources[use.Resource].Dirty = true;
+				m_Resources[use.Resource].Covered = 0;
+				imageWrite = true;
+			}
+			LastImageWrites += imageWrite ? 1 : 0;
+
+			//transients whose last pass this was go back to the pool
+			for (Resource& resource : m_Resources) {
+				if (resource.Transient && resource.LastUse == int(p) && resource.Texture) {
+					release(resource);
+					inUse -= resource.Bytes;
+				}
+			}
+		}
+		trimPool();
+	}
+
+private:
+	//live passes, from the sinks back; first and last live pass of every resource
+	void cull() {
+		for (Resource& resource : m_Resources) {
+			resource.Needed = false;
+			resource.FirstUse = -1;
+			resource.LastUse = -1;
+			resource.Dirty = false;
+			resource.Covered = 0;
+		}
+		LastCulled = 0;
+		LastCulledNames.clear();
+		for (int p = int(m_Passes.size()) - 1; p >= 0; --p) {
+			Pass& pass = m_Passes[p];
+			pass.Live = pass.Sink;
+			for (const RGUse& use : pass.Writes)
+				pass.Live |= m_Resources[use.Resource].Needed;
+			if (!pass.Live) {
+				LastCulled++;
+				LastCulledNames.push_back(pass.Name);
+				continue;
+			}
+			for (const RGUse& use : pass.Reads)
+				m_Resources[use.Resource].Needed = true;
+		}
+		std::reverse(LastCulledNames.begin(), LastCulledNames.end());
+		for (int p = 0; p < int(m_Passes.size()); ++p) {
+			if (!m_Passes[p].Live)
+				continue;
+			for (const std::vector<RGUse>* uses : { &m_Passes[p].Reads, &m_Passes[p].Writes })
+				for (const RGUse& use : *uses) {
+					Resource& resource = m_Resources[use.Resource];
+					if (resource.FirstUse < 0)
+						resource.FirstUse = p;
+					resource.LastUse = p;
+				}
+		}
+	}
+
+	//bits a use needs after image stores not covered yet
+	static GLbitfield barrierBits(const Resource& resource, RGAccess access) {
+		if (!resource.Dirty)
+			return 0;
+		GLbitfield needed = 0;
+		switch (access) {
+		case RG_SAMPLE: needed = GL_TEXTURE_FETCH_BARRIER_BIT; break;
+		case RG_IMAGE_READ:
+		case RG_IMAGE_WRITE: needed = GL_SHADER_IMAGE_ACCESS_BARRIER_BIT; break;
+		case RG_ATTACHMENT: needed = GL_FRAMEBUFFER_BARRIER_BIT; break;
+		case RG_UPDATE: needed = GL_TEXTURE_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT; break;
+		}
+		return needed & ~resource.Covered;
+	}
+
+	//pooled texture for a transient at its first pass, returns the bytes it adds
+	double acquire(unsigned int index, int pass) {
+		Resource& resource = m_Resources[index];
+		if (!resource.Transient || resource.FirstUse != pass || resource.Texture)
+			return 0.0;
+		LastTransientBytes += resource.Bytes;
+		for (PooledTexture& pooled : m_Pool) {
+			if (!pooled.InUse && pooled.Desc == resource.Desc) {
+				//aliased this frame: the earlier transient's image accesses are ordered before this one's
+				if (pooled.LastFrame == m_Frame) {
+					resource.Dirty = true;
+					resource.Covered = 0;
+				}
+				pooled.InUse = true;
+				pooled.LastFrame = m_Frame;
+				resource.Texture = pooled.Texture;
+				return resource.Bytes;
+			}
+		}
+		const RGTextureDesc& desc = resource.Desc;
+		GLenum format = desc.Format == GL_RGBA32F ? GL_RGBA : desc.Format == GL_RG32F ? GL_RG : GL_RED;
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glState().BindTexture(GL_TEXTURE_2D, texture);
+		for (int level = 0, w = desc.Width, h = desc.Height; level < desc.Levels; ++level, w = std::max(w / 2, 1), h = std::max(h / 2, 1))
+			glTexImage2D(GL_TEXTURE_2D, level, desc.Format, w, h, 0, format, GL_FLOAT, nullptr);
+		gpuMemory().TrackTexture(texture, GM_RENDER_GRAPH, "RenderGraph pool", desc.Format, desc.Width, desc.Height, desc.Levels);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, desc.Levels - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, desc.Wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, desc.Wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc.Filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, desc.Filter);
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+		m_Pool.push_back({ desc, texture, true, m_Frame });
+		LastTexturesCreated++;
+		resource.Texture = texture;
+		return resource.Bytes;
+	}
+
+	void release(Resource& resource) {
+		for (PooledTexture& pooled : m_Pool)
+			if (pooled.Texture == resource.Texture)
+				pooled.InUse = false;
+		resource.Texture = 0;
+	}
+
+	void trimPool() {
+		for (size_t i = 0; i < m_Pool.size();) {
+			if (!m_Pool[i].InUse && m_Frame - m_Pool[i].LastFrame > RG_POOL_IDLE_FRAMES) {
+				glState().DeleteTextures(1, &m_Pool[i].Texture);
+				m_Pool.erase(m_Pool.begin() + i);
+			}
+			else {
+				++i;
+			}
+		}
+	}
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLState.h"
+#include "Shader.h"
+#include "ThreadPool.h"
+
+//default render queue settings, sort key fields from the most significant down:
+const int RQ_PASS_BITS = 4;
+const int RQ_PROGRAM_BITS = 8;
+const int RQ_MATERIAL_BITS = 12;
+const int RQ_GEOMETRY_BITS = 12; //vertex array (and index buffer)
+const int RQ_DEPTH_BITS = 28; //front to back
+const int RQ_RADIX_BITS = 8; //digit of the radix sort
+const size_t RQ_SORT_GRAIN = 8192; //items per radix sort chunk
+const unsigned int RQ_PASS_OPAQUE = 0;
+
+const int RQ_DEPTH_SHIFT = 0;
+const int RQ_GEOMETRY_SHIFT = RQ_DEPTH_SHIFT + RQ_DEPTH_BITS;
+const int RQ_MATERIAL_SHIFT = RQ_GEOMETRY_SHIFT + RQ_GEOMETRY_BITS;
+const int RQ_PROGRAM_SHIFT = RQ_MATERIAL_SHIFT + RQ_MATERIAL_BITS;
+const int RQ_PASS_SHIFT = RQ_PROGRAM_SHIFT + RQ_PROGRAM_BITS;
+
+
+inline uint64_t rqField(uint64_t key, int shift, int bits) {
+	return (key >> shift) & ((uint64_t(1) << bits) - 1);
+}
+
+//depth: distance from the camera over the far plane, [0, 1]. Smaller keys draw first: front to back
+inline uint64_t rqSortKey(unsigned int pass, unsigned int program, unsigned int material, unsigned int geometry, float depth) {
+	uint64_t depthBits = uint64_t(std::min(std::max(depth, 0.0f), 1.0f) * double((uint64_t(1) << RQ_DEPTH_BITS) - 1));
+	return uint64_t(pass) << RQ_PASS_SHIFT | uint64_t(program) << RQ_PROGRAM_SHIFT | uint64_t(material) << RQ_MATERIAL_SHIFT
+		| uint64_t(geometry) << RQ_GEOMETRY_SHIFT | depthBits << RQ_DEPTH_SHIFT;
+}
+
+struct RQItem {
+	uint64_t Key;
+	unsigned int Draw; //index of the draw's transform
+};
+
+/*
+ * LSD radix sort of the items by key, stable, RQ_RADIX_BITS per pass. Digits every key shares (the
+ * pass field of a single pass queue, unused material bits, ...) are skipped. With a pool every pass
+ * runs in chunks: a histogram per chunk, a prefix sum over (digit, chunk), then every chunk scatters
+ * its items to its own offsets, so the order within a digit stays the input order.
+ */
+inline void rqRadixSort(std::vector<RQItem>& items, std::vector<RQItem>& scratch, ThreadPool* pool) {
+	const size_t buckets = size_t(1) << RQ_RADIX_BITS;
+	size_t count = items.size();
+	if (count < 2)
+		return;
+	uint64_t differing = 0;
+	for (const RQItem& item : items)
+		differing |= item.Key ^ items[0].Key;
+	size_t chunks = pool ? std::min(pool->GetThreadCount() * 4, (count + RQ_SORT_GRAIN - 1) / RQ_SORT_GRAIN) : 1;
+	chunks = std::max<size_t>(chunks, 1);
+	size_t chunkSize = (count + chunks - 1) / chunks;
+	std::vector<std::array<size_t, buckets>> offsets(chunks);
+	scratch.resize(count);
+
+	auto forChunks = [&](const std::function<void(size_t, size_t, size_t)>& fn) {
+		auto run = [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; ++c)
+				fn(c, c * chunkSize, std::min(count, (c + 1) * chunkSize));
+		};
+		if (pool && chunks > 1)
+			pool->ParallelFor(chunks, 1, run);
+		else
+			run(0, chunks);
+	};
+
+	for (int shift = 0; shift < 64; shift += RQ_RADIX_BITS) {
+		if (((differing >> shift) & (buckets - 1)) == 0)
+			continue;
+		forChunks([&](size_t c, size_t begin, size_t end) {
+			offsets[c].fill(0);
+			for (size_t i = begin; i < end; ++i)
+				offsets[c][(items[i].Key >> shift) & (buckets - 1)]++;
+		});
+		size_t sum = 0;
+		for (size_t digit = 0; digit < buckets; ++digit) {
+			for (size_t c = 0; c < chunks; ++c) {
+				size_t n = offsets[c][digit];
+				offsets[c][digit] = sum;
+				sum += n;
+			}
+		}
+		forChunks([&](size_t c, size_t begin, size_t end) {
+			std::array<size_t, buckets>& next = offsets[c];
+			for (size_t i = begin; i < end; ++i)
+				scratch[next[(items[i].Key >> shift) & (buckets - 1)]++] = items[i];
+		});
+		items.swap(scratch);
+	}
+}
+
+//program, material and geometry switches when the items are drawn in their current order
+struct RQStateChanges {
+	unsigned int Programs;
+	unsigned int Materials;
+	unsigned int Geometries;
+
+	unsigned int Total() const {
+		return Programs + Materials + Geometries;
+	}
+};
+
+inline RQStateChanges rqCountStateChanges(const std::vector<RQItem>& items) {
+	RQStateChanges changes = { 0, 0, 0 };
+	for (size_t i = 0; i < items.size(); ++i) {
+		uint64_t key = items[i].Key, previous = i > 0 ? items[i - 1].Key : ~key;
+		bool program = rqField(key ^ previous, RQ_PROGRAM_SHIFT, RQ_PROGRAM_BITS + RQ_PASS_BITS) != 0;
+		changes.Programs += program ? 1 : 0;
+		//a material is program state, it is set again after a switch
+		changes.Materials += program || rqField(key ^ previous, RQ_MATERIAL_SHIFT, RQ_MATERIAL_BITS) != 0 ? 1 : 0;
+		changes.Geometries += rqField(key ^ previous, RQ_GEOMETRY_SHIFT, RQ_GEOMETRY_BITS) != 0 ? 1 : 0;
+	}
+	return changes;
+}
+
+
+/*
+ * Draws of the frame with a 64 bit sort key each: pass, program, material, geometry, depth. Every frame
+ * the programs (with a function setting their per frame uniforms), materials and geometries are
+ * registered, the draws submitted in any order, then Sort() orders them by key and Execute() draws
+ * them through the state cache: a program is set up when it changes, a material (u_Material.color /
+ * shininess) when it or the program changes, u_Model for every draw. Depth is the least significant
+ * field, so the opaque draws of one state go front to back for early z.
+ */
+class RenderQueue {
+public:
+	struct Material {
+		glm::vec3 Color;
+		float Shininess;
+	};
+	struct Geometry {
+		unsigned int VertexArray;
+		unsigned int IndexBuffer; //0: glDrawArrays
+		unsigned int Count; //indices, or vertices
+	};
+
+private:
+	struct Program {
+		Shader* Source;
+		std::function<void(Shader&)> Setup;
+	};
+
+	std::vector<Program> m_Programs;
+	std::vector<Material> m_Materials;
+	std::vector<Geometry> m_Geometries;
+	std::vector<RQItem> m_Items;
+	std::vector<RQItem> m_Scratch;
+	std::vector<glm::mat4> m_Models;
+
+public:
+	bool Sorted; //off: drawn in submission order
+	//stats of the last Sort() / Execute()
+	double LastSortMs;
+	RQStateChanges LastUnsortedChanges;
+	RQStateChanges LastChanges;
+	unsigned int LastDraws;
+
+	//ctor
+	RenderQueue()
+		: Sorted(true), LastSortMs(0.0), LastUnsortedChanges{ 0, 0, 0 }, LastChanges{ 0, 0, 0 }, LastDraws(0) {};
+
+	size_t GetSize() const {
+		return m_Items.size();
+	}
+	const std::vector<RQItem>& GetItems() const {
+		return m_Items;
+	}
+
+	/*-------building, every frame-------*/
+
+	void Reset() {
+		m_Programs.clear();
+		m_Materials.clear();
+		m_Geometries.clear();
+		m_Items.clear();
+		m_Models.clear();
+	}
+
+	unsigned int AddProgram(Shader& shader, const std::function<void(Shader&)>& setup) {
+		m_Programs.push_back({ &shader, setup });
+		return (unsigned int)m_Programs.size() - 1;
+	}
+	unsigned int AddMaterial(const glm::vec3& color, float shininess) {
+		m_Materials.push_back({ color, shininess });
+		return (unsigned int)m_Materials.size() - 1;
+	}
+	unsigned int AddGeometry(unsigned int vertexArray, unsigned int indexBuffer, unsigned int count) {
+		m_Geometries.push_back({ vertexArray, indexBuffer, count });
+		return (unsigned int)m_Geometries.size() - 1;
+	}
+
+	//depth: see rqSortKey
+	void Submit(unsigned int pass, unsigned int program, unsigned int material, unsigned int geometry, float depth, const glm::mat4& model) {
+		m_Items.push_back({ rqSortKey(pass, program, material, geometry, depth), (unsigned int)m_Models.size() });
+		m_Models.push_back(model);
+	}
+
+	/*-------sorting and drawing-------*/
+
+	void Sort(ThreadPool* pool = nullptr) {
+		LastUnsortedChanges = rqCountStateChanges(m_Items);
+		auto start = std::chrono::high_resolution_clock::now();
+		if (Sorted)
+			rqRadixSort(m_Items, m_Scratch, pool);
+		LastSortMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		LastChanges = rqCountStateChanges(m_Items);
+	}
+
+	//draws of one pass, after Sort(): when sorted they are contiguous
+	void Execute(unsigned int pass) {
+		LastDraws = 0;
+		int program = -1, material = -1, geometry = -1;
+		for (const RQItem& item : m_Items) {
+			if (rqField(item.Key, RQ_PASS_SHIFT, RQ_PASS_BITS) != pass)
+				continue;
+			int p = int(rqField(item.Key, RQ_PROGRAM_SHIFT, RQ_PROGRAM_BITS));
+			int m = int(rqField(item.Key, RQ_MATERIAL_SHIFT, RQ_MATERIAL_BITS));
+			int g = int(rqField(item.Key, RQ_GEOMETRY_SHIFT, RQ_GEOMETRY_BITS));
+			Shader& shader = *m_Programs[p].Source;
+			if (p != program) {
+				shader.Bind();
+				if (m_Programs[p].Setup)
+					m_Programs[p].Setup(shader);
+				program = p;
+				material = -1;
+			}
+			if (m != material) {
+				const Material& mat = m_Materials[m];
+				shader.SetUniform3f("u_Material.color", mat.Color.x, mat.Color.y, mat.Color.z);
+				shader.SetUniform1f("u_Material.shininess", mat.Shininess);
+				material = m;
+			}
+			const Geometry& geo = m_Geometries[g];
+			if (g != geometry) {
+				glState().BindVertexArray(geo.VertexArray);
+				if (geo.IndexBuffer)
+					glState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo.IndexBuffer);
+				geometry = g;
+			}
+			shader.SetUniformM4fv("u_Model", 1, GL_FALSE, glm::value_ptr(m_Models[item.Draw]));
+			if (geo.IndexBuffer)
+				glDrawElements(GL_TRIANGLES, (GLsizei)geo.Count, GL_UNSIGNED_INT, nullptr);
+			else
+				glDrawArrays(GL_TRIANGLES, 0, (GLsizei)geo.Count);
+			LastDraws++;
+		}
+	}
+};
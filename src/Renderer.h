@@ -4,6 +4,8 @@
 #include <GL/glew.h>
 #include <iostream>
 
+#include "GLState.h"
+#include "GPUMemory.h"
 #include "VertexArray.h"
 #include "IndexBuffer.h"
 #include "Shader.h"
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <random>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+#include <glm/glm.hpp>
+
+//default sample table settings:
+const int ST_NUM_SAMPLES = 25; //NUM_SAMPLES in VSSM_Scene.shader
+const int ST_VEC4_PER_SET = (ST_NUM_SAMPLES + 1) / 2; //two samples per vec4 (std140)
+const int ST_NOISE_SIZE = 64; //blue noise tile, power of two
+const unsigned int ST_SEED = 20240611u;
+const unsigned int ST_UNIFORM_BINDING = 0; //SampleTables block in VSSM_Scene.shader
+const unsigned int ST_NOISE_TEXTURE_UNIT = 3; //u_BlueNoise in VSSM_Scene.shader
+
+//u_SampleSet values, 0 keeps the per-fragment generated disk (POISSON_PER_FRAGMENT shader variants)
+enum SampleSet
+{
+	SAMPLES_PROCEDURAL,
+	SAMPLES_POISSON,
+	SAMPLES_VOGEL,
+	SAMPLES_BLUE_NOISE,
+	SAMPLES_COUNT
+};
+
+static const char* SAMPLE_SET_NAMES[SAMPLES_COUNT] = { "Procedural (per fragment)", "Poisson", "Vogel spiral", "Blue noise" };
+
+
+/*-----------------------------Sample set generators (deterministic for a given seed)---------------------------------*/
+
+// ring spiral of poissonDiskSamples() with a zero start angle (the old per-fragment pattern)
+inline std::vector<glm::vec2> GenerateProceduralDisk(int count, int rings = 10) {
+	std::vector<glm::vec2> samples(count);
+	float angleStep = 6.283185307f * float(rings) / float(count);
+	for (int i = 0; i < count; ++i) {
+		float radius = float(i + 1) / float(count);
+		float angle = angleStep * i;
+		samples[i] = glm::vec2(std::cos(angle), std::sin(angle)) * std::pow(radius, 0.75f);
+	}
+	return samples;
+}
+
+// golden angle spiral, equal area per sample
+inline std::vector<glm::vec2> GenerateVogelDisk(int count) {
+	const float goldenAngle = 2.399963230f;
+	std::vector<glm::vec2> samples(count);
+	for (int i = 0; i < count; ++i) {
+		float radius = std::sqrt((i + 0.5f) / count);
+		float angle = i * goldenAngle;
+		samples[i] = glm::vec2(std::cos(angle), std::sin(angle)) * radius;
+	}
+	return samples;
+}
+
+// dart throwing in the unit disk with a minimum distance, shrunk until `count` darts fit
+inline std::vector<glm::vec2> GeneratePoissonDisk(int count, unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	//dense packing would allow ~ sqrt(pi / (count * 2 * sqrt(3))) * 2, start a bit below it
+	float minDistance = 1.6f / std::sqrt(float(count));
+	std::vector<glm::vec2> samples;
+	while (true) {
+		samples.clear();
+		for (int attempt = 0; attempt < count * 200 && (int)samples.size() < count; ++attempt) {
+			glm::vec2 p(uniform(rng), uniform(rng));
+			if (glm::dot(p, p) > 1.0f)
+				continue;
+			bool accepted = true;
+			for (const auto& s : samples) {
+				if (glm::distance(p, s) < minDistance) {
+					accepted = false;
+					break;
+				}
+			}
+			if (accepted)
+				samples.push_back(p);
+		}
+		if ((int)samples.size() == count)
+			return samples;
+		minDistance *= 0.95f;
+	}
+}
+
+// Mitchell's best candidate: every new sample is the candidate furthest from the previous ones
+inline std::vector<glm::vec2> GenerateBlueNoiseDisk(int count, unsigned int seed, int candidatesPerSample = 32) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	auto randomInDisk = [&]() {
+		while (true) {
+			glm::vec2 p(uniform(rng), uniform(rng));
+			if (glm::dot(p, p) <= 1.0f)
+				return p;
+		}
+	};
+	std::vector<glm::vec2> samples;
+	samples.push_back(randomInDisk());
+	while ((int)samples.size() < count) {
+		glm::vec2 best(0.0f);
+		float bestDistance = -1.0f;
+		int candidates = candidatesPerSample * (int)samples.size();
+		for (int c = 0; c < candidates; ++c) {
+			glm::vec2 p = randomInDisk();
+			float nearest = FLT_MAX;
+			for (const auto& s : samples)
+				nearest = std::min(nearest, glm::distance(p, s));
+			if (nearest > bestDistance) {
+				bestDistance = nearest;
+				best = p;
+			}
+		}
+		samples.push_back(best);
+	}
+	return samples;
+}
+
+// size x size tileable blue noise in [0, 1): pixels ranked by farthest point insertion
+// on the torus, so every threshold of the ranks is an even spread of pixels
+inline std::vector<float> GenerateBlueNoiseTexture(int size, unsigned int seed) {
+	int count = size * size;
+	std::mt19937 rng(seed);
+	std::vector<float> nearest(count, FLT_MAX); //squared toroidal distance to the closest placed pixel
+	std::vector<int> rank(count, -1);
+	auto placePixel = [&](int pixel, int order) {
+		rank[pixel] = order;
+		int px = pixel % size, py = pixel / size;
+		for (int i = 0; i < count; ++i) {
+			int dx = std::abs(i % size - px), dy = std::abs(i / size - py);
+			dx = std::min(dx, size - dx);
+			dy = std::min(dy, size - dy);
+			nearest[i] = std::min(nearest[i], float(dx * dx + dy * dy));
+		}
+	};
+
+	placePixel((int)(rng() % count), 0);
+	std::vector<int> ties;
+	for (int order = 1; order < count; ++order) {
+		float best = -1.0f;
+		ties.clear();
+		for (int i = 0; i < count; ++i) {
+			if (rank[i] >= 0)
+				continue;
+			if (nearest[i] > best) {
+				best = nearest[i];
+				ties.clear();
+			}
+			if (nearest[i] == best)
+				ties.push_back(i);
+		}
+		placePixel(ties[rng() % ties.size()], order);
+	}
+
+	std::vector<float> noise(count);
+	for (int i = 0; i < count; ++i)
+		noise[i] = (rank[i] + 0.5f) / count;
+	return noise;
+}
+
+
+/*-----------------------------GPU layout---------------------------------*/
+
+// std140 payload of the SampleTables uniform block: SAMPLES_COUNT sets of ST_NUM_SAMPLES vec2,
+// packed two per vec4 (slot 0 is unused by the procedural path but keeps the indexing simple)
+inline std::vector<glm::vec4> BuildSampleTables(unsigned int seed) {
+	std::vector<glm::vec2> sets[SAMPLES_COUNT] = {
+		GenerateProceduralDisk(ST_NUM_SAMPLES),
+		GeneratePoissonDisk(ST_NUM_SAMPLES, seed),
+		GenerateVogelDisk(ST_NUM_SAMPLES),
+		GenerateBlueNoiseDisk(ST_NUM_SAMPLES, seed + 1)
+	};
+	std::vector<glm::vec4> packed(SAMPLES_COUNT * ST_VEC4_PER_SET, glm::vec4(0.0f));
+	for (int s = 0; s < SAMPLES_COUNT; ++s) {
+		for (int i = 0; i < ST_NUM_SAMPLES; ++i) {
+			glm::vec4& v = packed[s * ST_VEC4_PER_SET + i / 2];
+			v[(i & 1) * 2 + 0] = sets[s][i].x;
+			v[(i & 1) * 2 + 1] = sets[s][i].y;
+		}
+	}
+	return packed;
+}
+
+
+/*
+ * GPU copies of the tables: the sample sets in a uniform buffer and the blue noise tile
+ * (per pixel rotation of the disk) in a small repeating texture.
+ */
+class SampleTables {
+private:
+	unsigned int m_UniformBuffer;
+	unsigned int m_NoiseTexture;
+
+public:
+	//ctor
+	explicit SampleTables(unsigned int seed = ST_SEED)
+		: m_UniformBuffer(0), m_NoiseTexture(0) {
+		std::vector<glm::vec4> tables = BuildSampleTables(seed);
+		glGenBuffers(1, &m_UniformBuffer);
+		glState().BindBuffer(GL_UNIFORM_BUFFER, m_UniformBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, tables.size() * sizeof(glm::vec4), tables.data(), GL_STATIC_DRAW);
+		gpuMemory().TrackBuffer(m_UniformBuffer, GM_LOOKUP, "Sample tables", tables.size() * sizeof(glm::vec4));
+		glState().BindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		std::vector<float> noise = GenerateBlueNoiseTexture(ST_NOISE_SIZE, seed);
+		glGenTextures(1, &m_NoiseTexture);
+		glState().BindTexture(GL_TEXTURE_2D, m_NoiseTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, ST_NOISE_SIZE, ST_NOISE_SIZE, 0, GL_RED, GL_FLOAT, noise.data());
+		gpuMemory().TrackTexture(m_NoiseTexture, GM_LOOKUP, "Blue noise", GL_R32F, ST_NOISE_SIZE, ST_NOISE_SIZE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+	};
+	//dtor
+	~SampleTables() {
+		glState().DeleteBuffers(1, &m_UniformBuffer);
+		glState().DeleteTextures(1, &m_NoiseTexture);
+	};
+
+	void Bind() const {
+		glState().BindBufferBase(GL_UNIFORM_BUFFER, ST_UNIFORM_BINDING, m_UniformBuffer);
+		glState().ActiveTexture(GL_TEXTURE0 + ST_NOISE_TEXTURE_UNIT);
+		glState().BindTexture(GL_TEXTURE_2D, m_NoiseTexture);
+	}
+};
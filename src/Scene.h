@@ -0,0 +1,299 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define SCENE_SIMD 1
+#else
+#define SCENE_SIMD 0
+#endif
+
+#include "Bounds.h"
+#include "ThreadPool.h"
+
+//default scene settings:
+const size_t SC_BLOCK = 4; //entries per SIMD batch
+const size_t SC_GRAIN = 1024; //blocks per thread pool chunk
+
+
+//contiguous view over scene arrays (upload straight into GPU buffers)
+template<typename T>
+struct Span {
+	const T* data;
+	size_t size;
+
+	const T& operator[](size_t i) const { return data[i]; }
+	const T* begin() const { return data; }
+	const T* end() const { return data + size; }
+};
+
+
+/*
+ * Data oriented scene: one entry per object, every attribute stored in its own array
+ * (structure of arrays). World matrices and world bounds are only rebuilt for dirty entries,
+ * 4 entries at a time with SSE, spread over a thread pool.
+ */
+class Scene {
+public:
+	//transforms (SoA)
+	std::vector<float> PosX, PosY, PosZ;
+	std::vector<float> RotX, RotY, RotZ, RotW; //unit quaternion
+	std::vector<float> ScaleX, ScaleY, ScaleZ;
+	//object space bounds as center / half extent (SoA)
+	std::vector<float> LocalCX, LocalCY, LocalCZ;
+	std::vector<float> LocalEX, LocalEY, LocalEZ;
+	//outputs
+	std::vector<glm::mat4> World;
+	std::vector<AABB> WorldBounds;
+	//render data
+	std::vector<unsigned int> MeshID;
+	std::vector<unsigned int> MaterialID;
+	std::vector<uint8_t> Dirty;
+
+private:
+	size_t m_Count;
+
+public:
+	//ctor
+	Scene() : m_Count(0) {};
+
+	size_t Count() const {
+		return m_Count;
+	}
+
+	void Reserve(size_t count) {
+		size_t padded = Padded(count);
+		for (auto* v : FloatArrays())
+			v->reserve(padded);
+		World.reserve(padded);
+		WorldBounds.reserve(padded);
+		MeshID.reserve(padded);
+		MaterialID.reserve(padded);
+		Dirty.reserve(padded);
+	}
+
+	//returns the entry index
+	unsigned int Add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale,
+					 const AABB& localBounds, unsigned int mesh, unsigned int material) {
+		size_t i = m_Count++;
+		Resize(m_Count);
+		SetPosition(i, position);
+		SetRotation(i, rotation);
+		SetScale(i, scale);
+		glm::vec3 c = localBounds.Center();
+		glm::vec3 e = localBounds.Extent() * 0.5f;
+		LocalCX[i] = c.x; LocalCY[i] = c.y; LocalCZ[i] = c.z;
+		LocalEX[i] = e.x; LocalEY[i] = e.y; LocalEZ[i] = e.z;
+		MeshID[i] = mesh;
+		MaterialID[i] = material;
+		return (unsigned int)i;
+	}
+
+	//drop every entry from index count on
+	void Truncate(size_t count) {
+		if (count >= m_Count)
+			return;
+		m_Count = count;
+		Resize(m_Count);
+	}
+
+	/*-------setters, only mark dirty on change-------*/
+	void SetPosition(size_t i, const glm::vec3& p) {
+		if (PosX[i] != p.x || PosY[i] != p.y || PosZ[i] != p.z) {
+			PosX[i] = p.x; PosY[i] = p.y; PosZ[i] = p.z;
+			Dirty[i] = 1;
+		}
+	}
+
+	void SetRotation(size_t i, const glm::quat& q) {
+		if (RotX[i] != q.x || RotY[i] != q.y || RotZ[i] != q.z || RotW[i] != q.w) {
+			RotX[i] = q.x; RotY[i] = q.y; RotZ[i] = q.z; RotW[i] = q.w;
+			Dirty[i] = 1;
+		}
+	}
+
+	void SetScale(size_t i, const glm::vec3& s) {
+		if (ScaleX[i] != s.x || ScaleY[i] != s.y || ScaleZ[i] != s.z) {
+			ScaleX[i] = s.x; ScaleY[i] = s.y; ScaleZ[i] = s.z;
+			Dirty[i] = 1;
+		}
+	}
+
+	void SetLocalBounds(size_t i, const AABB& localBounds) {
+		glm::vec3 c = localBounds.Center();
+		glm::vec3 e = localBounds.Extent() * 0.5f;
+		LocalCX[i] = c.x; LocalCY[i] = c.y; LocalCZ[i] = c.z;
+		LocalEX[i] = e.x; LocalEY[i] = e.y; LocalEZ[i] = e.z;
+		Dirty[i] = 1;
+	}
+
+	void MarkAllDirty() {
+		std::fill(Dirty.begin(), Dirty.begin() + m_Count, 1);
+	}
+
+	/*-------spans for GPU upload / culling-------*/
+	Span<glm::mat4> WorldMatrices() const { return { World.data(), m_Count }; }
+	Span<AABB> Bounds() const { return { WorldBounds.data(), m_Count }; }
+	Span<unsigned int> Meshes() const { return { MeshID.data(), m_Count }; }
+	Span<unsigned int> Materials() const { return { MaterialID.data(), m_Count }; }
+
+	//union of the world bounds of [first, last)
+	AABB BoundsOf(size_t first, size_t last) const {
+		AABB box;
+		for (size_t i = first; i < last && i < m_Count; ++i)
+			box.Expand(WorldBounds[i]);
+		return box;
+	}
+
+	//rebuild world matrices and bounds of the dirty entries, returns how many were rebuilt
+	size_t Update(ThreadPool* pool = nullptr) {
+		size_t blocks = Padded(m_Count) / SC_BLOCK;
+		std::atomic<size_t> updated(0);
+		auto job = [&](size_t begin, size_t end) {
+			size_t local = 0;
+			for (size_t b = begin; b < end; ++b)
+				local += UpdateBlock(b * SC_BLOCK);
+			updated += local;
+		};
+		if (pool)
+			pool->ParallelFor(blocks, SC_GRAIN, job);
+		else
+			job(0, blocks);
+		return updated;
+	}
+
+private:
+	static size_t Padded(size_t count) {
+		return (count + SC_BLOCK - 1) / SC_BLOCK * SC_BLOCK;
+	}
+
+	std::vector<std::vector<float>*> FloatArrays() {
+		return { &PosX, &PosY, &PosZ, &RotX, &RotY, &RotZ, &RotW, &ScaleX, &ScaleY, &ScaleZ,
+				 &LocalCX, &LocalCY, &LocalCZ, &LocalEX, &LocalEY, &LocalEZ };
+	}
+
+	//arrays are padded to whole SIMD blocks, padding entries are identity transforms
+	void Resize(size_t count) {
+		size_t padded = Padded(count);
+		for (auto* v : FloatArrays())
+			v->resize(padded, 0.0f);
+		for (size_t i = count; i < padded; ++i) {
+			PosX[i] = PosY[i] = PosZ[i] = 0.0f;
+			RotX[i] = RotY[i] = RotZ[i] = 0.0f; RotW[i] = 1.0f;
+			ScaleX[i] = ScaleY[i] = ScaleZ[i] = 1.0f;
+			LocalCX[i] = LocalCY[i] = LocalCZ[i] = 0.0f;
+			LocalEX[i] = LocalEY[i] = LocalEZ[i] = 0.0f;
+		}
+		World.resize(padded, glm::mat4(1.0f));
+		WorldBounds.resize(padded);
+		MeshID.resize(padded, 0);
+		MaterialID.resize(padded, 0);
+		Dirty.resize(padded, 0);
+		for (size_t i = count; i < padded; ++i)
+			Dirty[i] = 0;
+	}
+
+	//4 consecutive entries starting at i
+	size_t UpdateBlock(size_t i) {
+		uint8_t* dirty = &Dirty[i];
+		size_t n = size_t(dirty[0]) + dirty[1] + dirty[2] + dirty[3];
+		if (n == 0)
+			return 0;
+#if SCENE_SIMD
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 two = _mm_set1_ps(2.0f);
+		__m128 qx = _mm_loadu_ps(&RotX[i]), qy = _mm_loadu_ps(&RotY[i]);
+		__m128 qz = _mm_loadu_ps(&RotZ[i]), qw = _mm_loadu_ps(&RotW[i]);
+		__m128 sx = _mm_loadu_ps(&ScaleX[i]), sy = _mm_loadu_ps(&ScaleY[i]), sz = _mm_loadu_ps(&ScaleZ[i]);
+		__m128 px = _mm_loadu_ps(&PosX[i]), py = _mm_loadu_ps(&PosY[i]), pz = _mm_loadu_ps(&PosZ[i]);
+
+		__m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+		__m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+		__m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+		//rotation * scale, column major (cAB: column A, row B)
+		__m128 c00 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+		__m128 c01 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+		__m128 c02 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+		__m128 c10 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+		__m128 c11 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+		__m128 c12 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+		__m128 c20 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+		__m128 c21 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+		__m128 c22 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+
+		//world bounds: center = M * c, extent = |M| * e
+		__m128 lcx = _mm_loadu_ps(&LocalCX[i]), lcy = _mm_loadu_ps(&LocalCY[i]), lcz = _mm_loadu_ps(&LocalCZ[i]);
+		__m128 lex = _mm_loadu_ps(&LocalEX[i]), ley = _mm_loadu_ps(&LocalEY[i]), lez = _mm_loadu_ps(&LocalEZ[i]);
+		__m128 wcx = _mm_add_ps(px, _mm_add_ps(_mm_mul_ps(c00, lcx), _mm_add_ps(_mm_mul_ps(c10, lcy), _mm_mul_ps(c20, lcz))));
+		__m128 wcy = _mm_add_ps(py, _mm_add_ps(_mm_mul_ps(c01, lcx), _mm_add_ps(_mm_mul_ps(c11, lcy), _mm_mul_ps(c21, lcz))));
+		__m128 wcz = _mm_add_ps(pz, _mm_add_ps(_mm_mul_ps(c02, lcx), _mm_add_ps(_mm_mul_ps(c12, lcy), _mm_mul_ps(c22, lcz))));
+		__m128 wex = _mm_add_ps(_mm_mul_ps(Abs(c00), lex), _mm_add_ps(_mm_mul_ps(Abs(c10), ley), _mm_mul_ps(Abs(c20), lez)));
+		__m128 wey = _mm_add_ps(_mm_mul_ps(Abs(c01), lex), _mm_add_ps(_mm_mul_ps(Abs(c11), ley), _mm_mul_ps(Abs(c21), lez)));
+		__m128 wez = _mm_add_ps(_mm_mul_ps(Abs(c02), lex), _mm_add_ps(_mm_mul_ps(Abs(c12), ley), _mm_mul_ps(Abs(c22), lez)));
+
+		//SoA -> one mat4 per entry
+		__m128 zero = _mm_setzero_ps();
+		__m128 col0[4] = { c00, c01, c02, zero };
+		__m128 col1[4] = { c10, c11, c12, zero };
+		__m128 col2[4] = { c20, c21, c22, zero };
+		__m128 col3[4] = { px, py, pz, one };
+		_MM_TRANSPOSE4_PS(col0[0], col0[1], col0[2], col0[3]);
+		_MM_TRANSPOSE4_PS(col1[0], col1[1], col1[2], col1[3]);
+		_MM_TRANSPOSE4_PS(col2[0], col2[1], col2[2], col2[3]);
+		_MM_TRANSPOSE4_PS(col3[0], col3[1], col3[2], col3[3]);
+
+		alignas(16) float bmin[3][4], bmax[3][4];
+		_mm_store_ps(bmin[0], _mm_sub_ps(wcx, wex)); _mm_store_ps(bmax[0], _mm_add_ps(wcx, wex));
+		_mm_store_ps(bmin[1], _mm_sub_ps(wcy, wey)); _mm_store_ps(bmax[1], _mm_add_ps(wcy, wey));
+		_mm_store_ps(bmin[2], _mm_sub_ps(wcz, wez)); _mm_store_ps(bmax[2], _mm_add_ps(wcz, wez));
+
+		for (int lane = 0; lane < 4; ++lane) {
+			if (!dirty[lane])
+				continue;
+			float* m = &World[i + lane][0][0];
+			_mm_storeu_ps(m + 0, col0[lane]);
+			_mm_storeu_ps(m + 4, col1[lane]);
+			_mm_storeu_ps(m + 8, col2[lane]);
+			_mm_storeu_ps(m + 12, col3[lane]);
+			WorldBounds[i + lane] = AABB(glm::vec3(bmin[0][lane], bmin[1][lane], bmin[2][lane]),
+										 glm::vec3(bmax[0][lane], bmax[1][lane], bmax[2][lane]));
+			dirty[lane] = 0;
+		}
+#else
+		for (size_t lane = 0; lane < 4; ++lane) {
+			if (dirty[lane])
+				UpdateScalar(i + lane);
+		}
+#endif
+		return n;
+	}
+
+#if SCENE_SIMD
+	static __m128 Abs(__m128 v) {
+		return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+	}
+#endif
+
+	//reference path, also used without SSE
+	void UpdateScalar(size_t i) {
+		float x = RotX[i], y = RotY[i], z = RotZ[i], w = RotW[i];
+		glm::mat4& m = World[i];
+		m[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f) * ScaleX[i];
+		m[1] = glm::vec4(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f) * ScaleY[i];
+		m[2] = glm::vec4(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f) * ScaleZ[i];
+		m[3] = glm::vec4(PosX[i], PosY[i], PosZ[i], 1.0f);
+		glm::vec3 c(LocalCX[i], LocalCY[i], LocalCZ[i]);
+		glm::vec3 e(LocalEX[i], LocalEY[i], LocalEZ[i]);
+		WorldBounds[i] = AABB(c - e, c + e).Transform(m);
+		Dirty[i] = 0;
+	}
+};
@@ -3,7 +3,9 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <vector>
 #include <unordered_map>
+#include <memory>
 
 #include "Renderer.h"
 
@@ -21,19 +23,27 @@ class Shader {
 	unsigned int m_Type;
 	std::string m_FilePath;
 	unsigned int m_RendererID;
+	std::vector<std::string> m_Defines; //injected right after the #version line of every stage
+	std::unordered_map<std::string, std::unique_ptr<Shader>> m_Variants; //Variant(), compiled on first request
 
 	std::unordered_map<std::string, int> m_UniformLocationCache;
 
 public:
 	//ctor (vertex shader and fragment shader)
-	Shader(unsigned int type, const std::string& filepath)
-		:m_Type(type), m_FilePath(filepath), m_RendererID(0) {
+	//defines: variants of the same file, e.g. { "INSTANCED" } or { "NUM_SAMPLES 16" }
+	Shader(unsigned int type, const std::string& filepath, const std::vector<std::string>& defines = {})
+		:m_Type(type), m_FilePath(filepath), m_RendererID(0), m_Defines(defines) {
 		if (m_Type == VF_SHADER) {
 			ShaderProgramSource source = ParseShader(filepath);
 			m_RendererID = CreateShader(source.VertexSource, source.FragmentSource);
 		}
 		else if(m_Type == CP_SHADER){
-			std::string src = readFileIntoString(filepath);
+			//GL 3.3 contexts: no program, the caller checks GLCapabilities before dispatching
+			if (!GLEW_VERSION_4_3) {
+				std::cout << filepath << ": compute shaders need GL 4.3, skipped" << std::endl;
+				return;
+			}
+			std::string src = InjectDefines(ExpandIncludes(readFileIntoString(filepath), Directory(filepath)));
 			unsigned int compute = CompileShader(GL_COMPUTE_SHADER, src);
 			m_RendererID = glCreateProgram();
 			glAttachShader(m_RendererID, compute);
@@ -48,7 +58,7 @@ public:
 	
 	//dtor
 	~Shader() {
-		glDeleteProgram(m_RendererID);
+		glState().DeleteProgram(m_RendererID);
 	};
 
 	unsigned int getID() const {
@@ -59,12 +69,23 @@ public:
 		return m_RendererID;
 	}
 
+	//the same file with one more define, owned by this shader
+	Shader& Variant(const std::string& define) {
+		auto it = m_Variants.find(define);
+		if (it == m_Variants.end()) {
+			std::vector<std::string> defines = m_Defines;
+			defines.push_back(define);
+			it = m_Variants.emplace(define, std::unique_ptr<Shader>(new Shader(m_Type, m_FilePath, defines))).first;
+		}
+		return *it->second;
+	}
+
 	void Bind() const {
-		glUseProgram(m_RendererID);
+		glState().UseProgram(m_RendererID);
 	};
 
 	void Unbind() const {
-		glUseProgram(0);
+		glState().UseProgram(0);
 	};
 
 	//set uniforms
@@ -77,6 +98,12 @@ public:
 	void SetUniform1b(const std::string& name, bool value) {
 		glUniform1i(GetUniformLocation(name), (int)value);
 	}
+	void SetUniform2i(const std::string& name, int v0, int v1) {
+		glUniform2i(GetUniformLocation(name), v0, v1);
+	};
+	void SetUniform2f(const std::string& name, float v0, float v1) {
+		glUniform2f(GetUniformLocation(name), v0, v1);
+	};
 	void SetUniform3f(const std::string& name, float v0, float v1, float v2) {
 		glUniform3f(GetUniformLocation(name), v0, v1, v2);
 	};
@@ -86,6 +113,15 @@ public:
 	void SetUniformM4fv(const std::string& name, int count, unsigned char transpose, const float* value) {
 		glUniformMatrix4fv(GetUniformLocation(name), count, transpose, value);
 	};
+	//uniform blocks (GLSL 330 has no layout(binding) for them)
+	void SetUniformBlockBinding(const std::string& name, unsigned int binding) {
+		unsigned int index = glGetUniformBlockIndex(m_RendererID, name.c_str());
+		if (index == GL_INVALID_INDEX) {
+			std::cout << "Warning: uniform block " << name << " doesn't exist!" << std::endl;
+			return;
+		}
+		glUniformBlockBinding(m_RendererID, index, binding);
+	};
 
 private:
 
@@ -128,14 +164,63 @@ private:
 					type = ShaderType::FRAGMENT;
 				}
 			}
+			else if (line.find("#include") != std::string::npos) {
+				ss[(int)type] << ExpandIncludes(line + '\n', Directory(filepath));
+			}
 			else {
 				ss[(int)type] << line << '\n';
+				if (line.find("#version") != std::string::npos) {
+					for (const auto& define : m_Defines)
+						ss[(int)type] << "#define " << define << '\n';
+				}
 			}
 		}
 
 		return { ss[0].str(), ss[1].str() }; //use struct to multi return
 	};
 
+	//directory part of a path, with the trailing separator
+	static std::string Directory(const std::string& filepath) {
+		size_t slash = filepath.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : filepath.substr(0, slash + 1);
+	}
+
+	//replace every #include "file" line (path relative to the including file) by the file, recursively
+	std::string ExpandIncludes(const std::string& source, const std::string& directory) {
+		std::istringstream in(source);
+		std::ostringstream out;
+		std::string line;
+		while (getline(in, line)) {
+			size_t first = line.find('"');
+			size_t last = line.find('"', first + 1);
+			if (line.find("#include") == std::string::npos || first == std::string::npos || last == std::string::npos) {
+				out << line << '\n';
+				continue;
+			}
+			std::string path = directory + line.substr(first + 1, last - first - 1);
+			std::ifstream file(path);
+			if (file.fail()) {
+				std::cout << "Shader include: " << path << " is invalid!" << std::endl;
+				continue;
+			}
+			out << ExpandIncludes(readFileIntoString(path), Directory(path));
+		}
+		return out.str();
+	}
+
+	//insert the defines after the #version line of a single stage source
+	std::string InjectDefines(const std::string& source) {
+		if (m_Defines.empty())
+			return source;
+		size_t pos = source.find("#version");
+		pos = (pos == std::string::npos) ? 0 : source.find('\n', pos);
+		pos = (pos == std::string::npos) ? source.size() : pos + 1;
+		std::string defines;
+		for (const auto& define : m_Defines)
+			defines += "#define " + define + "\n";
+		return source.substr(0, pos) + defines + source.substr(pos);
+	}
+
 	unsigned int CompileShader(unsigned int type, const std::string& source) {
 		unsigned int id = glCreateShader(type); 
 		const char* src = source.c_str();
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+#include "Shader.h"
+#include "FullscreenQuad.h"
+#include "ThreadPool.h"
+#include "DepthRasterizer.h"
+#include "CPUShadows.h"
+
+//default shadow bake settings:
+const int SB_LIGHTMAP_SIZE = 512;
+const int SB_SHADOW_MAP_SIZE = 2048; //CPU bakes: static casters only, twice the live map
+const unsigned int SB_TEXTURE_UNIT = 10; //u_BakedShadow in VSSM_Scene.shader
+const unsigned int SB_DYNAMIC_TEXTURE_UNIT = 11; //u_DynamicDepthMap in Shadows.glsl, the casters that are not baked
+const uint64_t SB_HASH_SEED = 14695981039346656037ull; //FNV-1a offset basis
+
+enum BakeSource {
+	BAKE_CPU = 0, //CPUShadowEvaluator (Basic / PCF / PCSS / VSSM) over the thread pool
+	BAKE_GPU = 1 //Shadows.glsl with the current technique, one frame of the light pass
+};
+const char* const BAKE_SOURCE_NAMES[] = { "CPU reference (thread pool)", "GPU (current technique)" };
+
+//FNV-1a over raw bytes, chained: the bake keys of the light, the casters and every receiver
+inline uint64_t bakeHash(uint64_t hash, const void* data, size_t bytes) {
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < bytes; ++i) {
+		hash ^= p[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+template<typename T>
+uint64_t bakeHash(uint64_t hash, const T& value) {
+	return bakeHash(hash, &value, sizeof(T));
+}
+
+
+/*
+ * Baked shadow factor of one static planar receiver (R8, linear, clamp to edge). Texel (x, y) is the
+ * world point Origin + AxisU * (x + 0.5) / size + AxisV * (y + 0.5) / size with one normal, so the
+ * lit pass finds its texel from the fragment position alone. BakedKey is the scene key the texels
+ * were made with; a receiver is only baked again when its key changes.
+ */
+class ShadowLightmap {
+private:
+	unsigned int m_Texture;
+	unsigned int m_FBO;
+	int m_Size;
+	std::vector<float> m_Shadow;
+
+public:
+	glm::vec3 Origin;
+	glm::vec3 AxisU;
+	glm::vec3 AxisV;
+	glm::vec3 Normal;
+	uint64_t BakedKey;
+	bool Valid;
+
+	//ctor
+	explicit ShadowLightmap(int size = SB_LIGHTMAP_SIZE)
+		: m_Texture(0), m_FBO(0), m_Size(size), Origin(0.0f), AxisU(1.0f, 0.0f, 0.0f), AxisV(0.0f, 0.0f, 1.0f),
+		Normal(0.0f, 1.0f, 0.0f), BakedKey(0), Valid(false) {
+		glGenTextures(1, &m_Texture);
+		glState().BindTexture(GL_TEXTURE_2D, m_Texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, size, size, 0, GL_RED, GL_FLOAT, nullptr);
+		gpuMemory().TrackTexture(m_Texture, GM_SHADOW_MAPS, "Baked lightmap", GL_R8, size, size);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+		glGenFramebuffers(1, &m_FBO);
+		glState().BindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_Texture, 0);
+		glState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+	};
+	//dtor
+	~ShadowLightmap() {
+		glState().DeleteFramebuffers(1, &m_FBO);
+		glState().DeleteTextures(1, &m_Texture);
+	};
+
+	//gtor
+	int GetSize() const {
+		return m_Size;
+	}
+	double GetResidentBytes() const {
+		return double(m_Size) * m_Size;
+	}
+
+	//the rectangle localOrigin + [0, 1] localU + [0, 1] localV of a mesh placed by model
+	void SetRect(const glm::mat4& model, const glm::vec3& localOrigin, const glm::vec3& localU, const glm::vec3& localV) {
+		Origin = glm::vec3(model * glm::vec4(localOrigin, 1.0f));
+		AxisU = glm::vec3(model * glm::vec4(localU, 0.0f));
+		AxisV = glm::vec3(model * glm::vec4(localV, 0.0f));
+		Normal = glm::normalize(glm::cross(AxisV, AxisU));
+	}
+	uint64_t RectKey() const {
+		uint64_t key = bakeHash(SB_HASH_SEED, Origin);
+		key = bakeHash(key, AxisU);
+		key = bakeHash(key, AxisV);
+		return bakeHash(key, m_Size);
+	}
+	glm::vec3 TexelPosition(int x, int y) const {
+		return Origin + AxisU * ((x + 0.5f) / m_Size) + AxisV * ((y + 0.5f) / m_Size);
+	}
+
+	//CPU bake from a shadow map of the static casters; the texels are set up on the pool, then shaded on it
+	void BakeCPU(const CPUShadowMap& map, const CPUShadowEvaluator& evaluator, const glm::mat4& lightSpaceMatrix,
+		const glm::vec3& lightPos, ThreadPool* pool) {
+		ShadowGBuffer texels(m_Size, m_Size);
+		auto setup = [&](size_t begin, size_t end) {
+			for (size_t y = begin; y < end; ++y)
+				for (int x = 0; x < m_Size; ++x) {
+					size_t i = y * m_Size + x;
+					glm::vec3 p = TexelPosition(x, int(y));
+					glm::vec4 light = lightSpaceMatrix * glm::vec4(p, 1.0f);
+					texels.LightX[i] = light.x;
+					texels.LightY[i] = light.y;
+					texels.LightZ[i] = light.z;
+					texels.LightW[i] = light.w;
+					texels.NdotL[i] = glm::dot(Normal, glm::normalize(lightPos - p));
+				}
+		};
+		if (pool)
+			pool->ParallelFor(size_t(m_Size), 16, setup);
+		else
+			setup(0, size_t(m_Size));
+		evaluator.Evaluate(map, texels, m_Shadow, pool);
+		glState().BindTexture(GL_TEXTURE_2D, m_Texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_Size, m_Size, GL_RED, GL_FLOAT, m_Shadow.data());
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	//GPU bake, bakeShader: BakeShadow.shader with the shadow uniforms and tables of a static casters light pass set.
+	//Leaves the default framebuffer bound, the viewport at the lightmap size
+	void BakeGPU(Shader& bakeShader, const FullscreenQuad& quad) {
+		bakeShader.Bind();
+		bakeShader.SetUniform3f("u_LightmapOrigin", Origin.x, Origin.y, Origin.z);
+		bakeShader.SetUniform3f("u_LightmapAxisU", AxisU.x, AxisU.y, AxisU.z);
+		bakeShader.SetUniform3f("u_LightmapAxisV", AxisV.x, AxisV.y, AxisV.z);
+		bakeShader.SetUniform3f("u_LightmapNormal", Normal.x, Normal.y, Normal.z);
+		glState().BindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+		glState().Viewport(0, 0, m_Size, m_Size);
+		glState().Disable(GL_DEPTH_TEST);
+		quad.Draw(bakeShader);
+		glState().Enable(GL_DEPTH_TEST);
+		glState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	//world position -> lightmap uv for the lit pass
+	void SetUniforms(Shader& shader) const {
+		glm::vec3 u = AxisU / glm::dot(AxisU, AxisU), v = AxisV / glm::dot(AxisV, AxisV);
+		shader.SetUniform3f("u_LightmapOrigin", Origin.x, Origin.y, Origin.z);
+		shader.SetUniform3f("u_LightmapU", u.x, u.y, u.z);
+		shader.SetUniform3f("u_LightmapV", v.x, v.y, v.z);
+	}
+
+	void Bind(unsigned int unit = SB_TEXTURE_UNIT) const {
+		glState().ActiveTexture(GL_TEXTURE0 + unit);
+		glState().BindTexture(GL_TEXTURE_2D, m_Texture);
+	}
+};
+
+
+/*
+ * Bakes the shadow of the static casters into the lightmaps of the static receivers, incrementally:
+ *  - the keys are made by the caller: the caster key (light position, static caster transforms) and
+ *    the scene key (caster key, light size, technique),
+ *  - a receiver is stale when the scene key or its own rectangle changed,
+ *  - the CPU path keeps the rasterized shadow map of the static casters (SB_SHADOW_MAP_SIZE) and
+ *    its SAT, and only draws it again when the caster key changes: a receiver that moved, or a new
+ *    light size, is shaded again from the cached map.
+ * A planar receiver cannot shadow itself, so it does not have to be one of the casters.
+ */
+class ShadowBaker {
+private:
+	DepthRasterizer m_Rasterizer;
+	std::unique_ptr<CPUShadowMap> m_Map; //created by the first CPU bake
+	uint64_t m_MapKey;
+	FullscreenQuad m_Quad;
+
+public:
+	BakeSource Source;
+	bool AutoRebake; //bake stale receivers as soon as they change
+	CPUShadowEvaluator Evaluator;
+	//last bake
+	double LastBakeMs;
+	double LastMapMs; //CPU: static casters rasterized + SAT, 0 when the cached map was reused
+	int LastBaked;
+	size_t LastTexels;
+
+	//ctor
+	ShadowBaker()
+		: m_Rasterizer(SB_SHADOW_MAP_SIZE), m_MapKey(0), Source(BAKE_CPU), AutoRebake(true),
+		LastBakeMs(0.0), LastMapMs(0.0), LastBaked(0), LastTexels(0) {};
+
+	int GetShadowMapSize() const {
+		return SB_SHADOW_MAP_SIZE;
+	}
+	static uint64_t ReceiverKey(const ShadowLightmap& lightmap, uint64_t sceneKey) {
+		return bakeHash(lightmap.RectKey(), sceneKey);
+	}
+	static bool IsStale(const ShadowLightmap& lightmap, uint64_t sceneKey) {
+		return !lightmap.Valid || lightmap.BakedKey != ReceiverKey(lightmap, sceneKey);
+	}
+
+	/*
+	 * CPU bake of the stale receivers. submitCasters: draws the static casters into the rasterizer
+	 * (called only when the caster key changed); lightSize: in texels of the SB_SHADOW_MAP_SIZE map;
+	 * type: u_ShadowRenderType, the moment techniques (EVSM / MSM / VSM) are baked as VSSM
+	 */
+	int BakeCPU(const std::vector<ShadowLightmap*>& receivers, uint64_t casterKey, uint64_t sceneKey,
+		const std::function<void(DepthRasterizer&)>& submitCasters, const glm::mat4& lightSpaceMatrix,
+		const glm::vec3& lightPos, float lightSize, int type, ThreadPool* pool) {
+		auto start = std::chrono::high_resolution_clock::now();
+		int baked = 0;
+		size_t texels = 0;
+		double mapMs = 0.0;
+		for (ShadowLightmap* lightmap : receivers) {
+			if (!IsStale(*lightmap, sceneKey))
+				continue;
+			if (!m_Map || m_MapKey != casterKey) {
+				auto mapStart = std::chrono::high_resolution_clock::now();
+				if (!m_Map)
+					m_Map.reset(new CPUShadowMap(SB_SHADOW_MAP_SIZE));
+				m_Rasterizer.Clear();
+				submitCasters(m_Rasterizer);
+				m_Rasterizer.Rasterize(pool);
+				m_Map->SetDepth(m_Rasterizer.GetDepth().data());
+				m_MapKey = casterKey;
+				std::chrono::duration<double, std::milli> ms = std::chrono::high_resolution_clock::now() - mapStart;
+				mapMs = ms.count();
+			}
+			Evaluator.Type = std::min(type, CS_TYPES - 1);
+			Evaluator.LightSize = lightSize;
+			lightmap->BakeCPU(*m_Map, Evaluator, lightSpaceMatrix, lightPos, pool);
+			lightmap->BakedKey = ReceiverKey(*lightmap, sceneKey);
+			lightmap->Valid = true;
+			baked++;
+			texels += size_t(lightmap->GetSize()) * lightmap->GetSize();
+		}
+		record(start, baked, texels, mapMs);
+		return baked;
+	}
+
+	//GPU bake of the stale receivers, after a static casters light pass (see BakeGPU of ShadowLightmap)
+	int BakeGPU(const std::vector<ShadowLightmap*>& receivers, uint64_t sceneKey, Shader& bakeShader) {
+		auto start = std::chrono::high_resolution_clock::now();
+		int baked = 0;
+		size_t texels = 0;
+		for (ShadowLightmap* lightmap : receivers) {
+			if (!IsStale(*lightmap, sceneKey))
+				continue;
+			lightmap->BakeGPU(bakeShader, m_Quad);
+			lightmap->BakedKey = ReceiverKey(*lightmap, sceneKey);
+			lightmap->Valid = true;
+			baked++;
+			texels += size_t(lightmap->GetSize()) * lightmap->GetSize();
+		}
+		record(start, baked, texels, 0.0);
+		return baked;
+	}
+
+	//drops every bake, the next frame bakes again
+	void Invalidate(const std::vector<ShadowLightmap*>& receivers) {
+		for (ShadowLightmap* lightmap : receivers)
+			lightmap->Valid = false;
+		m_MapKey = 0;
+	}
+
+private:
+	//the stats keep the last bake that did something
+	void record(std::chrono::high_resolution_clock::time_point start, int baked, size_t texels, double mapMs) {
+		if (!baked)
+			return;
+		std::chrono::duration<double, std::milli> ms = std::chrono::high_resolution_clock::now() - start;
+		LastBakeMs = ms.count();
+		LastMapMs = mapMs;
+		LastBaked = baked;
+		LastTexels = texels;
+	}
+};
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+#include "Shader.h"
+#include "FullscreenQuad.h"
+
+//default shadow mask settings:
+const unsigned int SM_MASK_TEXTURE_UNIT = 4; //u_ShadowMask in VSSM_Scene.shader
+const unsigned int SM_DEPTH_TEXTURE_UNIT = 5; //u_SceneDepth in ShadowMask.shader
+const unsigned int SM_NORMAL_TEXTURE_UNIT = 6; //u_SceneNormal in ShadowMask.shader
+const unsigned int SM_LOW_MASK_TEXTURE_UNIT = 7; //u_LowMask in ShadowMask.shader (UPSAMPLE)
+const float SM_EDGE_THRESHOLD = 0.5f;
+const float SM_ERROR_THRESHOLD = 0.1f; //mask difference counted as a visibly wrong pixel
+const float SM_UMBRA = 0.05f; //reference shadow at or below this is umbra, light there is leaking
+static const char* MASK_RESOLUTION_NAMES[3] = { "full", "half", "quarter" }; //Downsample 1, 2, 4
+
+
+//camera and light of the frame the mask is evaluated for
+struct ShadowMaskView {
+	glm::mat4 ViewProjection;
+	glm::mat4 LightSpaceMatrix;
+	glm::vec3 LightPosition;
+	float NearPlane;
+	float FarPlane;
+	bool DynamicCasters; //the baked receiver (prepass alpha 0) evaluates the dynamic caster map, nothing otherwise
+};
+
+//difference between a mask and a reference evaluation
+struct MaskError {
+	double Mean; //mean absolute difference
+	double AboveThreshold; //fraction of pixels off by more than SM_ERROR_THRESHOLD
+	double Leak; //fraction of the reference umbra pixels more than SM_ERROR_THRESHOLD brighter
+};
+
+
+/*
+ * Deferred screen-space shadow mask.
+ * A depth prepass (VSSM_Scene.shader with DEPTH_PREPASS) writes depth and normals of the visible
+ * surfaces, then one fullscreen pass (ShadowMask.shader) rebuilds the world position of every pixel
+ * and evaluates the selected shadow technique once into an R8 mask. The lit pass reads the mask at
+ * gl_FragCoord instead of filtering the shadow map for every fragment it shades, overdrawn or not.
+ * With Downsample 2 or 4 the technique runs on every 2nd / 4th pixel in x and y, and a joint bilateral
+ * upsample (ShadowMask.shader with UPSAMPLE) guided by the full resolution depth and normals fills the
+ * mask, evaluating again at full resolution where the matching neighbours disagree (shadow edges).
+ * The shadow map textures and sample tables must be bound on their usual units before Evaluate().
+ */
+class ShadowMask {
+private:
+	int m_Width;
+	int m_Height;
+	unsigned int m_PrepassFBO;
+	unsigned int m_Depth;
+	unsigned int m_Normal;
+	unsigned int m_MaskFBO;
+	unsigned int m_Mask;
+	unsigned int m_LowFBO;
+	unsigned int m_LowMask;
+	int m_LowDownsample; //m_LowMask allocation
+	unsigned int m_ReferenceFBO;
+	unsigned int m_Reference;
+
+	FullscreenQuad m_Quad;
+
+	static unsigned int createTarget(const char* owner, int width, int height, GLenum internalFormat, GLenum format, GLenum type) {
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glState().BindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+		gpuMemory().TrackTexture(texture, GM_SCREEN_TARGETS, owner, internalFormat, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+
+	static unsigned int createMaskFBO(unsigned int mask) {
+		unsigned int fbo;
+		glGenFramebuffers(1, &fbo);
+		glState().BindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mask, 0);
+		glState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+		return fbo;
+	}
+
+	int lowWidth() const {
+		return (m_Width + Downsample - 1) / Downsample;
+	}
+	int lowHeight() const {
+		return (m_Height + Downsample - 1) / Downsample;
+	}
+
+	//the evaluation pass into `fbo`, one texel every `downsample` pixels
+	void evaluatePass(Shader& maskShader, const ShadowMaskView& view, unsigned int fbo, int width, int height, int downsample) {
+		glState().BindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glState().Viewport(0, 0, width, height);
+		setViewUniforms(maskShader, view);
+		maskShader.SetUniform1i("u_Downsample", downsample);
+		m_Quad.Draw(maskShader);
+	}
+
+	void setViewUniforms(Shader& shader, const ShadowMaskView& view) {
+		glm::mat4 invViewProjection = glm::inverse(view.ViewProjection);
+		shader.Bind();
+		shader.SetUniformM4fv("u_InvViewProjection", 1, GL_FALSE, glm::value_ptr(invViewProjection));
+		shader.SetUniformM4fv("u_LightSpaceMatrix", 1, GL_FALSE, glm::value_ptr(view.LightSpaceMatrix));
+		shader.SetUniform3f("u_LightPosition", view.LightPosition.x, view.LightPosition.y, view.LightPosition.z);
+		shader.SetUniform1i("u_DynamicCasters", view.DynamicCasters ? 1 : 0);
+	}
+
+	void bindPrepass() const {
+		glState().ActiveTexture(GL_TEXTURE0 + SM_DEPTH_TEXTURE_UNIT);
+		glState().BindTexture(GL_TEXTURE_2D, m_Depth);
+		glState().ActiveTexture(GL_TEXTURE0 + SM_NORMAL_TEXTURE_UNIT);
+		glState().BindTexture(GL_TEXTURE_2D, m_Normal);
+	}
+
+	void createTargets() {
+		m_Depth = createTarget("ShadowMask depth", m_Width, m_Height, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT);
+		m_Normal = createTarget("ShadowMask normal", m_Width, m_Height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+		m_Mask = createTarget("ShadowMask", m_Width, m_Height, GL_R8, GL_RED, GL_UNSIGNED_BYTE);
+
+		glGenFramebuffers(1, &m_PrepassFBO);
+		glState().BindFramebuffer(GL_FRAMEBUFFER, m_PrepassFBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_Normal, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_Depth, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "Shadow mask prepass framebuffer incomplete!" << std::endl;
+
+		m_MaskFBO = createMaskFBO(m_Mask);
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	void deleteTargets() {
+		glState().DeleteFramebuffers(1, &m_PrepassFBO);
+		glState().DeleteFramebuffers(1, &m_MaskFBO);
+		glState().DeleteTextures(1, &m_Depth);
+		glState().DeleteTextures(1, &m_Normal);
+		glState().DeleteTextures(1, &m_Mask);
+		if (m_LowMask) {
+			glState().DeleteFramebuffers(1, &m_LowFBO);
+			glState().DeleteTextures(1, &m_LowMask);
+			m_LowFBO = m_LowMask = 0;
+			m_LowDownsample = 0;
+		}
+		if (m_Reference) {
+			glState().DeleteFramebuffers(1, &m_ReferenceFBO);
+			glState().DeleteTextures(1, &m_Reference);
+			m_ReferenceFBO = m_Reference = 0;
+		}
+	}
+
+	std::vector<unsigned char> readMask(unsigned int texture) const {
+		std::vector<unsigned char> pixels((size_t)m_Width * m_Height);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glState().BindTexture(GL_TEXTURE_2D, texture);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+		return pixels;
+	}
+
+public:
+	int Downsample; //1: full resolution, 2: half, 4: quarter
+	bool EdgeFallback;
+	float EdgeThreshold;
+
+	//ctor
+	ShadowMask(int width, int height)
+		: m_Width(width), m_Height(height), m_LowFBO(0), m_LowMask(0), m_LowDownsample(0), m_ReferenceFBO(0), m_Reference(0),
+		Downsample(1), EdgeFallback(true), EdgeThreshold(SM_EDGE_THRESHOLD) {
+		createTargets();
+	};
+	//dtor
+	~ShadowMask() {
+		deleteTargets();
+	};
+
+	//match the resolution the camera pass renders at (dynamic resolution)
+	void Resize(int width, int height) {
+		if (width == m_Width && height == m_Height)
+			return;
+		deleteTargets();
+		m_Width = width;
+		m_Height = height;
+		createTargets();
+	}
+
+	//gtor
+	unsigned int GetMask() const {
+		return m_Mask;
+	}
+	unsigned int GetDepth() const {
+		return m_Depth;
+	}
+
+	//bind and clear the prepass target, the caller draws the visible objects with a DEPTH_PREPASS shader
+	void BeginPrepass() {
+		glState().BindFramebuffer(GL_FRAMEBUFFER, m_PrepassFBO);
+		glState().Viewport(0, 0, m_Width, m_Height);
+		glState().Enable(GL_DEPTH_TEST);
+		glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	//one shadow evaluation per prepass pixel (Downsample 1), or per low resolution texel plus the upsample
+	void Evaluate(Shader& maskShader, Shader& upsampleShader, const ShadowMaskView& view) {
+		glState().Disable(GL_DEPTH_TEST);
+		bindPrepass();
+		if (Downsample <= 1) {
+			evaluatePass(maskShader, view, m_MaskFBO, m_Width, m_Height, 1);
+			glState().Enable(GL_DEPTH_TEST);
+			return;
+		}
+
+		if (m_LowDownsample != Downsample) {
+			if (m_LowMask) {
+				glState().DeleteFramebuffers(1, &m_LowFBO);
+				glState().DeleteTextures(1, &m_LowMask);
+			}
+			m_LowMask = createTarget("ShadowMask low resolution", lowWidth(), lowHeight(), GL_R8, GL_RED, GL_UNSIGNED_BYTE);
+			m_LowFBO = createMaskFBO(m_LowMask);
+			m_LowDownsample = Downsample;
+		}
+		evaluatePass(maskShader, view, m_LowFBO, lowWidth(), lowHeight(), Downsample);
+
+		glState().BindFramebuffer(GL_FRAMEBUFFER, m_MaskFBO);
+		glState().Viewport(0, 0, m_Width, m_Height);
+		glState().ActiveTexture(GL_TEXTURE0 + SM_LOW_MASK_TEXTURE_UNIT);
+		glState().BindTexture(GL_TEXTURE_2D, m_LowMask);
+		setViewUniforms(upsampleShader, view);
+		upsampleShader.SetUniform1i("u_LowMask", SM_LOW_MASK_TEXTURE_UNIT);
+		upsampleShader.SetUniform1i("u_Downsample", Downsample);
+		upsampleShader.SetUniform2f("u_NearFar", view.NearPlane, view.FarPlane);
+		upsampleShader.SetUniform1b("u_EdgeFallback", EdgeFallback);
+		upsampleShader.SetUniform1f("u_EdgeThreshold", EdgeThreshold);
+		m_Quad.Draw(upsampleShader);
+		glState().Enable(GL_DEPTH_TEST);
+	}
+
+	//evaluate the mask again at full resolution and compare (reads both masks back, stalls: stats only);
+	//maskShader may be set up for another technique than the mask (reference for light leaking)
+	MaskError MeasureError(Shader& maskShader, const ShadowMaskView& view) {
+		if (!m_Reference) {
+			m_Reference = createTarget("ShadowMask reference", m_Width, m_Height, GL_R8, GL_RED, GL_UNSIGNED_BYTE);
+			m_ReferenceFBO = createMaskFBO(m_Reference);
+		}
+		glState().Disable(GL_DEPTH_TEST);
+		bindPrepass();
+		evaluatePass(maskShader, view, m_ReferenceFBO, m_Width, m_Height, 1);
+		glState().Enable(GL_DEPTH_TEST);
+
+		std::vector<unsigned char> mask = readMask(m_Mask);
+		std::vector<unsigned char> reference = readMask(m_Reference);
+		double sum = 0.0;
+		size_t above = 0, umbra = 0, leaking = 0;
+		for (size_t i = 0; i < mask.size(); ++i) {
+			float difference = std::abs(int(mask[i]) - int(reference[i])) / 255.0f;
+			sum += difference;
+			above += difference > SM_ERROR_THRESHOLD;
+			if (reference[i] <= SM_UMBRA * 255.0f) {
+				umbra++;
+				leaking += (mask[i] - reference[i]) / 255.0f > SM_ERROR_THRESHOLD;
+			}
+		}
+		double pixels = (double)mask.size();
+		return { sum / pixels, above / pixels, umbra ? double(leaking) / umbra : 0.0 };
+	}
+
+	void Bind(unsigned int unit = SM_MASK_TEXTURE_UNIT) const {
+		glState().ActiveTexture(GL_TEXTURE0 + unit);
+		glState().BindTexture(GL_TEXTURE_2D, m_Mask);
+	}
+};
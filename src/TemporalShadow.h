@@ -0,0 +1,212 @@
+#pragma once
+
+#include <cmath>
+#include <iostream>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLState.h"
+#include "GPUMemory.h"
+#include "Shader.h"
+#include "FullscreenQuad.h"
+
+//default temporal shadow settings:
+const float TS_BLEND = 0.1f; //weight of the current frame once the history has converged
+const float TS_DEPTH_TOLERANCE = 0.02f; //relative view depth difference still treated as the same surface
+const float TS_NORMAL_TOLERANCE = 0.9f; //min cosine between the current and the reprojected normal
+const double TS_GOLDEN_RATIO = 0.6180339887; //per frame offset of the blue noise rotation
+
+
+/*
+ * Temporal accumulation of the shadow factor in screen space.
+ * The lit pass renders into an offscreen target split in three (ambient, direct light, normal + this
+ * frame's shadow) plus depth. Resolve() reprojects last frame's accumulated shadow with the previous
+ * view-projection, rejects it where depth or normal disagree (disocclusion), clamps it to the 3x3
+ * neighbourhood of this frame's shadow (light or casters moved) and blends. Composite() writes
+ * ambient + shadow * direct and the scene depth to the default framebuffer.
+ * Normals, depth and history are double buffered; the two lighting targets are shared.
+ */
+class TemporalShadow {
+private:
+	int m_Width;
+	int m_Height;
+	unsigned int m_Ambient;
+	unsigned int m_Direct;
+	unsigned int m_NormalShadow[2];
+	unsigned int m_Depth[2];
+	unsigned int m_SceneFBO[2];
+	unsigned int m_History[2]; //R: accumulated shadow, G: frames accumulated
+	unsigned int m_HistoryFBO[2];
+	int m_Current;
+	bool m_HistoryValid;
+	unsigned int m_Frame;
+	glm::mat4 m_PrevViewProjection;
+
+	FullscreenQuad m_Quad;
+
+	static unsigned int createTarget(const char* owner, int width, int height, GLenum internalFormat, GLenum format, GLenum type, GLenum filter) {
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glState().BindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+		gpuMemory().TrackTexture(texture, GM_SCREEN_TARGETS, owner, internalFormat, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+
+	static void bindTexture(unsigned int unit, unsigned int texture) {
+		glState().ActiveTexture(GL_TEXTURE0 + unit);
+		glState().BindTexture(GL_TEXTURE_2D, texture);
+	}
+
+	void createTargets() {
+		m_Ambient = createTarget("TemporalShadow ambient", m_Width, m_Height, GL_RGBA16F, GL_RGBA, GL_FLOAT, GL_NEAREST);
+		m_Direct = createTarget("TemporalShadow direct", m_Width, m_Height, GL_RGBA16F, GL_RGBA, GL_FLOAT, GL_NEAREST);
+		const GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+		glGenFramebuffers(2, m_SceneFBO);
+		glGenFramebuffers(2, m_HistoryFBO);
+		for (int i = 0; i < 2; ++i) {
+			m_NormalShadow[i] = createTarget("TemporalShadow normal", m_Width, m_Height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_NEAREST);
+			m_Depth[i] = createTarget("TemporalShadow depth", m_Width, m_Height, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, GL_NEAREST);
+			glState().BindFramebuffer(GL_FRAMEBUFFER, m_SceneFBO[i]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_Ambient, 0);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_Direct, 0);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_NormalShadow[i], 0);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_Depth[i], 0);
+			glDrawBuffers(3, drawBuffers);
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+				std::cout << "Temporal shadow scene framebuffer incomplete!" << std::endl;
+
+			//the history is sampled bilinearly at the reprojected position
+			m_History[i] = createTarget("TemporalShadow history", m_Width, m_Height, GL_RG16F, GL_RG, GL_FLOAT, GL_LINEAR);
+			glState().BindFramebuffer(GL_FRAMEBUFFER, m_HistoryFBO[i]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_History[i], 0);
+		}
+		glState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	void deleteTargets() {
+		glState().DeleteFramebuffers(2, m_SceneFBO);
+		glState().DeleteFramebuffers(2, m_HistoryFBO);
+		glState().DeleteTextures(1, &m_Ambient);
+		glState().DeleteTextures(1, &m_Direct);
+		glState().DeleteTextures(2, m_NormalShadow);
+		glState().DeleteTextures(2, m_Depth);
+		glState().DeleteTextures(2, m_History);
+	}
+
+public:
+	float Blend;
+	float DepthTolerance;
+	float NormalTolerance;
+	bool NeighborhoodClamp;
+
+	//ctor
+	TemporalShadow(int width, int height)
+		: m_Width(width), m_Height(height), m_Current(0), m_HistoryValid(false), m_Frame(0), m_PrevViewProjection(1.0f),
+		Blend(TS_BLEND), DepthTolerance(TS_DEPTH_TOLERANCE), NormalTolerance(TS_NORMAL_TOLERANCE), NeighborhoodClamp(true) {
+		createTargets();
+	};
+	//dtor
+	~TemporalShadow() {
+		deleteTargets();
+	};
+
+	//match the resolution the camera pass renders at (dynamic resolution), the history starts over
+	void Resize(int width, int height) {
+		if (width == m_Width && height == m_Height)
+			return;
+		deleteTargets();
+		m_Width = width;
+		m_Height = height;
+		createTargets();
+		m_HistoryValid = false;
+	}
+
+	//forget the history (the next frame starts from its own shadow)
+	void Invalidate() {
+		m_HistoryValid = false;
+	}
+
+	//rotation offset of the blue noise tile, decorrelates the PCSS taps between frames
+	float NoiseOffset() const {
+		return (float)std::fmod(m_Frame * TS_GOLDEN_RATIO, 1.0);
+	}
+
+	//bind and clear the offscreen lit pass target; the clear color is the background of the ambient target
+	void BeginScene(const glm::vec3& clearColor) {
+		glState().BindFramebuffer(GL_FRAMEBUFFER, m_SceneFBO[m_Current]);
+		glState().Viewport(0, 0, m_Width, m_Height);
+		const float ambient[4] = { clearColor.x, clearColor.y, clearColor.z, 0.0f };
+		const float direct[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		const float normalShadow[4] = { 0.5f, 0.5f, 0.5f, 1.0f }; //background is lit
+		const float depth = 1.0f;
+		glClearBufferfv(GL_COLOR, 0, ambient);
+		glClearBufferfv(GL_COLOR, 1, direct);
+		glClearBufferfv(GL_COLOR, 2, normalShadow);
+		glClearBufferfv(GL_DEPTH, 0, &depth);
+	}
+
+	//accumulate this frame's shadow into the history; viewProjection: camera of this frame
+	void Resolve(Shader& resolveShader, const glm::mat4& viewProjection, float nearPlane, float farPlane) {
+		int previous = 1 - m_Current;
+		glState().BindFramebuffer(GL_FRAMEBUFFER, m_HistoryFBO[m_Current]);
+		glState().Viewport(0, 0, m_Width, m_Height);
+		glState().Disable(GL_DEPTH_TEST);
+		bindTexture(0, m_Depth[m_Current]);
+		bindTexture(1, m_NormalShadow[m_Current]);
+		bindTexture(2, m_Depth[previous]);
+		bindTexture(3, m_NormalShadow[previous]);
+		bindTexture(4, m_History[previous]);
+
+		glm::mat4 invViewProjection = glm::inverse(viewProjection);
+		resolveShader.Bind();
+		resolveShader.SetUniform1i("u_Depth", 0);
+		resolveShader.SetUniform1i("u_NormalShadow", 1);
+		resolveShader.SetUniform1i("u_PrevDepth", 2);
+		resolveShader.SetUniform1i("u_PrevNormalShadow", 3);
+		resolveShader.SetUniform1i("u_History", 4);
+		resolveShader.SetUniformM4fv("u_InvViewProjection", 1, GL_FALSE, glm::value_ptr(invViewProjection));
+		resolveShader.SetUniformM4fv("u_PrevViewProjection", 1, GL_FALSE, glm::value_ptr(m_PrevViewProjection));
+		resolveShader.SetUniform2f("u_NearFar", nearPlane, farPlane);
+		resolveShader.SetUniform1b("u_HistoryValid", m_HistoryValid);
+		resolveShader.SetUniform1f("u_Blend", Blend);
+		resolveShader.SetUniform1f("u_DepthTolerance", DepthTolerance);
+		resolveShader.SetUniform1f("u_NormalTolerance", NormalTolerance);
+		resolveShader.SetUniform1b("u_NeighborhoodClamp", NeighborhoodClamp);
+		m_Quad.Draw(resolveShader);
+
+		m_PrevViewProjection = viewProjection;
+		glState().Enable(GL_DEPTH_TEST);
+	}
+
+	//lighting with the accumulated shadow to `targetFBO` (default framebuffer, or the dynamic resolution
+	//target of the same size), then flip to the other frame's targets
+	void Composite(Shader& compositeShader, unsigned int targetFBO = 0) {
+		glState().BindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+		glState().Viewport(0, 0, m_Width, m_Height);
+		bindTexture(0, m_Ambient);
+		bindTexture(1, m_Direct);
+		bindTexture(2, m_History[m_Current]);
+		bindTexture(3, m_Depth[m_Current]);
+		compositeShader.Bind();
+		compositeShader.SetUniform1i("u_Ambient", 0);
+		compositeShader.SetUniform1i("u_Direct", 1);
+		compositeShader.SetUniform1i("u_Shadow", 2);
+		compositeShader.SetUniform1i("u_Depth", 3);
+		//the scene depth goes along so later forward draws (light gizmo) are still depth tested
+		glState().DepthFunc(GL_ALWAYS);
+		m_Quad.Draw(compositeShader);
+		glState().DepthFunc(GL_LESS);
+
+		m_Current = 1 - m_Current;
+		m_HistoryValid = true;
+		m_Frame++;
+	}
+};
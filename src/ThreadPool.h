@@ -0,0 +1,269 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+
+
+/*
+ * Work stealing job system with a blocking ParallelFor.
+ *  - every worker owns a deque: it pushes and pops its own jobs at the back (the most recent, still in
+ *    cache), idle threads steal the oldest job at the front of another deque. Threads outside the pool
+ *    (the main thread) share one more deque,
+ *  - a job runs once the jobs it depends on are done: Spawn() counts the unfinished dependencies and
+ *    each of them releases the job when it finishes (fork / join without a central scheduler),
+ *  - Wait() runs other jobs until the one waited on is done, so jobs can spawn and wait on jobs and
+ *    ParallelFor can be called from inside a job,
+ *  - deterministic mode: the workers stay idle and the waiting thread runs the jobs one at a time in
+ *    the order they became ready, so a frame runs the same way every time (debugging, golden tests).
+ * The calling thread takes part in the work, so a pool of 0 workers runs everything inline.
+ */
+class ThreadPool {
+public:
+	struct Job {
+		std::function<void()> Fn;
+		std::atomic<int> Pending; //unfinished dependencies, +1 while Spawn() is adding them
+		std::atomic<bool> Done;
+		std::mutex Mutex; //guards Dependents against the job finishing
+		std::vector<std::shared_ptr<Job>> Dependents;
+
+		Job() : Pending(1), Done(false) {};
+	};
+	typedef std::shared_ptr<Job> JobHandle;
+
+private:
+	struct Queue {
+		std::mutex Mutex;
+		std::deque<JobHandle> Jobs;
+	};
+
+	std::vector<std::thread> m_Workers;
+	std::vector<std::unique_ptr<Queue>> m_Queues; //one per worker, the last one for threads outside the pool
+	std::mutex m_Mutex;
+	std::condition_variable m_Signal; //a job was queued or finished
+	std::atomic<size_t> m_Queued;
+	std::atomic<bool> m_Deterministic;
+	bool m_Quit;
+
+	//stats
+	std::atomic<size_t> m_Run;
+	std::atomic<size_t> m_Stolen;
+
+	//pool and queue of the calling thread
+	struct ThreadSlot {
+		const ThreadPool* Pool;
+		size_t Queue;
+	};
+	static ThreadSlot& threadSlot() {
+		static thread_local ThreadSlot slot = { nullptr, 0 };
+		return slot;
+	}
+
+public:
+	//ctor, workers: extra threads besides the caller (default: one per core minus the caller)
+	explicit ThreadPool(int workers = -1)
+		: m_Queued(0), m_Deterministic(false), m_Quit(false), m_Run(0), m_Stolen(0) {
+		if (workers < 0)
+			workers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+		for (int i = 0; i <= workers; ++i)
+			m_Queues.emplace_back(new Queue());
+		for (int i = 0; i < workers; ++i)
+			m_Workers.emplace_back([this, i]() { WorkerLoop(size_t(i)); });
+	};
+	//dtor, spawned jobs must have been waited on
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Quit = true;
+		}
+		m_Signal.notify_all();
+		for (auto& t : m_Workers)
+			t.join();
+	};
+
+	size_t GetThreadCount() const {
+		return m_Workers.size() + 1;
+	}
+	//jobs run / taken from another thread's deque since the pool was made
+	size_t GetJobsRun() const {
+		return m_Run;
+	}
+	size_t GetJobsStolen() const {
+		return m_Stolen;
+	}
+
+	//only between frames: no job may be in flight
+	void SetDeterministic(bool deterministic) {
+		m_Deterministic = deterministic;
+	}
+	bool IsDeterministic() const {
+		return m_Deterministic;
+	}
+
+	/*-------jobs-------*/
+
+	//fn runs once every job of dependencies is done
+	JobHandle Spawn(std::function<void()> fn, const std::vector<JobHandle>& dependencies = {}) {
+		JobHandle job = std::make_shared<Job>();
+		job->Fn = std::move(fn);
+		for (const JobHandle& dependency : dependencies) {
+			if (!dependency)
+				continue;
+			std::lock_guard<std::mutex> lock(dependency->Mutex);
+			if (dependency->Done)
+				continue;
+			job->Pending++;
+			dependency->Dependents.push_back(job);
+		}
+		release(job);
+		return job;
+	}
+
+	//runs other jobs until job is done
+	void Wait(const JobHandle& job) {
+		while (job && !job->Done.load(std::memory_order_acquire)) {
+			JobHandle next = take(callerQueue(), true);
+			if (next) {
+				execute(next);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Signal.wait(lock, [&]() { return job->Done.load(std::memory_order_acquire) || m_Queued > 0; });
+		}
+	}
+
+	void Wait(const std::vector<JobHandle>& jobs) {
+		for (const JobHandle& job : jobs)
+			Wait(job);
+	}
+
+	/*-------data parallel-------*/
+
+	//fn(begin, end) over [0, count) in chunks of grain, returns when all chunks are done.
+	//one runner job per thread pulls chunks from a shared counter, the caller is one of them
+	void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn) {
+		if (count == 0)
+			return;
+		grain = std::max<size_t>(grain, 1);
+		if (m_Workers.empty() || m_Deterministic || count <= grain) {
+			fn(0, count);
+			return;
+		}
+		std::atomic<size_t> next(0);
+		auto run = [&]() {
+			while (true) {
+				size_t begin = next.fetch_add(grain);
+				if (begin >= count)
+					break;
+				fn(begin, std::min(begin + grain, count));
+			}
+		};
+		size_t runners = std::min((count + grain - 1) / grain, GetThreadCount());
+		std::vector<JobHandle> jobs;
+		for (size_t r = 1; r < runners; ++r)
+			jobs.push_back(Spawn(run));
+		run();
+		Wait(jobs);
+	}
+
+private:
+	size_t callerQueue() const {
+		const ThreadSlot& slot = threadSlot();
+		return slot.Pool == this ? slot.Queue : m_Workers.size();
+	}
+
+	//last dependency (or Spawn itself) done: queue it
+	void release(const JobHandle& job) {
+		if (--job->Pending != 0)
+			return;
+		//deterministic: one FIFO queue, in the order the jobs became ready
+		Queue& queue = *m_Queues[m_Deterministic ? m_Workers.size() : callerQueue()];
+		{
+			//counted before it is visible: a worker popping it right away never takes m_Queued below zero
+			std::lock_guard<std::mutex> lock(queue.Mutex);
+			m_Queued++;
+			queue.Jobs.push_back(job);
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+		}
+		m_Signal.notify_all();
+	}
+
+	//own deque at the back, then the others at the front. The caller of Wait() in deterministic mode: FIFO
+	JobHandle take(size_t own, bool caller) {
+		if (m_Deterministic) {
+			if (!caller)
+				return nullptr;
+			Queue& queue = *m_Queues[m_Workers.size()];
+			std::lock_guard<std::mutex> lock(queue.Mutex);
+			if (queue.Jobs.empty())
+				return nullptr;
+			JobHandle job = queue.Jobs.front();
+			queue.Jobs.pop_front();
+			m_Queued--;
+			return job;
+		}
+		{
+			Queue& queue = *m_Queues[own];
+			std::lock_guard<std::mutex> lock(queue.Mutex);
+			if (!queue.Jobs.empty()) {
+				JobHandle job = queue.Jobs.back();
+				queue.Jobs.pop_back();
+				m_Queued--;
+				return job;
+			}
+		}
+		for (size_t i = 1; i < m_Queues.size(); ++i) {
+			Queue& queue = *m_Queues[(own + i) % m_Queues.size()];
+			std::lock_guard<std::mutex> lock(queue.Mutex);
+			if (!queue.Jobs.empty()) {
+				JobHandle job = queue.Jobs.front();
+				queue.Jobs.pop_front();
+				m_Queued--;
+				m_Stolen++;
+				return job;
+			}
+		}
+		return nullptr;
+	}
+
+	void execute(const JobHandle& job) {
+		job->Fn();
+		job->Fn = nullptr;
+		m_Run++;
+		std::vector<JobHandle> dependents;
+		{
+			std::lock_guard<std::mutex> lock(job->Mutex);
+			job->Done.store(true, std::memory_order_release);
+			dependents.swap(job->Dependents);
+		}
+		for (const JobHandle& dependent : dependents)
+			release(dependent);
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+		}
+		m_Signal.notify_all();
+	}
+
+	void WorkerLoop(size_t index) {
+		threadSlot() = { this, index };
+		while (true) {
+			JobHandle job = take(index, false);
+			if (job) {
+				execute(job);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Signal.wait(lock, [this]() { return m_Quit || (m_Queued > 0 && !m_Deterministic); });
+			if (m_Quit)
+				return;
+		}
+	}
+};
@@ -17,7 +17,7 @@ public:
 	};
 	//dtor
 	~VertexArray() {
-		glDeleteVertexArrays(1, &m_RendererID);
+		glState().DeleteVertexArrays(1, &m_RendererID);
 	};
 
 	void AddBuffer(const VertexBuffer& vb, const VertexBufferLayout& layout) {
@@ -39,10 +39,10 @@ public:
 	};
 
 	void Bind() const {
-		glBindVertexArray(m_RendererID);
+		glState().BindVertexArray(m_RendererID);
 	};
 	void Unbind() const {
-		glBindVertexArray(0);
+		glState().BindVertexArray(0);
 	};
 
 };
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../BVH.h"
+
+
+/*-----------------------------BVH frustum culling vs brute force---------------------------------*/
+// random boxes, random camera frusta: visible sets must match Frustum::Intersects per object,
+// after the initial build, after a small refit and after a large move (rebuild)
+
+inline int RunBVHBenchmark(size_t count) {
+	std::cout << "BVH culling benchmark: " << count << " objects" << std::endl;
+
+	std::mt19937 rng(4321);
+	auto rand01 = [&]() { return float(rng() >> 8) * (1.0f / 16777216.0f); };
+	auto randomBox = [&](float worldSize) {
+		glm::vec3 center = glm::vec3(rand01(), rand01(), rand01()) * worldSize - glm::vec3(worldSize * 0.5f);
+		glm::vec3 half = glm::vec3(0.25f + rand01(), 0.25f + rand01(), 0.25f + rand01());
+		return AABB(center - half, center + half);
+	};
+
+	const float worldSize = 400.0f;
+	std::vector<AABB> boxes(count);
+	for (auto& box : boxes)
+		box = randomBox(worldSize);
+
+	const int viewCount = 64;
+	std::vector<Frustum> views;
+	for (int v = 0; v < viewCount; ++v) {
+		glm::vec3 eye = glm::vec3(rand01(), rand01(), rand01()) * worldSize - glm::vec3(worldSize * 0.5f);
+		glm::vec3 target = eye + glm::vec3(rand01() - 0.5f, rand01() - 0.5f, rand01() - 0.5f) + glm::vec3(1e-3f, 0.0f, 0.0f);
+		glm::mat4 view = glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 50.0f + rand01() * 150.0f);
+		views.emplace_back(projection * view);
+	}
+
+	BVH bvh;
+	std::vector<unsigned int> visible, reference;
+	int failures = 0;
+	auto compare = [&](const char* stage) {
+		double bvhMs = 0.0, bruteMs = 0.0;
+		size_t visibleTotal = 0, nodesTotal = 0;
+		int mismatches = 0;
+		for (const Frustum& frustum : views) {
+			auto t0 = std::chrono::high_resolution_clock::now();
+			bvh.Query(frustum, visible);
+			auto t1 = std::chrono::high_resolution_clock::now();
+			reference.clear();
+			for (size_t i = 0; i < count; ++i) {
+				if (frustum.Intersects(boxes[i]))
+					reference.push_back((unsigned int)i);
+			}
+			auto t2 = std::chrono::high_resolution_clock::now();
+			bvhMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+			bruteMs += std::chrono::duration<double, std::milli>(t2 - t1).count();
+			visibleTotal += visible.size();
+			nodesTotal += bvh.LastNodesVisited;
+
+			std::sort(visible.begin(), visible.end());
+			if (visible != reference)
+				mismatches++;
+		}
+		std::cout << "  " << stage << ": bvh " << bvhMs / viewCount << " ms, brute force " << bruteMs / viewCount
+			<< " ms per view (x" << bruteMs / std::max(bvhMs, 1e-6) << "), " << visibleTotal / viewCount << " visible, "
+			<< nodesTotal / viewCount << " nodes visited, SAH cost " << bvh.GetCost()
+			<< ", " << mismatches << " mismatching views" << std::endl;
+		failures += mismatches;
+	};
+
+	auto timed = [](auto fn) {
+		auto start = std::chrono::high_resolution_clock::now();
+		fn();
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	};
+
+	double buildMs = timed([&]() { bvh.Build(boxes.data(), count); });
+	std::cout << "  build: " << buildMs << " ms, " << bvh.GetNodeCount() << " nodes" << std::endl;
+	compare("built   ");
+
+	//small jitter on 10% of the objects: refit only
+	for (size_t i = 0; i < count; i += 10) {
+		glm::vec3 offset = glm::vec3(rand01() - 0.5f, rand01() - 0.5f, rand01() - 0.5f) * 2.0f;
+		boxes[i] = AABB(boxes[i].Min + offset, boxes[i].Max + offset);
+	}
+	bool rebuilt = false;
+	double refitMs = timed([&]() { rebuilt = bvh.Update(boxes.data(), count); });
+	std::cout << "  refit: " << refitMs << " ms" << (rebuilt ? " (rebuilt)" : "") << std::endl;
+	compare("refitted");
+
+	//scatter half of the objects: the refitted tree degrades and gets rebuilt
+	for (size_t i = 0; i < count; i += 2)
+		boxes[i] = randomBox(worldSize);
+	double updateMs = timed([&]() { rebuilt = bvh.Update(boxes.data(), count); });
+	std::cout << "  scatter update: " << updateMs << " ms" << (rebuilt ? " (rebuilt)" : " (refit)") << std::endl;
+	compare("scattered");
+
+	std::cout << "  " << (BVH_SIMD ? "SSE" : "scalar") << " leaf test, " << bvh.Rebuilds << " builds, " << bvh.Refits << " refits" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
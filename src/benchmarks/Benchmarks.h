@@ -0,0 +1,61 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include "SceneBenchmark.h"
+#include "BVHBenchmark.h"
+#include "SampleBenchmark.h"
+#include "SATPathBenchmark.h"
+#include "CPUShadowBenchmark.h"
+#include "RasterizerBenchmark.h"
+#include "JobBenchmark.h"
+#include "RenderQueueBenchmark.h"
+#include "GPUMemoryBenchmark.h"
+
+
+/*-----------------------------Command line benchmarks (no window; sat opens a hidden GL context)---------------------------------*/
+// usage: VSSM --bench <name> [args]
+
+inline int RunBenchmark(const std::string& name, int argc, char** argv) {
+	if (name == "scene") {
+		size_t count = argc > 0 ? (size_t)std::atoll(argv[0]) : 1000000;
+		return RunSceneBenchmark(count);
+	}
+	if (name == "bvh") {
+		size_t count = argc > 0 ? (size_t)std::atoll(argv[0]) : 100000;
+		return RunBVHBenchmark(count);
+	}
+	if (name == "samples") {
+		unsigned int seed = argc > 0 ? (unsigned int)std::atoll(argv[0]) : ST_SEED;
+		return RunSampleBenchmark(seed);
+	}
+	if (name == "sat") {
+		int size = argc > 0 ? std::atoi(argv[0]) : SP_SIZE;
+		return RunSATPathBenchmark(size);
+	}
+	if (name == "cpushadows") {
+		int width = argc > 0 ? std::atoi(argv[0]) : CSB_WIDTH;
+		int height = argc > 1 ? std::atoi(argv[1]) : (argc > 0 ? width : CSB_HEIGHT); //square when only the width is given
+		std::string golden = argc > 2 ? argv[2] : "";
+		return RunCPUShadowBenchmark(width, height, golden);
+	}
+	if (name == "raster") {
+		size_t triangles = argc > 0 ? (size_t)std::atoll(argv[0]) : RB_TRIANGLES;
+		return RunRasterizerBenchmark(triangles);
+	}
+	if (name == "jobs") {
+		size_t items = argc > 0 ? (size_t)std::atoll(argv[0]) : JB_ITEMS;
+		return RunJobBenchmark(items);
+	}
+	if (name == "queue") {
+		size_t draws = argc > 0 ? (size_t)std::atoll(argv[0]) : RQB_DRAWS;
+		return RunRenderQueueBenchmark(draws);
+	}
+	if (name == "memory")
+		return RunGPUMemoryCheck();
+	std::cout << "Unknown benchmark: " << name << std::endl;
+	std::cout << "Available: scene [count], bvh [count], samples [seed], sat [size], cpushadows [width [height [golden prefix]]], raster [triangles], jobs [items], queue [draws], memory" << std::endl;
+	return -1;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#include "../CPUShadows.h"
+#include "../ThreadPool.h"
+
+//default CPU shadow benchmark settings:
+const int CSB_WIDTH = 1600;
+const int CSB_HEIGHT = 1200;
+const int CSB_MAP_SIZE = 1024;
+const int CSB_REPEATS = 3;
+const int CSB_GOLDEN_TOLERANCE = 2; //8 bit levels: libm sin / pow may differ in the last bit between toolchains
+
+
+/*-----------------------------CPU reference shadows: throughput and golden images (no GL)---------------------------------*/
+// an analytic scene in light clip space: a tilted ground plane under a few spheres. The shadow map and
+// the G-buffer (the ground and one sphere, slightly zoomed out so the borders are exercised) are built
+// on the CPU, then every technique of CPUShadowEvaluator shades the G-buffer: scalar on one thread,
+// SIMD on one thread and SIMD on the thread pool, in M pixels/s. The SIMD image has to match the
+// scalar one exactly. With a golden prefix every image is written as <prefix>_<technique>.pgm when
+// the file does not exist yet and compared with it otherwise; returns 1 on any mismatch.
+
+struct BenchSphere { float X, Y, Radius, Depth; };
+const int CSB_SPHERES_COUNT = 4;
+const BenchSphere CSB_SPHERES[CSB_SPHERES_COUNT] = {
+	{ 0.30f, 0.35f, 0.12f, 0.35f },
+	{ 0.65f, 0.30f, 0.08f, 0.55f },
+	{ 0.55f, 0.70f, 0.15f, 0.25f },
+	{ 0.20f, 0.75f, 0.05f, 0.70f }
+};
+
+//nearest surface at (u, v) and its dot(normal, lightDir), the first `spheres` spheres in front of the ground
+inline float benchSceneDepth(float u, float v, float& ndotl, int spheres) {
+	float depth = 0.8f + 0.1f * u - 0.05f * v; //ground
+	ndotl = 0.9f;
+	for (int i = 0; i < spheres; ++i) {
+		const BenchSphere& s = CSB_SPHERES[i];
+		float dx = u - s.X, dy = v - s.Y;
+		float r2 = dx * dx + dy * dy;
+		if (r2 < s.Radius * s.Radius) {
+			float h = std::sqrt(s.Radius * s.Radius - r2);
+			float d = s.Depth - h * 0.5f;
+			if (d < depth) {
+				depth = d;
+				ndotl = h / s.Radius;
+			}
+		}
+	}
+	return depth;
+}
+
+inline bool writePGM(const std::string& path, const std::vector<unsigned char>& pixels, int width, int height) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	file << "P5\n" << width << " " << height << "\n255\n";
+	file.write((const char*)pixels.data(), pixels.size());
+	return bool(file);
+}
+
+inline bool readPGM(const std::string& path, std::vector<unsigned char>& pixels, int& width, int& height) {
+	std::ifstream file(path, std::ios::binary);
+	std::string magic;
+	int maxValue;
+	if (!(file >> magic >> width >> height >> maxValue) || magic != "P5" || maxValue != 255)
+		return false;
+	file.get();
+	pixels.resize(size_t(width) * height);
+	file.read((char*)pixels.data(), pixels.size());
+	return bool(file);
+}
+
+inline int RunCPUShadowBenchmark(int width, int height, const std::string& goldenPrefix) {
+	std::cout << "CPU shadow benchmark: " << width << "x" << height << " G-buffer, " << CSB_MAP_SIZE << "^2 shadow map" << std::endl;
+
+	CPUShadowMap map(CSB_MAP_SIZE);
+	{
+		std::vector<float> depth(size_t(CSB_MAP_SIZE) * CSB_MAP_SIZE);
+		float ndotl;
+		for (int y = 0; y < CSB_MAP_SIZE; ++y)
+			for (int x = 0; x < CSB_MAP_SIZE; ++x)
+				depth[size_t(y) * CSB_MAP_SIZE + x] = benchSceneDepth((x + 0.5f) / CSB_MAP_SIZE, (y + 0.5f) / CSB_MAP_SIZE, ndotl, CSB_SPHERES_COUNT);
+		map.SetDepth(depth.data());
+	}
+
+	//receivers over [-0.02, 1.02]^2: the ground and the first sphere, the others only cast shadows.
+	//w != 1 so the perspective divide is not a no-op
+	ShadowGBuffer gbuffer(width, height);
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x) {
+			size_t i = size_t(y) * width + x;
+			float u = -0.02f + 1.04f * (x + 0.5f) / width, v = -0.02f + 1.04f * (y + 0.5f) / height;
+			float w = 1.0f + 0.25f * u;
+			float depth = benchSceneDepth(u, v, gbuffer.NdotL[i], 1);
+			gbuffer.LightX[i] = (u * 2.0f - 1.0f) * w;
+			gbuffer.LightY[i] = (v * 2.0f - 1.0f) * w;
+			gbuffer.LightZ[i] = (depth * 2.0f - 1.0f) * w;
+			gbuffer.LightW[i] = w;
+		}
+
+	ThreadPool pool;
+	CPUShadowEvaluator evaluator;
+	double pixels = double(width) * height;
+	auto timeEvaluate = [&](bool simd, ThreadPool* p, std::vector<float>& shadow) {
+		evaluator.UseSIMD = simd;
+		double best = 1e30;
+		for (int r = 0; r < CSB_REPEATS; ++r) {
+			auto start = std::chrono::high_resolution_clock::now();
+			evaluator.Evaluate(map, gbuffer, shadow, p);
+			std::chrono::duration<double, std::milli> ms = std::chrono::high_resolution_clock::now() - start;
+			best = std::min(best, ms.count());
+		}
+		return best;
+	};
+
+	bool ok = true;
+	std::vector<float> scalar, simd, pooled;
+	for (int type = 0; type < CS_TYPES; ++type) {
+		evaluator.Type = type;
+		double scalarMs = timeEvaluate(false, nullptr, scalar);
+		double simdMs = timeEvaluate(true, nullptr, simd);
+		double pooledMs = timeEvaluate(true, &pool, pooled);
+		size_t differ = 0;
+		double lit = 0.0;
+		for (size_t i = 0; i < scalar.size(); ++i) {
+			differ += (scalar[i] != simd[i] || simd[i] != pooled[i]) ? 1 : 0;
+			lit += scalar[i];
+		}
+		ok &= differ == 0;
+		std::cout << "  " << CPU_SHADOW_TYPE_NAMES[type] << ": scalar " << pixels / (scalarMs * 1e3) << " M pixels/s, SIMD "
+			<< pixels / (simdMs * 1e3) << " M pixels/s, SIMD + pool " << pixels / (pooledMs * 1e3) << " M pixels/s ("
+			<< pooledMs << " ms / frame), mean visibility " << lit / pixels
+			<< (differ ? ", SIMD differs from scalar in " + std::to_string(differ) + " pixels" : "") << std::endl;
+
+		if (goldenPrefix.empty())
+			continue;
+		std::vector<unsigned char> image(scalar.size());
+		for (size_t i = 0; i < scalar.size(); ++i)
+			image[i] = (unsigned char)std::lround(std::min(std::max(scalar[i], 0.0f), 1.0f) * 255.0f);
+		std::string path = goldenPrefix + "_" + CPU_SHADOW_TYPE_NAMES[type] + ".pgm";
+		std::vector<unsigned char> golden;
+		int goldenWidth, goldenHeight;
+		if (!readPGM(path, golden, goldenWidth, goldenHeight)) {
+			bool written = writePGM(path, image, width, height);
+			ok &= written;
+			std::cout << "    " << (written ? "wrote " : "could not write ") << path << std::endl;
+			continue;
+		}
+		if (goldenWidth != width || goldenHeight != height) {
+			std::cout << "    " << path << ": golden is " << goldenWidth << "x" << goldenHeight << std::endl;
+			ok = false;
+			continue;
+		}
+		size_t mismatches = 0;
+		int maxDifference = 0;
+		for (size_t i = 0; i < image.size(); ++i) {
+			int difference = std::abs(int(image[i]) - int(golden[i]));
+			maxDifference = std::max(maxDifference, difference);
+			mismatches += difference > CSB_GOLDEN_TOLERANCE ? 1 : 0;
+		}
+		ok &= mismatches == 0;
+		std::cout << "    " << path << ": " << (mismatches ? "MISMATCH" : "match") << " (" << mismatches
+			<< " pixels over " << CSB_GOLDEN_TOLERANCE << " levels, max " << maxDifference << ")" << std::endl;
+	}
+	std::cout << "  threads: " << pool.GetThreadCount() << (CPU_SHADOWS_SIMD ? ", SSE2" : ", scalar only") << ", tile " << CS_TILE << std::endl;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "../Profiler.h"
+
+//default camera path benchmark settings:
+const int CP_WARMUP_FRAMES = 2 * PF_QUERY_FRAMES;
+const int CP_PATH_FRAMES = 1200;
+const float CP_TWO_PI = 6.28318531f;
+
+
+/*-----------------------------Camera path benchmark (in app, runs on the live scene)---------------------------------*/
+// flies the camera along a fixed path (one orbit of the scene center, diving close to the ground and
+// back out, so the shaded pixel count and the overdraw change all the way), once per variant.
+// the path is indexed by frame, not time, so every variant renders the same views.
+// reports the GPU frame time (mean, 95th percentile, frames over the target) and the render scale
+
+class CameraPathBenchmark {
+private:
+	std::vector<std::string> m_Variants;
+	std::vector<double> m_FrameMs;
+	std::vector<double> m_Scales;
+	int m_Changes;
+	int m_Current;
+	int m_Frame;
+	double m_TargetMs;
+	std::ostringstream m_Result;
+
+public:
+	std::string Result;
+
+	//ctor
+	CameraPathBenchmark() : m_Changes(0), m_Current(-1), m_Frame(0), m_TargetMs(0.0) {};
+
+	bool IsRunning() const {
+		return m_Current >= 0;
+	}
+
+	void Start(const std::vector<std::string>& variants, double targetMs) {
+		m_Variants = variants;
+		m_TargetMs = targetMs;
+		m_Current = variants.empty() ? -1 : 0;
+		m_Frame = 0;
+		m_FrameMs.clear();
+		m_Scales.clear();
+		m_Changes = 0;
+		m_Result.str("");
+		m_Result.precision(2);
+		m_Result << std::fixed << "Camera path (" << CP_PATH_FRAMES << " frames, target " << targetMs << " ms):";
+		Result = "running...";
+	}
+
+	int CurrentVariant() const {
+		return m_Current;
+	}
+
+	//camera position and look-at target for this frame, around `center` at `radius`
+	void Pose(const glm::vec3& center, float radius, glm::vec3& position, glm::vec3& target) const {
+		float t = float(m_Frame) / CP_PATH_FRAMES;
+		float angle = CP_TWO_PI * t;
+		float distance = radius * (0.7f + 0.5f * std::cos(2.0f * angle)); //close twice per orbit
+		float height = radius * (0.15f + 0.35f * (0.5f + 0.5f * std::cos(2.0f * angle)));
+		position = center + glm::vec3(distance * std::cos(angle), height, distance * std::sin(angle));
+		target = center;
+	}
+
+	//call once the frame is submitted; returns true on the frame the benchmark finishes
+	bool Record(const Profiler& profiler, float scale, bool scaleChanged) {
+		if (m_Current < 0)
+			return false;
+		if (m_Frame >= CP_WARMUP_FRAMES) {
+			//each GPU frame time once, on the frame it is read back
+			if (profiler.HasNewGPUFrame()) {
+				m_FrameMs.push_back(profiler.GetGPUFrameMs());
+				m_Scales.push_back(scale);
+			}
+			m_Changes += scaleChanged;
+		}
+		if (++m_Frame < CP_PATH_FRAMES)
+			return false;
+
+		//this variant's line
+		std::vector<double> sorted = m_FrameMs;
+		std::sort(sorted.begin(), sorted.end());
+		double mean = 0.0, meanScale = 0.0;
+		size_t over = 0;
+		for (size_t i = 0; i < m_FrameMs.size(); ++i) {
+			mean += m_FrameMs[i];
+			meanScale += m_Scales[i];
+			over += m_FrameMs[i] > m_TargetMs;
+		}
+		double frames = std::max<size_t>(1, m_FrameMs.size());
+		double p95 = sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, size_t(sorted.size() * 0.95))];
+		m_Result << (m_Current ? ", " : " ") << m_Variants[m_Current] << " " << mean / frames << " ms (p95 " << p95
+			<< ", over target " << 100.0 * over / frames << "%, scale " << meanScale / frames << ", " << m_Changes << " changes)";
+
+		m_Frame = 0;
+		m_FrameMs.clear();
+		m_Scales.clear();
+		m_Changes = 0;
+		if (++m_Current < (int)m_Variants.size())
+			return false;
+		m_Current = -1;
+		Result = m_Result.str();
+		return true;
+	}
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+
+#include "../GPUMemory.h"
+
+//default GPU memory check settings:
+const int GMB_SHADOW_MAP_SIZE = 1024;
+const int GMB_MIN_SHADOW_MAP_SIZE = 256;
+const size_t GMB_MESH_BYTES = size_t(8) << 20;
+const size_t GMB_BUDGET = size_t(6) << 20;
+
+
+/*-----------------------------GPU memory accounting: sizes, bookkeeping and budget (no GL)---------------------------------*/
+// the sizes the tracker reports for the formats the renderer allocates, against the known ones
+// (RG32F at 1024^2 is 8 MiB, a full mip chain 4/3 of it minus the rounding of the last levels, ...),
+// then the bookkeeping of a private tracker with made up names: a re-specified texture replaces its
+// record, a buffer and a texture of the same name are two allocations, a release frees its category.
+// Last the budget: a 1024^2 RG32F shadow map and an 8 MiB mesh under 6 MiB have to end up at
+// 256^2 with the mesh evicted, and Restore() has to give both back. returns 1 when a check fails.
+
+inline int RunGPUMemoryCheck() {
+	std::cout << "GPU memory check" << std::endl;
+	bool ok = true;
+	auto check = [&](const std::string& what, size_t reported, size_t expected) {
+		bool same = reported == expected;
+		ok &= same;
+		std::cout << "  " << what << ": " << reported << " bytes (" << gmMiB(reported) << " MiB)" << (same ? "" : ", EXPECTED " + std::to_string(expected)) << std::endl;
+	};
+
+	const size_t MiB = size_t(1) << 20;
+	check("RG32F 1024^2", gmTextureBytes(GL_RG32F, 1024, 1024), 8 * MiB);
+	check("RGBA32F 1024^2 (moment SAT)", gmTextureBytes(GL_RGBA32F, 1024, 1024), 16 * MiB);
+	check("R16 1024^2 (shadow map)", gmTextureBytes(GL_R16, 1024, 1024), 2 * MiB);
+	check("R8 1024^2 (lightmap)", gmTextureBytes(GL_R8, 1024, 1024), 1 * MiB);
+	check("DEPTH_COMPONENT32 1024^2 (depth buffer)", gmTextureBytes(GL_DEPTH_COMPONENT32, 1024, 1024), 4 * MiB);
+	check("RGBA16F 1920x1080 (temporal target)", gmTextureBytes(GL_RGBA16F, 1920, 1080), size_t(1920) * 1080 * 8);
+	//4^0 + 4^-1 + ... + 4^-10 of 8 MiB, the last level is one texel
+	size_t chain = 0;
+	for (int size = 1024; size >= 1; size /= 2)
+		chain += size_t(size) * size * 8;
+	check("RG32F 1024^2, 11 levels (blurred moments)", gmTextureBytes(GL_RG32F, 1024, 1024, 11), chain);
+	check("RG32F 512^2, 10 levels (depth pyramid)", gmTextureBytes(GL_RG32F, 512, 512, 10), (chain - 8 * MiB));
+	//non square chains clamp at one texel per side
+	check("RG32F 4x1, 3 levels", gmTextureBytes(GL_RG32F, 4, 1, 3), (4 + 2 + 1) * 8);
+	check("unknown format", gmTextureBytes(GL_RGB, 1024, 1024), 0);
+
+	GPUMemory memory(0);
+	memory.TrackTexture(1, GM_SHADOW_TABLES, "SAT", GL_RG32F, 1024, 1024);
+	memory.TrackBuffer(1, GM_MESHES, "Mesh", 1000);
+	memory.TrackRenderbuffer(1, GM_SHADOW_MAPS, "Depth buffer", GL_DEPTH_COMPONENT32, 1024, 1024);
+	check("3 kinds of name 1", memory.GetTotal(), 8 * MiB + 1000 + 4 * MiB);
+	memory.TrackTexture(1, GM_SHADOW_TABLES, "SAT", GL_RG32F, 512, 512);
+	check("texture re-specified at 512^2", memory.GetTotal(GM_SHADOW_TABLES), 2 * MiB);
+	check("peak", memory.PeakBytes, 8 * MiB + 1000 + 4 * MiB);
+	const unsigned int names[2] = { 1, 2 };
+	memory.Release(GM_KIND_TEXTURE, 2, names);
+	check("texture released (name 2 untracked)", memory.GetTotal(GM_SHADOW_TABLES), 0);
+	check("buffer and renderbuffer left", memory.GetTotal(), 1000 + 4 * MiB);
+	ok &= memory.GetCount() == 2 && memory.Find(GM_KIND_BUFFER, 1) && !memory.Find(GM_KIND_TEXTURE, 1);
+
+	//budget: halve the map, then evict the mesh
+	GPUMemory budgeted(GMB_BUDGET);
+	int shadowMapSize = GMB_SHADOW_MAP_SIZE;
+	bool meshResident = true;
+	auto specifyShadowMap = [&]() {
+		budgeted.TrackTexture(10, GM_SHADOW_MAPS, "Shadow map", GL_RG32F, shadowMapSize, shadowMapSize);
+	};
+	auto uploadMesh = [&]() {
+		budgeted.TrackBuffer(20, GM_MESHES, "Streamed mesh", GMB_MESH_BYTES);
+		meshResident = true;
+	};
+	specifyShadowMap();
+	uploadMesh();
+	budgeted.AddPressureHandler("Shadow map resolution", [&]() {
+		if (shadowMapSize / 2 < GMB_MIN_SHADOW_MAP_SIZE)
+			return false;
+		shadowMapSize /= 2;
+		specifyShadowMap();
+		return true;
+	}, [&]() {
+		shadowMapSize = GMB_SHADOW_MAP_SIZE;
+		specifyShadowMap();
+	});
+	budgeted.AddPressureHandler("Streamed meshes", [&]() {
+		if (!meshResident)
+			return false;
+		const unsigned int mesh = 20;
+		budgeted.Release(GM_KIND_BUFFER, 1, &mesh);
+		meshResident = false;
+		return true;
+	}, [&]() {
+		uploadMesh();
+	});
+	budgeted.Enforce();
+	bool degraded = shadowMapSize == GMB_MIN_SHADOW_MAP_SIZE && !meshResident && !budgeted.LastOverBudget && budgeted.LastReliefSteps == 3;
+	ok &= degraded;
+	std::cout << "  budget " << gmMiB(GMB_BUDGET) << " MiB: shadow map " << shadowMapSize << "^2, mesh " << (meshResident ? "resident" : "evicted")
+		<< ", " << budgeted.LastReliefSteps << " steps, " << gmMiB(budgeted.GetTotal()) << " MiB" << (degraded ? "" : ", EXPECTED 256^2, evicted, 3 steps") << std::endl;
+	budgeted.Enforce();
+	ok &= budgeted.LastReliefSteps == 0;
+	budgeted.Restore();
+	check("restored", budgeted.GetTotal(), 8 * MiB + GMB_MESH_BYTES);
+
+	std::ostringstream json;
+	memory.WriteJSON(json);
+	std::string text = json.str();
+	bool written = text.find("\"total\": " + std::to_string(memory.GetTotal())) != std::string::npos
+		&& std::count(text.begin(), text.end(), '{') == std::count(text.begin(), text.end(), '}')
+		&& std::count(text.begin(), text.end(), '[') == std::count(text.begin(), text.end(), ']');
+	ok &= written;
+	std::cout << "  JSON dump: " << text.size() << " bytes" << (written ? "" : ", MALFORMED") << std::endl;
+	std::cout << (ok ? "All checks passed" : "FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
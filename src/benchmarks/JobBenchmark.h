@@ -0,0 +1,150 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+
+#include "../ThreadPool.h"
+
+//default job system benchmark settings:
+const size_t JB_ITEMS = 1 << 20; //ParallelFor elements
+const size_t JB_GRAIN = 1024;
+const int JB_LAYERS = 16; //dependency graph: layers of jobs, each job waits on two of the layer before
+const int JB_WIDTH = 64;
+const int JB_JOB_WORK = 2000; //iterations per graph job
+const int JB_REPEATS = 5;
+
+
+/*-----------------------------Job system: scaling over 1..N threads and deterministic mode (no GL)---------------------------------*/
+// three workloads on pools of 1, 2, 4 .. hardware threads: a flat ParallelFor, a layered dependency
+// graph (every job depends on two jobs of the layer above, the way a frame's cull jobs depend on the
+// scene update) and the same graph with a nested ParallelFor in every job (fork / join from inside
+// jobs). Every result has to match the single thread one. Then the graph runs twice in deterministic
+// mode on a full pool: both runs have to execute the jobs in the same order, on the calling thread
+// only. returns 1 when a check fails.
+
+//some work the compiler cannot fold, depends on seed
+inline float benchJobWork(float seed, int iterations) {
+	float x = seed;
+	for (int i = 0; i < iterations; ++i)
+		x = std::sin(x) * 0.5f + std::cos(x * 1.5f) + 0.001f * i;
+	return x;
+}
+
+struct JobGraphResult {
+	std::vector<float> Values; //one per job, from the values of its dependencies
+	std::vector<int> Order; //jobs in the order they ran
+	size_t OffCaller; //jobs that ran on another thread than the caller
+};
+
+inline JobGraphResult runJobGraph(ThreadPool& pool, bool nested) {
+	JobGraphResult result;
+	result.Values.assign(size_t(JB_LAYERS) * JB_WIDTH, 0.0f);
+	result.OffCaller = 0;
+	std::mutex orderMutex;
+	std::thread::id caller = std::this_thread::get_id();
+
+	std::vector<ThreadPool::JobHandle> jobs(result.Values.size());
+	for (int layer = 0; layer < JB_LAYERS; ++layer)
+		for (int i = 0; i < JB_WIDTH; ++i) {
+			int index = layer * JB_WIDTH + i;
+			int a = layer > 0 ? (layer - 1) * JB_WIDTH + i : -1;
+			int b = layer > 0 ? (layer - 1) * JB_WIDTH + (i * 7 + 3) % JB_WIDTH : -1;
+			std::vector<ThreadPool::JobHandle> dependencies;
+			if (layer > 0)
+				dependencies = { jobs[a], jobs[b] };
+			jobs[index] = pool.Spawn([&, index, a, b]() {
+				float seed = a < 0 ? float(index) * 0.01f : result.Values[a] + result.Values[b];
+				float value;
+				if (nested) {
+					std::vector<float> partial(8);
+					pool.ParallelFor(partial.size(), 1, [&](size_t begin, size_t end) {
+						for (size_t p = begin; p < end; ++p)
+							partial[p] = benchJobWork(seed + float(p), JB_JOB_WORK / 8);
+					});
+					value = 0.0f;
+					for (float p : partial)
+						value += p;
+				}
+				else {
+					value = benchJobWork(seed, JB_JOB_WORK);
+				}
+				result.Values[index] = value;
+				std::lock_guard<std::mutex> lock(orderMutex);
+				result.Order.push_back(index);
+				result.OffCaller += std::this_thread::get_id() != caller ? 1 : 0;
+			}, dependencies);
+		}
+	pool.Wait(jobs);
+	return result;
+}
+
+inline int RunJobBenchmark(size_t items) {
+	std::cout << "Job system benchmark: ParallelFor over " << items << " items (grain " << JB_GRAIN << "), graph of "
+		<< JB_LAYERS << " x " << JB_WIDTH << " jobs" << std::endl;
+
+	bool ok = true;
+	std::vector<float> data(items), reference;
+	JobGraphResult graphReference, nestedReference;
+	double singleMs[3] = { 0.0, 0.0, 0.0 };
+	int hardware = std::max(1, (int)std::thread::hardware_concurrency());
+	for (int threads = 1; ; threads = std::min(threads * 2, hardware)) {
+		ThreadPool pool(threads - 1);
+		double best[3] = { 1e30, 1e30, 1e30 };
+		JobGraphResult graph, nested;
+		size_t stolenBefore = pool.GetJobsStolen(), runBefore = pool.GetJobsRun();
+		for (int r = 0; r < JB_REPEATS; ++r) {
+			auto start = std::chrono::high_resolution_clock::now();
+			pool.ParallelFor(items, JB_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i)
+					data[i] = benchJobWork(float(i) * 1e-3f, 16);
+			});
+			std::chrono::duration<double, std::milli> ms = std::chrono::high_resolution_clock::now() - start;
+			best[0] = std::min(best[0], ms.count());
+
+			start = std::chrono::high_resolution_clock::now();
+			graph = runJobGraph(pool, false);
+			ms = std::chrono::high_resolution_clock::now() - start;
+			best[1] = std::min(best[1], ms.count());
+
+			start = std::chrono::high_resolution_clock::now();
+			nested = runJobGraph(pool, true);
+			ms = std::chrono::high_resolution_clock::now() - start;
+			best[2] = std::min(best[2], ms.count());
+		}
+		bool same = true;
+		if (threads == 1) {
+			reference = data;
+			graphReference = graph;
+			nestedReference = nested;
+			std::copy(best, best + 3, singleMs);
+		}
+		else {
+			same = data == reference && graph.Values == graphReference.Values && nested.Values == nestedReference.Values;
+			ok &= same;
+		}
+		std::cout << "  " << threads << " thread" << (threads > 1 ? "s: " : ": ")
+			<< "ParallelFor " << best[0] << " ms (x" << singleMs[0] / best[0] << "), graph "
+			<< best[1] << " ms (x" << singleMs[1] / best[1] << "), nested " << best[2] << " ms (x" << singleMs[2] / best[2] << "), "
+			<< pool.GetJobsStolen() - stolenBefore << " of " << pool.GetJobsRun() - runBefore << " jobs stolen"
+			<< (same ? "" : ", DIFFERS from 1 thread") << std::endl;
+		if (threads == hardware)
+			break;
+	}
+
+	//deterministic: same order twice, nothing on the workers, same values as the threaded runs
+	ThreadPool pool;
+	pool.SetDeterministic(true);
+	JobGraphResult first = runJobGraph(pool, true);
+	JobGraphResult second = runJobGraph(pool, true);
+	bool deterministic = first.Order == second.Order && first.OffCaller == 0 && second.OffCaller == 0
+		&& first.Values == nestedReference.Values && second.Values == nestedReference.Values;
+	ok &= deterministic;
+	std::cout << "  deterministic mode (" << pool.GetThreadCount() << " threads in the pool): "
+		<< (deterministic ? "same order on both runs, caller only" : "NOT deterministic") << std::endl;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include <GL/glew.h>
+
+#include "../GLState.h"
+#include "../Shader.h"
+#include "../MomentBlur.h"
+#include "../DepthSAT.h"
+
+//default moment filter benchmark settings:
+const int MF_SIZES[] = { 1024, 2048, 4096 };
+const int MF_REPEATS = 20;
+const int MF_SAT_MAX_SIZE = 2048; //ComputeSAT.shader: one work group of 1024 scans a row of 2 * 1024 texels
+
+
+/*-----------------------------SAT vs separable blur (in app, needs the GL context, blocks for a moment)---------------------------------*/
+// builds both moment filters MF_REPEATS times on a synthetic shadow map of every size in MF_SIZES
+// and averages their GL_TIME_ELAPSED queries. The SAT is the renderer's DepthSAT, the blur is
+// MomentBlur with the given radius and no mip chain
+
+//shadow map of the given size in `format`, a depth ramp with a few steps so the data is not uniform
+inline unsigned int createBenchDepthMap(int size, DepthFormat format) {
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glState().BindTexture(GL_TEXTURE_2D, texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, depthInternalFormat(format), size, size);
+	std::vector<float> row(size);
+	for (int y = 0; y < size; ++y) {
+		for (int x = 0; x < size; ++x)
+			row[x] = ((x / 64 + y / 64) % 2) ? 0.3f + 0.4f * x / size : 0.9f;
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, size, 1, GL_RED, GL_FLOAT, row.data());
+	}
+	glState().BindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+//average GPU time of `build` over MF_REPEATS runs
+template<typename Build>
+double timeGPUBuild(Build build) {
+	unsigned int queries[MF_REPEATS];
+	glGenQueries(MF_REPEATS, queries);
+	build(); //warm up (shader and texture residency)
+	for (int i = 0; i < MF_REPEATS; ++i) {
+		glBeginQuery(GL_TIME_ELAPSED, queries[i]);
+		build();
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+	double ms = 0.0;
+	for (int i = 0; i < MF_REPEATS; ++i) {
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &ns);
+		ms += double(ns) * 1e-6;
+	}
+	glDeleteQueries(MF_REPEATS, queries);
+	return ms / MF_REPEATS;
+}
+
+inline std::string RunMomentFilterBenchmark(Shader& satRowShader, Shader& satColumnShader, Shader& blurShader,
+	DepthFormat format, int radius, bool gaussian) {
+	std::ostringstream out;
+	out.precision(3);
+	out << std::fixed << "SAT vs blur (" << DEPTH_FORMAT_NAMES[format] << ", radius " << radius << (gaussian ? ", gaussian" : ", box") << "):";
+	for (int size : MF_SIZES) {
+		unsigned int depth = createBenchDepthMap(size, format);
+		MomentBlur blur(size);
+		blur.Radius = radius;
+		blur.Gaussian = gaussian;
+		double blurMs = timeGPUBuild([&]() { blur.Build(depth, blurShader); });
+
+		out << " " << size << ": ";
+		if (size <= MF_SAT_MAX_SIZE) {
+			DepthSAT sat(size);
+			double satMs = timeGPUBuild([&]() { sat.Build(depth, satRowShader, satColumnShader); });
+			out << "SAT " << satMs << " ms, blur " << blurMs << " ms";
+			if (satMs > 0.0)
+				out << " (x" << blurMs / satMs << ")";
+		}
+		else {
+			out << "SAT n/a (rows over " << MF_SAT_MAX_SIZE << "), blur " << blurMs << " ms";
+		}
+		out << ", blur " << blur.GetBuildBytes(format) / (1024.0 * 1024.0) << " MB;";
+		glState().DeleteTextures(1, &depth);
+	}
+	return out.str();
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "../GLState.h"
+#include "../Shader.h"
+#include "../DepthSAT.h"
+
+//default moment precision benchmark settings:
+const int MP_WINDOWS = 20000;
+const int MP_MAX_RADIUS = 64; //texels, about the widest VSSM blocker search / penumbra
+const unsigned int MP_SEED = 7;
+const double MP_MIN_VARIANCE = 0.0001; //chebyshev() in Shadows.glsl
+const double MP_RECEIVER_OFFSET = 0.01; //receiver depth behind the window mean
+
+struct MomentStorage {
+	DepthFormat Format;
+	float Center;
+	const char* Name;
+};
+const MomentStorage MP_STORAGES[] = {
+	{ DEPTH_RG32F, 0.0f, "RG32F" },
+	{ DEPTH_RG32F, DS_CENTER, "RG32F centered" },
+	{ DEPTH_R16, 0.0f, "R16" },
+	{ DEPTH_R16, DS_CENTER, "R16 centered" },
+	{ DEPTH_R16F, DS_CENTER, "R16F centered" }
+};
+
+
+/*-----------------------------Moment storage precision (in app, reads back the live shadow map, stalls)---------------------------------*/
+// the reference is the live shadow map read back as floats, summed in double. For every storage in
+// MP_STORAGES the depth is uploaded in that format (the driver quantizes it), DepthSAT builds its table
+// on the GPU and the table is read back. MP_WINDOWS random square windows (radius 1..MP_MAX_RADIUS)
+// are evaluated from the 4 corners like getDepthMean() in Shadows.glsl, in float, and compared with
+// the reference: mean depth, variance and the Chebyshev visibility of a receiver MP_RECEIVER_OFFSET
+// behind the mean. Memory and bandwidth are per frame at the given size; "before" is the RG32F map
+// with the two transposing passes through an intermediate table
+
+//Chebyshev upper bound of Shadows.glsl chebyshev()
+inline double chebyshevVisibility(double mean, double mean2, double t) {
+	if (t <= mean)
+		return 1.0;
+	double variance = std::max(mean2 - mean * mean, MP_MIN_VARIANCE);
+	double d = t - mean;
+	return variance / (variance + d * d);
+}
+
+inline std::string RunMomentPrecisionBenchmark(unsigned int depthMap, int size, const char* liveFormat,
+	Shader& rowShader, Shader& columnShader) {
+	size_t texels = size_t(size) * size;
+	std::vector<float> depth(texels);
+	glState().BindTexture(GL_TEXTURE_2D, depthMap);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, depth.data());
+	glState().BindTexture(GL_TEXTURE_2D, 0);
+
+	//reference sums, (size + 1)^2 with a zero row and column in front
+	size_t stride = size_t(size) + 1;
+	std::vector<double> sum(stride * stride, 0.0), sum2(stride * stride, 0.0);
+	for (int y = 0; y < size; ++y) {
+		for (int x = 0; x < size; ++x) {
+			double d = depth[size_t(y) * size + x];
+			size_t i = (y + 1) * stride + (x + 1);
+			sum[i] = d + sum[i - 1] + sum[i - stride] - sum[i - stride - 1];
+			sum2[i] = d * d + sum2[i - 1] + sum2[i - stride] - sum2[i - stride - 1];
+		}
+	}
+
+	//windows [x0, x1] x [y0, y1], inside the map with a texel to spare so every corner is a table texel
+	struct Window { int X0, Y0, X1, Y1; };
+	std::vector<Window> windows(MP_WINDOWS);
+	std::mt19937 rng(MP_SEED);
+	int maxRadius = std::max(1, std::min(MP_MAX_RADIUS, size / 2 - 2));
+	for (Window& w : windows) {
+		int radius = 1 + int(rng() % maxRadius);
+		int cx = radius + 1 + int(rng() % (size - 2 * radius - 2));
+		int cy = radius + 1 + int(rng() % (size - 2 * radius - 2));
+		w = { cx - radius, cy - radius, cx + radius, cy + radius };
+	}
+
+	std::ostringstream out;
+	out << std::fixed;
+	out.precision(1);
+	double before = double(texels) * (8.0 + 8.0 + 8.0);
+	out << "Moment storage at " << size << "^2 (reference: live " << liveFormat << " map, " << MP_WINDOWS << " windows):"
+		<< " before " << before / (1024.0 * 1024.0) << " MB, " << double(texels) * (8.0 + 4 * 8.0) / (1024.0 * 1024.0) << " MB / frame;";
+
+	std::vector<float> table(texels * 2);
+	for (const MomentStorage& storage : MP_STORAGES) {
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glState().BindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, depthInternalFormat(storage.Format), size, size, 0, GL_RED, GL_FLOAT, depth.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		DepthSAT sat(size);
+		sat.Center = storage.Center;
+		sat.Build(texture, rowShader, columnShader);
+		glState().BindTexture(GL_TEXTURE_2D, sat.GetTexture());
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_FLOAT, table.data());
+		glState().BindTexture(GL_TEXTURE_2D, 0);
+		glState().DeleteTextures(1, &texture);
+
+		double meanError = 0.0, maxMeanError = 0.0, varianceError = 0.0, visibilityError = 0.0, maxVisibilityError = 0.0;
+		for (const Window& w : windows) {
+			double area = double(w.X1 - w.X0 + 1) * (w.Y1 - w.Y0 + 1);
+			auto ref = [&](const std::vector<double>& s) {
+				return (s[(w.Y1 + 1) * stride + w.X1 + 1] - s[w.Y0 * stride + w.X1 + 1]
+					- s[(w.Y1 + 1) * stride + w.X0] + s[w.Y0 * stride + w.X0]) / area;
+			};
+			double refMean = ref(sum), refMean2 = ref(sum2);
+
+			//the table the way the lit pass reads it: float corners, float un-centering
+			auto corner = [&](int x, int y, int c) { return table[(size_t(y) * size + x) * 2 + c]; };
+			float m[2];
+			for (int c = 0; c < 2; ++c)
+				m[c] = (corner(w.X1, w.Y1, c) - corner(w.X0 - 1, w.Y1, c) - corner(w.X1, w.Y0 - 1, c) + corner(w.X0 - 1, w.Y0 - 1, c)) / float(area);
+			float mean = m[0] + storage.Center;
+			float mean2 = m[1] + storage.Center * (2.0f * m[0] + storage.Center);
+
+			double error = std::abs(mean - refMean);
+			meanError += error;
+			maxMeanError = std::max(maxMeanError, error);
+			varianceError += std::abs((double(mean2) - double(mean) * mean) - (refMean2 - refMean * refMean));
+			double t = refMean + MP_RECEIVER_OFFSET;
+			double visibility = std::abs(chebyshevVisibility(mean, mean2, t) - chebyshevVisibility(refMean, refMean2, t));
+			visibilityError += visibility;
+			maxVisibilityError = std::max(maxVisibilityError, visibility);
+		}
+		out.precision(1);
+		out << std::fixed << " " << storage.Name << ": " << sat.GetResidentBytes(storage.Format) / (1024.0 * 1024.0) << " MB, "
+			<< (double(texels) * depthTexelBytes(storage.Format) + sat.GetBuildBytes(storage.Format)) / (1024.0 * 1024.0) << " MB / frame";
+		out.precision(2);
+		out << std::scientific << ", mean err " << meanError / MP_WINDOWS << " (max " << maxMeanError << "), variance err "
+			<< varianceError / MP_WINDOWS << ", visibility err " << visibilityError / MP_WINDOWS << " (max " << maxVisibilityError << ");";
+	}
+	return out.str();
+}
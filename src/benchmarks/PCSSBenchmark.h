@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include "VariantBenchmark.h"
+
+
+/*-----------------------------PCSS depth pyramid benchmark (in app, runs on the live scene)---------------------------------*/
+// a VariantBenchmark over pyramid off / on: times the lit pass and the pyramid build, then the early exit
+// counters of each variant (atomics, so they stay out of the timed frames)
+
+class PCSSBenchmark {
+private:
+	enum Scope { PB_LIT, PB_PYRAMID };
+	enum Counter { PB_FRAGMENTS, PB_EARLY_LIT, PB_EARLY_SHADOWED };
+
+	VariantBenchmark m_Variants;
+
+public:
+	std::string Result;
+
+	bool IsRunning() const {
+		return m_Variants.IsRunning();
+	}
+
+	void Start() {
+		m_Variants.Start({ "pyramid off", "pyramid on" }, std::vector<std::string>{ "Lit pass", "Depth pyramid" },
+			{ "PCSS fragments", "PCSS early lit", "PCSS early shadowed" });
+		Result = m_Variants.Result;
+	}
+
+	//settings the frame has to render with
+	bool UsePyramid() const {
+		return m_Variants.CurrentVariant() == 1;
+	}
+	bool CollectStats() const {
+		return m_Variants.CollectStats();
+	}
+
+	//call after the lit pass; returns true on the frame the benchmark finishes
+	bool Record(const Profiler& profiler, size_t objectCount) {
+		if (!m_Variants.Record(profiler))
+			return false;
+		double off = m_Variants.GetMs(0, PB_LIT);
+		double on = m_Variants.GetMs(1, PB_LIT);
+		double pyramid = m_Variants.GetMs(1, PB_PYRAMID);
+		double fragments = m_Variants.GetCounter(1, PB_FRAGMENTS) > 0.0 ? m_Variants.GetCounter(1, PB_FRAGMENTS) : 1.0;
+		double earlyLit = m_Variants.GetCounter(1, PB_EARLY_LIT);
+		double earlyShadowed = m_Variants.GetCounter(1, PB_EARLY_SHADOWED);
+		std::ostringstream out;
+		out.precision(3);
+		out << std::fixed << "PCSS (" << objectCount << " objects): lit " << off << " -> " << on << " ms"
+			<< " + pyramid " << pyramid << " ms, saved " << (off - on - pyramid) << " ms; early exit "
+			<< 100.0 * (earlyLit + earlyShadowed) / fragments << "% (lit " << 100.0 * earlyLit / fragments
+			<< "%, shadowed " << 100.0 * earlyShadowed / fragments << "%)";
+		Result = out.str();
+		return true;
+	}
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../DepthRasterizer.h"
+#include "../ThreadPool.h"
+
+//default rasterizer benchmark settings:
+const int RB_SIZE = 1024; //SHADOW_MAP_WIDTH
+const size_t RB_TRIANGLES = 1000000;
+const int RB_SPHERE_SEGMENTS = 16; //2 * 16 * 16 triangles per sphere
+const int RB_FILL_GRID = 97; //fine cells per side of the fill rule mesh, not a divisor of the map size
+const int RB_REPEATS = 5;
+
+
+/*-----------------------------Software light depth pass: triangles/s over 1..N threads (no GL)---------------------------------*/
+// a tessellated ground plane under a grid of spheres, seen by a perspective light like LightFrustum,
+// with about `triangles` triangles. DepthRasterizer draws it with 1, 2, 4 .. hardware threads; every
+// depth buffer has to be identical to the single thread one. Then the fill rule check: a jittered grid
+// that covers the whole viewport (and past the guard band, so clipping runs) is drawn with every triangle nearer
+// than the ones before, so any pixel covered twice passes the depth test again; it must give exactly
+// one fragment per pixel and leave no pixel at the clear value. returns 1 when a check fails.
+
+//unit sphere, triangle list
+inline std::vector<glm::vec3> benchSphere(int segments) {
+	std::vector<glm::vec3> triangles;
+	auto point = [&](int i, int j) {
+		float theta = 3.14159265f * i / segments, phi = 6.28318531f * j / segments;
+		return glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+	};
+	for (int i = 0; i < segments; ++i)
+		for (int j = 0; j < segments; ++j) {
+			glm::vec3 a = point(i, j), b = point(i + 1, j), c = point(i + 1, j + 1), d = point(i, j + 1);
+			triangles.insert(triangles.end(), { a, b, c, c, d, a });
+		}
+	return triangles;
+}
+
+inline int RunRasterizerBenchmark(size_t triangles) {
+	std::cout << "Depth rasterizer benchmark: " << RB_SIZE << "^2, tiles " << DR_TILE << ", "
+		<< DR_SUBPIXEL_BITS << " subpixel bits" << (DEPTH_RASTERIZER_SIMD ? ", SSE2" : ", scalar") << std::endl;
+
+	//ground: (n x n) quads, indexed
+	int n = 64;
+	std::vector<glm::vec3> ground;
+	std::vector<unsigned int> groundIndices;
+	for (int z = 0; z <= n; ++z)
+		for (int x = 0; x <= n; ++x)
+			ground.push_back(glm::vec3(-10.0f + 20.0f * x / n, 0.0f, -10.0f + 20.0f * z / n));
+	for (int z = 0; z < n; ++z)
+		for (int x = 0; x < n; ++x) {
+			unsigned int i = z * (n + 1) + x;
+			groundIndices.insert(groundIndices.end(), { i, i + 1, i + n + 2, i + n + 2, i + n + 1, i });
+		}
+	std::vector<glm::vec3> sphere = benchSphere(RB_SPHERE_SEGMENTS);
+	size_t sphereTriangles = sphere.size() / 3;
+	int spheres = std::max(1, int((triangles - std::min(triangles, groundIndices.size() / 3)) / sphereTriangles));
+	int side = int(std::ceil(std::sqrt(double(spheres))));
+	std::vector<glm::mat4> models;
+	for (int i = 0; i < spheres; ++i) {
+		float x = -9.0f + 18.0f * (i % side + 0.5f) / side, z = -9.0f + 18.0f * (i / side + 0.5f) / side;
+		float radius = 0.4f * 18.0f / side;
+		models.push_back(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, radius * (1.5f + float(i % 3)), z)), glm::vec3(radius)));
+	}
+	glm::mat4 light = glm::perspective(glm::radians(90.0f), 1.0f, 1.0f, 40.0f)
+		* glm::lookAt(glm::vec3(2.0f, 12.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	DepthRasterizer rasterizer(RB_SIZE);
+	auto submitScene = [&]() {
+		rasterizer.Clear();
+		rasterizer.Submit(ground.data(), groundIndices.data(), groundIndices.size() / 3, light);
+		for (const glm::mat4& model : models)
+			rasterizer.Submit(sphere.data(), nullptr, sphereTriangles, light * model);
+	};
+
+	bool ok = true;
+	std::vector<float> reference;
+	double singleMs = 0.0;
+	int hardware = std::max(1, (int)std::thread::hardware_concurrency());
+	for (int threads = 1; ; threads = std::min(threads * 2, hardware)) {
+		ThreadPool pool(threads - 1);
+		double best = 1e30;
+		for (int r = 0; r < RB_REPEATS; ++r) {
+			submitScene();
+			auto start = std::chrono::high_resolution_clock::now();
+			rasterizer.Rasterize(&pool);
+			std::chrono::duration<double, std::milli> ms = std::chrono::high_resolution_clock::now() - start;
+			best = std::min(best, ms.count());
+		}
+		bool same = true;
+		if (threads == 1) {
+			reference = rasterizer.GetDepth();
+			singleMs = best;
+			std::cout << "  " << rasterizer.LastTriangles << " triangles (" << spheres << " spheres), " << rasterizer.LastBinned
+				<< " set up, " << rasterizer.LastClipped << " clipped, " << rasterizer.LastCulled << " culled, "
+				<< rasterizer.LastFragments << " fragments" << std::endl;
+		}
+		else {
+			same = std::memcmp(reference.data(), rasterizer.GetDepth().data(), reference.size() * sizeof(float)) == 0;
+			ok &= same;
+		}
+		std::cout << "  " << threads << " thread" << (threads > 1 ? "s: " : ": ") << best << " ms, "
+			<< rasterizer.LastTriangles / (best * 1e3) << " M triangles/s, x" << singleMs / best
+			<< (same ? "" : ", DIFFERS from 1 thread") << std::endl;
+		if (threads == hardware)
+			break;
+	}
+
+	//fill rule: grid in clip space, jittered over [-0.95, 0.95]^2 and two rings of wide cells out to +-4,
+	//so the cells across the viewport edge reach past the guard band. Later triangles are nearer
+	std::vector<float> lines = { -4.0f, -2.5f };
+	for (int i = 0; i <= RB_FILL_GRID; ++i)
+		lines.push_back(-0.95f + 1.9f * i / RB_FILL_GRID);
+	lines.insert(lines.end(), { 2.5f, 4.0f });
+	int cells = int(lines.size()) - 1;
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> jitter(-0.2f * 1.9f / RB_FILL_GRID, 0.2f * 1.9f / RB_FILL_GRID);
+	std::vector<glm::vec2> grid;
+	for (int y = 0; y <= cells; ++y)
+		for (int x = 0; x <= cells; ++x) {
+			bool fine = x > 2 && y > 2 && x < cells - 2 && y < cells - 2;
+			grid.push_back(glm::vec2(lines[x] + (fine ? jitter(rng) : 0.0f), lines[y] + (fine ? jitter(rng) : 0.0f)));
+		}
+	std::vector<glm::vec3> fill;
+	size_t fillTriangles = size_t(cells) * cells * 2;
+	auto corner = [&](int x, int y, size_t triangle) {
+		glm::vec2 p = grid[size_t(y) * (cells + 1) + x];
+		return glm::vec3(p, 0.9f - 1.8f * float(triangle) / float(fillTriangles));
+	};
+	for (int y = 0; y < cells; ++y)
+		for (int x = 0; x < cells; ++x) {
+			size_t t = fill.size() / 3;
+			//alternate the diagonal so both orientations of shared edges occur
+			if ((x + y) % 2) {
+				fill.insert(fill.end(), { corner(x, y, t), corner(x + 1, y, t), corner(x + 1, y + 1, t) });
+				fill.insert(fill.end(), { corner(x + 1, y + 1, t + 1), corner(x, y + 1, t + 1), corner(x, y, t + 1) });
+			}
+			else {
+				fill.insert(fill.end(), { corner(x, y, t), corner(x + 1, y, t), corner(x, y + 1, t) });
+				fill.insert(fill.end(), { corner(x + 1, y, t + 1), corner(x + 1, y + 1, t + 1), corner(x, y + 1, t + 1) });
+			}
+		}
+	ThreadPool pool;
+	rasterizer.Clear();
+	rasterizer.Submit(fill.data(), nullptr, fillTriangles, glm::mat4(1.0f));
+	rasterizer.Rasterize(&pool);
+	size_t pixels = size_t(RB_SIZE) * RB_SIZE, holes = 0;
+	for (float d : rasterizer.GetDepth())
+		holes += d == 1.0f ? 1 : 0;
+	bool watertight = holes == 0 && rasterizer.LastFragments == pixels;
+	ok &= watertight;
+	std::cout << "  fill rule (" << fillTriangles << " triangles, " << rasterizer.LastClipped << " clipped): "
+		<< rasterizer.LastFragments << " fragments for " << pixels << " pixels, " << holes << " holes"
+		<< (watertight ? ", watertight" : ", NOT watertight") << std::endl;
+	return ok ? 0 : 1;
+}
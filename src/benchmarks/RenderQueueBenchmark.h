@@ -0,0 +1,104 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "../RenderQueue.h"
+#include "../ThreadPool.h"
+
+//default render queue benchmark settings:
+const size_t RQB_DRAWS = 100000;
+const unsigned int RQB_PROGRAMS = 8;
+const unsigned int RQB_MATERIALS = 256;
+const unsigned int RQB_GEOMETRIES = 64;
+const int RQB_REPEATS = 5;
+const unsigned int RQB_SEED = 1234;
+
+
+/*-----------------------------Render queue: submission, sort and state changes of N draws (no GL)---------------------------------*/
+// draws with random program / material / geometry / depth are submitted to a RenderQueue (what Submit()
+// costs with its key and transform), then sorted: std::sort, the radix sort on one thread and on the
+// pool. All three orders have to agree. The program, material and geometry switches of the submission
+// order against the sorted one are the state changes the sort saves, and the sorted order has to be
+// front to back within every state. returns 1 when a check fails.
+
+inline int RunRenderQueueBenchmark(size_t draws) {
+	std::cout << "Render queue benchmark: " << draws << " draws, " << RQB_PROGRAMS << " programs, " << RQB_MATERIALS << " materials, "
+		<< RQB_GEOMETRIES << " geometries" << std::endl;
+
+	std::mt19937 rng(RQB_SEED);
+	std::uniform_int_distribution<unsigned int> program(0, RQB_PROGRAMS - 1), material(0, RQB_MATERIALS - 1), geometry(0, RQB_GEOMETRIES - 1);
+	std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+	struct Draw {
+		unsigned int Program, Material, Geometry;
+		float Depth;
+		glm::mat4 Model;
+	};
+	std::vector<Draw> scene(draws);
+	for (Draw& draw : scene)
+		draw = { program(rng), material(rng), geometry(rng), depth(rng), glm::mat4(1.0f) };
+
+	RenderQueue queue;
+	double submitMs = 1e30;
+	for (int r = 0; r < RQB_REPEATS; ++r) {
+		auto start = std::chrono::high_resolution_clock::now();
+		queue.Reset();
+		for (const Draw& draw : scene)
+			queue.Submit(RQ_PASS_OPAQUE, draw.Program, draw.Material, draw.Geometry, draw.Depth, draw.Model);
+		submitMs = std::min(submitMs, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+	}
+	const std::vector<RQItem> submitted = queue.GetItems();
+	RQStateChanges unsortedChanges = rqCountStateChanges(submitted);
+
+	bool ok = true;
+	std::vector<RQItem> reference, items, scratch;
+	double stdMs = 1e30;
+	for (int r = 0; r < RQB_REPEATS; ++r) {
+		reference = submitted;
+		auto start = std::chrono::high_resolution_clock::now();
+		std::stable_sort(reference.begin(), reference.end(), [](const RQItem& a, const RQItem& b) { return a.Key < b.Key; });
+		stdMs = std::min(stdMs, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+	}
+	std::cout << "  submit " << submitMs << " ms (" << submitMs * 1e6 / draws << " ns / draw), std::stable_sort " << stdMs << " ms" << std::endl;
+
+	ThreadPool single(0);
+	ThreadPool pool;
+	ThreadPool* pools[2] = { &single, &pool };
+	for (ThreadPool* p : pools) {
+		double best = 1e30;
+		for (int r = 0; r < RQB_REPEATS; ++r) {
+			items = submitted;
+			auto start = std::chrono::high_resolution_clock::now();
+			rqRadixSort(items, scratch, p);
+			best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+		}
+		bool same = items.size() == reference.size() && std::equal(items.begin(), items.end(), reference.begin(),
+			[](const RQItem& a, const RQItem& b) { return a.Key == b.Key && a.Draw == b.Draw; });
+		ok &= same;
+		std::cout << "  radix sort on " << p->GetThreadCount() << " thread" << (p->GetThreadCount() > 1 ? "s: " : ": ") << best << " ms (x"
+			<< stdMs / best << " std::stable_sort)" << (same ? "" : ", DIFFERS from std::stable_sort") << std::endl;
+	}
+
+	//front to back within every program / material / geometry
+	size_t depthOrder = 0;
+	const uint64_t stateMask = ~((uint64_t(1) << RQ_GEOMETRY_SHIFT) - 1);
+	for (size_t i = 1; i < items.size(); ++i)
+		if ((items[i].Key & stateMask) == (items[i - 1].Key & stateMask) && items[i].Key < items[i - 1].Key)
+			depthOrder++;
+	ok &= depthOrder == 0;
+
+	RQStateChanges sortedChanges = rqCountStateChanges(items);
+	std::cout << "  state changes, submission order: " << unsortedChanges.Programs << " programs, " << unsortedChanges.Materials << " materials, "
+		<< unsortedChanges.Geometries << " geometries" << std::endl;
+	std::cout << "  state changes, sorted: " << sortedChanges.Programs << " programs, " << sortedChanges.Materials << " materials, "
+		<< sortedChanges.Geometries << " geometries (" << unsortedChanges.Total() - sortedChanges.Total() << " saved, "
+		<< 100.0 * (unsortedChanges.Total() - sortedChanges.Total()) / std::max(1u, unsortedChanges.Total()) << "%)"
+		<< (depthOrder ? ", NOT front to back" : ", front to back within every state") << std::endl;
+	return ok ? 0 : 1;
+}
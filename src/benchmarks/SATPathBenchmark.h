@@ -0,0 +1,183 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "../GLState.h"
+#include "../GLCapabilities.h"
+#include "../DepthSAT.h"
+#include "MomentFilterBenchmark.h"
+
+//default SAT path benchmark settings:
+const int SP_SIZE = 1024;
+const int SP_COMPUTE_ROW = 2048; //ComputeSAT.shader: 1024 invocations scan 2 texels each
+
+
+/*-----------------------------Depth SAT: compute vs GL 3.3 fragment path (hidden window, own GL context)---------------------------------*/
+// opens an invisible 3.3 core context like main(), prints what it can run, builds the depth SAT of a
+// synthetic RG32F shadow map with every path it supports and checks each table bit for bit against a
+// CPU emulation of the same float additions in the same order (the compute up-sweep, the recursive
+// doubling of SATDoubling.shader). the error against a double precision SAT and the GPU time of both
+// paths are printed too. returns 1 when a table is not bit exact.
+// software: LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=llvmpipe VSSM --bench sat
+
+//centered moments of the shadow map, interleaved (depth, depth^2) per texel
+inline std::vector<float> satMoments(const std::vector<float>& depth, float center) {
+	std::vector<float> moments(depth.size() * 2);
+	for (size_t i = 0; i < depth.size(); ++i) {
+		float d = depth[i] - center;
+		moments[2 * i] = d;
+		moments[2 * i + 1] = d * d;
+	}
+	return moments;
+}
+
+//inclusive prefix sums of `count` vec2 (stride in vec2) in the order of the ComputeSAT.shader up-sweep
+inline void computeScanLine(float* line, size_t count, size_t stride) {
+	std::vector<float> data(SP_COMPUTE_ROW * 2, 0.0f);
+	for (size_t i = 0; i < count; ++i) {
+		data[2 * i] = line[2 * i * stride];
+		data[2 * i + 1] = line[2 * i * stride + 1];
+	}
+	const unsigned int invocations = SP_COMPUTE_ROW / 2;
+	for (unsigned int step = 0; (1u << step) <= invocations; ++step) {
+		unsigned int mask = (1u << step) - 1;
+		for (unsigned int id = 0; id < invocations; ++id) {
+			unsigned int rd = ((id >> step) << (step + 1)) + mask;
+			unsigned int wr = rd + 1 + (id & mask);
+			data[2 * wr] += data[2 * rd];
+			data[2 * wr + 1] += data[2 * rd + 1];
+		}
+	}
+	for (size_t i = 0; i < count; ++i) {
+		line[2 * i * stride] = data[2 * i];
+		line[2 * i * stride + 1] = data[2 * i + 1];
+	}
+}
+
+//the same with recursive doubling: pass i adds the value 2^i before
+inline void doublingScanLine(float* line, size_t count, size_t stride) {
+	std::vector<float> previous(count * 2);
+	for (size_t offset = 1; offset < count; offset *= 2) {
+		for (size_t i = 0; i < count; ++i) {
+			previous[2 * i] = line[2 * i * stride];
+			previous[2 * i + 1] = line[2 * i * stride + 1];
+		}
+		for (size_t i = offset; i < count; ++i) {
+			line[2 * i * stride] = previous[2 * i] + previous[2 * (i - offset)];
+			line[2 * i * stride + 1] = previous[2 * i + 1] + previous[2 * (i - offset) + 1];
+		}
+	}
+}
+
+//rows, then columns
+template<typename ScanLine>
+std::vector<float> emulateSAT(std::vector<float> moments, int size, ScanLine scanLine) {
+	for (int y = 0; y < size; ++y)
+		scanLine(&moments[size_t(y) * size * 2], size_t(size), 1);
+	for (int x = 0; x < size; ++x)
+		scanLine(&moments[size_t(x) * 2], size_t(size), size_t(size));
+	return moments;
+}
+
+//prints the comparison of a GPU table with its emulation, returns true when bit exact
+inline bool compareSAT(const char* name, const std::vector<float>& table, const std::vector<float>& emulated,
+	const std::vector<double>& exact, double ms, double megabytes) {
+	size_t mismatches = 0;
+	uint32_t maxUlps = 0;
+	double maxError = 0.0;
+	for (size_t i = 0; i < table.size(); ++i) {
+		uint32_t a, b;
+		std::memcpy(&a, &table[i], sizeof(a));
+		std::memcpy(&b, &emulated[i], sizeof(b));
+		if (a != b) {
+			mismatches++;
+			maxUlps = std::max(maxUlps, a > b ? a - b : b - a);
+		}
+		maxError = std::max(maxError, std::abs(table[i] - exact[i]));
+	}
+	std::cout << "  " << name << ": " << ms << " ms, " << megabytes << " MB / build, "
+		<< (mismatches ? "NOT bit exact" : "bit exact") << " (" << mismatches << " values differ, max " << maxUlps << " ulp)"
+		<< ", max error vs double " << maxError << std::endl;
+	return mismatches == 0;
+}
+
+inline int RunSATPathBenchmark(int size) {
+	if (!glfwInit())
+		return -1;
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "VSSM SAT", NULL, NULL);
+	if (!window) {
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	if (glewInit() != GLEW_OK) {
+		std::cout << "Failed to initialize GLEW" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	GLCapabilities caps = DetectGLCapabilities();
+	PrintGLCapabilities(caps);
+	std::cout << "Depth SAT " << size << "x" << size << ", centered on " << DS_CENTER << std::endl;
+
+	bool exact = true;
+	{
+		unsigned int depthMap = createBenchDepthMap(size, DEPTH_RG32F);
+		std::vector<float> depth(size_t(size) * size);
+		glState().BindTexture(GL_TEXTURE_2D, depthMap);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, depth.data());
+		std::vector<float> moments = satMoments(depth, DS_CENTER);
+
+		//double precision table of the same moments
+		std::vector<double> sat(moments.begin(), moments.end());
+		for (int y = 0; y < size; ++y)
+			for (int x = 0; x < size; ++x)
+				for (int c = 0; c < 2; ++c) {
+					size_t i = (size_t(y) * size + x) * 2 + c;
+					sat[i] += (x > 0 ? sat[i - 2] : 0.0) + (y > 0 ? sat[i - size_t(size) * 2] : 0.0)
+						- (x > 0 && y > 0 ? sat[i - size_t(size) * 2 - 2] : 0.0);
+				}
+
+		DepthSAT depthSAT(size);
+		std::vector<float> table(moments.size());
+		auto readTable = [&]() {
+			glState().BindTexture(GL_TEXTURE_2D, depthSAT.GetTexture());
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_FLOAT, table.data());
+			glState().BindTexture(GL_TEXTURE_2D, 0);
+		};
+
+		Shader doublingShader(VF_SHADER, "src/shaders/SATDoubling.shader");
+		double fragmentMs = timeGPUBuild([&]() { depthSAT.BuildFragment(depthMap, doublingShader); });
+		readTable();
+		exact &= compareSAT("fragment (recursive doubling)", table, emulateSAT(moments, size, doublingScanLine), sat,
+			fragmentMs, depthSAT.GetFragmentBuildBytes(DEPTH_RG32F) / (1024.0 * 1024.0));
+
+		if (caps.ComputeShaders && size <= SP_COMPUTE_ROW) {
+			Shader rowShader(CP_SHADER, "src/shaders/ComputeSAT.shader", { "DEPTH" });
+			Shader columnShader(CP_SHADER, "src/shaders/ComputeSAT.shader", { "COLUMNS" });
+			double computeMs = timeGPUBuild([&]() { depthSAT.Build(depthMap, rowShader, columnShader); });
+			readTable();
+			exact &= compareSAT("compute (up-sweep, in place)", table, emulateSAT(moments, size, computeScanLine), sat,
+				computeMs, depthSAT.GetBuildBytes(DEPTH_RG32F) / (1024.0 * 1024.0));
+		}
+		else {
+			std::cout << "  compute: n/a (" << (caps.ComputeShaders ? "rows over 2048" : "no GL 4.3") << ")" << std::endl;
+		}
+		glState().DeleteTextures(1, &depthMap);
+	}
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return exact ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cmath>
+
+#include "../SampleTables.h"
+
+
+/*-----------------------------Sample tables: generator output and filter quality---------------------------------*/
+// prints the tables for a seed and estimates how well each set filters a straight shadow edge (the common PCF case):
+// a 64x64 tile of pixels sees the edge at a distance varying across the tile, the covered fraction of every pixel
+// is compared with the exact disk coverage. the raw RMSE is the noise, the RMSE after a 4x4 box blur is what is
+// left once the eye (or a temporal / spatial filter) averages neighbours, i.e. the visible banding.
+// rotations: none, white noise (the per fragment hash) and the blue noise tile
+
+inline int RunSampleBenchmark(unsigned int seed) {
+	std::cout << "Sample tables, seed " << seed << std::endl;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<glm::vec4> tables = BuildSampleTables(seed);
+	std::vector<float> blueNoise = GenerateBlueNoiseTexture(ST_NOISE_SIZE, seed);
+	std::chrono::duration<double, std::milli> generateMs = std::chrono::high_resolution_clock::now() - start;
+	std::cout << "  generated in " << generateMs.count() << " ms (" << ST_NOISE_SIZE << "x" << ST_NOISE_SIZE << " blue noise)" << std::endl;
+
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::vector<float> whiteNoise(blueNoise.size());
+	for (auto& v : whiteNoise)
+		v = uniform(rng);
+
+	//fraction of the unit disk beyond a line at signed distance d from the center
+	auto segmentFraction = [](float d) {
+		d = std::max(-1.0f, std::min(1.0f, d));
+		return (std::acos(d) - d * std::sqrt(1.0f - d * d)) / 3.14159265f;
+	};
+
+	const int size = ST_NOISE_SIZE;
+	const int edgeAngles = 16;
+	const int blur = 4;
+	//returns raw and blurred RMSE over the edge angles
+	auto edgeError = [&](const std::vector<glm::vec2>& samples, const std::vector<float>* rotation) {
+		double raw = 0.0, blurred = 0.0;
+		std::vector<float> error(size * size);
+		for (int a = 0; a < edgeAngles; ++a) {
+			float theta = 6.2831853f * (a + 0.37f) / edgeAngles;
+			glm::vec2 normal(std::cos(theta), std::sin(theta));
+			for (int y = 0; y < size; ++y) {
+				for (int x = 0; x < size; ++x) {
+					//edge distance sweeps [-1.2, 1.2] filter radii across the tile
+					glm::vec2 p((x + 0.5f) / size * 2.0f - 1.0f, (y + 0.5f) / size * 2.0f - 1.0f);
+					float d = glm::dot(p, normal) * 1.2f;
+					float angle = rotation ? (*rotation)[y * size + x] * 6.2831853f : 0.0f;
+					float c = std::cos(angle), sn = std::sin(angle);
+					int hits = 0;
+					for (const auto& s : samples)
+						hits += glm::dot(glm::vec2(c * s.x - sn * s.y, sn * s.x + c * s.y), normal) > d;
+					error[y * size + x] = hits / float(samples.size()) - segmentFraction(d);
+					raw += error[y * size + x] * error[y * size + x];
+				}
+			}
+			for (int y = 0; y < size; ++y) {
+				for (int x = 0; x < size; ++x) {
+					float sum = 0.0f;
+					for (int by = 0; by < blur; ++by)
+						for (int bx = 0; bx < blur; ++bx)
+							sum += error[((y + by) % size) * size + (x + bx) % size];
+					sum /= blur * blur;
+					blurred += sum * sum;
+				}
+			}
+		}
+		double n = double(edgeAngles) * size * size;
+		return std::make_pair(std::sqrt(raw / n), std::sqrt(blurred / n));
+	};
+
+	std::cout << std::fixed << std::setprecision(4);
+	std::cout << "  edge RMSE raw / 4x4 blurred:    no rotation        white noise        blue noise" << std::endl;
+	for (int s = 0; s < SAMPLES_COUNT; ++s) {
+		std::vector<glm::vec2> samples(ST_NUM_SAMPLES);
+		for (int i = 0; i < ST_NUM_SAMPLES; ++i) {
+			const glm::vec4& v = tables[s * ST_VEC4_PER_SET + i / 2];
+			samples[i] = (i & 1) ? glm::vec2(v.z, v.w) : glm::vec2(v.x, v.y);
+		}
+		float minDistance = FLT_MAX;
+		for (int i = 0; i < ST_NUM_SAMPLES; ++i)
+			for (int j = i + 1; j < ST_NUM_SAMPLES; ++j)
+				minDistance = std::min(minDistance, glm::distance(samples[i], samples[j]));
+
+		auto none = edgeError(samples, nullptr);
+		auto white = edgeError(samples, &whiteNoise);
+		auto blue = edgeError(samples, &blueNoise);
+		std::cout << "  " << std::left << std::setw(26) << SAMPLE_SET_NAMES[s] << std::right << "     "
+			<< none.first << " / " << none.second << "    " << white.first << " / " << white.second << "    "
+			<< blue.first << " / " << blue.second << "    (min distance " << minDistance << ")" << std::endl;
+	}
+
+	//the tables as uploaded, one vec4 (two samples) per line
+	for (int s = 1; s < SAMPLES_COUNT; ++s) {
+		std::cout << "  // " << SAMPLE_SET_NAMES[s] << std::endl;
+		for (int i = 0; i < ST_VEC4_PER_SET; ++i) {
+			const glm::vec4& v = tables[s * ST_VEC4_PER_SET + i];
+			std::cout << "  vec4(" << v.x << ", " << v.y << ", " << v.z << ", " << v.w << ")," << std::endl;
+		}
+	}
+	return 0;
+}
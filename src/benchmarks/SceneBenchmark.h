@@ -0,0 +1,73 @@
+#pragma once
+
+#include <iostream>
+#include <chrono>
+#include <random>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../Scene.h"
+#include "../ThreadPool.h"
+
+
+/*-----------------------------Scene transform update microbenchmark---------------------------------*/
+// full rebuild and 10% dirty rebuild of `count` transforms, single thread vs thread pool,
+// the SIMD output is checked against glm on the way
+
+inline int RunSceneBenchmark(size_t count) {
+	std::cout << "Scene update benchmark: " << count << " transforms" << std::endl;
+
+	std::mt19937 rng(1234);
+	auto rand01 = [&]() { return float(rng() >> 8) * (1.0f / 16777216.0f); };
+
+	Scene scene;
+	scene.Reserve(count);
+	AABB unitBox(glm::vec3(-0.5f), glm::vec3(0.5f));
+	for (size_t i = 0; i < count; ++i) {
+		glm::vec3 axis = glm::normalize(glm::vec3(rand01() - 0.5f, rand01() - 0.5f, rand01() - 0.5f) + glm::vec3(1e-3f));
+		glm::quat q = glm::angleAxis(rand01() * 6.2831853f, axis);
+		scene.Add(glm::vec3(rand01(), rand01(), rand01()) * 100.0f, q, glm::vec3(0.5f + rand01()), unitBox, 0, 0);
+	}
+
+	ThreadPool pool;
+	const int repeats = 10;
+	auto timeUpdate = [&](ThreadPool* p, float dirtyFraction) {
+		double total = 0.0;
+		size_t updated = 0;
+		for (int r = 0; r < repeats; ++r) {
+			if (dirtyFraction >= 1.0f)
+				scene.MarkAllDirty();
+			else
+				for (size_t i = 0; i < count; ++i)
+					scene.Dirty[i] = rand01() < dirtyFraction ? 1 : 0;
+			auto start = std::chrono::high_resolution_clock::now();
+			updated = scene.Update(p);
+			std::chrono::duration<double, std::milli> ms = std::chrono::high_resolution_clock::now() - start;
+			total += ms.count();
+		}
+		return std::make_pair(total / repeats, updated);
+	};
+
+	auto report = [&](const char* name, std::pair<double, size_t> result) {
+		std::cout << "  " << name << ": " << result.first << " ms, " << result.second << " updated, "
+			<< (result.second / (result.first * 1e-3) * 1e-6) << " M transforms/s" << std::endl;
+	};
+	report("all dirty, 1 thread       ", timeUpdate(nullptr, 1.0f));
+	report("all dirty, pool           ", timeUpdate(&pool, 1.0f));
+	report("10% dirty, 1 thread       ", timeUpdate(nullptr, 0.1f));
+	report("10% dirty, pool           ", timeUpdate(&pool, 0.1f));
+	std::cout << "  threads: " << pool.GetThreadCount() << (SCENE_SIMD ? ", SSE" : ", scalar") << std::endl;
+
+	//glm reference check on a few entries
+	float maxError = 0.0f;
+	for (size_t i = 0; i < count; i += count / 64 + 1) {
+		glm::quat q(scene.RotW[i], scene.RotX[i], scene.RotY[i], scene.RotZ[i]);
+		glm::mat4 ref = glm::translate(glm::mat4(1.0f), glm::vec3(scene.PosX[i], scene.PosY[i], scene.PosZ[i])) *
+						glm::mat4_cast(q) * glm::scale(glm::mat4(1.0f), glm::vec3(scene.ScaleX[i], scene.ScaleY[i], scene.ScaleZ[i]));
+		for (int c = 0; c < 4; ++c)
+			for (int r = 0; r < 4; ++r)
+				maxError = std::max(maxError, std::fabs(ref[c][r] - scene.World[i][c][r]));
+	}
+	std::cout << "  max error vs glm: " << maxError << std::endl;
+	return maxError < 1e-3f ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include "../Profiler.h"
+
+//default variant benchmark settings:
+const int VB_WARMUP_FRAMES = 2 * PF_QUERY_FRAMES; //let the GPU timings of the previous variant drain
+const int VB_TIMED_FRAMES = 120;
+const int VB_STATS_FRAMES = 10;
+
+
+/*-----------------------------Variant benchmark (in app, runs on the live scene)---------------------------------*/
+// renders VB_TIMED_FRAMES frames with each variant in turn and compares the GPU time of some profiler scopes (summed).
+// the caller applies CurrentVariant() before rendering and calls Record() once the frame is submitted.
+// optional counters are averaged over VB_STATS_FRAMES extra frames per variant with CollectStats() on,
+// so instrumented shaders stay out of the timed frames.
+// Result is a generic summary; benchmarks reporting more than that format their own from GetMs() / GetCounter()
+
+class VariantBenchmark {
+private:
+	std::vector<std::string> m_Variants;
+	std::vector<std::vector<double>> m_Ms; //per variant, per scope
+	std::vector<std::string> m_Scopes;
+	std::vector<std::string> m_Counters;
+	std::vector<std::vector<double>> m_CounterSums;
+	int m_Current;
+	int m_Frame;
+
+public:
+	std::string Result;
+
+	//ctor
+	VariantBenchmark() : m_Current(-1), m_Frame(0) {};
+
+	bool IsRunning() const {
+		return m_Current >= 0;
+	}
+
+	void Start(const std::vector<std::string>& variants, const std::string& gpuScope, const std::vector<std::string>& counters = {}) {
+		Start(variants, std::vector<std::string>{ gpuScope }, counters);
+	}
+	void Start(const std::vector<std::string>& variants, const std::vector<std::string>& gpuScopes, const std::vector<std::string>& counters = {}) {
+		m_Variants = variants;
+		m_Ms.assign(variants.size(), std::vector<double>(gpuScopes.size(), 0.0));
+		m_Scopes = gpuScopes;
+		m_Counters = counters;
+		m_CounterSums.assign(variants.size(), std::vector<double>(counters.size(), 0.0));
+		m_Current = variants.empty() ? -1 : 0;
+		m_Frame = 0;
+		Result = "running...";
+	}
+
+	int CurrentVariant() const {
+		return m_Current;
+	}
+	bool CollectStats() const {
+		return m_Current >= 0 && m_Frame >= VB_WARMUP_FRAMES + VB_TIMED_FRAMES;
+	}
+
+	//returns true on the frame the benchmark finishes
+	bool Record(const Profiler& profiler) {
+		if (m_Current < 0)
+			return false;
+		if (CollectStats()) {
+			for (size_t c = 0; c < m_Counters.size(); ++c)
+				m_CounterSums[m_Current][c] += profiler.GetCounter(m_Counters[c]);
+		}
+		else if (m_Frame >= VB_WARMUP_FRAMES) {
+			for (size_t s = 0; s < m_Scopes.size(); ++s)
+				m_Ms[m_Current][s] += profiler.GetLastGPUms(m_Scopes[s]);
+		}
+		int statsFrames = m_Counters.empty() ? 0 : VB_STATS_FRAMES;
+		if (++m_Frame < VB_WARMUP_FRAMES + VB_TIMED_FRAMES + statsFrames)
+			return false;
+		m_Frame = 0;
+		if (++m_Current < (int)m_Variants.size())
+			return false;
+
+		m_Current = -1;
+		std::ostringstream out;
+		out.precision(3);
+		out << std::fixed;
+		for (size_t s = 0; s < m_Scopes.size(); ++s)
+			out << (s ? " + " : "") << m_Scopes[s];
+		out << ":";
+		for (int i = 0; i < (int)m_Variants.size(); ++i) {
+			out << (i ? ", " : " ") << m_Variants[i] << " " << GetMs(i) << " ms";
+			if (i > 0 && GetMs(0) > 0.0)
+				out << " (x" << GetMs(i) / GetMs(0) << ")";
+			for (size_t c = 0; c < m_Counters.size(); ++c)
+				out << ", " << m_Counters[c] << " " << GetCounter(i, c);
+		}
+		Result = out.str();
+		return true;
+	}
+
+	//per frame averages of the last run: one scope, or all of them summed (scope < 0)
+	double GetMs(int variant, int scope = -1) const {
+		double ms = 0.0;
+		for (int s = 0; s < (int)m_Scopes.size(); ++s) {
+			if (scope < 0 || s == scope)
+				ms += m_Ms[variant][s];
+		}
+		return ms / VB_TIMED_FRAMES;
+	}
+	double GetCounter(int variant, size_t counter) const {
+		return m_CounterSums[variant][counter] / VB_STATS_FRAMES;
+	}
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../Bounds.h"
+
+//default light frustum settings:
+const float LF_DEFAULT_FOV = 45.0f; //fixed frustum used when fitting is off (or nothing to fit)
+const float LF_DEFAULT_NEAR = 1.0f;
+const float LF_DEFAULT_FAR = 100.0f;
+const float LF_MIN_NEAR = 0.05f;
+const float LF_MAX_HALF_TAN = 5.67f; //~80 degrees, receivers right under the light
+const float LF_SIZE_STEPS_PER_OCTAVE = 8.0f; //window size quantization (stops size jitter)
+
+
+/*
+ * Fits the perspective shadow frustum of a point light to the scene, every frame:
+ *  - the window (left/right/bottom/top) encloses the visible receivers only,
+ *  - near is pulled back to the closest caster that can shadow them, far is the furthest receiver,
+ *  - window size is quantized and its center is snapped to whole texels so the map does not shimmer,
+ *  - casters outside the final frustum are counted (stats; the depth pass culls through the BVH).
+ */
+class LightFrustum {
+public:
+	glm::mat4 View;
+	glm::mat4 Projection;
+	glm::mat4 LightSpaceMatrix;
+	float NearPlane;
+	float FarPlane;
+
+	//stats
+	int CastersTotal;
+	int CastersCulled;
+	float TexelDensity; //shadow map texels per world unit at the receivers' center
+	float BaselineTexelDensity; //same measure for the fixed 45 degree frustum
+	float FilterScale; //texel size ratio fixed / fitted, keeps filter widths in world units
+
+	//ctor
+	LightFrustum()
+		: View(1.0f), Projection(1.0f), LightSpaceMatrix(1.0f),
+		NearPlane(LF_DEFAULT_NEAR), FarPlane(LF_DEFAULT_FAR),
+		CastersTotal(0), CastersCulled(0),
+		TexelDensity(0.0f), BaselineTexelDensity(0.0f), FilterScale(1.0f) {}
+
+	//filter width (texels of this frustum's map) covering filterTexels of the fixed frustum in world space
+	float FilterWidth(float filterTexels) const {
+		return filterTexels * FilterScale;
+	}
+
+	//the original fixed frustum: 45 degrees, [1, 100], looking at target
+	void SetFixed(const glm::vec3& lightPos, const glm::vec3& target, int casterCount) {
+		View = LookAt(lightPos, target);
+		NearPlane = LF_DEFAULT_NEAR;
+		FarPlane = LF_DEFAULT_FAR;
+		Projection = glm::perspective(glm::radians(LF_DEFAULT_FOV), 1.0f, NearPlane, FarPlane);
+		LightSpaceMatrix = Projection * View;
+		CastersTotal = casterCount;
+		CastersCulled = 0;
+		FilterScale = 1.0f;
+	}
+
+	/*
+	 * casters / receivers: world space bounds
+	 * viewProjection: camera matrix, receivers outside the camera frustum are ignored
+	 * mapSize: shadow map resolution in texels
+	 * filterTexels: filter kernel width in texels of the fixed frustum (the light size); the shaders widen it
+	 *   by FilterScale (FilterWidth()), half of the widened kernel is kept free at the border (PCSS / VSSM cut it out)
+	 */
+	void Fit(const glm::vec3& lightPos,
+			 const std::vector<AABB>& casters,
+			 const std::vector<AABB>& receivers,
+			 const glm::mat4& viewProjection,
+			 int mapSize, float filterTexels)
+	{
+		//STEP 1: visible receivers (clipped by the camera frustum bounds)
+		Frustum camFrustum(viewProjection);
+		AABB camBounds = FrustumBounds(viewProjection);
+		AABB allReceivers, visibleReceivers;
+		for (const auto& r : receivers) {
+			allReceivers.Expand(r);
+			if (camFrustum.Intersects(r))
+				visibleReceivers.Expand(r.Intersect(camBounds));
+		}
+		if (!visibleReceivers.IsValid()) {
+			SetFixed(lightPos, allReceivers.IsValid() ? allReceivers.Center() : glm::vec3(0.0f), (int)casters.size());
+			return;
+		}
+
+		//STEP 2: light orientation, aimed at all receivers so it only rotates when objects move
+		View = LookAt(lightPos, allReceivers.Center());
+
+		//STEP 3: window in tangent space (x/-z, y/-z) and depth range of the visible receivers
+		float minTx = FLT_MAX, maxTx = -FLT_MAX, minTy = FLT_MAX, maxTy = -FLT_MAX;
+		float receiverNear = FLT_MAX, receiverFar = 0.0f;
+		bool behindLight = false;
+		for (int i = 0; i < 8; ++i) {
+			glm::vec3 p = glm::vec3(View * glm::vec4(visibleReceivers.Corner(i), 1.0f));
+			float depth = -p.z;
+			if (depth <= LF_MIN_NEAR) {
+				behindLight = true;
+				continue;
+			}
+			minTx = std::min(minTx, p.x / depth);
+			maxTx = std::max(maxTx, p.x / depth);
+			minTy = std::min(minTy, p.y / depth);
+			maxTy = std::max(maxTy, p.y / depth);
+			receiverNear = std::min(receiverNear, depth);
+			receiverFar = std::max(receiverFar, depth);
+		}
+		if (behindLight || receiverFar <= 0.0f) {
+			//receivers wrap around the light, use the widest window we allow
+			minTx = minTy = -LF_MAX_HALF_TAN;
+			maxTx = maxTy = LF_MAX_HALF_TAN;
+			receiverNear = LF_MIN_NEAR;
+			receiverFar = std::max(receiverFar, glm::length(visibleReceivers.Extent()) + glm::length(lightPos - visibleReceivers.Center()));
+		}
+		minTx = std::max(minTx, -LF_MAX_HALF_TAN); maxTx = std::min(maxTx, LF_MAX_HALF_TAN);
+		minTy = std::max(minTy, -LF_MAX_HALF_TAN); maxTy = std::min(maxTy, LF_MAX_HALF_TAN);
+
+		//STEP 4: filter border and texel snapping
+		//the border is sized from the window the fit ends with, before snapping (which only grows it and
+		//shrinks the kernel): size = extent * res / (res - 2 * pad - 2), pad = filterTexels * baseline / (2 * size)
+		float res = float(mapSize);
+		float baselineSize = 2.0f * std::tan(glm::radians(LF_DEFAULT_FOV) * 0.5f);
+		float fitSize = (std::max(maxTx - minTx, maxTy - minTy) * res + filterTexels * baselineSize) / (res - 2.0f);
+		float padTexels = filterTexels * baselineSize / (2.0f * fitSize);
+		float usable = std::max(res - 2.0f * padTexels - 2.0f, res * 0.25f);
+		float sizeX = SnapSize((maxTx - minTx) * res / usable);
+		float sizeY = SnapSize((maxTy - minTy) * res / usable);
+		float texelX = sizeX / res;
+		float texelY = sizeY / res;
+		float centerX = std::round((minTx + maxTx) * 0.5f / texelX) * texelX;
+		float centerY = std::round((minTy + maxTy) * 0.5f / texelY) * texelY;
+
+		//STEP 5: near plane from the casters overlapping the window
+		float nearPlane = receiverNear;
+		for (const auto& c : casters) {
+			float casterNear = FLT_MAX;
+			float cMinTx = FLT_MAX, cMaxTx = -FLT_MAX, cMinTy = FLT_MAX, cMaxTy = -FLT_MAX;
+			bool crossesLight = false;
+			for (int i = 0; i < 8; ++i) {
+				glm::vec3 p = glm::vec3(View * glm::vec4(c.Corner(i), 1.0f));
+				float depth = -p.z;
+				casterNear = std::min(casterNear, depth);
+				if (depth <= LF_MIN_NEAR) {
+					crossesLight = true;
+					continue;
+				}
+				cMinTx = std::min(cMinTx, p.x / depth); cMaxTx = std::max(cMaxTx, p.x / depth);
+				cMinTy = std::min(cMinTy, p.y / depth); cMaxTy = std::max(cMaxTy, p.y / depth);
+			}
+			bool inWindow = crossesLight ||
+				(cMaxTx >= centerX - sizeX * 0.5f && cMinTx <= centerX + sizeX * 0.5f &&
+				 cMaxTy >= centerY - sizeY * 0.5f && cMinTy <= centerY + sizeY * 0.5f);
+			if (inWindow && casterNear < receiverFar)
+				nearPlane = std::min(nearPlane, casterNear);
+		}
+		NearPlane = std::max(nearPlane * 0.99f, LF_MIN_NEAR);
+		FarPlane = std::max(receiverFar * 1.01f, NearPlane + 0.01f);
+
+		Projection = glm::frustum((centerX - sizeX * 0.5f) * NearPlane, (centerX + sizeX * 0.5f) * NearPlane,
+								  (centerY - sizeY * 0.5f) * NearPlane, (centerY + sizeY * 0.5f) * NearPlane,
+								  NearPlane, FarPlane);
+		LightSpaceMatrix = Projection * View;
+
+		//STEP 6: count the casters outside the fitted frustum
+		Frustum lightFrustum(LightSpaceMatrix);
+		CastersTotal = (int)casters.size();
+		CastersCulled = 0;
+		for (const auto& c : casters) {
+			if (!lightFrustum.Intersects(c))
+				CastersCulled++;
+		}
+
+		//stats: texels per world unit at the receivers' center
+		float centerDepth = std::max(-(View * glm::vec4(visibleReceivers.Center(), 1.0f)).z, LF_MIN_NEAR);
+		TexelDensity = res / (std::max(sizeX, sizeY) * centerDepth);
+		BaselineTexelDensity = res / (baselineSize * centerDepth);
+		FilterScale = baselineSize / std::max(sizeX, sizeY);
+	}
+
+private:
+	static glm::mat4 LookAt(const glm::vec3& lightPos, const glm::vec3& target) {
+		glm::vec3 dir = target - lightPos;
+		glm::vec3 up(0.0f, 1.0f, 0.0f);
+		if (glm::length(dir) < 1e-4f)
+			dir = glm::vec3(0.0f, -1.0f, 0.0f);
+		if (std::fabs(glm::dot(glm::normalize(dir), up)) > 0.99f)
+			up = glm::vec3(0.0f, 0.0f, 1.0f);
+		return glm::lookAt(lightPos, lightPos + dir, up);
+	}
+
+	//round the window size up to 1/LF_SIZE_STEPS_PER_OCTAVE octave steps
+	static float SnapSize(float size) {
+		size = std::max(size, 1e-4f);
+		float steps = std::ceil(std::log2(size) * LF_SIZE_STEPS_PER_OCTAVE);
+		return std::exp2(steps / LF_SIZE_STEPS_PER_OCTAVE);
+	}
+};
@@ -0,0 +1,39 @@
+#shader vertex
+#version 330 core
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec2 aTexCoords;
+
+out vec2 v_TexCoord;
+
+void main() {
+	v_TexCoord = aTexCoords;
+	gl_Position = vec4(aPosition, 1.0f);
+}
+
+
+
+#shader fragment
+#version 330 core
+
+layout(location = 0) out float baked; //shadow factor of the static casters, 1: lit
+
+in vec2 v_TexCoord;
+
+//lightmap texel -> world: origin + uv.x * axisU + uv.y * axisV (ShadowLightmap, ShadowBake.h)
+uniform vec3 u_LightmapOrigin;
+uniform vec3 u_LightmapAxisU;
+uniform vec3 u_LightmapAxisV;
+uniform vec3 u_LightmapNormal;
+
+uniform mat4 u_LightSpaceMatrix; //bake light, not the camera fitted one
+uniform vec3 u_LightPosition;
+
+#include "Shadows.glsl"
+
+
+void main() {
+	vec3 position = u_LightmapOrigin + v_TexCoord.x * u_LightmapAxisU + v_TexCoord.y * u_LightmapAxisV;
+	vec3 lightDir = normalize(u_LightPosition - position);
+	baked = ShadowCalculation(u_LightSpaceMatrix * vec4(position, 1.0f), u_LightmapNormal, lightDir);
+}
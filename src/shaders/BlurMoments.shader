@@ -0,0 +1,67 @@
+// Separable blur of the moment map (R: depth, G: depth^2), one direction per dispatch.
+// A work group filters TILE texels of one row (or column): it loads them and the radius on both
+// sides into shared memory once, then every invocation sums its window from there.
+
+#version 430 core
+
+#define TILE 128
+#define MAX_RADIUS 32 //MomentBlur.h MB_MAX_RADIUS
+
+layout(local_size_x = TILE) in;
+
+layout(rg32f, binding = 0) readonly uniform image2D input_image;
+layout(rg32f, binding = 1) writeonly uniform image2D output_image;
+
+uniform ivec2 u_Direction; //(1, 0): rows, (0, 1): columns
+uniform bool u_FromDepth; //first pass: the moments are made from the shadow map (depth in R, any format)
+uniform sampler2D u_Depth;
+uniform int u_Radius; //texels on each side, at most MAX_RADIUS
+uniform bool u_Gaussian; //false: box
+
+shared vec2 tile[TILE + 2 * MAX_RADIUS];
+
+
+// texel at position x along the blur direction on line `line`
+ivec2 texel(int x, int line) {
+	return u_Direction.x == 1 ? ivec2(x, line) : ivec2(line, x);
+}
+
+vec2 loadMoments(ivec2 P) {
+	if (u_FromDepth) {
+		float depth = texelFetch(u_Depth, P, 0).r;
+		return vec2(depth, depth * depth);
+	}
+	return imageLoad(input_image, P).rg;
+}
+
+void main(void)
+{
+	ivec2 size = imageSize(output_image);
+	int length = u_Direction.x == 1 ? size.x : size.y;
+	int line = int(gl_WorkGroupID.y);
+	int start = int(gl_WorkGroupID.x) * TILE;
+	int local = int(gl_LocalInvocationID.x);
+	int radius = min(u_Radius, MAX_RADIUS);
+
+	// the tile and its apron, clamped to the edge
+	for (int i = local; i < TILE + 2 * radius; i += TILE) {
+		int x = clamp(start + i - radius, 0, length - 1);
+		tile[i] = loadMoments(texel(x, line));
+	}
+	barrier();
+	memoryBarrierShared();
+
+	int x = start + local;
+	if (x >= length) {
+		return;
+	}
+	float sigma = max(float(radius) * 0.5, 0.5);
+	vec2 sum = vec2(0.0);
+	float weightSum = 0.0;
+	for (int k = -radius; k <= radius; ++k) {
+		float weight = u_Gaussian ? exp(-0.5 * float(k * k) / (sigma * sigma)) : 1.0;
+		sum += weight * tile[local + k + radius];
+		weightSum += weight;
+	}
+	imageStore(output_image, texel(x, line), vec4(sum / weightSum, 0.0, 0.0));
+}
@@ -8,13 +8,78 @@ precision highp float;
 precision highp int;
 
 
+// MOMENTS4: 4 moments per texel (EVSM / MSM, MomentSAT.h). 512 invocations cover a 1024 texel row,
+// which keeps the shared array at 16 KB. WARP: first pass, the moments are made from the depth in R
+// DEPTH / COLUMNS: the 2 moment table (DepthSAT.h), summed in place in one texture. DEPTH makes the
+// moments from the shadow map (any depth format, read through a sampler) and sums the rows,
+// COLUMNS sums the columns of that table. The other passes sum rows and write them transposed
+#ifdef MOMENTS4
+layout(local_size_x = 512) in;
+#define SAT_TYPE vec4
+#define SAT_STORE(v) (v)
+#else
 layout(local_size_x = 1024) in;
+#define SAT_TYPE vec2
+#define SAT_STORE(v) vec4(v, 0.0, 0.0)
+#endif
 
-shared vec2 shared_data[gl_WorkGroupSize.x * 2];
+shared SAT_TYPE shared_data[gl_WorkGroupSize.x * 2];
 
 
+#if defined(WARP) || defined(DEPTH)
+uniform sampler2D u_Depth; //shadow map, depth in R
+#elif defined(MOMENTS4)
+layout(rgba32f, binding = 0) readonly uniform image2D input_image;
+#elif !defined(COLUMNS)
 layout(rg32f, binding = 0) readonly uniform image2D input_image;
+#endif
+#ifdef MOMENTS4
+layout(rgba32f, binding = 1) writeonly uniform image2D output_image;
+#elif defined(COLUMNS)
+layout(rg32f, binding = 1) uniform image2D output_image; //read and written in place
+#else
 layout(rg32f, binding = 1) writeonly uniform image2D output_image;
+#endif
+
+// texel of the table a row element goes to: in place for the 2 moment table, transposed otherwise
+#ifdef DEPTH
+#define SAT_AT(P) (P)
+#else
+#define SAT_AT(P) (P).yx
+#endif
+
+#ifdef WARP
+uniform int u_MomentTechnique; //0: EVSM, 1: MSM
+uniform vec2 u_EVSMExponents; //positive, negative warp
+
+// EVSM: positive and negative exponential warp of the depth in [-1, 1] and their squares
+// MSM: depth, depth^2, depth^3, depth^4
+vec4 warpMoments(float depth) {
+	if (u_MomentTechnique == 0) {
+		float d = 2.0 * depth - 1.0;
+		float positive = exp(u_EVSMExponents.x * d);
+		float negative = -exp(-u_EVSMExponents.y * d);
+		return vec4(positive, positive * positive, negative, negative * negative);
+	}
+	float depth2 = depth * depth;
+	return vec4(depth, depth2, depth2 * depth, depth2 * depth2);
+}
+#define SAT_LOAD(P) warpMoments(texelFetch(u_Depth, P, 0).r)
+#elif defined(DEPTH)
+uniform float u_Center; //subtracted from the depth, the sums of the centered moments keep more fp32 bits
+
+vec2 centeredMoments(float depth) {
+	float d = depth - u_Center;
+	return vec2(d, d * d);
+}
+#define SAT_LOAD(P) centeredMoments(texelFetch(u_Depth, P, 0).r)
+#elif defined(COLUMNS)
+#define SAT_LOAD(P) imageLoad(output_image, (P).yx).rg
+#elif defined(MOMENTS4)
+#define SAT_LOAD(P) imageLoad(input_image, P)
+#else
+#define SAT_LOAD(P) imageLoad(input_image, P).rg
+#endif
 
 
 void main(void)
@@ -26,8 +91,8 @@ void main(void)
 	ivec2 P = ivec2(id * 2, gl_WorkGroupID.x);
 	const uint steps = uint(log2(gl_WorkGroupSize.x)) + 1;
 	uint step = 0;
-	shared_data[id * 2] = imageLoad(input_image, P).rg;
-	shared_data[id * 2 + 1] = imageLoad(input_image, P + ivec2(1, 0)).rg;
+	shared_data[id * 2] = SAT_LOAD(P);
+	shared_data[id * 2 + 1] = SAT_LOAD(P + ivec2(1, 0));
 
 	barrier();
 	memoryBarrierShared();
@@ -43,6 +108,6 @@ void main(void)
 		memoryBarrierShared();
 	}
 
-	imageStore(output_image, P.yx, vec4(shared_data[id * 2], 0.0, 0.0));
-	imageStore(output_image, P.yx + ivec2(0, 1), vec4(shared_data[id * 2 + 1], 0.0, 0.0));
+	imageStore(output_image, SAT_AT(P), SAT_STORE(shared_data[id * 2]));
+	imageStore(output_image, SAT_AT(P + ivec2(1, 0)), SAT_STORE(shared_data[id * 2 + 1]));
 }
\ No newline at end of file
@@ -23,5 +23,5 @@ in vec2 TexCoords;
 uniform sampler2D u_DebugTexture;
 
 void main() {
-	FragColor = vec4(texture(u_DebugTexture, TexCoords).rgb, 1.0f);
+	FragColor = vec4(texture(u_DebugTexture, TexCoords).rrr, 1.0f);
 }
\ No newline at end of file
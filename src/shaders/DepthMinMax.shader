@@ -0,0 +1,40 @@
+//One level of the min/max depth pyramid used by the PCSS blocker search:
+//every output texel keeps the min and max depth of the 2x2 source texels under it.
+
+#version 430 core
+
+precision highp float;
+precision highp int;
+
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(rg32f, binding = 0) readonly uniform image2D u_Source;
+layout(rg32f, binding = 1) writeonly uniform image2D u_Target;
+
+uniform int u_FromDepth; //1: source is the shadow map (depth in R), 0: source is the previous min/max level
+uniform sampler2D u_Depth; //the shadow map, read through a sampler so any depth format works
+
+vec2 loadMinMax(ivec2 P) {
+	if (u_FromDepth != 0) {
+		return texelFetch(u_Depth, P, 0).rr;
+	}
+	return imageLoad(u_Source, P).rg;
+}
+
+
+void main(void)
+{
+	ivec2 P = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(P, imageSize(u_Target))))
+		return;
+
+	vec2 a = loadMinMax(P * 2);
+	vec2 b = loadMinMax(P * 2 + ivec2(1, 0));
+	vec2 c = loadMinMax(P * 2 + ivec2(0, 1));
+	vec2 d = loadMinMax(P * 2 + ivec2(1, 1));
+
+	float minDepth = min(min(a.x, b.x), min(c.x, d.x));
+	float maxDepth = max(max(a.y, b.y), max(c.y, d.y));
+	imageStore(u_Target, P, vec4(minDepth, maxDepth, 0.0, 0.0));
+}
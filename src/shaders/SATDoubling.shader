@@ -0,0 +1,46 @@
+// GL 3.3 fallback of the depth SAT (DepthSAT.h): recursive doubling over two ping-pong targets.
+// Pass i adds the texel u_Offset = 2^i to the left (or below), after ceil(log2(size)) passes per
+// direction every texel holds the sum of its whole row (column) prefix. The first pass reads the
+// shadow map and makes the centered moments, like the DEPTH pass of ComputeSAT.shader.
+
+#shader vertex
+#version 330 core
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec2 aTexCoords;
+
+void main() {
+	gl_Position = vec4(aPosition, 1.0f);
+}
+
+
+
+#shader fragment
+#version 330 core
+
+layout(location = 0) out vec2 sums;
+
+uniform sampler2D u_Source; //shadow map (first pass) or the previous pass
+uniform bool u_FromDepth;
+uniform float u_Center; //subtracted from the depth before it is squared
+uniform ivec2 u_Offset; //(2^i, 0): rows, (0, 2^i): columns
+
+
+vec2 load(ivec2 P) {
+	vec2 value = texelFetch(u_Source, P, 0).rg;
+	if (u_FromDepth) {
+		float d = value.x - u_Center;
+		return vec2(d, d * d);
+	}
+	return value;
+}
+
+void main() {
+	ivec2 P = ivec2(gl_FragCoord.xy);
+	ivec2 Q = P - u_Offset;
+	vec2 value = load(P);
+	if (Q.x >= 0 && Q.y >= 0) {
+		value += load(Q);
+	}
+	sums = value;
+}
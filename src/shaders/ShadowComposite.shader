@@ -0,0 +1,34 @@
+#shader vertex
+#version 330 core
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec2 aTexCoords;
+
+out vec2 v_TexCoord;
+
+void main() {
+	v_TexCoord = aTexCoords;
+	gl_Position = vec4(aPosition, 1.0f);
+}
+
+
+
+#shader fragment
+#version 330 core
+
+layout(location = 0) out vec4 color;
+
+in vec2 v_TexCoord;
+
+uniform sampler2D u_Ambient; //ambient term (background where nothing was drawn)
+uniform sampler2D u_Direct; //diffuse + specular, unshadowed
+uniform sampler2D u_Shadow; //R: shadow factor
+uniform sampler2D u_Depth; //scene depth, copied so later draws are depth tested against the scene
+
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float shadow = texelFetch(u_Shadow, pixel, 0).r;
+	vec3 lighting = texelFetch(u_Ambient, pixel, 0).rgb + shadow * texelFetch(u_Direct, pixel, 0).rgb;
+	color = vec4(lighting, 1.0f);
+	gl_FragDepth = texelFetch(u_Depth, pixel, 0).r;
+}
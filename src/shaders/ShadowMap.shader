@@ -1,5 +1,9 @@
 #shader vertex
 #version 330 core
+#ifdef INSTANCED
+#extension GL_ARB_shader_storage_buffer_object : require
+#extension GL_ARB_shading_language_420pack : require
+#endif
 
 
 layout(location = 0) in vec3 aPosition;
@@ -10,9 +14,23 @@ uniform mat4 u_LightSpaceMatrix;
 uniform mat4 u_Model;
 out vec4 v_Position;
 
+#ifdef INSTANCED
+// instance id grouped by mesh, offset by the indirect command's baseInstance
+layout(location = 3) in uint aInstanceID;
+
+layout(std430, binding = 0) readonly buffer InstanceModels {
+    mat4 u_Models[];
+};
+#endif
+
 void main()
 {
-    gl_Position = u_LightSpaceMatrix * u_Model * vec4(aPosition, 1.0);
+#ifdef INSTANCED
+    mat4 model = u_Models[aInstanceID];
+#else
+    mat4 model = u_Model;
+#endif
+    gl_Position = u_LightSpaceMatrix * model * vec4(aPosition, 1.0);
     v_Position = gl_Position;
 }
 
@@ -32,6 +50,7 @@ void main()
     float depth_2 = depth * depth;
     //store shadow map and square shadow map in one texture
     // R channel for shadow map, G channel for square shadow map
+    // (dropped by the depth only formats, the SAT and the blur square the depth themselves)
     gl_FragColor = vec4(depth, depth_2, 0.0, 0.0);
     
 }
\ No newline at end of file
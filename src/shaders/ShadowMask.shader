@@ -0,0 +1,145 @@
+#shader vertex
+#version 330 core
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec2 aTexCoords;
+
+out vec2 v_TexCoord;
+
+void main() {
+	v_TexCoord = aTexCoords;
+	gl_Position = vec4(aPosition, 1.0f);
+}
+
+
+
+#shader fragment
+#version 330 core
+#ifdef SHADOW_STATS
+#extension GL_ARB_shader_storage_buffer_object : require
+#extension GL_ARB_shading_language_420pack : require
+#endif
+
+layout(location = 0) out float mask; //shadow factor, 1: lit
+
+in vec2 v_TexCoord;
+
+uniform sampler2D u_SceneDepth; //depth prepass, full resolution
+uniform sampler2D u_SceneNormal; //rgb: normal * 0.5 + 0.5, a: 0 on the baked receiver
+
+uniform mat4 u_InvViewProjection; //camera of this frame
+uniform mat4 u_LightSpaceMatrix;
+uniform vec3 u_LightPosition;
+
+uniform int u_Downsample; //1, 2 or 4: low resolution texel (x, y) evaluates the full resolution pixel (x, y) * u_Downsample
+
+#ifdef UPSAMPLE
+uniform sampler2D u_LowMask; //shadow evaluated every u_Downsample pixels
+uniform vec2 u_NearFar; //camera near / far planes
+uniform bool u_EdgeFallback; //evaluate at full resolution where the low resolution neighbours disagree
+uniform float u_EdgeThreshold; //shadow difference between matching neighbours that counts as an edge
+
+#ifdef SHADOW_STATS
+//0 pixels upsampled, 1 pixels evaluated at full resolution
+layout(std430, binding = 5) buffer MaskStats {
+	uint u_MaskStats[];
+};
+#define MASK_STAT(i) atomicAdd(u_MaskStats[i], 1u)
+#else
+#define MASK_STAT(i)
+#endif
+
+#define DEPTH_SIGMA 0.02 //relative view depth difference of a half weight neighbour
+#define NORMAL_POWER 8.0
+#define MATCH_WEIGHT 0.5 //geometric weight above which a neighbour is the same surface
+#endif
+
+#include "Shadows.glsl"
+
+
+vec3 sceneNormal(ivec2 pixel) {
+	return normalize(texelFetch(u_SceneNormal, pixel, 0).rgb * 2.0 - 1.0);
+}
+
+// shadow of a full resolution pixel, from the world position rebuilt out of the prepass depth
+float evaluateShadow(ivec2 pixel, float depth) {
+	vec2 ndc = (vec2(pixel) + 0.5) / vec2(textureSize(u_SceneDepth, 0)) * 2.0 - 1.0;
+	vec4 world = u_InvViewProjection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+	world /= world.w;
+	vec3 lightDir = normalize(u_LightPosition - world.xyz);
+	//the baked receiver has the static casters in its lightmap: only the dynamic ones are evaluated
+	if (texelFetch(u_SceneNormal, pixel, 0).a < 0.5) {
+		return u_DynamicCasters ? Dynamic_ShadowCalculation(u_LightSpaceMatrix * world, sceneNormal(pixel), lightDir) : 1.0;
+	}
+	return ShadowCalculation(u_LightSpaceMatrix * world, sceneNormal(pixel), lightDir);
+}
+
+#ifdef UPSAMPLE
+float linearDepth(float depth) {
+	float z = depth * 2.0 - 1.0;
+	return 2.0 * u_NearFar.x * u_NearFar.y / (u_NearFar.y + u_NearFar.x - z * (u_NearFar.y - u_NearFar.x));
+}
+
+// joint bilateral upsample: the 4 low resolution samples around the pixel, weighted by distance
+// and by how well their depth / normal (at the pixel they were evaluated for) match this pixel
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(u_SceneDepth, pixel, 0).r;
+	if (depth >= 1.0) {
+		mask = 1.0;
+		return;
+	}
+	MASK_STAT(0);
+	float z = linearDepth(depth);
+	vec3 normal = sceneNormal(pixel);
+
+	ivec2 fullSize = textureSize(u_SceneDepth, 0);
+	ivec2 lowSize = textureSize(u_LowMask, 0);
+	vec2 lowPos = vec2(pixel) / float(u_Downsample);
+	ivec2 base = ivec2(floor(lowPos));
+	vec2 f = lowPos - vec2(base);
+
+	float sum = 0.0, weightSum = 0.0;
+	float lo = 1.0, hi = 0.0;
+	bool matched = false;
+	for (int i = 0; i < 4; ++i) {
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 low = clamp(base + offset, ivec2(0), lowSize - 1);
+		ivec2 source = min(low * u_Downsample, fullSize - 1);
+		float s = texelFetch(u_LowMask, low, 0).r;
+
+		float relative = abs(linearDepth(texelFetch(u_SceneDepth, source, 0).r) - z) / (DEPTH_SIGMA * z);
+		float geometric = exp2(-relative * relative) * pow(max(dot(sceneNormal(source), normal), 0.0), NORMAL_POWER);
+		float bilinear = (offset.x == 1 ? f.x : 1.0 - f.x) * (offset.y == 1 ? f.y : 1.0 - f.y);
+		float weight = (bilinear + 1e-3) * geometric;
+		sum += weight * s;
+		weightSum += weight;
+		if (geometric > MATCH_WEIGHT) {
+			matched = true;
+			lo = min(lo, s);
+			hi = max(hi, s);
+		}
+	}
+
+	// no neighbour on this surface (thin object, silhouette) or a shadow edge runs between them
+	if (u_EdgeFallback && (!matched || hi - lo > u_EdgeThreshold)) {
+		MASK_STAT(1);
+		mask = evaluateShadow(pixel, depth);
+		return;
+	}
+	mask = weightSum > 1e-6 ? sum / weightSum : texelFetch(u_LowMask, clamp(base, ivec2(0), lowSize - 1), 0).r;
+}
+
+#else
+// one evaluation per (low resolution) texel
+void main() {
+	ivec2 pixel = min(ivec2(gl_FragCoord.xy) * u_Downsample, textureSize(u_SceneDepth, 0) - 1);
+	float depth = texelFetch(u_SceneDepth, pixel, 0).r;
+	// background: nothing to shadow
+	if (depth >= 1.0) {
+		mask = 1.0;
+		return;
+	}
+	mask = evaluateShadow(pixel, depth);
+}
+#endif
@@ -0,0 +1,634 @@
+// shadow map lookups shared by the forward lit pass (VSSM_Scene.shader) and the screen-space
+// shadow mask pass (ShadowMask.shader); included with #include, the including stage declares the
+// SSBO extensions when SHADOW_STATS is defined
+
+uniform sampler2D u_DepthMap; //R: shadow map (RG32F / R16 / R16F, DepthSAT.h)
+uniform sampler2D u_DepthSAT; //SAT of the depth and the squared depth, centered on u_SATCenter
+uniform float u_SATCenter;
+uniform sampler2D u_MomentSAT; //SAT of 4 moments (EVSM / MSM), MomentSAT.h
+uniform sampler2D u_FilteredMoments; //blurred moments for plain VSM (MomentBlur.h), optionally mipmapped
+uniform sampler2D u_DepthMinMax; //min/max depth pyramid, R: min, G: max, level 0 is half the shadow map size
+uniform sampler2D u_DynamicDepthMap; //R: shadow map of the casters that are not in the bake (ShadowBake.h)
+uniform bool u_DynamicCasters; //u_DynamicDepthMap was drawn this frame: the baked receivers add its shadow to the lightmap
+
+uniform bool u_UseDepthPyramid; //PCSS early exit for fully lit / fully shadowed regions
+
+uniform int u_SampleSet; //precomputed tables: 1 Poisson, 2 Vogel spiral, 3 blue noise; 0 is drawn by the POISSON_PER_FRAGMENT variant
+uniform sampler2D u_BlueNoise; //tiled blue noise, per pixel rotation of the precomputed disks
+uniform float u_NoiseOffset; //added to the blue noise every frame when the shadow is accumulated over time
+
+uniform bool u_AdaptiveSamples; //PCSS tap count follows the search / filter footprint (Vogel spiral of any size)
+uniform int u_MaxTaps; //quality budget: most taps one adaptive loop may take
+uniform float u_TexelsPerTap; //footprint area (texels) covered by one adaptive tap
+
+uniform float u_TextureSize;
+uniform float u_LightSize;
+
+uniform vec2 u_EVSMExponents; //positive, negative warp
+uniform float u_MomentBias; //MSM: pulls the moments towards a valid distribution
+
+uniform int u_ShadowRenderType; //0 Basic, 1 PCF, 2 PCSS, 3 VSSM, 4 EVSM, 5 MSM, 6 VSM
+
+#ifdef SHADOW_STATS
+//PCSS fragments: 0 total, 1 early exit lit, 2 early exit shadowed, 3 shadow map taps
+layout(std430, binding = 3) buffer ShadowStats {
+	uint u_ShadowStats[];
+};
+#define SHADOW_STAT_ADD(i, n) atomicAdd(u_ShadowStats[i], uint(n))
+#else
+#define SHADOW_STAT_ADD(i, n)
+#endif
+#define SHADOW_STAT(i) SHADOW_STAT_ADD(i, 1)
+
+
+#define EPS 1e-3
+
+#define PI 3.141592653589793
+#define PI2 6.283185307179586
+#define NUM_RINGS 10
+
+#define NUM_SAMPLES 25 //PCSS sample parameter in step 3
+#define BLOCKER_SEARCH_NUM_SAMPLES NUM_SAMPLES //PCSS sample parameter in step 1
+#define SAMPLE_SETS 4
+#define SAMPLE_VEC4_PER_SET 13 //NUM_SAMPLES vec2 packed two per vec4
+#define MIN_ADAPTIVE_TAPS 4
+#define MAX_ADAPTIVE_TAPS 64
+#define GOLDEN_ROTATION mat2(-0.7373688, 0.6754903, -0.6754903, -0.7373688) //rotation by the golden angle
+
+// precomputed unit disk samples (SampleTables.h), SAMPLE_SETS sets of NUM_SAMPLES
+layout(std140) uniform SampleTables {
+	vec4 u_SampleTables[SAMPLE_SETS * SAMPLE_VEC4_PER_SET];
+};
+
+
+/*******-------------------- PCSS functions --------------------******/
+
+highp float rand_1to1(highp float x) {
+	// -1 -1
+	return fract(sin(x) * 10000.0);
+}
+
+highp float rand_2to1(vec2 uv) {
+	// 0 - 1
+	const highp float a = 12.9898, b = 78.233, c = 43758.5453;
+	highp float dt = dot(uv.xy, vec2(a, b)), sn = mod(dt, PI);
+	return fract(sin(sn) * c);
+}
+
+
+#ifdef POISSON_PER_FRAGMENT
+// poisson distribution generated per fragment (sample set 0); the array costs NUM_SAMPLES vec2 of
+// registers, so only the POISSON_PER_FRAGMENT variant declares it
+vec2 poissonDisk[NUM_SAMPLES];
+
+void poissonDiskSamples(const in vec2 randomSeed) {
+
+	float ANGLE_STEP = PI2 * float(NUM_RINGS) / float(NUM_SAMPLES);
+	float INV_NUM_SAMPLES = 1.0 / float(NUM_SAMPLES);
+
+	float angle = rand_2to1(randomSeed) * PI2;
+	float radius = INV_NUM_SAMPLES;
+	float radiusStep = radius;
+
+	for (int i = 0; i < NUM_SAMPLES; i++) {
+		poissonDisk[i] = vec2(cos(angle), sin(angle)) * pow(radius, 0.75);
+		radius += radiusStep;
+		angle += ANGLE_STEP;
+	}
+}
+
+void uniformDiskSamples(const in vec2 randomSeed) {
+
+	float randNum = rand_2to1(randomSeed);
+	float sampleX = rand_1to1(randNum);
+	float sampleY = rand_1to1(sampleX);
+
+	float angle = sampleX * PI2;
+	float radius = sqrt(sampleY);
+
+	for (int i = 0; i < NUM_SAMPLES; i++) {
+		poissonDisk[i] = vec2(radius * cos(angle), radius * sin(angle));
+
+		sampleX = rand_1to1(sampleY);
+		sampleY = rand_1to1(sampleX);
+
+		angle = sampleX * PI2;
+		radius = sqrt(sampleY);
+	}
+}
+#endif
+
+// disk sample i of the current set: the per fragment disk (POISSON_PER_FRAGMENT), or the precomputed
+// one rotated by the blue noise value of this pixel
+mat2 sampleRotation;
+
+void prepareDiskSamples(const in vec2 randomSeed) {
+#ifdef POISSON_PER_FRAGMENT
+	if (!u_AdaptiveSamples) {
+		poissonDiskSamples(randomSeed);
+		return;
+	}
+#endif
+	float angle = fract(texelFetch(u_BlueNoise, ivec2(gl_FragCoord.xy) & (textureSize(u_BlueNoise, 0) - 1), 0).r + u_NoiseOffset) * PI2;
+	float c = cos(angle), s = sin(angle);
+	sampleRotation = mat2(c, s, -s, c);
+}
+
+vec2 diskSample(int i) {
+#ifdef POISSON_PER_FRAGMENT
+	return poissonDisk[i];
+#else
+	vec4 packed = u_SampleTables[u_SampleSet * SAMPLE_VEC4_PER_SET + i / 2];
+	return sampleRotation * ((i & 1) == 0 ? packed.xy : packed.zw);
+#endif
+}
+
+
+// adaptive mode: tap count for a disk footprint of the given radius (texels), within the quality budget
+int adaptiveTapCount(float radiusTexels) {
+	float area = PI * radiusTexels * radiusTexels;
+	int budget = clamp(u_MaxTaps, MIN_ADAPTIVE_TAPS, MAX_ADAPTIVE_TAPS);
+	return clamp(int(ceil(area / u_TexelsPerTap)), MIN_ADAPTIVE_TAPS, budget);
+}
+
+// tap i of an n tap Vogel spiral, the direction advances by the golden angle every tap
+// (start with sampleRotation[0] so the spiral turns with the blue noise)
+vec2 spiralTap(int i, int n, inout vec2 direction) {
+	vec2 tap = direction * sqrt((float(i) + 0.5) / float(n));
+	direction = GOLDEN_ROTATION * direction;
+	return tap;
+}
+
+
+/*******-------------------- Depth pyramid --------------------******/
+
+// min and max depth of the shadow map texels a filter of the given radius (uv units) can touch,
+// from the 2x2 pyramid texels at the level whose texels are at least as wide as the region
+vec2 depthRange(vec2 center, float radius) {
+	float texel = 1.0 / u_TextureSize;
+	radius += texel; // bilinear taps reach one texel further
+	float regionTexels = 2.0 * radius * u_TextureSize;
+	int maxLevel = int(log2(u_TextureSize)) - 1;
+	int level = clamp(int(ceil(log2(regionTexels))) - 1, 0, maxLevel);
+
+	ivec2 levelSize = textureSize(u_DepthMinMax, level);
+	ivec2 lo = clamp(ivec2(floor((center - radius) * vec2(levelSize))), ivec2(0), levelSize - 1);
+	ivec2 hi = clamp(ivec2(floor((center + radius) * vec2(levelSize))), ivec2(0), levelSize - 1);
+
+	vec2 a = texelFetch(u_DepthMinMax, lo, level).rg;
+	vec2 b = texelFetch(u_DepthMinMax, ivec2(hi.x, lo.y), level).rg;
+	vec2 c = texelFetch(u_DepthMinMax, ivec2(lo.x, hi.y), level).rg;
+	vec2 d = texelFetch(u_DepthMinMax, hi, level).rg;
+	return vec2(min(min(a.x, b.x), min(c.x, d.x)), max(max(a.y, b.y), max(c.y, d.y)));
+}
+
+
+/*******-------------------- VSSM functions --------------------******/
+
+//get mean of random 2D area from SAT 
+vec4 getMean(sampler2D sat, float wPenumbra, vec3 projCoords) {
+
+	vec2 stride = 1.0 / vec2(u_TextureSize);
+
+	float xmax = projCoords.x + wPenumbra * stride.x;
+	float xmin = projCoords.x - wPenumbra * stride.x;
+	float ymax = projCoords.y + wPenumbra * stride.y;
+	float ymin = projCoords.y - wPenumbra * stride.y;
+
+	vec4 A = texture(sat, vec2(xmin, ymin));
+	vec4 B = texture(sat, vec2(xmax, ymin));
+	vec4 C = texture(sat, vec2(xmin, ymax));
+	vec4 D = texture(sat, vec2(xmax, ymax));
+
+	float sPenumbra = 2.0 * wPenumbra;
+
+	vec4 moments = (D + A - B - C) / float(sPenumbra * sPenumbra);
+
+	return moments;
+}
+
+// mean depth and squared depth of the window from the centered depth SAT:
+// E[d] = E[c] + k, E[d^2] = E[c^2] + k (2 E[c] + k) with c = d - k
+vec2 getDepthMean(float wPenumbra, vec3 projCoords) {
+	vec2 centered = getMean(u_DepthSAT, wPenumbra, projCoords).xy;
+	return vec2(centered.x + u_SATCenter, centered.y + u_SATCenter * (2.0 * centered.x + u_SATCenter));
+}
+
+// Chebychevs inequality, use to estimate CDF, percentage of non-blockers
+// in filter's area
+float chebyshev(vec2 moments, float currentDepth) {
+	if (currentDepth <= moments.x) {
+		return 1.0;
+	}
+	// calculate variance from mean.
+	float variance = moments.y - (moments.x * moments.x);
+	variance = max(variance, 0.0001);
+	float d = currentDepth - moments.x;
+	float p_max = variance / (variance + d * d);
+	return p_max;
+}
+
+/*******-------------------- PCSS calculation --------------------******/
+
+// depthMap: the shadow map searched and filtered, useDepthPyramid: the early exit (u_DepthMinMax is built from u_DepthMap)
+float pcssShadow(sampler2D depthMap, bool useDepthPyramid, vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
+{
+	// Handling Perspective Issues
+	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+	// transform to [0,1] range
+	projCoords = projCoords * 0.5 + 0.5;
+	// get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
+	float closestDepth = texture(depthMap, projCoords.xy).r;
+	
+	// get depth of current fragment from light's perspective
+	float currentDepth = projCoords.z;
+	if (currentDepth > 1.0f) {
+		return 1.0f;
+	}
+	// check whether current frag pos is in shadow
+	float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
+	
+
+	/***--------STEP 1: Blocker search: find the average blocker depth---------***/
+
+	prepareDiskSamples(projCoords.xy); //per fragment poisson disk or rotated precomputed table
+
+	float sampleStride = u_LightSize/2.5; 
+	float dBlocker = 0.0;
+	float sampleSize = 1.0 / u_TextureSize * sampleStride;
+	int blockerNumSample = BLOCKER_SEARCH_NUM_SAMPLES;
+
+	float border = sampleStride / u_TextureSize;
+	// just cut out the no padding area according to the sarched area size
+	if (projCoords.x <= border || projCoords.x >= 1.0f - border) {
+		return 1.0;
+	}
+	if (projCoords.y <= border || projCoords.y >= 1.0f - border) {
+		return 1.0;
+	}
+	SHADOW_STAT(0);
+
+	/***--------STEP 0: early exit from the min/max depth pyramid---------***/
+	if (useDepthPyramid) {
+		vec2 searchRange = depthRange(projCoords.xy, sampleSize);
+		// nothing in the search region is in front of the receiver: no blocker, fully lit
+		if (searchRange.x >= currentDepth) {
+			SHADOW_STAT(1);
+			return 1.0;
+		}
+		// every search tap is a blocker: the average blocker depth is at least max(min depth, bias),
+		// which bounds the PCF radius; if the whole PCF region is in front too, the fragment is fully shadowed
+		if (searchRange.y < currentDepth) {
+			if (searchRange.y < bias) {
+				SHADOW_STAT(2);
+				return 0.0;
+			}
+			float nearestBlocker = max(searchRange.x, bias);
+			float maxPenumbra = (currentDepth - nearestBlocker) * (u_LightSize / 2.5) / nearestBlocker;
+			float maxFilterSize = 1.0 / u_TextureSize * 5.0 * maxPenumbra;
+			if (depthRange(projCoords.xy, min(maxFilterSize, 1.0)).y < currentDepth - bias) {
+				SHADOW_STAT(2);
+				return 0.0;
+			}
+		}
+	}
+
+	// adaptive: as many taps as the search footprint needs
+	if (u_AdaptiveSamples) {
+		blockerNumSample = adaptiveTapCount(sampleStride);
+	}
+	vec2 spiralDirection = sampleRotation[0];
+
+	int count = 0;
+	for (int i = 0; i < blockerNumSample; ++i) {
+		vec2 offset = u_AdaptiveSamples ? spiralTap(i, blockerNumSample, spiralDirection) : diskSample(i);
+		vec2 sampleCoord = offset * sampleSize + projCoords.xy;
+		float closestDepth = texture(depthMap, sampleCoord).r;
+		//Only compute average depth of blocker! not the average of the whole filter's area!
+		if (closestDepth < currentDepth) {
+			dBlocker += closestDepth;
+			count++;
+		}
+	}
+	
+	SHADOW_STAT_ADD(3, blockerNumSample);
+	// no blocker in the search region: fully lit
+	if (count == 0) {
+		return 1.0;
+	}
+	dBlocker /= count;
+
+	if (dBlocker < bias) {
+		return 0.0;
+	}
+	if (dBlocker > 1.0) {
+		return 1.0;
+	}
+
+	/***---------STEP 02: Penumbra estimation----------***/
+	// estimation the filter size to control the softness
+
+	float lightWidth = u_LightSize/2.5;
+	float wPenumbra = (currentDepth - dBlocker) * lightWidth / dBlocker;
+
+	float filterStride = 5.0;
+	float filterSize = 1.0 / u_TextureSize * filterStride * wPenumbra;
+
+	/***--------STEP 03: Percentage Closer Filtering (PCF)---------***/
+
+	float shadow = 0.0;
+	int NumSample = NUM_SAMPLES;
+	// adaptive: a few taps for hard contact shadows, more for wide penumbrae
+	if (u_AdaptiveSamples) {
+		NumSample = adaptiveTapCount(filterStride * wPenumbra);
+	}
+	spiralDirection = sampleRotation[0];
+
+	for (int i = 0; i < NumSample; ++i) {
+		vec2 offset = u_AdaptiveSamples ? spiralTap(i, NumSample, spiralDirection) : diskSample(i);
+		vec2 sampleCoord = offset * filterSize + projCoords.xy;
+		float pcfDepth = texture(depthMap, sampleCoord).r;
+		shadow += currentDepth - bias > pcfDepth ? 0.0 : 1.0;
+	}
+	SHADOW_STAT_ADD(3, NumSample);
+	
+	shadow /= NumSample;
+
+	return shadow;
+}
+
+float PCSS_ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
+{
+	return pcssShadow(u_DepthMap, u_UseDepthPyramid, fragPosLightSpace, normal, lightDir);
+}
+
+// shadow of the dynamic casters alone on a baked receiver: PCSS whatever the technique, the
+// tables of the other techniques are only built for the full shadow map
+float Dynamic_ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
+{
+	return pcssShadow(u_DynamicDepthMap, false, fragPosLightSpace, normal, lightDir);
+}
+
+
+
+/*******-------------------- VSSM calculation --------------------******/
+
+float VSSM_ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
+{
+	float bias = max(0.005 * (1.0 - dot(normal, lightDir)), 0.005);
+
+	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+	// transform to [0,1] range
+	projCoords = projCoords * 0.5 + 0.5;
+	// get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
+	float closestDepth = texture(u_DepthMap, projCoords.xy).r;
+	float blockerSearchSize = u_LightSize/2.0f;
+	float currentDepth = projCoords.z - bias;
+	// keep the shadow at 1.0 when outside the zFar region of the light's frustum.
+	if (currentDepth > 1.0) {
+		return 1.0f;
+	}
+	float border = blockerSearchSize / u_TextureSize;
+	// just cut out the no padding area according to the sarched area size
+	if (projCoords.x <= border || projCoords.x >= 1.0f - border){
+		return 1.0;
+	}
+	if (projCoords.y <= border || projCoords.y >= 1.0f - border) {
+		return 1.0;
+	}
+	// Estimate average blocker depth
+	vec2 moments = getDepthMean(float(blockerSearchSize), projCoords);
+	//moments.x: store mean of random 2D area of shadow map
+	//moments.y: store mean of random 2D area of squared shadow map
+	float averageDepth = moments.x;
+	float alpha = chebyshev(moments.xy, currentDepth);
+	float dBlocker = (averageDepth - alpha * (currentDepth-bias)) / (1.0 - alpha);
+	if (dBlocker < EPS) {
+		return 0.0;
+	}
+	if (dBlocker > 1.0) {
+		return 1.0;
+	}
+	float wPenumbra = (currentDepth - dBlocker) * u_LightSize / dBlocker;
+	if (wPenumbra <= 0.0) {
+		return 1.0;
+	}
+	moments = getDepthMean(wPenumbra, projCoords);
+	if (currentDepth <= moments.x) {
+		return 1.0;
+	}
+	// CDF estimation
+	float shadow = chebyshev(moments.xy, currentDepth);
+	return shadow;
+}
+
+
+
+/*******-------------------- EVSM / MSM calculation --------------------******/
+
+#define EVSM_MIN_VARIANCE 1e-4 //in depth units, scaled by the warp slope
+
+// Chebyshev upper bound with a variance floor
+float chebyshevBound(vec2 moments, float t, float minVariance) {
+	if (t <= moments.x) {
+		return 1.0;
+	}
+	float variance = max(moments.y - moments.x * moments.x, minVariance);
+	float d = t - moments.x;
+	return variance / (variance + d * d);
+}
+
+// EVSM: the tighter of the bounds of the positive and the negative warp
+float evsmVisibility(vec4 moments, float depth) {
+	float d = 2.0 * depth - 1.0;
+	vec2 warped = vec2(exp(u_EVSMExponents.x * d), -exp(-u_EVSMExponents.y * d));
+	vec2 slope = EVSM_MIN_VARIANCE * u_EVSMExponents * abs(warped);
+	float positive = chebyshevBound(moments.xy, warped.x, slope.x * slope.x);
+	float negative = chebyshevBound(moments.zw, warped.y, slope.y * slope.y);
+	return min(positive, negative);
+}
+
+// MSM: Hamburger 4 moment reconstruction (Peters and Klein 2015), the lowest shadow intensity
+// any depth distribution with these moments can have at this depth
+float msmVisibility(vec4 moments, float depth) {
+	vec4 b = mix(moments, vec4(0.5), u_MomentBias);
+	vec3 z;
+	z[0] = depth;
+
+	// Cholesky factorization of the Hankel matrix of b
+	float L32D22 = -b[0] * b[1] + b[2];
+	float D22 = -b[0] * b[0] + b[1];
+	float squaredDepthVariance = -b[1] * b[1] + b[3];
+	float D33D22 = dot(vec2(squaredDepthVariance, -L32D22), vec2(D22, L32D22));
+	float invD22 = 1.0 / D22;
+	float L32 = L32D22 * invD22;
+
+	// solve B c = (1, z, z^2)
+	vec3 c = vec3(1.0, z[0], z[0] * z[0]);
+	c[1] -= b.x;
+	c[2] -= b.y + L32 * c[1];
+	c[1] *= invD22;
+	c[2] *= D22 / D33D22;
+	c[1] -= L32 * c[2];
+	c[0] -= dot(c.yz, b.xy);
+
+	// the roots of c[0] + c[1] z + c[2] z^2 are the other two support points
+	float p = c[1] / c[2];
+	float q = c[0] / c[2];
+	float r = sqrt(max(p * p * 0.25 - q, 0.0));
+	z[1] = -p * 0.5 - r;
+	z[2] = -p * 0.5 + r;
+
+	vec4 weights = z[2] < z[0] ? vec4(z[1], z[0], 1.0, 1.0) : (z[1] < z[0] ? vec4(z[0], z[1], 0.0, 1.0) : vec4(0.0));
+	float quotient = (weights[0] * z[2] - b[0] * (weights[0] + z[2]) + b[1]) / ((z[2] - weights[1]) * (z[0] - z[1]));
+	return 1.0 - clamp(weights[2] + weights[3] * quotient, 0.0, 1.0);
+}
+
+float momentVisibility(vec4 moments, float depth) {
+	return u_ShadowRenderType == 4 ? evsmVisibility(moments, depth) : msmVisibility(moments, depth);
+}
+
+// same steps as VSSM, the lit fraction of the search region and of the penumbra filter come from
+// the 4 moments; the mean blocker depth uses the first moment of the VSSM table
+float Moment_ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
+{
+	float bias = max(0.005 * (1.0 - dot(normal, lightDir)), 0.005);
+
+	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+	projCoords = projCoords * 0.5 + 0.5;
+	float blockerSearchSize = u_LightSize / 2.0f;
+	float currentDepth = projCoords.z - bias;
+	if (currentDepth > 1.0) {
+		return 1.0f;
+	}
+	float border = blockerSearchSize / u_TextureSize;
+	if (projCoords.x <= border || projCoords.x >= 1.0f - border) {
+		return 1.0;
+	}
+	if (projCoords.y <= border || projCoords.y >= 1.0f - border) {
+		return 1.0;
+	}
+	// Estimate average blocker depth
+	float averageDepth = getDepthMean(blockerSearchSize, projCoords).x;
+	float alpha = momentVisibility(getMean(u_MomentSAT, blockerSearchSize, projCoords), currentDepth);
+	if (alpha >= 1.0 - EPS) {
+		return 1.0;
+	}
+	float dBlocker = (averageDepth - alpha * currentDepth) / (1.0 - alpha);
+	if (dBlocker < EPS) {
+		return 0.0;
+	}
+	if (dBlocker > 1.0) {
+		return 1.0;
+	}
+	float wPenumbra = (currentDepth - dBlocker) * u_LightSize / dBlocker;
+	if (wPenumbra <= 0.0) {
+		return 1.0;
+	}
+	return momentVisibility(getMean(u_MomentSAT, wPenumbra, projCoords), currentDepth);
+}
+
+
+
+/*******-------------------- VSM calculation --------------------******/
+// fixed penumbra: one lookup of the prefiltered moments, the filter width is the blur radius
+// (plus the mip level the hardware picks for the pixel's footprint when the map is mipmapped)
+float VSM_ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
+{
+	float bias = max(0.005 * (1.0 - dot(normal, lightDir)), 0.005);
+
+	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+	projCoords = projCoords * 0.5 + 0.5;
+	float currentDepth = projCoords.z - bias;
+	if (currentDepth > 1.0) {
+		return 1.0;
+	}
+	return chebyshev(texture(u_FilteredMoments, projCoords.xy).rg, currentDepth);
+}
+
+
+
+/*******-------------------- PCF calculation --------------------******/
+// basic code from learnOpenGL, shadow Chapter.
+// Cheack link here https://learnopengl.com/Advanced-Lighting/Shadows/Shadow-Mapping
+float PCF_ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
+{
+	// perform perspective divide
+	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+	// Transform to [0,1] range
+	projCoords = projCoords * 0.5 + 0.5;
+	// Get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
+	float closestDepth = texture(u_DepthMap, projCoords.xy).r;
+	// Get depth of current fragment from light's perspective
+	float currentDepth = projCoords.z;
+	// Keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
+	if (currentDepth > 1.0) {
+		return 1.0;
+	}
+	// Calculate bias (based on depth map resolution and slope)
+	float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
+	// Check whether current frag pos is in shadow
+	// float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
+	// PCF
+	float shadow = 0.0;
+	vec2 texelSize = 1.0 / vec2(u_TextureSize);
+	for (int x = -1; x <= 1; ++x)
+	{
+		for (int y = -1; y <= 1; ++y)
+		{
+			float pcfDepth = texture(u_DepthMap, projCoords.xy + vec2(x, y) * texelSize).r;
+			shadow += currentDepth - bias > pcfDepth ? 0.0 : 1.0;
+		}
+	}
+	shadow /= 9.0;
+	return shadow;
+}
+
+
+/*******-------------------- Basic calculation --------------------******/
+// basic code from learnOpenGL, shadow Chapter.
+// Cheack link here https://learnopengl.com/Advanced-Lighting/Shadows/Shadow-Mapping
+float Basic_ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
+{
+	// perform perspective divide
+	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+	// Transform to [0,1] range
+	projCoords = projCoords * 0.5 + 0.5;
+	// Get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
+	float closestDepth = texture(u_DepthMap, projCoords.xy).r;
+	// Get depth of current fragment from light's perspective
+	float currentDepth = projCoords.z;
+	// Keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
+	if (currentDepth > 1.0) {
+		return 1.0;
+	}
+	// Calculate bias (based on depth map resolution and slope)
+	float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
+	// Check whether current frag pos is in shadow
+	float shadow = currentDepth - bias > closestDepth  ? 0.0 : 1.0;
+	return shadow;
+}
+
+
+// shadow factor (1: lit, 0: shadowed) of the selected technique
+float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir) {
+	if (u_ShadowRenderType == 0) {
+		return Basic_ShadowCalculation(fragPosLightSpace, normal, lightDir);
+	}
+	else if (u_ShadowRenderType == 1) {
+		return PCF_ShadowCalculation(fragPosLightSpace, normal, lightDir);
+	}
+	else if (u_ShadowRenderType == 2) {
+		return PCSS_ShadowCalculation(fragPosLightSpace, normal, lightDir);
+	}
+	else if (u_ShadowRenderType == 3) {
+		return VSSM_ShadowCalculation(fragPosLightSpace, normal, lightDir);
+	}
+	else if (u_ShadowRenderType == 4 || u_ShadowRenderType == 5) {
+		return Moment_ShadowCalculation(fragPosLightSpace, normal, lightDir);
+	}
+	else if (u_ShadowRenderType == 6) {
+		return VSM_ShadowCalculation(fragPosLightSpace, normal, lightDir);
+	}
+	return 1.0;
+}
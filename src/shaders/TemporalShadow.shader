@@ -0,0 +1,117 @@
+#shader vertex
+#version 330 core
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec2 aTexCoords;
+
+out vec2 v_TexCoord;
+
+void main() {
+	v_TexCoord = aTexCoords;
+	gl_Position = vec4(aPosition, 1.0f);
+}
+
+
+
+#shader fragment
+#version 330 core
+#ifdef SHADOW_STATS
+#extension GL_ARB_shader_storage_buffer_object : require
+#extension GL_ARB_shading_language_420pack : require
+#endif
+
+layout(location = 0) out vec2 history; //R: accumulated shadow, G: frames accumulated
+
+in vec2 v_TexCoord;
+
+uniform sampler2D u_Depth; //scene depth of this frame
+uniform sampler2D u_NormalShadow; //rgb: normal * 0.5 + 0.5, a: shadow factor of this frame
+uniform sampler2D u_PrevDepth;
+uniform sampler2D u_PrevNormalShadow;
+uniform sampler2D u_History; //previous resolve
+
+uniform mat4 u_InvViewProjection; //this frame
+uniform mat4 u_PrevViewProjection;
+uniform vec2 u_NearFar; //camera near / far planes
+uniform bool u_HistoryValid;
+
+uniform float u_Blend; //weight of the current frame once converged
+uniform float u_DepthTolerance; //relative view depth difference
+uniform float u_NormalTolerance; //min cosine between the normals
+uniform bool u_NeighborhoodClamp;
+
+#ifdef SHADOW_STATS
+//0 pixels resolved, 1 history rejected (disocclusion), 2 history clamped (stale)
+layout(std430, binding = 4) buffer TemporalStats {
+	uint u_TemporalStats[];
+};
+#define TEMPORAL_STAT(i) atomicAdd(u_TemporalStats[i], 1u)
+#else
+#define TEMPORAL_STAT(i)
+#endif
+
+#define CLAMP_EPS 0.02 //clamps smaller than this are quantization, not ghosting
+
+
+// view space distance of a depth buffer value
+float linearDepth(float depth) {
+	float z = depth * 2.0 - 1.0;
+	return 2.0 * u_NearFar.x * u_NearFar.y / (u_NearFar.y + u_NearFar.x - z * (u_NearFar.y - u_NearFar.x));
+}
+
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	ivec2 size = textureSize(u_NormalShadow, 0);
+	float depth = texelFetch(u_Depth, pixel, 0).r;
+	vec4 normalShadow = texelFetch(u_NormalShadow, pixel, 0);
+	float current = normalShadow.a;
+	// background: nothing to accumulate
+	if (depth >= 1.0) {
+		history = vec2(1.0, 0.0);
+		return;
+	}
+	TEMPORAL_STAT(0);
+
+	// where this surface was on screen last frame (static scene: same world position)
+	vec4 world = u_InvViewProjection * vec4(v_TexCoord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	world /= world.w;
+	vec4 prevClip = u_PrevViewProjection * world;
+	vec2 prevUV = prevClip.xy / prevClip.w * 0.5 + 0.5;
+
+	bool valid = u_HistoryValid && prevClip.w > 0.0 && all(greaterThanEqual(prevUV, vec2(0.0))) && all(lessThanEqual(prevUV, vec2(1.0)));
+	if (valid) {
+		// same surface: last frame's depth buffer holds the expected view depth (clip w) and a similar normal
+		ivec2 prevPixel = clamp(ivec2(prevUV * vec2(size)), ivec2(0), size - 1);
+		float prevDepth = linearDepth(texelFetch(u_PrevDepth, prevPixel, 0).r);
+		vec3 prevNormal = normalize(texelFetch(u_PrevNormalShadow, prevPixel, 0).rgb * 2.0 - 1.0);
+		vec3 normal = normalize(normalShadow.rgb * 2.0 - 1.0);
+		valid = abs(prevDepth - prevClip.w) < u_DepthTolerance * prevClip.w && dot(normal, prevNormal) > u_NormalTolerance;
+	}
+	if (!valid) {
+		TEMPORAL_STAT(1);
+		history = vec2(current, 1.0);
+		return;
+	}
+
+	vec2 previous = texture(u_History, prevUV).rg;
+	// neighbourhood clamp: history outside the range of this frame's 3x3 shadow is stale (light or casters moved)
+	if (u_NeighborhoodClamp) {
+		float lo = current, hi = current;
+		for (int y = -1; y <= 1; ++y) {
+			for (int x = -1; x <= 1; ++x) {
+				float s = texelFetch(u_NormalShadow, clamp(pixel + ivec2(x, y), ivec2(0), size - 1), 0).a;
+				lo = min(lo, s);
+				hi = max(hi, s);
+			}
+		}
+		float clamped = clamp(previous.r, lo, hi);
+		if (abs(clamped - previous.r) > CLAMP_EPS) {
+			TEMPORAL_STAT(2);
+		}
+		previous.r = clamped;
+	}
+
+	// running average over the first frames, exponential once 1 / u_Blend frames are in
+	float frames = min(previous.g + 1.0, 1.0 / u_Blend);
+	history = vec2(mix(previous.r, current, 1.0 / frames), frames);
+}